@@ -0,0 +1,198 @@
+﻿// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "fe.h"
+#include "utils.h"
+#include "action.h"
+
+/* the strings of a table, sized by a first pass with pBuf NULL */
+typedef struct _ACTION_POOL
+{
+	WCHAR* pBuf;
+	size_t szUsed;
+} ACTION_POOL;
+
+static LPCWSTR AddActionString(ACTION_POOL* pPool, const cJSON* pItem, const char* pKey)
+{
+	int sz;
+	WCHAR* pStr;
+	const char* str = cJSON_GetStringValue(cJSON_GetObjectItem(pItem, pKey));
+	if (!str)
+		return NULL;
+	sz = MultiByteToWideChar(CP_UTF8, 0, str, -1, NULL, 0);
+	if (sz <= 0)
+		return NULL;
+	if (!pPool->pBuf)
+	{
+		pPool->szUsed += sz;
+		return L"";
+	}
+	pStr = pPool->pBuf + pPool->szUsed;
+	MultiByteToWideChar(CP_UTF8, 0, str, -1, pStr, sz);
+	pPool->szUsed += sz;
+	return pStr;
+}
+
+static WORD GetActionShow(const cJSON* pItem, const char* pKey, LPCSTR pDefault)
+{
+	const char* sw = cJSON_GetStringValue(cJSON_GetObjectItem(pItem, pKey));
+	return FeStrToShow(sw ? sw : pDefault);
+}
+
+static UINT GetActionNumber(const cJSON* pItem, const char* pKey, UINT uDefault)
+{
+	const cJSON* pNumber = cJSON_GetObjectItem(pItem, pKey);
+	return cJSON_IsNumber(pNumber) ? (UINT)pNumber->valuedouble : uDefault;
+}
+
+/* the first action key found wins, in this order */
+static VOID CompileAction(const cJSON* pItem, FE_ACTION* pAction, ACTION_POOL* pPool)
+{
+	ZeroMemory(pAction, sizeof(FE_ACTION));
+	if ((pAction->lpValue = AddActionString(pPool, pItem, "exec")) != NULL)
+	{
+		pAction->uType = FE_ACTION_EXEC;
+		pAction->u.Exec.wShow = GetActionShow(pItem, "window", NULL);
+	}
+	else if ((pAction->lpValue = AddActionString(pPool, pItem, "kill")) != NULL)
+	{
+		const char* str = cJSON_GetStringValue(cJSON_GetObjectItem(pItem, "kill"));
+		pAction->uType = FE_ACTION_KILL;
+		if (_strnicmp(str, "pid=", 4) == 0)
+			pAction->u.Kill.dwPid = strtoul(&str[4], NULL, 0);
+	}
+	else if ((pAction->lpValue = AddActionString(pPool, pItem, "resolution")) != NULL)
+	{
+		pAction->uType = FE_ACTION_RESOLUTION;
+		pAction->u.Resolution.lpMonitor = AddActionString(pPool, pItem, "monitor");
+	}
+	else if ((pAction->lpValue = AddActionString(pPool, pItem, "find")) != NULL)
+	{
+		pAction->uType = FE_ACTION_FIND;
+		pAction->u.Find.wHide = GetActionShow(pItem, "hide", "hide");
+		pAction->u.Find.wShow = GetActionShow(pItem, "show", "restore");
+	}
+	else if ((pAction->lpValue = AddActionString(pPool, pItem, "screenshot")) != NULL)
+	{
+		pAction->uType = FE_ACTION_SCREENSHOT;
+		pAction->u.Screenshot.lpSave = AddActionString(pPool, pItem, "save");
+		pAction->u.Screenshot.lpCompression = AddActionString(pPool, pItem, "compression");
+		pAction->u.Screenshot.lpFormat = AddActionString(pPool, pItem, "format");
+		pAction->u.Screenshot.bDelta = cJSON_IsTrue(cJSON_GetObjectItem(pItem, "delta"));
+	}
+	else if ((pAction->lpValue = AddActionString(pPool, pItem, "record")) != NULL)
+	{
+		pAction->uType = FE_ACTION_RECORD;
+		pAction->u.Record.lpSave = AddActionString(pPool, pItem, "save");
+		pAction->u.Record.lpCompression = AddActionString(pPool, pItem, "compression");
+		pAction->u.Record.uFps = GetActionNumber(pItem, "fps", 5);
+	}
+	else if ((pAction->lpValue = AddActionString(pPool, pItem, "shell")) != NULL)
+	{
+		pAction->uType = FE_ACTION_SHELL;
+		pAction->u.Shell.lpFile = AddActionString(pPool, pItem, "file");
+		pAction->u.Shell.lpArgs = AddActionString(pPool, pItem, "args");
+		pAction->u.Shell.lpDirectory = AddActionString(pPool, pItem, "directory");
+		pAction->u.Shell.wShow = GetActionShow(pItem, "window", NULL);
+	}
+	else if ((pAction->lpValue = AddActionString(pPool, pItem, "shortcut")) != NULL)
+	{
+		const cJSON* id = cJSON_GetObjectItem(pItem, "id");
+		pAction->u.Shortcut.lpFile = AddActionString(pPool, pItem, "file");
+		/* nothing to link to */
+		if (!pAction->u.Shortcut.lpFile)
+			return;
+		pAction->uType = FE_ACTION_SHORTCUT;
+		pAction->u.Shortcut.lpArgs = AddActionString(pPool, pItem, "args");
+		pAction->u.Shortcut.lpIcon = AddActionString(pPool, pItem, "icon");
+		pAction->u.Shortcut.nId = cJSON_IsNumber(id) ? (INT)id->valuedouble : 0;
+		pAction->u.Shortcut.wShow = GetActionShow(pItem, "window", NULL);
+	}
+}
+
+FE_ACTION_TABLE* FeCompileActions(const cJSON* pArray)
+{
+	UINT i;
+	size_t szActions;
+	const cJSON* pItem;
+	FE_ACTION Action;
+	ACTION_POOL Pool = { 0 };
+	FE_ACTION_TABLE* pTable;
+	int nCount = cJSON_GetArraySize(pArray);
+	if (!cJSON_IsArray(pArray))
+		return NULL;
+	cJSON_ArrayForEach(pItem, pArray)
+		CompileAction(pItem, &Action, &Pool);
+	szActions = sizeof(FE_ACTION) * (size_t)nCount;
+	pTable = calloc(1, sizeof(FE_ACTION_TABLE) + szActions + sizeof(WCHAR) * Pool.szUsed);
+	if (!pTable)
+		return NULL;
+	pTable->uCount = (UINT)nCount;
+	pTable->pActions = (FE_ACTION*)(pTable + 1);
+	Pool.pBuf = (WCHAR*)((UINT8*)pTable->pActions + szActions);
+	Pool.szUsed = 0;
+	i = 0;
+	cJSON_ArrayForEach(pItem, pArray)
+		CompileAction(pItem, &pTable->pActions[i++], &Pool);
+	return pTable;
+}
+
+VOID FeFreeActions(FE_ACTION_TABLE* pTable)
+{
+	free(pTable);
+}
+
+BOOL FeRunAction(const FE_ACTION_TABLE* pTable, UINT uIndex)
+{
+	const FE_ACTION* pAction;
+	if (!pTable || uIndex >= pTable->uCount)
+		return FALSE;
+	pAction = &pTable->pActions[uIndex];
+	switch (pAction->uType)
+	{
+	case FE_ACTION_EXEC:
+		FeAddLog(0, L"Exec: %s\r\n", pAction->lpValue);
+		FeExec(pAction->lpValue, pAction->u.Exec.wShow, FALSE, FALSE);
+		break;
+	case FE_ACTION_KILL:
+		FeAddLog(0, L"Kill: %s\r\n", pAction->lpValue);
+		if (pAction->u.Kill.dwPid)
+			FeKillProcessById(pAction->u.Kill.dwPid, 1);
+		else
+			FeKillProcessByName(pAction->lpValue, 1);
+		break;
+	case FE_ACTION_RESOLUTION:
+		FeAddLog(0, L"Resolution: %s\r\n", pAction->lpValue);
+		FeSetResolution(pAction->u.Resolution.lpMonitor, pAction->lpValue, CDS_UPDATEREGISTRY);
+		break;
+	case FE_ACTION_FIND:
+		FeAddLog(0, L"Find: %s\r\n", pAction->lpValue);
+		FeShowWindowByTitle(pAction->lpValue, pAction->u.Find.wHide, pAction->u.Find.wShow);
+		break;
+	case FE_ACTION_SCREENSHOT:
+		FeAddLog(0, L"Screenshot: %s\r\n", pAction->lpValue);
+		FeGetScreenShot(pAction->lpValue, pAction->u.Screenshot.lpSave, pAction->u.Screenshot.lpCompression,
+			pAction->u.Screenshot.lpFormat, pAction->u.Screenshot.bDelta);
+		break;
+	case FE_ACTION_RECORD:
+		FeAddLog(0, L"Record: %s\r\n", pAction->lpValue);
+		FeToggleRecord(pAction->lpValue, pAction->u.Record.lpSave, pAction->u.Record.lpCompression,
+			pAction->u.Record.uFps);
+		break;
+	case FE_ACTION_SHELL:
+		FeAddLog(0, L"Shell: %s %s %s %s\r\n", pAction->lpValue,
+			pAction->u.Shell.lpFile ? pAction->u.Shell.lpFile : L"",
+			pAction->u.Shell.lpArgs ? pAction->u.Shell.lpArgs : L"",
+			pAction->u.Shell.lpDirectory ? pAction->u.Shell.lpDirectory : L"");
+		FeShellExec(pAction->lpValue, pAction->u.Shell.lpFile, pAction->u.Shell.lpArgs,
+			pAction->u.Shell.lpDirectory, pAction->u.Shell.wShow);
+		break;
+	case FE_ACTION_SHORTCUT:
+		FeAddLog(0, L"Shortcut: %s.lnk -> %s\r\n", pAction->lpValue, pAction->u.Shortcut.lpFile);
+		FeCreateShortcut(pAction->u.Shortcut.lpFile, pAction->lpValue, pAction->u.Shortcut.lpArgs,
+			pAction->u.Shortcut.lpIcon, pAction->u.Shortcut.nId, pAction->u.Shortcut.wShow);
+		break;
+	default:
+		return FALSE;
+	}
+	return TRUE;
+}
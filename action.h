@@ -0,0 +1,101 @@
+﻿// SPDX-License-Identifier: GPL-3.0-or-later
+#pragma once
+
+#include "fe.h"
+#include "cJSON/cJSON.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+typedef enum _FE_ACTION_TYPE
+{
+	/* the entry has no action key, or it is incomplete */
+	FE_ACTION_NONE = 0,
+	FE_ACTION_EXEC,
+	FE_ACTION_KILL,
+	FE_ACTION_RESOLUTION,
+	FE_ACTION_FIND,
+	FE_ACTION_SCREENSHOT,
+	FE_ACTION_RECORD,
+	FE_ACTION_SHELL,
+	FE_ACTION_SHORTCUT,
+} FE_ACTION_TYPE;
+
+/* a hotkey, systray or init entry with its strings converted and its flags parsed */
+typedef struct _FE_ACTION
+{
+	FE_ACTION_TYPE uType;
+	/* the value of the key naming the action */
+	LPCWSTR lpValue;
+	union
+	{
+		struct
+		{
+			WORD wShow;
+		} Exec;
+		struct
+		{
+			/* 0 to kill by name */
+			DWORD dwPid;
+		} Kill;
+		struct
+		{
+			LPCWSTR lpMonitor;
+		} Resolution;
+		struct
+		{
+			WORD wHide;
+			WORD wShow;
+		} Find;
+		struct
+		{
+			LPCWSTR lpSave;
+			LPCWSTR lpCompression;
+			LPCWSTR lpFormat;
+			BOOL bDelta;
+		} Screenshot;
+		struct
+		{
+			LPCWSTR lpSave;
+			LPCWSTR lpCompression;
+			UINT uFps;
+		} Record;
+		struct
+		{
+			LPCWSTR lpFile;
+			LPCWSTR lpArgs;
+			LPCWSTR lpDirectory;
+			WORD wShow;
+		} Shell;
+		struct
+		{
+			LPCWSTR lpFile;
+			LPCWSTR lpArgs;
+			LPCWSTR lpIcon;
+			INT nId;
+			WORD wShow;
+		} Shortcut;
+	} u;
+} FE_ACTION;
+
+/* the actions of a JSON array, in one allocation with their strings */
+typedef struct _FE_ACTION_TABLE
+{
+	UINT uCount;
+	/* one per array item, FE_ACTION_NONE for the ones without an action */
+	FE_ACTION* pActions;
+} FE_ACTION_TABLE;
+
+/* NULL when pArray is not an array or out of memory */
+FE_ACTION_TABLE* FeCompileActions(const cJSON* pArray);
+
+VOID FeFreeActions(FE_ACTION_TABLE* pTable);
+
+/* run the action of array item uIndex, FALSE when there is none */
+BOOL FeRunAction(const FE_ACTION_TABLE* pTable, UINT uIndex);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,245 @@
+﻿// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "fe.h"
+#include "arena.h"
+
+/*
+ * Bump allocator for the temporaries of the PNG encoder. lodepng_malloc
+ * takes its blocks from the arena of the calling thread, or from the heap
+ * when it has none. Every block starts with a header naming its arena, so
+ * lodepng_free and lodepng_realloc work on either kind from any thread.
+ * Freeing an arena block does nothing, unless it is the last one of the
+ * arena of the calling thread: the vectors lodepng grows by doubling stay
+ * in place that way. The memory comes back on rewind or reset, and a reset
+ * merges the chunks so repeated work of the same size needs no more heap.
+ */
+
+#define ARENA_ALIGN (2 * sizeof(PVOID))
+#define ARENA_ROUND(x) (((x) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1))
+#define ARENA_CHUNK_SIZE 0x100000
+
+/* in front of every block, pArena is NULL for blocks on the heap */
+typedef struct _ARENA_BLOCK
+{
+	FE_ARENA* pArena;
+	size_t szSize;
+} ARENA_BLOCK;
+
+typedef struct _ARENA_CHUNK
+{
+	struct _ARENA_CHUNK* pNext;
+	size_t szSize;
+	size_t szUsed;
+} ARENA_CHUNK;
+
+#define ARENA_CHUNK_HEADER ARENA_ROUND(sizeof(ARENA_CHUNK))
+
+struct _FE_ARENA
+{
+	ARENA_CHUNK* pHead;
+	ARENA_CHUNK* pTail;
+	/* chunks after pCur are empty */
+	ARENA_CHUNK* pCur;
+	/* the last block in pCur, it can grow or be freed in place */
+	ARENA_BLOCK* pTop;
+	size_t szTotal;
+};
+
+static __declspec(thread) FE_ARENA* mThreadArena;
+/* malloc and realloc calls made for lodepng and the arena chunks */
+static volatile LONG64 mHeapAllocs;
+
+static UINT8* ArenaChunkData(ARENA_CHUNK* pChunk)
+{
+	return (UINT8*)pChunk + ARENA_CHUNK_HEADER;
+}
+
+static BOOL ArenaAddChunk(FE_ARENA* pArena, size_t szNeed)
+{
+	/* grow geometrically, a reset merges the chunks anyway */
+	size_t szSize = max(szNeed, max(ARENA_CHUNK_SIZE, pArena->szTotal));
+	ARENA_CHUNK* pChunk = malloc(ARENA_CHUNK_HEADER + szSize);
+	if (!pChunk)
+		return FALSE;
+	InterlockedIncrement64(&mHeapAllocs);
+	pChunk->pNext = NULL;
+	pChunk->szSize = szSize;
+	pChunk->szUsed = 0;
+	if (pArena->pTail)
+		pArena->pTail->pNext = pChunk;
+	else
+		pArena->pHead = pChunk;
+	pArena->pTail = pChunk;
+	pArena->szTotal += szSize;
+	return TRUE;
+}
+
+static VOID ArenaFreeChunks(FE_ARENA* pArena)
+{
+	while (pArena->pHead)
+	{
+		ARENA_CHUNK* pNext = pArena->pHead->pNext;
+		free(pArena->pHead);
+		pArena->pHead = pNext;
+	}
+	pArena->pTail = NULL;
+	pArena->pCur = NULL;
+	pArena->pTop = NULL;
+	pArena->szTotal = 0;
+}
+
+/* resize the last block without moving it */
+static BOOL ArenaResizeTop(FE_ARENA* pArena, ARENA_BLOCK* pBlock, size_t szSize)
+{
+	size_t szOffset, szNeed = ARENA_ROUND(sizeof(ARENA_BLOCK) + szSize);
+	if (pBlock != pArena->pTop || szNeed < szSize)
+		return FALSE;
+	szOffset = (UINT8*)pBlock - ArenaChunkData(pArena->pCur);
+	if (pArena->pCur->szSize - szOffset < szNeed)
+		return FALSE;
+	pArena->pCur->szUsed = szOffset + szNeed;
+	pBlock->szSize = szSize;
+	return TRUE;
+}
+
+FE_ARENA* FeCreateArena(VOID)
+{
+	return calloc(1, sizeof(FE_ARENA));
+}
+
+VOID FeFreeArena(FE_ARENA* pArena)
+{
+	if (!pArena)
+		return;
+	ArenaFreeChunks(pArena);
+	free(pArena);
+}
+
+PVOID FeArenaAlloc(FE_ARENA* pArena, size_t szSize)
+{
+	ARENA_BLOCK* pBlock;
+	size_t szNeed = ARENA_ROUND(sizeof(ARENA_BLOCK) + szSize);
+	if (szNeed < szSize)
+		return NULL;
+	if (!pArena->pCur)
+	{
+		if (!pArena->pHead && !ArenaAddChunk(pArena, szNeed))
+			return NULL;
+		pArena->pCur = pArena->pHead;
+		pArena->pCur->szUsed = 0;
+	}
+	while (pArena->pCur->szSize - pArena->pCur->szUsed < szNeed)
+	{
+		if (!pArena->pCur->pNext && !ArenaAddChunk(pArena, szNeed))
+			return NULL;
+		pArena->pCur = pArena->pCur->pNext;
+		pArena->pCur->szUsed = 0;
+	}
+	pBlock = (ARENA_BLOCK*)(ArenaChunkData(pArena->pCur) + pArena->pCur->szUsed);
+	pArena->pCur->szUsed += szNeed;
+	pBlock->pArena = pArena;
+	pBlock->szSize = szSize;
+	pArena->pTop = pBlock;
+	return pBlock + 1;
+}
+
+VOID FeGetArenaMark(FE_ARENA* pArena, FE_ARENA_MARK* pMark)
+{
+	pMark->pChunk = pArena->pCur;
+	pMark->szUsed = pArena->pCur ? pArena->pCur->szUsed : 0;
+}
+
+VOID FeRewindArena(FE_ARENA* pArena, const FE_ARENA_MARK* pMark)
+{
+	pArena->pCur = pMark->pChunk;
+	if (pArena->pCur)
+		pArena->pCur->szUsed = pMark->szUsed;
+	pArena->pTop = NULL;
+}
+
+VOID FeResetArena(FE_ARENA* pArena)
+{
+	if (pArena->pHead && pArena->pHead->pNext)
+	{
+		size_t szTotal = pArena->szTotal;
+		ArenaFreeChunks(pArena);
+		ArenaAddChunk(pArena, szTotal);
+	}
+	pArena->pCur = NULL;
+	pArena->pTop = NULL;
+}
+
+FE_ARENA* FeSetThreadArena(FE_ARENA* pArena)
+{
+	FE_ARENA* pPrev = mThreadArena;
+	mThreadArena = pArena;
+	return pPrev;
+}
+
+UINT64 FeGetHeapAllocs(VOID)
+{
+	return (UINT64)InterlockedCompareExchange64(&mHeapAllocs, 0, 0);
+}
+
+/* allocators for lodepng */
+
+void* lodepng_malloc(size_t size)
+{
+	ARENA_BLOCK* pBlock;
+	if (mThreadArena)
+		return FeArenaAlloc(mThreadArena, size);
+	if (size > (size_t)-1 - sizeof(ARENA_BLOCK))
+		return NULL;
+	pBlock = malloc(sizeof(ARENA_BLOCK) + size);
+	if (!pBlock)
+		return NULL;
+	InterlockedIncrement64(&mHeapAllocs);
+	pBlock->pArena = NULL;
+	pBlock->szSize = size;
+	return pBlock + 1;
+}
+
+void* lodepng_realloc(void* ptr, size_t new_size)
+{
+	void* pNew;
+	ARENA_BLOCK* pBlock;
+	if (!ptr)
+		return lodepng_malloc(new_size);
+	pBlock = (ARENA_BLOCK*)ptr - 1;
+	if (!pBlock->pArena && !mThreadArena)
+	{
+		if (new_size > (size_t)-1 - sizeof(ARENA_BLOCK))
+			return NULL;
+		pBlock = realloc(pBlock, sizeof(ARENA_BLOCK) + new_size);
+		if (!pBlock)
+			return NULL;
+		InterlockedIncrement64(&mHeapAllocs);
+		pBlock->szSize = new_size;
+		return pBlock + 1;
+	}
+	if (pBlock->pArena && pBlock->pArena == mThreadArena
+		&& ArenaResizeTop(mThreadArena, pBlock, new_size))
+		return ptr;
+	/* move between the heap and the arena, or out of the middle of it */
+	pNew = lodepng_malloc(new_size);
+	if (!pNew)
+		return NULL;
+	memcpy(pNew, ptr, min(pBlock->szSize, new_size));
+	lodepng_free(ptr);
+	return pNew;
+}
+
+void lodepng_free(void* ptr)
+{
+	ARENA_BLOCK* pBlock;
+	if (!ptr)
+		return;
+	pBlock = (ARENA_BLOCK*)ptr - 1;
+	if (!pBlock->pArena)
+		free(pBlock);
+	else if (pBlock->pArena == mThreadArena && pBlock == mThreadArena->pTop)
+	{
+		mThreadArena->pCur->szUsed = (UINT8*)pBlock - ArenaChunkData(mThreadArena->pCur);
+		mThreadArena->pTop = NULL;
+	}
+}
@@ -0,0 +1,47 @@
+﻿// SPDX-License-Identifier: GPL-3.0-or-later
+#pragma once
+
+#include "fe.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+typedef struct _FE_ARENA FE_ARENA;
+
+typedef struct _FE_ARENA_MARK
+{
+	PVOID pChunk;
+	size_t szUsed;
+} FE_ARENA_MARK;
+
+FE_ARENA* FeCreateArena(VOID);
+
+VOID FeFreeArena(FE_ARENA* pArena);
+
+/* the block can be passed to lodepng_realloc and lodepng_free */
+PVOID FeArenaAlloc(FE_ARENA* pArena, size_t szSize);
+
+VOID FeGetArenaMark(FE_ARENA* pArena, FE_ARENA_MARK* pMark);
+
+/* drop every block allocated since the mark */
+VOID FeRewindArena(FE_ARENA* pArena, const FE_ARENA_MARK* pMark);
+
+/* drop every block, and merge the chunks so the same work fits in one next time */
+VOID FeResetArena(FE_ARENA* pArena);
+
+/* serve lodepng_malloc on this thread from pArena, NULL for the heap, return the previous one */
+FE_ARENA* FeSetThreadArena(FE_ARENA* pArena);
+
+/* heap allocations made by the arenas and lodepng since the start, for benchmarks */
+UINT64 FeGetHeapAllocs(VOID);
+
+/* lodepng is built with LODEPNG_NO_COMPILE_ALLOCATORS to use these */
+void* lodepng_malloc(size_t size);
+void* lodepng_realloc(void* ptr, size_t new_size);
+void lodepng_free(void* ptr);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,101 @@
+﻿// SPDX-License-Identifier: GPL-3.0-or-later
+
+/* a key press through the compiled action table against the cJSON walk it replaced, which
+ * found the item, probed the action keys and converted the value on every press. the
+ * handlers are the shim ones, which only record the call. usage: action_bench [entries] */
+
+#include "fe.h"
+#include "utils.h"
+#include "action.h"
+
+#include <stdio.h>
+
+#define ACTION_PRESSES 200000
+
+static const char* mKeys[] = { "exec", "kill", "resolution", "find", "screenshot", "record", "shell", "shortcut" };
+
+static cJSON* CreateConfig(UINT uEntries)
+{
+	UINT i;
+	char Value[64];
+	cJSON* pArray = cJSON_CreateArray();
+	for (i = 0; pArray && i < uEntries; i++)
+	{
+		cJSON* pItem = cJSON_CreateObject();
+		snprintf(Value, sizeof(Value), "Ctrl-%u", i + 1);
+		cJSON_AddStringToObject(pItem, "key", Value);
+		cJSON_AddStringToObject(pItem, "note", "an entry of the generated config");
+		snprintf(Value, sizeof(Value), "C:\\Windows\\System32\\tool%u.exe /q", i);
+		cJSON_AddStringToObject(pItem, mKeys[i % ARRAYSIZE(mKeys)], Value);
+		cJSON_AddStringToObject(pItem, "file", "C:\\Windows\\notepad.exe");
+		cJSON_AddStringToObject(pItem, "window", "max");
+		cJSON_AddItemToArray(pArray, pItem);
+	}
+	return pArray;
+}
+
+/* the lookup and conversion of the old path, the handler call is the same for every type */
+static BOOL WalkAction(const cJSON* pArray, UINT uIndex)
+{
+	UINT i;
+	const cJSON* pItem = cJSON_GetArrayItem(pArray, (int)uIndex);
+	for (i = 0; pItem && i < ARRAYSIZE(mKeys); i++)
+	{
+		WCHAR* pValue = FeUtf8ToWcs(cJSON_GetStringValue(cJSON_GetObjectItem(pItem, mKeys[i])));
+		if (!pValue)
+			continue;
+		FeExec(pValue, FeStrToShow(cJSON_GetStringValue(cJSON_GetObjectItem(pItem, "window"))), FALSE, FALSE);
+		free(pValue);
+		return TRUE;
+	}
+	return FALSE;
+}
+
+static UINT NextIndex(UINT* pSeed, UINT uEntries)
+{
+	*pSeed = *pSeed * 1103515245 + 12345;
+	return (*pSeed >> 8) % uEntries;
+}
+
+int main(int argc, char* argv[])
+{
+	UINT i;
+	UINT uSeed = 1;
+	UINT uRuns = 0;
+	UINT uEntries = argc > 1 ? (UINT)atoi(argv[1]) : 10000;
+	UINT64 llStart;
+	double dCompile, dTable, dWalk;
+	cJSON* pConfig;
+	FE_ACTION_TABLE* pTable;
+	if (uEntries == 0)
+		uEntries = 1;
+	pConfig = CreateConfig(uEntries);
+	if (!pConfig)
+		return 1;
+	/* FeRunAction logs every press */
+	ShimQuietLog(TRUE);
+	llStart = FeGetTimestamp();
+	pTable = FeCompileActions(pConfig);
+	dCompile = FeElapsedMs(llStart, FeGetTimestamp());
+	if (!pTable)
+		return 1;
+
+	llStart = FeGetTimestamp();
+	for (i = 0; i < ACTION_PRESSES; i++)
+		uRuns += FeRunAction(pTable, NextIndex(&uSeed, uEntries));
+	dTable = FeElapsedMs(llStart, FeGetTimestamp());
+
+	uSeed = 1;
+	llStart = FeGetTimestamp();
+	for (i = 0; i < ACTION_PRESSES; i++)
+		uRuns -= WalkAction(pConfig, NextIndex(&uSeed, uEntries));
+	dWalk = FeElapsedMs(llStart, FeGetTimestamp());
+
+	printf("%u entries, compiled in %.2f ms\n", uEntries, dCompile);
+	printf("table %10.1f ns/press\n", dTable * 1e6 / ACTION_PRESSES);
+	printf("walk  %10.1f ns/press\n", dWalk * 1e6 / ACTION_PRESSES);
+	FeFreeActions(pTable);
+	cJSON_Delete(pConfig);
+	/* both ran every press */
+	return uRuns == 0 ? 0 : 1;
+}
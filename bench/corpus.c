@@ -0,0 +1,365 @@
+﻿// SPDX-License-Identifier: GPL-3.0-or-later
+
+/* the generated desktop corpus through every format and profile a screenshot can be saved
+ * in: sizes, encode and decode timings, heap allocations and the peak RSS, each file decoded
+ * back and compared. ru_maxrss only grows, so every case runs in a child of its own, and
+ * its peak RSS is what the encoder and decoder took over the image and output buffers the
+ * bench itself holds. NPROC sets the worker count.
+ * usage: corpus_bench [runs [sizes [report.json]]], sizes 1 to 3 for up to 1080p, 4K or 8K,
+ * 3 runs of 1080p by default */
+
+#include "fe.h"
+#include "utils.h"
+#include "pngenc.h"
+#include "imgenc.h"
+#include "swizzle.h"
+#include "arena.h"
+#include "images.h"
+#include "decode.h"
+
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+typedef struct _BENCH_CODEC
+{
+	/* for the report and for FeGetImageWriter */
+	const char* pFormat;
+	LPCWSTR lpFormat;
+	/* NULL for the formats without profiles */
+	const char* pProfile;
+	FE_PNG_PROFILE uProfile;
+} BENCH_CODEC;
+
+/* the file is written into a buffer sized up front, so no realloc is timed */
+typedef struct _BENCH_OUTPUT
+{
+	UINT8* pData;
+	size_t szData;
+	size_t szMax;
+} BENCH_OUTPUT;
+
+/* what the child of one case sends back */
+typedef struct _BENCH_RESULT
+{
+	UINT uError;
+	BOOL bMatch;
+	size_t szOutput;
+	double dEncBest;
+	double dEncTotal;
+	double dDecBest;
+	double dDecTotal;
+	UINT64 llEncAllocs;
+	UINT64 llDecAllocs;
+	/* ru_maxrss with the buffers of the bench touched, and after the runs */
+	size_t szBenchRss;
+	size_t szPeakRss;
+} BENCH_RESULT;
+
+static const UINT mSizes[][2] =
+{
+	{ 1920, 1080 },
+	{ 3840, 2160 },
+	{ 7680, 4320 },
+};
+
+static const BENCH_CODEC mCodecs[] =
+{
+	{ "png", L"png", "fast", FE_PNG_FAST },
+	{ "png", L"png", "balanced", FE_PNG_BALANCED },
+	{ "png", L"png", "max", FE_PNG_MAX },
+	{ "qoi", L"qoi", NULL, FE_PNG_FAST },
+	{ "bmp", L"bmp", NULL, FE_PNG_FAST },
+};
+
+static BOOL WriteBenchPart(PVOID pContext, const UINT8* pData, size_t szData)
+{
+	BENCH_OUTPUT* pOutput = pContext;
+	if (szData > pOutput->szMax - pOutput->szData)
+		return FALSE;
+	memcpy(pOutput->pData + pOutput->szData, pData, szData);
+	pOutput->szData += szData;
+	return TRUE;
+}
+
+/* the way RunScreenShotJob encodes a capture */
+static UINT EncodeBench(FE_PNG_ENCODER* pEncoder, const FE_IMAGE_WRITER* pWriter, BENCH_OUTPUT* pOutput,
+	const UINT8* pBgrx, UINT8* pRgba, UINT w, UINT h, FE_PNG_PROFILE uProfile)
+{
+	UINT uError;
+	UINT8* png = NULL;
+	size_t szPng = 0;
+	pOutput->szData = 0;
+	if (uProfile != FE_PNG_MAX || pWriter->pfnStream != FeStreamPngBgrx)
+		return pWriter->pfnStream(pEncoder, WriteBenchPart, pOutput, NULL, pBgrx,
+			w, h, (size_t)w * 4, uProfile);
+	FeSwizzleBgra(pRgba, pBgrx, (size_t)w * h);
+	uError = FeEncodePng(pEncoder, &png, &szPng, pRgba, w, h, uProfile);
+	if (uError == 0 && !WriteBenchPart(pOutput, png, szPng))
+		uError = 79;
+	free(png);
+	return uError;
+}
+
+/* the way a viewer would open the file, as BGRX for QOI and BMP and RGBA for PNG */
+static UINT DecodeBench(const FE_IMAGE_WRITER* pWriter, const BENCH_OUTPUT* pOutput, UINT8** ppOut,
+	UINT* pw, UINT* ph)
+{
+	unsigned dw = 0, dh = 0;
+	UINT uError;
+	if (pWriter->pfnStream == FeStreamQoiBgrx)
+		return BenchDecodeQoi(ppOut, pw, ph, pOutput->pData, pOutput->szData);
+	if (pWriter->pfnStream == FeStreamBmpBgrx)
+		return BenchDecodeBmp(ppOut, pw, ph, pOutput->pData, pOutput->szData);
+	uError = lodepng_decode32(ppOut, &dw, &dh, pOutput->pData, pOutput->szData);
+	*pw = dw;
+	*ph = dh;
+	return uError;
+}
+
+static VOID FreeDecoded(const FE_IMAGE_WRITER* pWriter, UINT8* pOut)
+{
+	if (pWriter->pfnStream == FeStreamPngBgrx)
+		lodepng_free(pOut);
+	else
+		free(pOut);
+}
+
+static BOOL CheckDecoded(const FE_IMAGE_WRITER* pWriter, const UINT8* pOut, const UINT8* pBgrx,
+	UINT w, UINT h)
+{
+	size_t i;
+	BOOL bRgba = pWriter->pfnStream == FeStreamPngBgrx;
+	for (i = 0; i < (size_t)w * h; i++)
+	{
+		const UINT8* p = pOut + i * 4;
+		const UINT8* q = pBgrx + i * 4;
+		if (p[0] != q[bRgba ? 2 : 0] || p[1] != q[1] || p[2] != q[bRgba ? 0 : 2])
+			return FALSE;
+	}
+	return TRUE;
+}
+
+/* ru_maxrss is in kilobytes on Linux */
+static size_t GetPeakRss(VOID)
+{
+	struct rusage ru;
+	if (getrusage(RUSAGE_SELF, &ru) != 0)
+		return 0;
+	return (size_t)ru.ru_maxrss * 1024;
+}
+
+static VOID AddBenchTimes(cJSON* pCase, const char* pPrefix, double dBest, double dTotal, UINT uRuns,
+	UINT64 llAllocs, size_t szIn)
+{
+	char Name[32];
+	snprintf(Name, sizeof(Name), "%s_best_ms", pPrefix);
+	cJSON_AddNumberToObject(pCase, Name, dBest);
+	snprintf(Name, sizeof(Name), "%s_mean_ms", pPrefix);
+	cJSON_AddNumberToObject(pCase, Name, dTotal / uRuns);
+	snprintf(Name, sizeof(Name), "%s_mb_per_s", pPrefix);
+	cJSON_AddNumberToObject(pCase, Name, dBest > 0.0 ? (double)szIn / 1048576.0 / (dBest / 1000.0) : 0.0);
+	snprintf(Name, sizeof(Name), "%s_allocs_per_run", pPrefix);
+	cJSON_AddNumberToObject(pCase, Name, (double)llAllocs / uRuns);
+}
+
+/* runs in the child, the encoder is created there since its workers do not survive a fork */
+static VOID RunBenchCodec(BENCH_RESULT* pResult, const BENCH_IMAGE* pImage, const BENCH_CODEC* pCodec,
+	UINT w, UINT h, UINT uRuns)
+{
+	UINT uRun;
+	size_t szIn = (size_t)w * h * 4;
+	const FE_IMAGE_WRITER* pWriter = FeGetImageWriter(pCodec->lpFormat);
+	FE_PNG_ENCODER* pEncoder = NULL;
+	/* QOI_OP_RGB for every pixel is the largest file */
+	BENCH_OUTPUT output = { malloc((size_t)w * h * 5 + 1024), 0, (size_t)w * h * 5 + 1024 };
+	UINT8* pBgrx = malloc(szIn);
+	UINT8* pRgba = malloc(szIn);
+	if (!output.pData || !pBgrx || !pRgba)
+	{
+		pResult->uError = 83;
+		goto out;
+	}
+	pImage->pfnDraw(pBgrx, w, h);
+	memset(output.pData, 0, output.szMax);
+	memset(pRgba, 0, szIn);
+	pResult->szBenchRss = GetPeakRss();
+	pEncoder = FeCreatePngEncoder();
+	if (!pEncoder)
+	{
+		pResult->uError = 83;
+		goto out;
+	}
+	for (uRun = 0; uRun < uRuns; uRun++)
+	{
+		double dMs;
+		UINT8* pOut = NULL;
+		UINT dw = 0, dh = 0;
+		UINT64 llAllocs = FeGetHeapAllocs();
+		UINT64 llStart = FeGetTimestamp();
+		pResult->uError = EncodeBench(pEncoder, pWriter, &output, pBgrx, pRgba, w, h, pCodec->uProfile);
+		dMs = FeElapsedMs(llStart, FeGetTimestamp());
+		pResult->llEncAllocs += FeGetHeapAllocs() - llAllocs;
+		pResult->dEncTotal += dMs;
+		if (uRun == 0 || dMs < pResult->dEncBest)
+			pResult->dEncBest = dMs;
+		if (pResult->uError != 0)
+			break;
+		llAllocs = FeGetHeapAllocs();
+		llStart = FeGetTimestamp();
+		pResult->uError = DecodeBench(pWriter, &output, &pOut, &dw, &dh);
+		dMs = FeElapsedMs(llStart, FeGetTimestamp());
+		pResult->llDecAllocs += FeGetHeapAllocs() - llAllocs;
+		pResult->dDecTotal += dMs;
+		if (uRun == 0 || dMs < pResult->dDecBest)
+			pResult->dDecBest = dMs;
+		if (pResult->uError == 0 && uRun == 0)
+			pResult->bMatch = dw == w && dh == h && CheckDecoded(pWriter, pOut, pBgrx, w, h);
+		FreeDecoded(pWriter, pOut);
+		if (pResult->uError != 0)
+			break;
+	}
+	pResult->szOutput = output.szData;
+	pResult->szPeakRss = GetPeakRss();
+out:
+	if (pEncoder)
+		FeFreePngEncoder(pEncoder);
+	free(output.pData);
+	free(pBgrx);
+	free(pRgba);
+}
+
+static BOOL ForkBenchCodec(BENCH_RESULT* pResult, const BENCH_IMAGE* pImage, const BENCH_CODEC* pCodec,
+	UINT w, UINT h, UINT uRuns)
+{
+	int fd[2];
+	int status;
+	pid_t pid;
+	ssize_t r;
+	ZeroMemory(pResult, sizeof(BENCH_RESULT));
+	if (pipe(fd) != 0)
+		return FALSE;
+	fflush(stdout);
+	fflush(stderr);
+	pid = fork();
+	if (pid == 0)
+	{
+		close(fd[0]);
+		RunBenchCodec(pResult, pImage, pCodec, w, h, uRuns);
+		r = write(fd[1], pResult, sizeof(BENCH_RESULT));
+		_exit(r == sizeof(BENCH_RESULT) ? 0 : 1);
+	}
+	close(fd[1]);
+	r = pid > 0 ? read(fd[0], pResult, sizeof(BENCH_RESULT)) : -1;
+	close(fd[0]);
+	if (pid > 0)
+		waitpid(pid, &status, 0);
+	return r == sizeof(BENCH_RESULT);
+}
+
+static UINT RunBenchCase(cJSON* pResults, size_t* pszMaxRss, const BENCH_IMAGE* pImage,
+	UINT w, UINT h, UINT uRuns)
+{
+	UINT i;
+	UINT uCases = 0;
+	size_t szIn = (size_t)w * h * 4;
+	for (i = 0; i < ARRAYSIZE(mCodecs); i++)
+	{
+		BENCH_RESULT result;
+		size_t szRss;
+		cJSON* pCase = cJSON_CreateObject();
+		cJSON_AddStringToObject(pCase, "image", pImage->pName);
+		cJSON_AddNumberToObject(pCase, "width", w);
+		cJSON_AddNumberToObject(pCase, "height", h);
+		cJSON_AddStringToObject(pCase, "format", mCodecs[i].pFormat);
+		if (mCodecs[i].pProfile)
+			cJSON_AddStringToObject(pCase, "profile", mCodecs[i].pProfile);
+		cJSON_AddItemToArray(pResults, pCase);
+		if (!ForkBenchCodec(&result, pImage, &mCodecs[i], w, h, uRuns) || result.uError != 0 || !result.bMatch)
+		{
+			fprintf(stderr, "%s %ux%u %s %s: %s %u\n", pImage->pName, w, h, mCodecs[i].pFormat,
+				mCodecs[i].pProfile ? mCodecs[i].pProfile : "", result.bMatch ? "error" : "mismatch",
+				result.uError);
+			if (!result.bMatch && result.uError == 0)
+				cJSON_AddStringToObject(pCase, "error", "decoded image differs");
+			else
+				cJSON_AddNumberToObject(pCase, "error", result.uError);
+			continue;
+		}
+		szRss = result.szPeakRss > result.szBenchRss ? result.szPeakRss - result.szBenchRss : 0;
+		*pszMaxRss = max(*pszMaxRss, szRss);
+		cJSON_AddNumberToObject(pCase, "input_bytes", (double)szIn);
+		cJSON_AddNumberToObject(pCase, "output_bytes", (double)result.szOutput);
+		AddBenchTimes(pCase, "encode", result.dEncBest, result.dEncTotal, uRuns, result.llEncAllocs, szIn);
+		AddBenchTimes(pCase, "decode", result.dDecBest, result.dDecTotal, uRuns, result.llDecAllocs, szIn);
+		cJSON_AddNumberToObject(pCase, "peak_rss", (double)szRss);
+		cJSON_AddNumberToObject(pCase, "bench_rss", (double)result.szBenchRss);
+		printf("%-8s %4ux%-4u %-3s %-8s %10zu bytes  encode %8.2f ms  decode %8.2f ms  %6.1f allocs  %7.1f MB\n",
+			pImage->pName, w, h, mCodecs[i].pFormat, mCodecs[i].pProfile ? mCodecs[i].pProfile : "",
+			result.szOutput, result.dEncBest, result.dDecBest, (double)result.llEncAllocs / uRuns,
+			(double)szRss / 1048576.0);
+		uCases++;
+	}
+	return uCases;
+}
+
+static BOOL WriteBenchReport(const char* pPath, const cJSON* pReport)
+{
+	BOOL bRet;
+	FILE* fp;
+	char* pText = cJSON_Print(pReport);
+	if (!pText)
+		return FALSE;
+	fp = fopen(pPath, "wb");
+	if (!fp)
+	{
+		cJSON_free(pText);
+		return FALSE;
+	}
+	bRet = fputs(pText, fp) >= 0;
+	bRet = fclose(fp) == 0 && bRet;
+	cJSON_free(pText);
+	return bRet;
+}
+
+int main(int argc, char* argv[])
+{
+	UINT i, j;
+	UINT uCases = 0;
+	size_t szMaxRss = 0;
+	SYSTEM_INFO si;
+	UINT uRuns = argc > 1 ? (UINT)atoi(argv[1]) : 3;
+	UINT uSizes = argc > 2 ? (UINT)atoi(argv[2]) : 1;
+	cJSON* pReport = cJSON_CreateObject();
+	cJSON* pResults;
+
+	/* the means divide by it */
+	if (uRuns == 0)
+		uRuns = 1;
+	uSizes = min(max(uSizes, 1), ARRAYSIZE(mSizes));
+	if (!pReport)
+		return 1;
+	GetSystemInfo(&si);
+	/* 3: peak_rss is per case and leaves out the bench_rss of the bench's own buffers */
+	cJSON_AddNumberToObject(pReport, "version", 3);
+	cJSON_AddNumberToObject(pReport, "cpu_features", FeGetCpuFeatures());
+	cJSON_AddNumberToObject(pReport, "processors", si.dwNumberOfProcessors);
+	cJSON_AddNumberToObject(pReport, "pointer_bits", (double)(sizeof(PVOID) * 8));
+	cJSON_AddNumberToObject(pReport, "runs", uRuns);
+	pResults = cJSON_AddArrayToObject(pReport, "results");
+	for (i = 0; i < uSizes; i++)
+	{
+		for (j = 0; j < gBenchImageCount; j++)
+			uCases += RunBenchCase(pResults, &szMaxRss, &gBenchImages[j], mSizes[i][0], mSizes[i][1], uRuns);
+	}
+	printf("%u of %u cases, peak RSS of a case %zu MB\n", uCases,
+		uSizes * gBenchImageCount * (UINT)ARRAYSIZE(mCodecs), szMaxRss >> 20);
+	if (argc > 3 && !WriteBenchReport(argv[3], pReport))
+	{
+		fprintf(stderr, "cannot write %s\n", argv[3]);
+		uCases = 0;
+	}
+	cJSON_Delete(pReport);
+	return uCases == uSizes * gBenchImageCount * ARRAYSIZE(mCodecs) ? 0 : 1;
+}
@@ -0,0 +1,126 @@
+﻿// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "decode.h"
+
+static UINT32 GetBe32(const UINT8* p)
+{
+	return ((UINT32)p[0] << 24) | ((UINT32)p[1] << 16) | ((UINT32)p[2] << 8) | p[3];
+}
+
+static UINT32 GetLe32(const UINT8* p)
+{
+	return p[0] | ((UINT32)p[1] << 8) | ((UINT32)p[2] << 16) | ((UINT32)p[3] << 24);
+}
+
+/* after the reference qoi.h, alpha is kept as the file has it */
+UINT BenchDecodeQoi(UINT8** ppBgrx, UINT* pw, UINT* ph, const UINT8* pData, size_t szData)
+{
+	size_t i, n = 14;
+	size_t szPixels;
+	UINT uRun = 0;
+	UINT8 Index[64][4] = { { 0 } };
+	/* RGBA */
+	UINT8 px[4] = { 0, 0, 0, 255 };
+	UINT8* pOut;
+	*ppBgrx = NULL;
+	if (szData < 14 + 8 || memcmp(pData, "qoif", 4) != 0)
+		return 28;
+	*pw = GetBe32(pData + 4);
+	*ph = GetBe32(pData + 8);
+	if (*pw == 0 || *ph == 0 || (UINT64)*pw * *ph >= 400000000 || pData[12] < 3 || pData[12] > 4)
+		return 93;
+	if (memcmp(pData + szData - 8, "\0\0\0\0\0\0\0\1", 8) != 0)
+		return 28;
+	szPixels = (size_t)*pw * *ph;
+	pOut = malloc(szPixels * 4);
+	if (!pOut)
+		return 83;
+	/* the end marker is never read as a chunk */
+	szData -= 8;
+	for (i = 0; i < szPixels; i++)
+	{
+		if (uRun > 0)
+			uRun--;
+		else if (n < szData)
+		{
+			UINT8 b = pData[n++];
+			if (b == 0xFE || b == 0xFF)
+			{
+				if (n + 3 + (b & 1) > szData)
+					break;
+				px[0] = pData[n++];
+				px[1] = pData[n++];
+				px[2] = pData[n++];
+				if (b == 0xFF)
+					px[3] = pData[n++];
+			}
+			else if ((b & 0xC0) == 0x00)
+				memcpy(px, Index[b], 4);
+			else if ((b & 0xC0) == 0x40)
+			{
+				px[0] += ((b >> 4) & 3) - 2;
+				px[1] += ((b >> 2) & 3) - 2;
+				px[2] += (b & 3) - 2;
+			}
+			else if ((b & 0xC0) == 0x80)
+			{
+				int dg;
+				if (n >= szData)
+					break;
+				dg = (b & 0x3F) - 32;
+				px[0] += dg - 8 + ((pData[n] >> 4) & 0x0F);
+				px[1] += dg;
+				px[2] += dg - 8 + (pData[n] & 0x0F);
+				n++;
+			}
+			else
+				uRun = b & 0x3F;
+			memcpy(Index[(px[0] * 3 + px[1] * 5 + px[2] * 7 + px[3] * 11) % 64], px, 4);
+		}
+		else
+			break;
+		pOut[i * 4] = px[2];
+		pOut[i * 4 + 1] = px[1];
+		pOut[i * 4 + 2] = px[0];
+		pOut[i * 4 + 3] = px[3];
+	}
+	/* every pixel, and nothing left over before the end marker */
+	if (i < szPixels || uRun != 0 || n != szData)
+	{
+		free(pOut);
+		return 28;
+	}
+	*ppBgrx = pOut;
+	return 0;
+}
+
+UINT BenchDecodeBmp(UINT8** ppBgrx, UINT* pw, UINT* ph, const UINT8* pData, size_t szData)
+{
+	UINT y;
+	INT iHeight;
+	size_t szRow, szOffset;
+	UINT8* pOut;
+	*ppBgrx = NULL;
+	/* BITMAPFILEHEADER and at least a BITMAPINFOHEADER */
+	if (szData < 54 || pData[0] != 'B' || pData[1] != 'M' || GetLe32(pData + 14) < 40)
+		return 28;
+	szOffset = GetLe32(pData + 10);
+	iHeight = (INT)GetLe32(pData + 22);
+	*pw = GetLe32(pData + 18);
+	*ph = iHeight < 0 ? (UINT)-iHeight : (UINT)iHeight;
+	/* one plane, 32 bits, BI_RGB */
+	if (pData[26] != 1 || pData[28] != 32 || GetLe32(pData + 30) != 0)
+		return 29;
+	if (*pw == 0 || *ph == 0 || *pw > 0x7FFFFFFF / 4)
+		return 93;
+	szRow = (size_t)*pw * 4;
+	if (GetLe32(pData + 2) != szData || szOffset > szData || (szData - szOffset) / szRow < *ph)
+		return 28;
+	pOut = malloc(szRow * *ph);
+	if (!pOut)
+		return 83;
+	for (y = 0; y < *ph; y++)
+		memcpy(pOut + y * szRow, pData + szOffset + (size_t)(iHeight < 0 ? y : *ph - 1 - y) * szRow, szRow);
+	*ppBgrx = pOut;
+	return 0;
+}
@@ -0,0 +1,11 @@
+﻿// SPDX-License-Identifier: GPL-3.0-or-later
+#pragma once
+
+#include "fe.h"
+
+/* decoders for what FeStreamQoiBgrx and FeStreamBmpBgrx write, into malloc'd top-down
+ * BGRX rows of w * 4 bytes, they return 0 or a lodepng-like error */
+UINT BenchDecodeQoi(UINT8** ppBgrx, UINT* pw, UINT* ph, const UINT8* pData, size_t szData);
+
+/* uncompressed 32-bit only, top-down or bottom-up */
+UINT BenchDecodeBmp(UINT8** ppBgrx, UINT* pw, UINT* ph, const UINT8* pData, size_t szData);
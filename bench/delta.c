@@ -0,0 +1,75 @@
+﻿// SPDX-License-Identifier: GPL-3.0-or-later
+
+/* screenshots of a desktop where one small block changes between frames, taken from the
+ * memory capture backend: FeStreamPngDelta against a full FeStreamPngBgrx per frame
+ * usage: delta_bench [frames [w h]] */
+
+#include "fe.h"
+#include "utils.h"
+#include "pngenc.h"
+#include "capture.h"
+
+#include <stdio.h>
+
+static BOOL CountBytes(PVOID pContext, const UINT8* pData, size_t szData)
+{
+	UNREFERENCED_PARAMETER(pData);
+	*(size_t*)pContext += szData;
+	return TRUE;
+}
+
+static VOID RunFrames(FE_CAPTURE* pCapture, FE_PNG_ENCODER* pEncoder, FE_PNG_DELTA* pDelta,
+	UINT w, UINT h, UINT uFrames, FE_PNG_PROFILE uProfile)
+{
+	UINT i;
+	size_t szTotal = 0;
+	UINT64 ullDirty = 0, ullTiles = 0;
+	UINT64 llStart = FeGetTimestamp();
+	for (i = 0; i < uFrames; i++)
+	{
+		size_t szStride;
+		FE_PNG_DELTA_STATS stats = { 0 };
+		UINT8* pFrame = FeGrabCapture(pCapture, 0, 0, (int)w, (int)h, &szStride);
+		if (!pFrame)
+			break;
+		if (pDelta)
+			FeStreamPngDelta(pEncoder, pDelta, CountBytes, &szTotal, NULL, pFrame, w, h, szStride,
+				uProfile, &stats);
+		else
+			FeStreamPngBgrx(pEncoder, CountBytes, &szTotal, NULL, pFrame, w, h, szStride, uProfile);
+		FeReleaseCapture(pCapture);
+		ullDirty += stats.uDirtyTiles;
+		ullTiles += stats.uTiles;
+	}
+	printf("%-6s %-8s %8.2f ms/frame %10zu bytes/frame", pDelta ? "delta" : "full",
+		uProfile == FE_PNG_FAST ? "fast" : "balanced", FeElapsedMs(llStart, FeGetTimestamp()) / uFrames,
+		szTotal / uFrames);
+	if (pDelta)
+		printf("  %.1f%% tiles dirty", ullTiles ? 100.0 * ullDirty / ullTiles : 0.0);
+	printf("\n");
+}
+
+int main(int argc, char* argv[])
+{
+	FE_PNG_PROFILE uProfile;
+	UINT uFrames = argc > 1 ? (UINT)atoi(argv[1]) : 30;
+	UINT w = argc > 3 ? (UINT)atoi(argv[2]) : 1920;
+	UINT h = argc > 3 ? (UINT)atoi(argv[3]) : 1080;
+	FE_PNG_ENCODER* pEncoder = FeCreatePngEncoder();
+	if (uFrames == 0)
+		uFrames = 1;
+	printf("%u frames of %ux%u\n", uFrames, w, h);
+	for (uProfile = FE_PNG_FAST; uProfile <= FE_PNG_BALANCED; uProfile++)
+	{
+		FE_CAPTURE* pCapture = FeCreateMemoryCapture(w, h);
+		FE_PNG_DELTA* pDelta = FeCreatePngDelta();
+		if (!pCapture || !pDelta)
+			return 1;
+		RunFrames(pCapture, pEncoder, NULL, w, h, uFrames, uProfile);
+		RunFrames(pCapture, pEncoder, pDelta, w, h, uFrames, uProfile);
+		FeFreePngDelta(pDelta);
+		FeFreeCapture(pCapture);
+	}
+	FeFreePngEncoder(pEncoder);
+	return 0;
+}
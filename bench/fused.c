@@ -0,0 +1,196 @@
+﻿// SPDX-License-Identifier: GPL-3.0-or-later
+
+/* FeEncodePngBgrx against the path it replaced in BmpToPng, the R and B swap over the
+ * captured frame and then lodepng_encode32, in MB/s of BGRX input and peak RSS. ru_maxrss
+ * only grows, so every path of every frame runs in a child of its own, and the RSS over
+ * the frame is what the path itself took. NPROC sets the worker count.
+ * usage: fused_bench [runs [sizes]], sizes 1 to 3 for up to 1080p, 4K or 8K, 3 runs of
+ * every size by default */
+
+#include "fe.h"
+#include "utils.h"
+#include "pngenc.h"
+#include "arena.h"
+#include "images.h"
+
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+typedef struct _FUSED_RESULT
+{
+	UINT uError;
+	BOOL bMatch;
+	size_t szPng;
+	double dBest;
+	/* ru_maxrss with the frame drawn, and after the runs */
+	size_t szFrameRss;
+	size_t szPeakRss;
+} FUSED_RESULT;
+
+static const UINT mSizes[][2] =
+{
+	{ 1920, 1080 },
+	{ 3840, 2160 },
+	{ 7680, 4320 },
+};
+
+static const char* mPaths[] = { "swap+lodepng", "bgrx" };
+
+/* ru_maxrss is in kilobytes on Linux */
+static size_t GetPeakRss(VOID)
+{
+	struct rusage ru;
+	if (getrusage(RUSAGE_SELF, &ru) != 0)
+		return 0;
+	return (size_t)ru.ru_maxrss * 1024;
+}
+
+/* what BmpToPng did with the GetDIBits buffer */
+static UINT EncodeSwapped(UINT8** ppPng, size_t* pszPng, UINT8* pRaw, UINT w, UINT h)
+{
+	size_t i;
+	for (i = 0; i < (size_t)w * h; i++)
+	{
+		UINT8* p = pRaw + i * 4;
+		UINT8 tmp = p[0];
+		p[0] = p[2];
+		p[2] = tmp;
+		p[3] = 0xFF;
+	}
+	return lodepng_encode32(ppPng, pszPng, pRaw, w, h);
+}
+
+static BOOL CheckFused(const UINT8* pPng, size_t szPng, const UINT8* pBgrx, UINT w, UINT h)
+{
+	size_t i;
+	UINT8* pOut = NULL;
+	unsigned dw, dh;
+	BOOL bRet = lodepng_decode32(&pOut, &dw, &dh, pPng, szPng) == 0 && dw == w && dh == h;
+	for (i = 0; bRet && i < (size_t)w * h; i++)
+		bRet = pOut[i * 4] == pBgrx[i * 4 + 2] && pOut[i * 4 + 1] == pBgrx[i * 4 + 1]
+			&& pOut[i * 4 + 2] == pBgrx[i * 4];
+	lodepng_free(pOut);
+	return bRet;
+}
+
+/* runs in the child, the frame is drawn again before each run since the swap is in place */
+static VOID RunFusedPath(FUSED_RESULT* pResult, UINT uPath, const BENCH_IMAGE* pImage,
+	UINT w, UINT h, UINT uRuns)
+{
+	UINT uRun;
+	UINT8* pPng = NULL;
+	UINT8* pFrame = malloc((size_t)w * h * 4);
+	FE_PNG_ENCODER* pEncoder = FeCreatePngEncoder();
+	if (!pFrame || !pEncoder)
+	{
+		pResult->uError = 83;
+		goto out;
+	}
+	pImage->pfnDraw(pFrame, w, h);
+	pResult->szFrameRss = GetPeakRss();
+	for (uRun = 0; uRun < uRuns && pResult->uError == 0; uRun++)
+	{
+		double dMs;
+		UINT64 llStart;
+		/* lodepng allocates the file with the arena.c lodepng_malloc */
+		if (uPath == 0)
+			lodepng_free(pPng);
+		else
+			free(pPng);
+		pPng = NULL;
+		if (uRun > 0)
+			pImage->pfnDraw(pFrame, w, h);
+		llStart = FeGetTimestamp();
+		if (uPath == 0)
+			pResult->uError = EncodeSwapped(&pPng, &pResult->szPng, pFrame, w, h);
+		else
+			pResult->uError = FeEncodePngBgrx(pEncoder, &pPng, &pResult->szPng, pFrame, w, h,
+				(size_t)w * 4, FE_PNG_BALANCED);
+		dMs = FeElapsedMs(llStart, FeGetTimestamp());
+		if (uRun == 0 || dMs < pResult->dBest)
+			pResult->dBest = dMs;
+	}
+	/* before the check, which decodes into a frame of its own */
+	pResult->szPeakRss = GetPeakRss();
+	if (pResult->uError == 0)
+	{
+		pImage->pfnDraw(pFrame, w, h);
+		pResult->bMatch = CheckFused(pPng, pResult->szPng, pFrame, w, h);
+	}
+out:
+	if (uPath == 0)
+		lodepng_free(pPng);
+	else
+		free(pPng);
+	if (pEncoder)
+		FeFreePngEncoder(pEncoder);
+	free(pFrame);
+}
+
+static BOOL ForkFusedPath(FUSED_RESULT* pResult, UINT uPath, const BENCH_IMAGE* pImage,
+	UINT w, UINT h, UINT uRuns)
+{
+	int fd[2];
+	int status;
+	pid_t pid;
+	ssize_t r;
+	ZeroMemory(pResult, sizeof(FUSED_RESULT));
+	if (pipe(fd) != 0)
+		return FALSE;
+	fflush(stdout);
+	pid = fork();
+	if (pid == 0)
+	{
+		close(fd[0]);
+		RunFusedPath(pResult, uPath, pImage, w, h, uRuns);
+		r = write(fd[1], pResult, sizeof(FUSED_RESULT));
+		_exit(r == sizeof(FUSED_RESULT) ? 0 : 1);
+	}
+	close(fd[1]);
+	r = pid > 0 ? read(fd[0], pResult, sizeof(FUSED_RESULT)) : -1;
+	close(fd[0]);
+	if (pid > 0)
+		waitpid(pid, &status, 0);
+	return r == sizeof(FUSED_RESULT);
+}
+
+int main(int argc, char* argv[])
+{
+	UINT i, j, k;
+	BOOL bRet = TRUE;
+	UINT uRuns = argc > 1 ? (UINT)atoi(argv[1]) : 3;
+	UINT uSizes = argc > 2 ? (UINT)atoi(argv[2]) : ARRAYSIZE(mSizes);
+
+	if (uRuns < 1)
+		uRuns = 1;
+	uSizes = min(max(uSizes, 1), ARRAYSIZE(mSizes));
+	printf("%-8s %-9s %-12s %10s %9s %10s %10s %10s\n", "image", "size", "path", "bytes", "ms", "MB/s",
+		"peak MB", "over frame");
+	for (i = 0; i < uSizes; i++)
+	{
+		UINT w = mSizes[i][0], h = mSizes[i][1];
+		for (j = 0; j < gBenchImageCount; j++)
+		{
+			for (k = 0; k < ARRAYSIZE(mPaths); k++)
+			{
+				FUSED_RESULT result;
+				if (!ForkFusedPath(&result, k, &gBenchImages[j], w, h, uRuns) || result.uError != 0
+					|| !result.bMatch)
+				{
+					printf("%-8s %4ux%-4u %-12s %s %u\n", gBenchImages[j].pName, w, h, mPaths[k],
+						result.uError ? "error" : "failed", result.uError);
+					bRet = FALSE;
+					continue;
+				}
+				printf("%-8s %4ux%-4u %-12s %10zu %9.1f %10.1f %10.1f %10.1f\n", gBenchImages[j].pName,
+					w, h, mPaths[k], result.szPng, result.dBest,
+					(double)w * h * 4 / 1048576.0 / (result.dBest / 1000.0),
+					(double)result.szPeakRss / 1048576.0,
+					(double)(result.szPeakRss - result.szFrameRss) / 1048576.0);
+			}
+		}
+	}
+	return bRet ? 0 : 1;
+}
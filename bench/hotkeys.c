@@ -0,0 +1,80 @@
+﻿// SPDX-License-Identifier: GPL-3.0-or-later
+
+/* FeInitializeHotkey, FeHandleHotkey on random registered ids and FeListHotkey for configs
+ * of 10, 1k and 40k hotkeys, with the shim RegisterHotKey and handlers.
+ * usage: hotkey_bench [presses] */
+
+#include "fe.h"
+#include "utils.h"
+
+#include <stdio.h>
+
+static const UINT mCounts[] = { 10, 1000, 40000 };
+
+static cJSON* CreateConfig(UINT uEntries)
+{
+	UINT i;
+	char Value[64];
+	cJSON* pArray = cJSON_CreateArray();
+	for (i = 0; pArray && i < uEntries; i++)
+	{
+		cJSON* pItem = cJSON_CreateObject();
+		snprintf(Value, sizeof(Value), "Ctrl-%u", 0x1000 + i);
+		cJSON_AddStringToObject(pItem, "key", Value);
+		cJSON_AddStringToObject(pItem, "note", "an entry of the generated config");
+		snprintf(Value, sizeof(Value), "C:\\Windows\\System32\\tool%u.exe /q", i);
+		cJSON_AddStringToObject(pItem, "exec", Value);
+		cJSON_AddItemToArray(pArray, pItem);
+	}
+	return pArray;
+}
+
+int main(int argc, char* argv[])
+{
+	UINT i, j;
+	UINT uPresses = argc > 1 ? (UINT)atoi(argv[1]) : 1000000;
+	if (uPresses == 0)
+		uPresses = 1;
+	/* every registration, press and listed key is logged */
+	ShimQuietLog(TRUE);
+	printf("%8s %10s %12s %10s\n", "hotkeys", "init ms", "ns/press", "list ms");
+	for (i = 0; i < ARRAYSIZE(mCounts); i++)
+	{
+		UINT uSeed = 1;
+		UINT uIds = 0;
+		UINT* pIds = malloc(sizeof(UINT) * mCounts[i]);
+		cJSON* pConfig = CreateConfig(mCounts[i]);
+		double dInit, dPress, dList;
+		UINT64 llStart;
+		MSG msg = { 0 };
+		if (!pIds || !pConfig)
+			return 1;
+		llStart = FeGetTimestamp();
+		FeInitializeHotkey(pConfig);
+		dInit = FeElapsedMs(llStart, FeGetTimestamp());
+		for (j = 0; j <= MAX_HOTKEY_ID && uIds < mCounts[i]; j++)
+		{
+			if (ShimGetHotKey((int)j, NULL))
+				pIds[uIds++] = j;
+		}
+		if (uIds != mCounts[i])
+			return 1;
+		msg.message = WM_HOTKEY;
+		llStart = FeGetTimestamp();
+		for (j = 0; j < uPresses; j++)
+		{
+			uSeed = uSeed * 1103515245 + 12345;
+			msg.wParam = pIds[(uSeed >> 8) % uIds];
+			FeHandleHotkey(&msg);
+		}
+		dPress = FeElapsedMs(llStart, FeGetTimestamp());
+		llStart = FeGetTimestamp();
+		FeListHotkey(NULL);
+		dList = FeElapsedMs(llStart, FeGetTimestamp());
+		printf("%8u %10.2f %12.1f %10.2f\n", mCounts[i], dInit, dPress * 1e6 / uPresses, dList);
+		FeUnregisterHotkey();
+		cJSON_Delete(pConfig);
+		free(pIds);
+	}
+	return 0;
+}
@@ -0,0 +1,127 @@
+﻿// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "images.h"
+
+/* same seed every time, the corpus does not change between reports */
+static UINT BenchRandom(UINT* pSeed)
+{
+	*pSeed = *pSeed * 1103515245 + 12345;
+	return *pSeed >> 8;
+}
+
+static VOID FillBenchRect(UINT8* pBgrx, UINT w, UINT h, UINT x0, UINT y0, UINT rw, UINT rh, UINT uColor)
+{
+	UINT x, y;
+	for (y = y0; y < min(y0 + rh, h); y++)
+	{
+		UINT32* p = (UINT32*)pBgrx + (size_t)y * w;
+		for (x = x0; x < min(x0 + rw, w); x++)
+			p[x] = uColor;
+	}
+}
+
+/* overlapping windows with title bars, buttons and borders in flat colors */
+static VOID DrawBenchFlat(UINT8* pBgrx, UINT w, UINT h)
+{
+	UINT i, j;
+	UINT uSeed = 1;
+	FillBenchRect(pBgrx, w, h, 0, 0, w, h, 0x003A6EA5);
+	for (i = 0; i < 12; i++)
+	{
+		UINT ww = w / 6 + BenchRandom(&uSeed) % (w / 3);
+		UINT wh = h / 6 + BenchRandom(&uSeed) % (h / 3);
+		UINT x = BenchRandom(&uSeed) % (w - ww);
+		UINT y = BenchRandom(&uSeed) % (h - wh);
+		FillBenchRect(pBgrx, w, h, x, y, ww, wh, 0x00808080);
+		FillBenchRect(pBgrx, w, h, x + 1, y + 1, ww - 2, wh - 2, 0x00F0F0F0);
+		FillBenchRect(pBgrx, w, h, x + 1, y + 1, ww - 2, 30, (i & 1) ? 0x000078D7 : 0x00FFFFFF);
+		for (j = 0; j < 4; j++)
+		{
+			UINT bx = x + ww - (j + 1) * 90;
+			FillBenchRect(pBgrx, w, h, bx, y + wh - 40, 80, 26, 0x00ADADAD);
+			FillBenchRect(pBgrx, w, h, bx + 1, y + wh - 39, 78, 24, 0x00E1E1E1);
+		}
+	}
+	FillBenchRect(pBgrx, w, h, 0, h - 40, w, 40, 0x00202020);
+}
+
+/* rows of glyph-like marks on a light page, like a document or a terminal */
+static VOID DrawBenchText(UINT8* pBgrx, UINT w, UINT h)
+{
+	UINT x, y;
+	for (y = 0; y < h; y++)
+	{
+		UINT32* p = (UINT32*)pBgrx + (size_t)y * w;
+		UINT uLine = y / 20;
+		UINT uRow = y % 20;
+		for (x = 0; x < w; x++)
+		{
+			UINT uChar = x / 9;
+			UINT uCol = x % 9;
+			UINT uSeed = uLine * 7919 + uChar * 104729;
+			UINT uGlyph = BenchRandom(&uSeed);
+			BOOL bInk = uRow >= 4 && uRow < 16 && uCol < 7
+				&& ((uGlyph >> ((uRow - 4) * 2 + (uCol > 3))) & 1)
+				&& uChar % 12 != 11 && (uChar * 9) % w < w - 40;
+			p[x] = bInk ? ((uLine % 7 == 0) ? 0x000000A0 : 0x00202020) : 0x00FFFFFF;
+		}
+	}
+}
+
+/* smooth value noise with grain, there are few exact repeats */
+static VOID DrawBenchPhoto(UINT8* pBgrx, UINT w, UINT h)
+{
+	UINT x, y, i;
+	UINT uSeed = 3;
+	UINT8 Grid[17][17][3];
+	for (y = 0; y < 17; y++)
+		for (x = 0; x < 17; x++)
+			for (i = 0; i < 3; i++)
+				Grid[y][x][i] = (UINT8)(40 + BenchRandom(&uSeed) % 180);
+	for (y = 0; y < h; y++)
+	{
+		UINT8* p = pBgrx + (size_t)y * w * 4;
+		UINT gy = y * 16 / h;
+		UINT fy = (y * 16 % h) * 256 / h;
+		for (x = 0; x < w; x++, p += 4)
+		{
+			UINT gx = x * 16 / w;
+			UINT fx = (x * 16 % w) * 256 / w;
+			for (i = 0; i < 3; i++)
+			{
+				UINT a = Grid[gy][gx][i] * (256 - fx) + Grid[gy][gx + 1][i] * fx;
+				UINT b = Grid[gy + 1][gx][i] * (256 - fx) + Grid[gy + 1][gx + 1][i] * fx;
+				UINT v = (a * (256 - fy) + b * fy) >> 16;
+				p[i] = (UINT8)min(v + BenchRandom(&uSeed) % 4, 255);
+			}
+			p[3] = 0;
+		}
+	}
+}
+
+/* wallpaper-like diagonal gradients */
+static VOID DrawBenchGradient(UINT8* pBgrx, UINT w, UINT h)
+{
+	UINT x, y;
+	for (y = 0; y < h; y++)
+	{
+		UINT8* p = pBgrx + (size_t)y * w * 4;
+		for (x = 0; x < w; x++, p += 4)
+		{
+			p[0] = (UINT8)(255 * x / w);
+			p[1] = (UINT8)(255 * y / h);
+			p[2] = (UINT8)(255 * (x + y) / (w + h));
+			p[3] = 0;
+		}
+	}
+}
+
+const BENCH_IMAGE gBenchImages[] =
+{
+	{ "flat", DrawBenchFlat },
+	{ "text", DrawBenchText },
+	{ "photo", DrawBenchPhoto },
+	{ "gradient", DrawBenchGradient },
+};
+
+const UINT gBenchImageCount = ARRAYSIZE(gBenchImages);
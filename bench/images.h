@@ -0,0 +1,18 @@
+﻿// SPDX-License-Identifier: GPL-3.0-or-later
+#pragma once
+
+#include "fe.h"
+
+typedef VOID (*BENCH_DRAW)(UINT8* pBgrx, UINT w, UINT h);
+
+typedef struct _BENCH_IMAGE
+{
+	const char* pName;
+	BENCH_DRAW pfnDraw;
+} BENCH_IMAGE;
+
+/* desktop-like content drawn as top-down BGRX rows, the same for every run */
+extern const BENCH_IMAGE gBenchImages[];
+
+extern const UINT gBenchImageCount;
+
@@ -0,0 +1,127 @@
+﻿// SPDX-License-Identifier: GPL-3.0-or-later
+
+/* the stripe encoder behind FeEncodePng against a plain lodepng_encode32 of the same
+ * frame, best of a few runs in MB/s of RGBA input, each PNG decoded back and compared.
+ * NPROC sets the worker count. usage: stripe_bench [runs [width height]], 1080p by default */
+
+#include "fe.h"
+#include "utils.h"
+#include "pngenc.h"
+#include "swizzle.h"
+#include "arena.h"
+#include "images.h"
+
+typedef struct _STRIPE_CODEC
+{
+	const char* pName;
+	/* FALSE for lodepng_encode32 */
+	BOOL bStripes;
+	FE_PNG_PROFILE uProfile;
+} STRIPE_CODEC;
+
+static const STRIPE_CODEC mCodecs[] =
+{
+	{ "lodepng", FALSE, FE_PNG_BALANCED },
+	{ "fast", TRUE, FE_PNG_FAST },
+	{ "balanced", TRUE, FE_PNG_BALANCED },
+	{ "max", TRUE, FE_PNG_MAX },
+};
+
+static UINT EncodeStripe(FE_PNG_ENCODER* pEncoder, const STRIPE_CODEC* pCodec, UINT8** ppPng,
+	size_t* pszPng, const UINT8* pRgba, UINT w, UINT h)
+{
+	UINT uError;
+	UINT8* pPng = NULL;
+	if (pCodec->bStripes)
+		return FeEncodePng(pEncoder, ppPng, pszPng, pRgba, w, h, pCodec->uProfile);
+	/* lodepng allocates with the arena.c lodepng_malloc, copy out like FeEncodePng */
+	uError = lodepng_encode32(&pPng, pszPng, pRgba, w, h);
+	if (!uError)
+	{
+		*ppPng = malloc(*pszPng);
+		if (*ppPng)
+			memcpy(*ppPng, pPng, *pszPng);
+		else
+			uError = 83;
+	}
+	lodepng_free(pPng);
+	return uError;
+}
+
+static BOOL CheckStripe(const UINT8* pPng, size_t szPng, const UINT8* pRgba, UINT w, UINT h)
+{
+	UINT8* pOut = NULL;
+	unsigned dw, dh;
+	BOOL bRet = lodepng_decode32(&pOut, &dw, &dh, pPng, szPng) == 0
+		&& dw == w && dh == h && memcmp(pOut, pRgba, (size_t)w * h * 4) == 0;
+	lodepng_free(pOut);
+	return bRet;
+}
+
+static BOOL RunStripeCase(FE_PNG_ENCODER* pEncoder, const BENCH_IMAGE* pImage, UINT w, UINT h, UINT uRuns)
+{
+	UINT i, uRun;
+	BOOL bRet = TRUE;
+	size_t szIn = (size_t)w * h * 4;
+	UINT8* pBgrx = malloc(szIn);
+	UINT8* pRgba = malloc(szIn);
+	if (!pBgrx || !pRgba)
+	{
+		free(pBgrx);
+		free(pRgba);
+		return FALSE;
+	}
+	pImage->pfnDraw(pBgrx, w, h);
+	FeSwizzleBgra(pRgba, pBgrx, (size_t)w * h);
+	for (i = 0; i < ARRAYSIZE(mCodecs); i++)
+	{
+		UINT uError = 0;
+		double dBest = 0.0;
+		UINT8* pPng = NULL;
+		size_t szPng = 0;
+		BOOL bSame;
+		for (uRun = 0; uRun < uRuns && uError == 0; uRun++)
+		{
+			double dMs;
+			UINT64 llStart = FeGetTimestamp();
+			free(pPng);
+			pPng = NULL;
+			uError = EncodeStripe(pEncoder, &mCodecs[i], &pPng, &szPng, pRgba, w, h);
+			dMs = FeElapsedMs(llStart, FeGetTimestamp());
+			if (uRun == 0 || dMs < dBest)
+				dBest = dMs;
+		}
+		bSame = uError == 0 && CheckStripe(pPng, szPng, pRgba, w, h);
+		printf("%-8s %5ux%-5u %-9s %10zu bytes %8.1f ms %8.1f MB/s %s\n", pImage->pName, w, h,
+			mCodecs[i].pName, szPng, dBest, (double)szIn / 1048576.0 / (dBest / 1000.0),
+			bSame ? "ok" : "MISMATCH");
+		if (!bSame)
+			bRet = FALSE;
+		free(pPng);
+	}
+	free(pBgrx);
+	free(pRgba);
+	return bRet;
+}
+
+int main(int argc, char* argv[])
+{
+	UINT i;
+	BOOL bRet = TRUE;
+	UINT uRuns = argc > 1 ? (UINT)atoi(argv[1]) : 3;
+	UINT w = 1920, h = 1080;
+	FE_PNG_ENCODER* pEncoder = FeCreatePngEncoder();
+
+	if (uRuns < 1)
+		uRuns = 1;
+	if (argc > 3)
+	{
+		w = (UINT)atoi(argv[2]);
+		h = (UINT)atoi(argv[3]);
+	}
+	for (i = 0; i < gBenchImageCount; i++)
+		bRet &= RunStripeCase(pEncoder, &gBenchImages[i], w, h, uRuns);
+	FeFreePngEncoder(pEncoder);
+	FeFreePngArenas();
+	return bRet ? 0 : 1;
+}
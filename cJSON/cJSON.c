@@ -249,6 +249,8 @@ static cJSON *cJSON_New_Item(const internal_hooks * const hooks)
     return node;
 }
 
+static void drop_index(cJSON *object);
+
 /* Delete a cJSON structure. */
 CJSON_PUBLIC(void) cJSON_Delete(cJSON *item)
 {
@@ -268,6 +270,7 @@ CJSON_PUBLIC(void) cJSON_Delete(cJSON *item)
         {
             global_hooks.deallocate(item->string);
         }
+        drop_index(item);
         global_hooks.deallocate(item);
         item = next;
     }
@@ -284,6 +287,74 @@ static unsigned char get_decimal_point(void)
 #endif
 }
 
+/* A chunk of a tree parsed by cJSON_ParseArena. The root is the first item of the first chunk,
+ * later chunks are linked from the first one, the newest first. */
+typedef struct cJSON_Arena
+{
+    struct cJSON_Arena *next;
+    size_t size;
+    size_t used;
+} cJSON_Arena;
+
+/* arena allocations keep the alignment of a double */
+#define arena_align(size) (((size) + (sizeof(double) - 1)) & ~(sizeof(double) - 1))
+#define arena_header_size arena_align(sizeof(cJSON_Arena))
+
+static cJSON_Arena *arena_create(size_t size)
+{
+    cJSON_Arena *arena = NULL;
+
+    size += arena_header_size;
+    arena = (cJSON_Arena*)global_hooks.allocate(size);
+    if (arena == NULL)
+    {
+        return NULL;
+    }
+    arena->next = NULL;
+    arena->size = size;
+    arena->used = arena_header_size;
+
+    return arena;
+}
+
+static void *arena_allocate(cJSON_Arena * const arena, size_t size)
+{
+    cJSON_Arena *chunk = (arena->next != NULL) ? arena->next : arena;
+    unsigned char *pointer = NULL;
+
+    size = arena_align(size);
+    if ((chunk->size - chunk->used) < size)
+    {
+        /* double the chunk size so a tree takes a handful of chunks */
+        chunk = arena_create(((chunk->size * 2) > size) ? (chunk->size * 2) : size);
+        if (chunk == NULL)
+        {
+            return NULL;
+        }
+        chunk->next = arena->next;
+        arena->next = chunk;
+    }
+    pointer = (unsigned char*)chunk + chunk->used;
+    chunk->used += size;
+
+    return pointer;
+}
+
+static void arena_free(cJSON_Arena *arena)
+{
+    cJSON_Arena *next = NULL;
+    if (arena == NULL)
+    {
+        return;
+    }
+    for (next = arena->next; next != NULL; next = arena->next)
+    {
+        arena->next = next->next;
+        global_hooks.deallocate(next);
+    }
+    global_hooks.deallocate(arena);
+}
+
 typedef struct
 {
     const unsigned char *content;
@@ -291,8 +362,38 @@ typedef struct
     size_t offset;
     size_t depth; /* How deeply nested (in arrays/objects) is the input at the current offset. */
     internal_hooks hooks;
+    cJSON_Arena *arena; /* NULL unless parsing with cJSON_ParseArena */
+    cJSON_bool in_situ; /* strings are decoded into content, which the caller lets us write */
 } parse_buffer;
 
+/* allocate from the arena if there is one, the hooks otherwise */
+static void *parse_allocate(parse_buffer * const input_buffer, size_t size)
+{
+    if (input_buffer->arena != NULL)
+    {
+        return arena_allocate(input_buffer->arena, size);
+    }
+
+    return input_buffer->hooks.allocate(size);
+}
+
+static cJSON *parse_new_item(parse_buffer * const input_buffer)
+{
+    cJSON *node = NULL;
+    if (input_buffer->arena == NULL)
+    {
+        return cJSON_New_Item(&(input_buffer->hooks));
+    }
+
+    node = (cJSON*)arena_allocate(input_buffer->arena, sizeof(cJSON));
+    if (node)
+    {
+        memset(node, '\0', sizeof(cJSON));
+    }
+
+    return node;
+}
+
 /* check if the given size is left to read in a given parse buffer (starting with 1) */
 #define can_read(buffer, size) ((buffer != NULL) && (((buffer)->offset + size) <= (buffer)->length))
 /* check if the buffer can be accessed at the given index (starting with 0) */
@@ -769,6 +870,8 @@ fail:
     return 0;
 }
 
+static void* cast_away_const(const void* string);
+
 /* Parse the input text into an unescaped cinput, and populate item. */
 static cJSON_bool parse_string(cJSON * const item, parse_buffer * const input_buffer)
 {
@@ -809,14 +912,30 @@ static cJSON_bool parse_string(cJSON * const item, parse_buffer * const input_bu
 
         /* This is at most how much we need for the output */
         allocation_length = (size_t) (input_end - buffer_at_offset(input_buffer)) - skipped_bytes;
-        output = (unsigned char*)input_buffer->hooks.allocate(allocation_length + sizeof(""));
+        if (input_buffer->in_situ)
+        {
+            /* escapes only shrink, so the output never passes the input and ends by the closing quote at the latest */
+            output = (unsigned char*)cast_away_const(input_pointer);
+            if (skipped_bytes == 0)
+            {
+                output_pointer = output + allocation_length - 1;
+                input_pointer = input_end;
+            }
+        }
+        else
+        {
+            output = (unsigned char*)parse_allocate(input_buffer, allocation_length + sizeof(""));
+        }
         if (output == NULL)
         {
             goto fail; /* allocation failure */
         }
     }
 
-    output_pointer = output;
+    if (output_pointer == NULL)
+    {
+        output_pointer = output;
+    }
     /* loop through the string literal */
     while (input_pointer < input_end)
     {
@@ -885,7 +1004,7 @@ static cJSON_bool parse_string(cJSON * const item, parse_buffer * const input_bu
     return true;
 
 fail:
-    if (output != NULL)
+    if ((output != NULL) && (input_buffer->arena == NULL) && !input_buffer->in_situ)
     {
         input_buffer->hooks.deallocate(output);
     }
@@ -1032,6 +1151,9 @@ static cJSON_bool print_value(const cJSON * const item, printbuffer * const outp
 static cJSON_bool parse_array(cJSON * const item, parse_buffer * const input_buffer);
 static cJSON_bool print_array(const cJSON * const item, printbuffer * const output_buffer);
 static cJSON_bool parse_object(cJSON * const item, parse_buffer * const input_buffer);
+#if CJSON_INDEX_MIN_ITEMS > 0
+static struct cJSON_Index *build_index(const cJSON * const object, cJSON_Arena * const arena);
+#endif
 static cJSON_bool print_object(const cJSON * const item, printbuffer * const output_buffer);
 
 /* Utility to jump whitespace and cr/lf */
@@ -1092,9 +1214,9 @@ CJSON_PUBLIC(cJSON *) cJSON_ParseWithOpts(const char *value, const char **return
 }
 
 /* Parse an object - create a new root, and populate. */
-CJSON_PUBLIC(cJSON *) cJSON_ParseWithLengthOpts(const char *value, size_t buffer_length, const char **return_parse_end, cJSON_bool require_null_terminated)
+static cJSON *parse_root(const char *value, size_t buffer_length, const char **return_parse_end, cJSON_bool require_null_terminated, cJSON_bool use_arena, cJSON_bool in_situ)
 {
-    parse_buffer buffer = { 0, 0, 0, 0, { 0, 0, 0 } };
+    parse_buffer buffer = { 0, 0, 0, 0, { 0, 0, 0 }, NULL, false };
     cJSON *item = NULL;
 
     /* reset error position */
@@ -1110,8 +1232,19 @@ CJSON_PUBLIC(cJSON *) cJSON_ParseWithLengthOpts(const char *value, size_t buffer
     buffer.length = buffer_length;
     buffer.offset = 0;
     buffer.hooks = global_hooks;
+    buffer.in_situ = in_situ;
 
-    item = cJSON_New_Item(&global_hooks);
+    if (use_arena)
+    {
+        /* start at twice the text, a tree of short strings takes a chunk or two more */
+        buffer.arena = arena_create(arena_align(sizeof(cJSON)) + buffer_length * 2);
+        if (buffer.arena == NULL)
+        {
+            goto fail;
+        }
+    }
+
+    item = parse_new_item(&buffer);
     if (item == NULL) /* memory fail */
     {
         goto fail;
@@ -1140,7 +1273,11 @@ CJSON_PUBLIC(cJSON *) cJSON_ParseWithLengthOpts(const char *value, size_t buffer
     return item;
 
 fail:
-    if (item != NULL)
+    if (buffer.arena != NULL)
+    {
+        arena_free(buffer.arena);
+    }
+    else if (item != NULL)
     {
         cJSON_Delete(item);
     }
@@ -1171,6 +1308,40 @@ fail:
     return NULL;
 }
 
+CJSON_PUBLIC(cJSON *) cJSON_ParseWithLengthOpts(const char *value, size_t buffer_length, const char **return_parse_end, cJSON_bool require_null_terminated)
+{
+    return parse_root(value, buffer_length, return_parse_end, require_null_terminated, false, false);
+}
+
+CJSON_PUBLIC(cJSON *) cJSON_ParseArena(const char *value)
+{
+    if (NULL == value)
+    {
+        return NULL;
+    }
+
+    return parse_root(value, strlen(value) + sizeof(""), NULL, false, true, false);
+}
+
+CJSON_PUBLIC(cJSON *) cJSON_ParseArenaInSitu(char *value)
+{
+    if (NULL == value)
+    {
+        return NULL;
+    }
+
+    return parse_root(value, strlen(value) + sizeof(""), NULL, false, true, true);
+}
+
+CJSON_PUBLIC(void) cJSON_DeleteArena(cJSON *item)
+{
+    if (item != NULL)
+    {
+        /* the root is the first item of the first chunk */
+        arena_free((cJSON_Arena*)((unsigned char*)item - arena_header_size));
+    }
+}
+
 /* Default options for cJSON_Parse */
 CJSON_PUBLIC(cJSON *) cJSON_Parse(const char *value)
 {
@@ -1476,7 +1647,7 @@ static cJSON_bool parse_array(cJSON * const item, parse_buffer * const input_buf
     do
     {
         /* allocate next item */
-        cJSON *new_item = cJSON_New_Item(&(input_buffer->hooks));
+        cJSON *new_item = parse_new_item(input_buffer);
         if (new_item == NULL)
         {
             goto fail; /* allocation failure */
@@ -1527,7 +1698,8 @@ success:
     return true;
 
 fail:
-    if (head != NULL)
+    /* an arena goes away in one piece */
+    if ((head != NULL) && (input_buffer->arena == NULL))
     {
         cJSON_Delete(head);
     }
@@ -1634,7 +1806,7 @@ static cJSON_bool parse_object(cJSON * const item, parse_buffer * const input_bu
     do
     {
         /* allocate next item */
-        cJSON *new_item = cJSON_New_Item(&(input_buffer->hooks));
+        cJSON *new_item = parse_new_item(input_buffer);
         if (new_item == NULL)
         {
             goto fail; /* allocation failure */
@@ -1698,11 +1870,24 @@ success:
     item->type = cJSON_Object;
     item->child = head;
 
+#if CJSON_INDEX_MIN_ITEMS > 0
+    /* the tree is freed in one piece, so index it now rather than on the heap by a lookup */
+    if (input_buffer->arena != NULL)
+    {
+        item->index = build_index(item, input_buffer->arena);
+        if (item->index == NULL)
+        {
+            return false;
+        }
+    }
+#endif
+
     input_buffer->offset++;
     return true;
 
 fail:
-    if (head != NULL)
+    /* an arena goes away in one piece */
+    if ((head != NULL) && (input_buffer->arena == NULL))
     {
         cJSON_Delete(head);
     }
@@ -1879,6 +2064,105 @@ CJSON_PUBLIC(cJSON *) cJSON_GetArrayItem(const cJSON *array, int index)
     return get_array_item(array, (size_t)index);
 }
 
+typedef struct cJSON_Index_Slot
+{
+    unsigned int hash;
+    cJSON *item;
+} cJSON_Index_Slot;
+
+/* open addressing table of the first member for each case folded key */
+struct cJSON_Index
+{
+    size_t mask;
+    cJSON_Index_Slot slots[1];
+};
+
+/* marks objects too small to index until they are modified */
+static struct cJSON_Index small_object_index;
+
+static void drop_index(cJSON *object)
+{
+    if ((object->index != NULL) && (object->index != &small_object_index))
+    {
+        global_hooks.deallocate(object->index);
+    }
+    object->index = NULL;
+}
+
+#if CJSON_INDEX_MIN_ITEMS > 0
+/* FNV-1a of the key folded the same way as case_insensitive_strcmp */
+static unsigned int case_insensitive_hash(const unsigned char *string)
+{
+    unsigned int hash = 2166136261U;
+    for (; *string != '\0'; string++)
+    {
+        hash = (hash ^ (unsigned int)tolower(*string)) * 16777619U;
+    }
+
+    return hash;
+}
+
+/* allocates from the arena if there is one */
+static struct cJSON_Index *build_index(const cJSON * const object, cJSON_Arena * const arena)
+{
+    struct cJSON_Index *index = NULL;
+    cJSON *current_element = NULL;
+    size_t count = 0;
+    size_t size = 2;
+    size_t size_bytes = 0;
+
+    for (current_element = object->child; current_element != NULL; current_element = current_element->next)
+    {
+        count++;
+    }
+    if (count < CJSON_INDEX_MIN_ITEMS)
+    {
+        return &small_object_index;
+    }
+
+    /* keep the load factor at or below 1/2 */
+    while (size < count * 2)
+    {
+        size *= 2;
+    }
+    size_bytes = sizeof(struct cJSON_Index) + (size - 1) * sizeof(cJSON_Index_Slot);
+    index = (struct cJSON_Index*)((arena != NULL) ? arena_allocate(arena, size_bytes) : global_hooks.allocate(size_bytes));
+    if (index == NULL)
+    {
+        return NULL;
+    }
+    memset(index->slots, '\0', size * sizeof(cJSON_Index_Slot));
+    index->mask = size - 1;
+
+    for (current_element = object->child; current_element != NULL; current_element = current_element->next)
+    {
+        unsigned int hash = 0;
+        size_t slot = 0;
+        if (current_element->string == NULL)
+        {
+            continue;
+        }
+        hash = case_insensitive_hash((const unsigned char*)current_element->string);
+        for (slot = hash & index->mask; index->slots[slot].item != NULL; slot = (slot + 1) & index->mask)
+        {
+            if ((index->slots[slot].hash == hash) && (case_insensitive_strcmp((const unsigned char*)current_element->string, (const unsigned char*)index->slots[slot].item->string) == 0))
+            {
+                break;
+            }
+        }
+        /* a linear search finds the first of duplicate keys */
+        if (index->slots[slot].item == NULL)
+        {
+            index->slots[slot].hash = hash;
+            index->slots[slot].item = current_element;
+        }
+    }
+
+    return index;
+}
+
+#endif
+
 static cJSON *get_object_item(const cJSON * const object, const char * const name, const cJSON_bool case_sensitive)
 {
     cJSON *current_element = NULL;
@@ -1888,6 +2172,31 @@ static cJSON *get_object_item(const cJSON * const object, const char * const nam
         return NULL;
     }
 
+#if CJSON_INDEX_MIN_ITEMS > 0
+    /* references share their members with an object that may be modified behind their back */
+    if (!case_sensitive && cJSON_IsObject(object) && !(object->type & cJSON_IsReference))
+    {
+        if (object->index == NULL)
+        {
+            ((cJSON*)cast_away_const(object))->index = build_index(object, NULL);
+        }
+        if ((object->index != NULL) && (object->index != &small_object_index))
+        {
+            const struct cJSON_Index *index = object->index;
+            unsigned int hash = case_insensitive_hash((const unsigned char*)name);
+            size_t slot = 0;
+            for (slot = hash & index->mask; index->slots[slot].item != NULL; slot = (slot + 1) & index->mask)
+            {
+                if ((index->slots[slot].hash == hash) && (case_insensitive_strcmp((const unsigned char*)name, (const unsigned char*)index->slots[slot].item->string) == 0))
+                {
+                    return index->slots[slot].item;
+                }
+            }
+            return NULL;
+        }
+    }
+#endif
+
     current_element = object->child;
     if (case_sensitive)
     {
@@ -1950,6 +2259,7 @@ static cJSON *create_reference(const cJSON *item, const internal_hooks * const h
 
     memcpy(reference, item, sizeof(cJSON));
     reference->string = NULL;
+    reference->index = NULL;
     reference->type |= cJSON_IsReference;
     reference->next = reference->prev = NULL;
     return reference;
@@ -1964,6 +2274,7 @@ static cJSON_bool add_item_to_array(cJSON *array, cJSON *item)
         return false;
     }
 
+    drop_index(array);
     child = array->child;
     /*
      * To find the last item in array quickly, we use prev in array
@@ -2193,6 +2504,7 @@ CJSON_PUBLIC(cJSON *) cJSON_DetachItemViaPointer(cJSON *parent, cJSON * const it
         return NULL;
     }
 
+    drop_index(parent);
     if (item != parent->child)
     {
         /* not the first element */
@@ -2277,6 +2589,7 @@ CJSON_PUBLIC(cJSON_bool) cJSON_InsertItemInArray(cJSON *array, int which, cJSON
         return add_item_to_array(array, newitem);
     }
 
+    drop_index(array);
     newitem->next = after_inserted;
     newitem->prev = after_inserted->prev;
     after_inserted->prev = newitem;
@@ -2303,6 +2616,7 @@ CJSON_PUBLIC(cJSON_bool) cJSON_ReplaceItemViaPointer(cJSON * const parent, cJSON
         return true;
     }
 
+    drop_index(parent);
     replacement->next = item->next;
     replacement->prev = item->prev;
 
@@ -20,6 +20,17 @@
   THE SOFTWARE.
 */
 
+/*
+  This is a modified copy of cJSON for fe, an intentional fork which is not a drop-in
+  replacement for upstream:
+  - struct cJSON has an extra member, index, so its size and layout differ from upstream.
+    Don't mix this header with code built against another cJSON, and don't allocate, copy
+    or compare items by value outside this library.
+  - cJSON_GetObjectItem and cJSON_HasObjectItem look members of wide objects up through
+    that index, see CJSON_INDEX_MIN_ITEMS.
+  - cJSON_ParseArena, cJSON_DeleteArena and cJSON_ParseArenaInSitu are additions.
+*/
+
 #ifndef cJSON__h
 #define cJSON__h
 
@@ -120,6 +131,11 @@ typedef struct cJSON
 
     /* The item's name string, if this item is the child of, or is in the list of subitems of an object. */
     char *string;
+
+    /* Not in upstream cJSON, see the note at the top of this file.
+     * Internal: hash index of an object's members, built by the first case insensitive lookup.
+     * The add/insert/detach/replace functions drop it, so don't relink child/next/prev or rename members by hand. */
+    struct cJSON_Index *index;
 } cJSON;
 
 typedef struct cJSON_Hooks
@@ -137,6 +153,12 @@ typedef int cJSON_bool;
 #define CJSON_NESTING_LIMIT 1000
 #endif
 
+/* Objects with at least this many members get a hash index for case insensitive lookups.
+ * The index is built lazily by a lookup, so first lookups on one object must not race. 0 disables it. */
+#ifndef CJSON_INDEX_MIN_ITEMS
+#define CJSON_INDEX_MIN_ITEMS 16
+#endif
+
 /* returns the version of cJSON as a string */
 CJSON_PUBLIC(const char*) cJSON_Version(void);
 
@@ -151,6 +173,13 @@ CJSON_PUBLIC(cJSON *) cJSON_ParseWithLength(const char *value, size_t buffer_len
 /* If you supply a ptr in return_parse_end and parsing fails, then return_parse_end will contain a pointer to the error so will match cJSON_GetErrorPtr(). */
 CJSON_PUBLIC(cJSON *) cJSON_ParseWithOpts(const char *value, const char **return_parse_end, cJSON_bool require_null_terminated);
 CJSON_PUBLIC(cJSON *) cJSON_ParseWithLengthOpts(const char *value, size_t buffer_length, const char **return_parse_end, cJSON_bool require_null_terminated);
+/* Like cJSON_Parse, but places every item and string of the tree in a few large blocks owned by the root.
+ * The tree is read only: don't add, detach, replace or cJSON_Delete its items. Free it with cJSON_DeleteArena. */
+CJSON_PUBLIC(cJSON *) cJSON_ParseArena(const char *value);
+CJSON_PUBLIC(void) cJSON_DeleteArena(cJSON *item);
+/* Like cJSON_ParseArena, but strings are decoded in place and point into value, which must outlive the tree.
+ * value is modified even if the parse fails. */
+CJSON_PUBLIC(cJSON *) cJSON_ParseArenaInSitu(char *value);
 
 /* Render a cJSON entity to text for transfer/storage. */
 CJSON_PUBLIC(char *) cJSON_Print(const cJSON *item);
@@ -0,0 +1,133 @@
+﻿// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "capture.h"
+
+UINT8* FeGrabCapture(FE_CAPTURE* pCapture, int x, int y, int w, int h, size_t* pszStride)
+{
+	UINT8* pRow;
+	if (InterlockedCompareExchange(&pCapture->lBusy, 1, 0) != 0)
+		return NULL;
+	pRow = pCapture->pfnGrab(pCapture, x, y, w, h, pszStride);
+	if (!pRow)
+		InterlockedExchange(&pCapture->lBusy, 0);
+	return pRow;
+}
+
+VOID FeReleaseCapture(FE_CAPTURE* pCapture)
+{
+	InterlockedExchange(&pCapture->lBusy, 0);
+}
+
+VOID FeFreeCapture(FE_CAPTURE* pCapture)
+{
+	if (pCapture)
+		pCapture->pfnFree(pCapture);
+}
+
+/* size of the block redrawn on every grab, like a clock or a cursor */
+#define MEMORY_CAPTURE_BLOCK 48
+
+typedef struct _MEMORY_CAPTURE
+{
+	FE_CAPTURE Capture;
+	UINT w;
+	UINT h;
+	UINT uFrame;
+	/* the fake screen and the frame buffer handed out, w * 4 bytes per row */
+	UINT8* pScreen;
+	UINT8* pFrame;
+} MEMORY_CAPTURE;
+
+/* gradients, flat windows and rows of text-like glyphs */
+static VOID DrawMemoryScreen(MEMORY_CAPTURE* pMem)
+{
+	UINT x, y;
+	for (y = 0; y < pMem->h; y++)
+	{
+		UINT8* p = pMem->pScreen + (size_t)y * pMem->w * 4;
+		for (x = 0; x < pMem->w; x++, p += 4)
+		{
+			if ((x / 400 + y / 300) % 3 == 0)
+			{
+				p[0] = (UINT8)(x * 200 / pMem->w);
+				p[1] = (UINT8)(y * 180 / pMem->h);
+				p[2] = (UINT8)((x + y) * 100 / (pMem->w + pMem->h));
+			}
+			else
+			{
+				BOOL bGlyph = (y % 24) < 14 && (x % 9) < 6 && (x * 7 + y * 3 + (x / 9) * 13) % 5 < 2;
+				p[0] = p[1] = p[2] = bGlyph ? 30 : 235;
+			}
+			p[3] = 0;
+		}
+	}
+}
+
+static VOID TickMemoryScreen(MEMORY_CAPTURE* pMem)
+{
+	UINT x, y;
+	UINT bw = min(pMem->w, MEMORY_CAPTURE_BLOCK);
+	UINT bh = min(pMem->h, MEMORY_CAPTURE_BLOCK);
+	UINT x0 = (pMem->uFrame * 7 * MEMORY_CAPTURE_BLOCK) % (pMem->w - bw + 1);
+	UINT y0 = (pMem->uFrame * 3 * MEMORY_CAPTURE_BLOCK) % (pMem->h - bh + 1);
+	pMem->uFrame++;
+	for (y = 0; y < bh; y++)
+	{
+		UINT8* p = pMem->pScreen + ((size_t)(y0 + y) * pMem->w + x0) * 4;
+		for (x = 0; x < bw; x++, p += 4)
+		{
+			p[0] = (UINT8)(x * 5 + pMem->uFrame);
+			p[1] = (UINT8)(y * 5 + pMem->uFrame * 3);
+			p[2] = (UINT8)(pMem->uFrame * 11);
+		}
+	}
+}
+
+static UINT8* GrabMemoryCapture(FE_CAPTURE* pCapture, int x, int y, int w, int h, size_t* pszStride)
+{
+	int i;
+	size_t szStride;
+	size_t szOffset;
+	MEMORY_CAPTURE* pMem = (MEMORY_CAPTURE*)pCapture;
+	if (x < 0 || y < 0 || w <= 0 || h <= 0 || (UINT)x + w > pMem->w || (UINT)y + h > pMem->h)
+		return NULL;
+	TickMemoryScreen(pMem);
+	szStride = (size_t)pMem->w * 4;
+	szOffset = (size_t)y * szStride + (size_t)x * 4;
+	/* stands in for BitBlt */
+	for (i = 0; i < h; i++)
+		memcpy(pMem->pFrame + szOffset + i * szStride, pMem->pScreen + szOffset + i * szStride, (size_t)w * 4);
+	*pszStride = szStride;
+	return pMem->pFrame + szOffset;
+}
+
+static VOID FreeMemoryCapture(FE_CAPTURE* pCapture)
+{
+	MEMORY_CAPTURE* pMem = (MEMORY_CAPTURE*)pCapture;
+	free(pMem->pScreen);
+	free(pMem->pFrame);
+	free(pMem);
+}
+
+FE_CAPTURE* FeCreateMemoryCapture(UINT w, UINT h)
+{
+	MEMORY_CAPTURE* pMem;
+	if (w == 0 || h == 0)
+		return NULL;
+	pMem = calloc(1, sizeof(MEMORY_CAPTURE));
+	if (!pMem)
+		return NULL;
+	pMem->Capture.pfnGrab = GrabMemoryCapture;
+	pMem->Capture.pfnFree = FreeMemoryCapture;
+	pMem->w = w;
+	pMem->h = h;
+	pMem->pScreen = malloc((size_t)w * h * 4);
+	pMem->pFrame = malloc((size_t)w * h * 4);
+	if (!pMem->pScreen || !pMem->pFrame)
+	{
+		FreeMemoryCapture(&pMem->Capture);
+		return NULL;
+	}
+	DrawMemoryScreen(pMem);
+	return &pMem->Capture;
+}
@@ -0,0 +1,53 @@
+﻿// SPDX-License-Identifier: GPL-3.0-or-later
+#pragma once
+
+#include "fe.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+typedef struct _FE_CAPTURE FE_CAPTURE;
+
+/* copy the area x, y, w, h of the screen into the frame buffer, return its first top-down
+ * BGRX row and the distance between rows, NULL when the area is not on the screen */
+typedef UINT8* (*FE_CAPTURE_GRAB)(FE_CAPTURE* pCapture, int x, int y, int w, int h, size_t* pszStride);
+
+typedef VOID (*FE_CAPTURE_FREE)(FE_CAPTURE* pCapture);
+
+/* a capture backend, embedded as the first member of its own struct */
+struct _FE_CAPTURE
+{
+	FE_CAPTURE_GRAB pfnGrab;
+	FE_CAPTURE_FREE pfnFree;
+	/* set from FeGrabCapture until FeReleaseCapture */
+	volatile LONG lBusy;
+};
+
+/* like pfnGrab, but NULL while the previous frame is still held */
+UINT8* FeGrabCapture(FE_CAPTURE* pCapture, int x, int y, int w, int h, size_t* pszStride);
+
+/* the frame is no longer read, can be called from any thread */
+VOID FeReleaseCapture(FE_CAPTURE* pCapture);
+
+VOID FeFreeCapture(FE_CAPTURE* pCapture);
+
+/* a w x h screen in memory which changes a little on every grab, for benchmarks */
+FE_CAPTURE* FeCreateMemoryCapture(UINT w, UINT h);
+
+/* the virtual screen, blitted into one cached DIB section */
+FE_CAPTURE* FeCreateGdiCapture(VOID);
+
+/* bounding rectangle of all monitors */
+VOID FeGetVirtualScreen(RECT* pRect);
+
+/* top-down 32-bit DIB section */
+HBITMAP FeCreateScreenBitmap(int w, int h, UINT8** ppPixels);
+
+/* copy the screen area at x, y to dx, dy of the bitmap */
+BOOL FeBlitScreen(HBITMAP hBitmap, int dx, int dy, int x, int y, int w, int h);
+
+#ifdef __cplusplus
+}
+#endif
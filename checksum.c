@@ -0,0 +1,325 @@
+﻿// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "fe.h"
+#include "utils.h"
+#include "checksum.h"
+
+/*
+ * CRC32 and adler32 for PNG chunks and zlib streams, lodepng is built with
+ * LODEPNG_NO_COMPILE_CRC and LODEPNG_NO_COMPILE_ADLER32 to use them.
+ * The CRC uses slice-by-8 tables, or carry-less multiplication folding when
+ * PCLMULQDQ is available. The adler32 sums 32 bytes per step with SSSE3 or
+ * AVX2.
+ */
+
+#if defined(_M_IX86) || defined(_M_X64)
+#define CHECKSUM_X86
+#include <immintrin.h>
+#include <wmmintrin.h>
+#endif
+
+#define ADLER_BASE 65521U
+/* the most bytes summed before s2 may overflow 32 bits */
+#define ADLER_NMAX 5552U
+
+typedef UINT (*CHECKSUM_PROC)(UINT uSum, const UINT8* pData, size_t szData);
+
+static UINT mCrcTable[8][256];
+static CHECKSUM_PROC mCrc32;
+static CHECKSUM_PROC mAdler32;
+static INIT_ONCE mInitOnce = INIT_ONCE_STATIC_INIT;
+
+/* uCrc is the inverted register here, the public functions invert it */
+static UINT Crc32Slice8(UINT uCrc, const UINT8* p, size_t sz)
+{
+	while (sz >= 8)
+	{
+		UINT a = uCrc ^ ((UINT)p[0] | ((UINT)p[1] << 8) | ((UINT)p[2] << 16) | ((UINT)p[3] << 24));
+		UINT b = (UINT)p[4] | ((UINT)p[5] << 8) | ((UINT)p[6] << 16) | ((UINT)p[7] << 24);
+		uCrc = mCrcTable[7][a & 0xFF] ^ mCrcTable[6][(a >> 8) & 0xFF]
+			^ mCrcTable[5][(a >> 16) & 0xFF] ^ mCrcTable[4][a >> 24]
+			^ mCrcTable[3][b & 0xFF] ^ mCrcTable[2][(b >> 8) & 0xFF]
+			^ mCrcTable[1][(b >> 16) & 0xFF] ^ mCrcTable[0][b >> 24];
+		p += 8;
+		sz -= 8;
+	}
+	while (sz--)
+		uCrc = mCrcTable[0][(uCrc ^ *p++) & 0xFF] ^ (uCrc >> 8);
+	return uCrc;
+}
+
+static UINT Adler32Scalar(UINT uAdler, const UINT8* p, size_t sz)
+{
+	UINT s1 = uAdler & 0xFFFF;
+	UINT s2 = uAdler >> 16;
+	while (sz > 0)
+	{
+		size_t i, n = sz > ADLER_NMAX ? ADLER_NMAX : sz;
+		for (i = 0; i < n; i++)
+		{
+			s1 += p[i];
+			s2 += s1;
+		}
+		p += n;
+		sz -= n;
+		s1 %= ADLER_BASE;
+		s2 %= ADLER_BASE;
+	}
+	return (s2 << 16) | s1;
+}
+
+#ifdef CHECKSUM_X86
+/* fold 64 bytes at a time into four 128-bit lanes, then reduce, see Intel's
+ * "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ" */
+static FE_TARGET("pclmul,sse4.1") UINT Crc32Clmul(UINT uCrc, const UINT8* p, size_t sz)
+{
+	static const UINT64 k1k2[2] = { 0x0154442bd4ULL, 0x01c6e41596ULL };
+	static const UINT64 k3k4[2] = { 0x01751997d0ULL, 0x00ccaa009eULL };
+	static const UINT64 k5k0[2] = { 0x0163cd6124ULL, 0x0000000000ULL };
+	static const UINT64 poly[2] = { 0x01db710641ULL, 0x01f7011641ULL };
+	__m128i x0, x1, x2, x3, x4, x5, x6, x7, x8;
+	size_t szFold = sz & ~(size_t)15;
+
+	if (sz < 64)
+		return Crc32Slice8(uCrc, p, sz);
+
+	x1 = _mm_xor_si128(_mm_loadu_si128((const __m128i*)p), _mm_cvtsi32_si128((int)uCrc));
+	x2 = _mm_loadu_si128((const __m128i*)(p + 16));
+	x3 = _mm_loadu_si128((const __m128i*)(p + 32));
+	x4 = _mm_loadu_si128((const __m128i*)(p + 48));
+	x0 = _mm_loadu_si128((const __m128i*)k1k2);
+	p += 64;
+	sz -= 64;
+	szFold -= 64;
+	while (szFold >= 64)
+	{
+		x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+		x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+		x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+		x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+		x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+		x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128((const __m128i*)p));
+		x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128((const __m128i*)(p + 16)));
+		x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128((const __m128i*)(p + 32)));
+		x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128((const __m128i*)(p + 48)));
+		p += 64;
+		sz -= 64;
+		szFold -= 64;
+	}
+
+	/* four lanes into one */
+	x0 = _mm_loadu_si128((const __m128i*)k3k4);
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+	while (szFold >= 16)
+	{
+		x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, _mm_loadu_si128((const __m128i*)p)), x5);
+		p += 16;
+		sz -= 16;
+		szFold -= 16;
+	}
+
+	/* 128 bits to 64 */
+	x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+	x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+	x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+	x0 = _mm_loadl_epi64((const __m128i*)k5k0);
+	x2 = _mm_srli_si128(x1, 4);
+	x1 = _mm_and_si128(x1, x3);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	/* Barrett reduction to 32 bits */
+	x0 = _mm_loadu_si128((const __m128i*)poly);
+	x2 = _mm_and_si128(x1, x3);
+	x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+	x2 = _mm_and_si128(x2, x3);
+	x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+	uCrc = (UINT)_mm_extract_epi32(x1, 1);
+
+	return Crc32Slice8(uCrc, p, sz);
+}
+
+static FE_TARGET("ssse3") UINT Adler32Ssse3(UINT uAdler, const UINT8* p, size_t sz)
+{
+	UINT s1 = uAdler & 0xFFFF;
+	UINT s2 = uAdler >> 16;
+	size_t szBlocks = sz / 32;
+	const __m128i tap1 = _mm_setr_epi8(32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17);
+	const __m128i tap2 = _mm_setr_epi8(16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1);
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i ones = _mm_set1_epi16(1);
+
+	sz -= szBlocks * 32;
+	while (szBlocks)
+	{
+		UINT n = ADLER_NMAX / 32;
+		__m128i vps, vs1, vs2;
+		if (n > szBlocks)
+			n = (UINT)szBlocks;
+		szBlocks -= n;
+		/* s1 is added to s2 once per byte of the n blocks */
+		vps = _mm_cvtsi32_si128((int)(s1 * n));
+		vs2 = _mm_cvtsi32_si128((int)s2);
+		vs1 = _mm_setzero_si128();
+		do
+		{
+			__m128i b1 = _mm_loadu_si128((const __m128i*)p);
+			__m128i b2 = _mm_loadu_si128((const __m128i*)(p + 16));
+			vps = _mm_add_epi32(vps, vs1);
+			vs1 = _mm_add_epi32(vs1, _mm_add_epi32(_mm_sad_epu8(b1, zero), _mm_sad_epu8(b2, zero)));
+			vs2 = _mm_add_epi32(vs2, _mm_madd_epi16(_mm_maddubs_epi16(b1, tap1), ones));
+			vs2 = _mm_add_epi32(vs2, _mm_madd_epi16(_mm_maddubs_epi16(b2, tap2), ones));
+			p += 32;
+		} while (--n);
+		vs2 = _mm_add_epi32(vs2, _mm_slli_epi32(vps, 5));
+		vs1 = _mm_add_epi32(vs1, _mm_shuffle_epi32(vs1, _MM_SHUFFLE(2, 3, 0, 1)));
+		vs1 = _mm_add_epi32(vs1, _mm_shuffle_epi32(vs1, _MM_SHUFFLE(1, 0, 3, 2)));
+		s1 += (UINT)_mm_cvtsi128_si32(vs1);
+		vs2 = _mm_add_epi32(vs2, _mm_shuffle_epi32(vs2, _MM_SHUFFLE(2, 3, 0, 1)));
+		vs2 = _mm_add_epi32(vs2, _mm_shuffle_epi32(vs2, _MM_SHUFFLE(1, 0, 3, 2)));
+		s2 = (UINT)_mm_cvtsi128_si32(vs2);
+		s1 %= ADLER_BASE;
+		s2 %= ADLER_BASE;
+	}
+	return Adler32Scalar((s2 << 16) | s1, p, sz);
+}
+
+static FE_TARGET("avx2") UINT Adler32Avx2(UINT uAdler, const UINT8* p, size_t sz)
+{
+	UINT s1 = uAdler & 0xFFFF;
+	UINT s2 = uAdler >> 16;
+	size_t szBlocks = sz / 32;
+	const __m256i tap = _mm256_setr_epi8(32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17,
+		16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1);
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i ones = _mm256_set1_epi16(1);
+
+	sz -= szBlocks * 32;
+	while (szBlocks)
+	{
+		UINT n = ADLER_NMAX / 32;
+		__m256i vps, vs1, vs2;
+		__m128i v1, v2;
+		if (n > szBlocks)
+			n = (UINT)szBlocks;
+		szBlocks -= n;
+		vps = _mm256_setr_epi32((int)(s1 * n), 0, 0, 0, 0, 0, 0, 0);
+		vs2 = _mm256_setr_epi32((int)s2, 0, 0, 0, 0, 0, 0, 0);
+		vs1 = _mm256_setzero_si256();
+		do
+		{
+			__m256i b = _mm256_loadu_si256((const __m256i*)p);
+			vps = _mm256_add_epi32(vps, vs1);
+			vs1 = _mm256_add_epi32(vs1, _mm256_sad_epu8(b, zero));
+			vs2 = _mm256_add_epi32(vs2, _mm256_madd_epi16(_mm256_maddubs_epi16(b, tap), ones));
+			p += 32;
+		} while (--n);
+		vs2 = _mm256_add_epi32(vs2, _mm256_slli_epi32(vps, 5));
+		v1 = _mm_add_epi32(_mm256_castsi256_si128(vs1), _mm256_extracti128_si256(vs1, 1));
+		v2 = _mm_add_epi32(_mm256_castsi256_si128(vs2), _mm256_extracti128_si256(vs2, 1));
+		v1 = _mm_add_epi32(v1, _mm_shuffle_epi32(v1, _MM_SHUFFLE(2, 3, 0, 1)));
+		v1 = _mm_add_epi32(v1, _mm_shuffle_epi32(v1, _MM_SHUFFLE(1, 0, 3, 2)));
+		v2 = _mm_add_epi32(v2, _mm_shuffle_epi32(v2, _MM_SHUFFLE(2, 3, 0, 1)));
+		v2 = _mm_add_epi32(v2, _mm_shuffle_epi32(v2, _MM_SHUFFLE(1, 0, 3, 2)));
+		s1 += (UINT)_mm_cvtsi128_si32(v1);
+		s2 = (UINT)_mm_cvtsi128_si32(v2);
+		s1 %= ADLER_BASE;
+		s2 %= ADLER_BASE;
+	}
+	_mm256_zeroupper();
+	return Adler32Scalar((s2 << 16) | s1, p, sz);
+}
+#endif
+
+static BOOL CALLBACK InitChecksum(PINIT_ONCE pInitOnce, PVOID pParameter, PVOID* ppContext)
+{
+	UINT i, j;
+	UINT uFeatures = FeGetCpuFeatures();
+	UNREFERENCED_PARAMETER(pInitOnce);
+	UNREFERENCED_PARAMETER(pParameter);
+	UNREFERENCED_PARAMETER(ppContext);
+
+	/* polynomial 0xEDB88320, table k advances the CRC by k more zero bytes */
+	for (i = 0; i < 256; i++)
+	{
+		UINT r = i;
+		for (j = 0; j < 8; j++)
+			r = (r & 1) ? (r >> 1) ^ 0xEDB88320U : r >> 1;
+		mCrcTable[0][i] = r;
+	}
+	for (i = 0; i < 256; i++)
+	{
+		for (j = 1; j < 8; j++)
+			mCrcTable[j][i] = (mCrcTable[j - 1][i] >> 8) ^ mCrcTable[0][mCrcTable[j - 1][i] & 0xFF];
+	}
+
+	mCrc32 = Crc32Slice8;
+	mAdler32 = Adler32Scalar;
+#ifdef CHECKSUM_X86
+	if ((uFeatures & FE_CPU_PCLMUL) && (uFeatures & FE_CPU_SSE41))
+		mCrc32 = Crc32Clmul;
+	if (uFeatures & FE_CPU_AVX2)
+		mAdler32 = Adler32Avx2;
+	else if (uFeatures & FE_CPU_SSSE3)
+		mAdler32 = Adler32Ssse3;
+#else
+	UNREFERENCED_PARAMETER(uFeatures);
+#endif
+	return TRUE;
+}
+
+UINT FeCrc32(UINT uCrc, const UINT8* pData, size_t szData)
+{
+	InitOnceExecuteOnce(&mInitOnce, InitChecksum, NULL, NULL);
+	return ~mCrc32(~uCrc, pData, szData);
+}
+
+UINT FeAdler32(UINT uAdler, const UINT8* pData, size_t szData)
+{
+	InitOnceExecuteOnce(&mInitOnce, InitChecksum, NULL, NULL);
+	return mAdler32(uAdler, pData, szData);
+}
+
+UINT FeAdler32Combine(UINT uAdler1, UINT uAdler2, size_t szData2)
+{
+	UINT uRem = (UINT)(szData2 % ADLER_BASE);
+	UINT s1 = uAdler1 & 0xFFFF;
+	UINT s2 = (UINT)(((UINT64)uRem * s1) % ADLER_BASE);
+	s1 += (uAdler2 & 0xFFFF) + ADLER_BASE - 1;
+	s2 += (uAdler1 >> 16) + (uAdler2 >> 16) + ADLER_BASE - uRem;
+	if (s1 >= ADLER_BASE)
+		s1 -= ADLER_BASE;
+	if (s1 >= ADLER_BASE)
+		s1 -= ADLER_BASE;
+	if (s2 >= (ADLER_BASE << 1))
+		s2 -= (ADLER_BASE << 1);
+	if (s2 >= ADLER_BASE)
+		s2 -= ADLER_BASE;
+	return (s2 << 16) | s1;
+}
+
+/* hooks for lodepng */
+
+unsigned lodepng_crc32(const unsigned char* data, size_t length)
+{
+	return FeCrc32(0, data, length);
+}
+
+unsigned lodepng_update_adler32(unsigned adler, const unsigned char* data, size_t length)
+{
+	return FeAdler32(adler, data, length);
+}
@@ -0,0 +1,22 @@
+﻿// SPDX-License-Identifier: GPL-3.0-or-later
+#pragma once
+
+#include "fe.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* running CRC32 as in zlib, start with 0 */
+UINT FeCrc32(UINT uCrc, const UINT8* pData, size_t szData);
+
+/* running adler32, start with 1 */
+UINT FeAdler32(UINT uAdler, const UINT8* pData, size_t szData);
+
+/* adler32 of A followed by B, from those of A and B and the length of B */
+UINT FeAdler32Combine(UINT uAdler1, UINT uAdler2, size_t szData2);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,238 @@
+﻿// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "clipboard.h"
+#include "jobqueue.h"
+
+/*
+ * Nothing is encoded when the clip is offered. CF_DIBV5 is copied from the
+ * captured rows, and the PNG is encoded on the job queue only once a
+ * WM_RENDERFORMAT or WM_RENDERALLFORMATS asks for it, which then waits for
+ * the job. A full queue leaves the encode to the caller. The job holds a
+ * reference, so the clip outlives FeFreeClip until the job's pfnDone.
+ */
+
+typedef enum _CLIP_PNG_STATE
+{
+	/* nobody asked for the PNG yet */
+	CLIP_PNG_IDLE = 0,
+	CLIP_PNG_QUEUED,
+	/* on the job queue or in FeRenderClip, the others wait for it */
+	CLIP_PNG_ENCODING,
+	/* pPng is NULL if the encode failed or the PNG was rendered */
+	CLIP_PNG_DONE,
+} CLIP_PNG_STATE;
+
+struct _FE_CLIP
+{
+	FE_JOB Job;
+	const FE_CLIP_OPS* pOps;
+	PVOID pContext;
+	FE_PNG_ENCODER* pEncoder;
+	const UINT8* pBgrx;
+	UINT w;
+	UINT h;
+	size_t szStride;
+	FE_PNG_PROFILE uProfile;
+	UINT uRendered;
+	SRWLOCK Lock;
+	CONDITION_VARIABLE Encoded;
+	CLIP_PNG_STATE uPng;
+	UINT8* pPng;
+	size_t szPng;
+	/* the owner and the job until its pfnDone */
+	volatile LONG lRefs;
+};
+
+static VOID ReleaseClip(FE_CLIP* pClip)
+{
+	if (InterlockedDecrement(&pClip->lRefs) != 0)
+		return;
+	free(pClip->pPng);
+	free(pClip);
+}
+
+/* encode the PNG unless somebody else has or is doing it */
+static VOID EncodeClipPng(FE_CLIP* pClip)
+{
+	UINT8* png = NULL;
+	size_t szPng = 0;
+	AcquireSRWLockExclusive(&pClip->Lock);
+	if (pClip->uPng != CLIP_PNG_QUEUED)
+	{
+		ReleaseSRWLockExclusive(&pClip->Lock);
+		return;
+	}
+	pClip->uPng = CLIP_PNG_ENCODING;
+	ReleaseSRWLockExclusive(&pClip->Lock);
+
+	if (FeEncodePngBgrx(pClip->pEncoder, &png, &szPng, pClip->pBgrx,
+		pClip->w, pClip->h, pClip->szStride, pClip->uProfile) != 0)
+		png = NULL;
+
+	AcquireSRWLockExclusive(&pClip->Lock);
+	pClip->pPng = png;
+	pClip->szPng = szPng;
+	pClip->uPng = CLIP_PNG_DONE;
+	WakeAllConditionVariable(&pClip->Encoded);
+	ReleaseSRWLockExclusive(&pClip->Lock);
+}
+
+/* a queued or running encode reads pBgrx */
+static VOID WaitClipPng(FE_CLIP* pClip)
+{
+	AcquireSRWLockExclusive(&pClip->Lock);
+	while (pClip->uPng == CLIP_PNG_QUEUED || pClip->uPng == CLIP_PNG_ENCODING)
+		SleepConditionVariableSRW(&pClip->Encoded, &pClip->Lock, INFINITE, 0);
+	ReleaseSRWLockExclusive(&pClip->Lock);
+}
+
+static VOID RunClipJob(FE_JOB* pJob)
+{
+	EncodeClipPng((FE_CLIP*)pJob);
+}
+
+static VOID DoneClipJob(FE_JOB* pJob)
+{
+	ReleaseClip((FE_CLIP*)pJob);
+}
+
+/* put the PNG on the job queue the first time it is asked for */
+static VOID StartClipPng(FE_CLIP* pClip)
+{
+	AcquireSRWLockExclusive(&pClip->Lock);
+	if (pClip->uPng != CLIP_PNG_IDLE)
+	{
+		ReleaseSRWLockExclusive(&pClip->Lock);
+		return;
+	}
+	pClip->uPng = CLIP_PNG_QUEUED;
+	ReleaseSRWLockExclusive(&pClip->Lock);
+	InterlockedIncrement(&pClip->lRefs);
+	if (FeSubmitJob(&pClip->Job))
+		return;
+	// when the queue is full the caller encodes it
+	InterlockedDecrement(&pClip->lRefs);
+	EncodeClipPng(pClip);
+}
+
+/* bottom-up rows after the header, the X byte is not used as alpha */
+static BOOL RenderClipDib(FE_CLIP* pClip)
+{
+	UINT y;
+	UINT8* pData;
+	BITMAPV5HEADER* pHeader;
+	size_t szRow = (size_t)pClip->w * 4;
+	pData = pClip->pOps->pfnAlloc(pClip->pContext, sizeof(BITMAPV5HEADER) + szRow * pClip->h);
+	if (!pData)
+		return FALSE;
+	pHeader = (BITMAPV5HEADER*)pData;
+	ZeroMemory(pHeader, sizeof(BITMAPV5HEADER));
+	pHeader->bV5Size = sizeof(BITMAPV5HEADER);
+	pHeader->bV5Width = (LONG)pClip->w;
+	pHeader->bV5Height = (LONG)pClip->h;
+	pHeader->bV5Planes = 1;
+	pHeader->bV5BitCount = 32;
+	pHeader->bV5Compression = BI_BITFIELDS;
+	pHeader->bV5SizeImage = (DWORD)(szRow * pClip->h);
+	pHeader->bV5RedMask = 0x00FF0000;
+	pHeader->bV5GreenMask = 0x0000FF00;
+	pHeader->bV5BlueMask = 0x000000FF;
+	pHeader->bV5CSType = LCS_sRGB;
+	pHeader->bV5Intent = LCS_GM_IMAGES;
+	pData += sizeof(BITMAPV5HEADER);
+	for (y = 0; y < pClip->h; y++)
+		memcpy(pData + (pClip->h - 1 - y) * szRow, pClip->pBgrx + y * pClip->szStride, szRow);
+	return pClip->pOps->pfnSet(pClip->pContext, FE_CLIP_DIBV5, pHeader);
+}
+
+static BOOL RenderClipPng(FE_CLIP* pClip)
+{
+	UINT8* png;
+	PVOID pData;
+	StartClipPng(pClip);
+	WaitClipPng(pClip);
+	AcquireSRWLockExclusive(&pClip->Lock);
+	png = pClip->pPng;
+	pClip->pPng = NULL;
+	ReleaseSRWLockExclusive(&pClip->Lock);
+	if (!png)
+		return FALSE;
+	pData = pClip->pOps->pfnAlloc(pClip->pContext, pClip->szPng);
+	if (pData)
+		memcpy(pData, png, pClip->szPng);
+	free(png);
+	if (!pData)
+		return FALSE;
+	return pClip->pOps->pfnSet(pClip->pContext, FE_CLIP_PNG, pData);
+}
+
+FE_CLIP* FeOfferClip(const FE_CLIP_OPS* pOps, PVOID pContext, FE_PNG_ENCODER* pEncoder,
+	const UINT8* pBgrx, UINT w, UINT h, size_t szStride, FE_PNG_PROFILE uProfile)
+{
+	FE_CLIP* pClip = calloc(1, sizeof(FE_CLIP));
+	if (!pClip)
+		return NULL;
+	pClip->pOps = pOps;
+	pClip->pContext = pContext;
+	pClip->pEncoder = pEncoder;
+	pClip->pBgrx = pBgrx;
+	pClip->w = w;
+	pClip->h = h;
+	pClip->szStride = szStride;
+	pClip->uProfile = uProfile;
+	pClip->Job.pfnRun = RunClipJob;
+	pClip->Job.pfnDone = DoneClipJob;
+	InitializeSRWLock(&pClip->Lock);
+	InitializeConditionVariable(&pClip->Encoded);
+	pClip->lRefs = 1;
+	if (!pOps->pfnOffer(pContext))
+	{
+		free(pClip);
+		return NULL;
+	}
+	return pClip;
+}
+
+BOOL FeRenderClip(FE_CLIP* pClip, FE_CLIP_FORMAT uFormat)
+{
+	BOOL bRet = FALSE;
+	if (pClip->uRendered & (1U << uFormat))
+		return TRUE;
+	switch (uFormat)
+	{
+	case FE_CLIP_DIBV5:
+		bRet = RenderClipDib(pClip);
+		break;
+	case FE_CLIP_PNG:
+		bRet = RenderClipPng(pClip);
+		break;
+	default:
+		return FALSE;
+	}
+	// a failed format is not retried, the clipboard keeps it empty
+	pClip->uRendered |= 1U << uFormat;
+	return bRet;
+}
+
+VOID FeRenderAllClip(FE_CLIP* pClip)
+{
+	UINT i;
+	// the job encodes the PNG while the DIB is copied
+	if (!(pClip->uRendered & (1U << FE_CLIP_PNG)))
+		StartClipPng(pClip);
+	for (i = 0; i < FE_CLIP_FORMATS; i++)
+		FeRenderClip(pClip, (FE_CLIP_FORMAT)i);
+}
+
+UINT FeGetClipRendered(const FE_CLIP* pClip)
+{
+	return pClip->uRendered;
+}
+
+VOID FeFreeClip(FE_CLIP* pClip)
+{
+	if (!pClip)
+		return;
+	// the renders waited for the encode, only the job's pfnDone may still be pending
+	ReleaseClip(pClip);
+}
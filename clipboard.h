@@ -0,0 +1,54 @@
+﻿// SPDX-License-Identifier: GPL-3.0-or-later
+#pragma once
+
+#include "fe.h"
+#include "pngenc.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+typedef enum _FE_CLIP_FORMAT
+{
+	FE_CLIP_DIBV5 = 0,
+	/* the registered "PNG" format */
+	FE_CLIP_PNG,
+	FE_CLIP_FORMATS
+} FE_CLIP_FORMAT;
+
+typedef struct _FE_CLIP_OPS
+{
+	/* take the clipboard and announce every format without its data */
+	BOOL (*pfnOffer)(PVOID pContext);
+	/* memory for szData bytes of one format */
+	PVOID (*pfnAlloc)(PVOID pContext, size_t szData);
+	/* put the memory from pfnAlloc on the clipboard, it is freed if this fails */
+	BOOL (*pfnSet)(PVOID pContext, FE_CLIP_FORMAT uFormat, PVOID pData);
+} FE_CLIP_OPS;
+
+/* a screenshot on the clipboard whose formats are rendered when they are asked for */
+typedef struct _FE_CLIP FE_CLIP;
+
+/* pBgrx is not copied, it must stay valid until FeFreeClip. Nothing is encoded yet, the
+ * PNG is encoded with pEncoder on the job queue once it is rendered */
+FE_CLIP* FeOfferClip(const FE_CLIP_OPS* pOps, PVOID pContext, FE_PNG_ENCODER* pEncoder,
+	const UINT8* pBgrx, UINT w, UINT h, size_t szStride, FE_PNG_PROFILE uProfile);
+
+/* render one format, does nothing if it was rendered before,
+ * the PNG is encoded on the job queue and waited for */
+BOOL FeRenderClip(FE_CLIP* pClip, FE_CLIP_FORMAT uFormat);
+
+/* render the formats nobody asked for yet, before the owner goes away,
+ * the DIB is copied while the job queue encodes the PNG */
+VOID FeRenderAllClip(FE_CLIP* pClip);
+
+/* formats rendered so far, 1 << FE_CLIP_FORMAT each */
+UINT FeGetClipRendered(const FE_CLIP* pClip);
+
+/* the renders waited for their encode, so pBgrx can go right after */
+VOID FeFreeClip(FE_CLIP* pClip);
+
+#ifdef __cplusplus
+}
+#endif
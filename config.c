@@ -3,11 +3,16 @@
 #include "fe.h"
 
 #include "utils.h"
-
-#include <math.h>
+#include "action.h"
 
 static BOOL mRunInitCmd = TRUE;
 
+/* compiled from the systray array, indexed by menu id - IDM_USER_MIN */
+static FE_ACTION_TABLE* mSystrayActions;
+
+/* the config text, the strings of the tree point into it */
+static CHAR* mConfigData;
+
 LPCWSTR FeGetConfigPath(VOID)
 {
 	static WCHAR FilePath[MAX_PATH];
@@ -103,17 +108,18 @@ static VOID FeInitializeTree(cJSON* pJSON)
 
 static VOID FeRunInitCmd(cJSON* pJSON)
 {
-	const cJSON* hi;
-	const cJSON* item;
+	UINT i;
+	FE_ACTION_TABLE* pInit;
 	if (mRunInitCmd != TRUE)
 		return;
 	FeAddLog(0, L"Execute init commands.\r\n");
 	mRunInitCmd = FALSE;
-	hi = cJSON_GetObjectItem(pJSON, "init");
-	cJSON_ArrayForEach(item, hi)
-	{
-		FeParseConfig(item);
-	}
+	pInit = FeCompileActions(cJSON_GetObjectItem(pJSON, "init"));
+	if (!pInit)
+		return;
+	for (i = 0; i < pInit->uCount; i++)
+		FeRunAction(pInit, i);
+	FeFreeActions(pInit);
 }
 
 
@@ -125,27 +131,38 @@ FeInitializeConfig(VOID)
 	if (!pConfigData)
 		return NULL;
 	cJSON_Minify(pConfigData);
-	pJSON = cJSON_Parse(pConfigData);
+	pJSON = cJSON_ParseArenaInSitu(pConfigData);
 	if (!pJSON)
 	{
 		WCHAR* wErr = FeUtf8ToWcs(cJSON_GetErrorPtr());
 		FeAddLog(1, L"Invalid JSON: %s\r\n", wErr ? wErr : L"UNKNOWN ERROR");
 		if (wErr)
 			free(wErr);
+		free(pConfigData);
 		return NULL;
 	}
-	free(pConfigData);
+	mConfigData = pConfigData;
 	FeAddLog(0, L"JSON Loaded.\r\n");
 	FeInitializeTree(pJSON);
+	mSystrayActions = FeCompileActions(cJSON_GetObjectItem(pJSON, "systray"));
 	FeRunInitCmd(pJSON);
 	return pJSON;
 }
 
+VOID FeFreeConfig(cJSON* pJSON)
+{
+	FeFreeActions(mSystrayActions);
+	mSystrayActions = NULL;
+	cJSON_DeleteArena(pJSON);
+	free(mConfigData);
+	mConfigData = NULL;
+}
+
 VOID FeReloadConfig(cJSON** m)
 {
 	cJSON* pJSON = *m;
 	FeUnregisterHotkey();
-	cJSON_Delete(pJSON);
+	FeFreeConfig(pJSON);
 	FeClearLog(0);
 	FeDeleteTree();
 	pJSON = FeInitializeConfig();
@@ -168,101 +185,7 @@ VOID FeEditConfig(HWND hWnd, cJSON** m)
 	FeReloadConfig(m);
 }
 
-VOID FeParseConfig(const cJSON* hk)
+BOOL FeRunSystrayAction(UINT uIndex)
 {
-	WCHAR* val = NULL;
-	val = FeUtf8ToWcs(cJSON_GetStringValue(cJSON_GetObjectItem(hk, "exec")));
-	if (val)
-	{
-		FeAddLog(0, L"Exec: %s\r\n", val);
-		FeExec(val, FeStrToShow(cJSON_GetStringValue(cJSON_GetObjectItem(hk, "window"))), FALSE, FALSE);
-		free(val);
-		return;
-	}
-	val = FeUtf8ToWcs(cJSON_GetStringValue(cJSON_GetObjectItem(hk, "kill")));
-	if (val)
-	{
-		FeAddLog(0, L"Kill: %s\r\n", val);
-		if (_wcsnicmp(val, L"pid=", 4) == 0)
-			FeKillProcessById(wcstoul(&val[4], NULL, 0), 1);
-		else
-			FeKillProcessByName(val, 1);
-		free(val);
-		return;
-	}
-	val = FeUtf8ToWcs(cJSON_GetStringValue(cJSON_GetObjectItem(hk, "resolution")));
-	if (val)
-	{
-		WCHAR* dev = FeUtf8ToWcs(cJSON_GetStringValue(cJSON_GetObjectItem(hk, "monitor")));
-		FeAddLog(0, L"Resolution: %s\r\n", val);
-		FeSetResolution(dev, val, CDS_UPDATEREGISTRY);
-		if (dev)
-			free(dev);
-		free(val);
-		return;
-	}
-	val = FeUtf8ToWcs(cJSON_GetStringValue(cJSON_GetObjectItem(hk, "find")));
-	if (val)
-	{
-		CHAR* sh = cJSON_GetStringValue(cJSON_GetObjectItem(hk, "hide"));
-		CHAR* ss = cJSON_GetStringValue(cJSON_GetObjectItem(hk, "show"));
-		FeAddLog(0, L"Find: %s\r\n", val);
-		FeShowWindowByTitle(val, FeStrToShow(sh ? sh : "hide"), FeStrToShow(ss ? ss : "restore"));
-		free(val);
-		return;
-	}
-	val = FeUtf8ToWcs(cJSON_GetStringValue(cJSON_GetObjectItem(hk, "screenshot")));
-	if (val)
-	{
-		WCHAR* save = FeUtf8ToWcs(cJSON_GetStringValue(cJSON_GetObjectItem(hk, "save")));
-		FeAddLog(0, L"Screenshot: %s\r\n", val);
-		FeGetScreenShot(val, save);
-		if (save)
-			free(save);
-		free(val);
-		return;
-	}
-	val = FeUtf8ToWcs(cJSON_GetStringValue(cJSON_GetObjectItem(hk, "shell")));
-	if (val)
-	{
-		WCHAR* file = FeUtf8ToWcs(cJSON_GetStringValue(cJSON_GetObjectItem(hk, "file")));
-		WCHAR* param = FeUtf8ToWcs(cJSON_GetStringValue(cJSON_GetObjectItem(hk, "args")));
-		WCHAR* dir = FeUtf8ToWcs(cJSON_GetStringValue(cJSON_GetObjectItem(hk, "directory")));
-		FeAddLog(0, L"Shell: %s %s %s %s\r\n", val,
-			file ? file : L"", param ? param : L"", dir ? dir : L"");
-		FeShellExec(val, file, param, dir,
-			FeStrToShow(cJSON_GetStringValue(cJSON_GetObjectItem(hk, "window"))));
-		if (file)
-			free(file);
-		if (param)
-			free(param);
-		if (dir)
-			free(dir);
-		free(val);
-		return;
-	}
-	val = FeUtf8ToWcs(cJSON_GetStringValue(cJSON_GetObjectItem(hk, "shortcut")));
-	if (val)
-	{
-		WCHAR* file = FeUtf8ToWcs(cJSON_GetStringValue(cJSON_GetObjectItem(hk, "file")));
-		WCHAR* args = FeUtf8ToWcs(cJSON_GetStringValue(cJSON_GetObjectItem(hk, "args")));
-		WCHAR* icon = FeUtf8ToWcs(cJSON_GetStringValue(cJSON_GetObjectItem(hk, "icon")));
-		double id = cJSON_GetNumberValue(cJSON_GetObjectItem(hk, "id"));
-		if (!file)
-		{
-			free(val);
-			return;
-		}
-		FeAddLog(0, L"Shortcut: %s.lnk -> %s\r\n", val, file);
-		FeCreateShortcut(file, val, args, icon, (id == (double)NAN) ? 0 : (int) id,
-			FeStrToShow(cJSON_GetStringValue(cJSON_GetObjectItem(hk, "window"))));
-		if (args)
-			free(args);
-		if (icon)
-			free(icon);
-		free(file);
-		free(val);
-		return;
-	}
+	return FeRunAction(mSystrayActions, uIndex);
 }
-
@@ -0,0 +1,58 @@
+﻿// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "fe.h"
+#include "utils.h"
+
+#if defined(_M_IX86) || defined(_M_X64)
+#include <intrin.h>
+#include <immintrin.h>
+
+static FE_TARGET("xsave") UINT GetCpuFeatures(VOID)
+{
+	int info[4];
+	int ext[4] = { 0 };
+	UINT uFeatures = 0;
+	__cpuid(info, 0);
+	if (info[0] < 1)
+		return 0;
+	if (info[0] >= 7)
+		__cpuidex(ext, 7, 0);
+	__cpuid(info, 1);
+	if (info[3] & (1 << 26))
+		uFeatures |= FE_CPU_SSE2;
+	if (info[2] & (1 << 9))
+		uFeatures |= FE_CPU_SSSE3;
+	if (info[2] & (1 << 19))
+		uFeatures |= FE_CPU_SSE41;
+	if (info[2] & (1 << 1))
+		uFeatures |= FE_CPU_PCLMUL;
+	// OSXSAVE and AVX, then check the OS saves the YMM state
+	if ((info[2] & (1 << 27)) && (info[2] & (1 << 28))
+		&& (_xgetbv(0) & 6) == 6 && (ext[1] & (1 << 5)))
+		uFeatures |= FE_CPU_AVX2;
+	return uFeatures;
+}
+#else
+static UINT GetCpuFeatures(VOID)
+{
+	return 0;
+}
+#endif
+
+static UINT mFeatures;
+static INIT_ONCE mInitOnce = INIT_ONCE_STATIC_INIT;
+
+static BOOL CALLBACK InitCpuFeatures(PINIT_ONCE pInitOnce, PVOID pParameter, PVOID* ppContext)
+{
+	UNREFERENCED_PARAMETER(pInitOnce);
+	UNREFERENCED_PARAMETER(pParameter);
+	UNREFERENCED_PARAMETER(ppContext);
+	mFeatures = GetCpuFeatures();
+	return TRUE;
+}
+
+UINT FeGetCpuFeatures(VOID)
+{
+	InitOnceExecuteOnce(&mInitOnce, InitCpuFeatures, NULL, NULL);
+	return mFeatures;
+}
@@ -3,6 +3,7 @@
 #include "fe.h"
 
 #include "utils.h"
+#include "jobqueue.h"
 
 #include <shellapi.h>
 
@@ -61,18 +62,9 @@ AddUserSystrayMenu(HMENU hMenu, UINT uPosition, UINT uFlags)
 static INT_PTR
 HandleUserSystrayId(int Id)
 {
-	int item;
-	const cJSON* st;
-	const cJSON* hk;
 	if (Id < IDM_USER_MIN || Id > IDM_USER_MAX)
 		return (INT_PTR)FALSE;
-	st = cJSON_GetObjectItem(mJson, "systray");
-	item = Id - IDM_USER_MIN;
-	hk = cJSON_GetArrayItem(st, item);
-	if (!hk)
-		return (INT_PTR)FALSE;
-	FeParseConfig(hk);
-	return (INT_PTR)TRUE;
+	return (INT_PTR)FeRunSystrayAction(Id - IDM_USER_MIN);
 }
 
 static INT_PTR
@@ -199,6 +191,18 @@ MainDlgProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
 		return (INT_PTR)TRUE;
 	case WM_APP:
 		return NotifyIconProc(hWnd, wParam, lParam);
+	case WM_FE_JOB_DONE:
+		FeCompleteJob(lParam);
+		break;
+	case WM_RENDERFORMAT:
+		FeRenderClipboard((UINT)wParam);
+		break;
+	case WM_RENDERALLFORMATS:
+		FeRenderAllClipboard();
+		break;
+	case WM_DESTROYCLIPBOARD:
+		FeDestroyClipboard();
+		break;
 	case WM_NOTIFY:
 		return TreeViewProc(hWnd, wParam, lParam);
 	case WM_SYSCOMMAND:
@@ -260,7 +264,9 @@ wWinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance, _In_ LPWSTR
 		}
 	}
 
-	cJSON_Delete(mJson);
+	FeStopJobQueue();
+	FeFreeScreenShotCache();
+	FeFreeConfig(mJson);
 	CloseHandle(hMutex);
 	return 0;
 }
@@ -15,6 +15,8 @@
 
 #define MAX_HOTKEY_ID 0xBFFF
 
+#define WM_FE_JOB_DONE (WM_APP + 1)
+
 #ifdef __cplusplus
 extern "C"
 {
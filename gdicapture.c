@@ -0,0 +1,99 @@
+﻿// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "capture.h"
+
+typedef struct _GDI_CAPTURE
+{
+	FE_CAPTURE Capture;
+	/* virtual screen sized, recreated when the desktop layout changes */
+	HBITMAP hBitmap;
+	UINT8* pPixels;
+	RECT rcDesktop;
+} GDI_CAPTURE;
+
+VOID FeGetVirtualScreen(RECT* pRect)
+{
+	pRect->left = GetSystemMetrics(SM_XVIRTUALSCREEN);
+	pRect->top = GetSystemMetrics(SM_YVIRTUALSCREEN);
+	pRect->right = pRect->left + GetSystemMetrics(SM_CXVIRTUALSCREEN);
+	pRect->bottom = pRect->top + GetSystemMetrics(SM_CYVIRTUALSCREEN);
+}
+
+HBITMAP FeCreateScreenBitmap(int w, int h, UINT8** ppPixels)
+{
+	HBITMAP hBitmap;
+	HDC hScreen = GetDC(NULL);
+	BITMAPINFO bmi = { 0 };
+	bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+	bmi.bmiHeader.biPlanes = 1;
+	bmi.bmiHeader.biBitCount = 32;
+	bmi.bmiHeader.biWidth = w;
+	bmi.bmiHeader.biHeight = -h;
+	bmi.bmiHeader.biCompression = BI_RGB;
+	hBitmap = CreateDIBSection(hScreen, &bmi, DIB_RGB_COLORS, (void**)ppPixels, NULL, 0);
+	ReleaseDC(NULL, hScreen);
+	return hBitmap;
+}
+
+BOOL FeBlitScreen(HBITMAP hBitmap, int dx, int dy, int x, int y, int w, int h)
+{
+	BOOL bRet = FALSE;
+	HGDIOBJ hOld;
+	HDC hScreen = GetDC(NULL);
+	HDC hDC = CreateCompatibleDC(hScreen);
+	if (hDC)
+	{
+		hOld = SelectObject(hDC, hBitmap);
+		bRet = BitBlt(hDC, dx, dy, w, h, hScreen, x, y, SRCCOPY);
+		// the bits are read by the background thread
+		GdiFlush();
+		SelectObject(hDC, hOld);
+		DeleteDC(hDC);
+	}
+	ReleaseDC(NULL, hScreen);
+	return bRet;
+}
+
+static UINT8* GrabGdiCapture(FE_CAPTURE* pCapture, int x, int y, int w, int h, size_t* pszStride)
+{
+	RECT desk;
+	size_t szStride;
+	GDI_CAPTURE* pGdi = (GDI_CAPTURE*)pCapture;
+	FeGetVirtualScreen(&desk);
+	if (!pGdi->hBitmap || !EqualRect(&desk, &pGdi->rcDesktop))
+	{
+		if (pGdi->hBitmap)
+			DeleteObject(pGdi->hBitmap);
+		pGdi->rcDesktop = desk;
+		pGdi->hBitmap = FeCreateScreenBitmap(desk.right - desk.left, desk.bottom - desk.top, &pGdi->pPixels);
+		if (!pGdi->hBitmap)
+			return NULL;
+	}
+	x -= desk.left;
+	y -= desk.top;
+	if (x < 0 || y < 0 || w <= 0 || h <= 0 || x + w > desk.right - desk.left || y + h > desk.bottom - desk.top)
+		return NULL;
+	if (!FeBlitScreen(pGdi->hBitmap, x, y, x + desk.left, y + desk.top, w, h))
+		return NULL;
+	szStride = (size_t)(desk.right - desk.left) * 4;
+	*pszStride = szStride;
+	return pGdi->pPixels + y * szStride + (size_t)x * 4;
+}
+
+static VOID FreeGdiCapture(FE_CAPTURE* pCapture)
+{
+	GDI_CAPTURE* pGdi = (GDI_CAPTURE*)pCapture;
+	if (pGdi->hBitmap)
+		DeleteObject(pGdi->hBitmap);
+	free(pGdi);
+}
+
+FE_CAPTURE* FeCreateGdiCapture(VOID)
+{
+	GDI_CAPTURE* pGdi = calloc(1, sizeof(GDI_CAPTURE));
+	if (!pGdi)
+		return NULL;
+	pGdi->Capture.pfnGrab = GrabGdiCapture;
+	pGdi->Capture.pfnFree = FreeGdiCapture;
+	return &pGdi->Capture;
+}
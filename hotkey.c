@@ -3,90 +3,236 @@
 #include "fe.h"
 
 #include "utils.h"
+#include "action.h"
+#include "checksum.h"
+
+/* a hotkey array item and the id it is registered with */
+typedef struct _HOTKEY_ENTRY
+{
+	/* modifiers << 32 | vk, 0 when not registered */
+	UINT64 ullData;
+	/* CRC32 of the item as JSON, unchanged items keep their id across reloads */
+	UINT uHash;
+	UINT uId;
+} HOTKEY_ENTRY;
+
+/* the id of a previous hotkey, sorted by hash */
+typedef struct _HOTKEY_OLD_ID
+{
+	UINT uHash;
+	UINT uId;
+} HOTKEY_OLD_ID;
 
 static cJSON* mHotkeyJson;
 static INT mHotkeyCount;
+/* one per array item */
+static HOTKEY_ENTRY* mHotkeys;
+/* compiled from mHotkeyJson, indexed by array item */
+static FE_ACTION_TABLE* mHotkeyActions;
 
-static UINT64 mHotkeyData[MAX_HOTKEY_ID + 1];
+/* array item + 1 of each hotkey id, 0 when the id is free */
+static UINT mHotkeyItem[MAX_HOTKEY_ID + 1];
 
 VOID
 FeUnregisterHotkey(VOID)
 {
 	int i;
-	for (i = 0; i <= mHotkeyCount; i++)
-		UnregisterHotKey(NULL, i);
+	for (i = 0; i < mHotkeyCount; i++)
+	{
+		if (mHotkeys[i].ullData == 0)
+			continue;
+		UnregisterHotKey(NULL, mHotkeys[i].uId);
+		mHotkeyItem[mHotkeys[i].uId] = 0;
+	}
+	/* mHotkeys stays for FeInitializeHotkey to reuse the ids */
+	FeFreeActions(mHotkeyActions);
+	mHotkeyActions = NULL;
 	mHotkeyJson = NULL;
 }
 
+static UINT
+GetHotkeyHash(const cJSON* hk)
+{
+	UINT uHash = 0;
+	CHAR* str = cJSON_PrintUnformatted(hk);
+	if (str)
+	{
+		uHash = FeCrc32(0, (const UINT8*)str, strlen(str));
+		cJSON_free(str);
+	}
+	return uHash;
+}
+
+static int
+CompareOldId(const void* a, const void* b)
+{
+	UINT x = ((const HOTKEY_OLD_ID*)a)->uHash;
+	UINT y = ((const HOTKEY_OLD_ID*)b)->uHash;
+	return (x > y) - (x < y);
+}
+
+/* the registered ids of the previous config, NULL when there are none */
+static HOTKEY_OLD_ID*
+GetOldIds(size_t* pCount)
+{
+	int i;
+	size_t n = 0;
+	HOTKEY_OLD_ID* pOld = NULL;
+	if (mHotkeys && mHotkeyCount > 0)
+		pOld = malloc(sizeof(HOTKEY_OLD_ID) * (size_t)mHotkeyCount);
+	if (pOld)
+	{
+		for (i = 0; i < mHotkeyCount; i++)
+		{
+			if (mHotkeys[i].ullData == 0)
+				continue;
+			pOld[n].uHash = mHotkeys[i].uHash;
+			pOld[n].uId = mHotkeys[i].uId;
+			n++;
+		}
+		qsort(pOld, n, sizeof(HOTKEY_OLD_ID), CompareOldId);
+	}
+	free(mHotkeys);
+	mHotkeys = NULL;
+	mHotkeyCount = 0;
+	*pCount = n;
+	return pOld;
+}
+
+/* claim the old id of an unchanged item, mark it so duplicates get the next one */
+static BOOL
+ClaimOldId(HOTKEY_OLD_ID* pOld, size_t szOld, HOTKEY_ENTRY* pEntry)
+{
+	size_t lo = 0, hi = szOld;
+	while (lo < hi)
+	{
+		size_t mid = lo + (hi - lo) / 2;
+		if (pOld[mid].uHash < pEntry->uHash)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	for (; lo < szOld && pOld[lo].uHash == pEntry->uHash; lo++)
+	{
+		if (pOld[lo].uId > MAX_HOTKEY_ID)
+			continue;
+		pEntry->uId = pOld[lo].uId;
+		pOld[lo].uId = MAX_HOTKEY_ID + 1;
+		return TRUE;
+	}
+	return FALSE;
+}
+
 VOID
 FeInitializeHotkey(cJSON* jsHotkeys)
 {
 	int i;
+	UINT uNextId = 0;
+	size_t szOld = 0;
 	const cJSON* hk = NULL;
 	const WCHAR* wkey;
+	HOTKEY_OLD_ID* pOld = GetOldIds(&szOld);
 	mHotkeyJson = jsHotkeys;
-	if (!mHotkeyJson)
-		return;
 	mHotkeyCount = cJSON_GetArraySize(mHotkeyJson);
-	if (mHotkeyCount <= 0)
-		return;
-	for (i = 0; i < mHotkeyCount && i <= MAX_HOTKEY_ID; i++)
+	if (!mHotkeyJson || mHotkeyCount <= 0)
+		goto out;
+	mHotkeys = calloc(mHotkeyCount, sizeof(HOTKEY_ENTRY));
+	if (!mHotkeys)
+	{
+		FeAddLog(0, L"Out of memory for %d hotkeys.\r\n", mHotkeyCount);
+		mHotkeyCount = 0;
+		goto out;
+	}
+	mHotkeyActions = FeCompileActions(mHotkeyJson);
+	i = 0;
+	cJSON_ArrayForEach(hk, mHotkeyJson)
 	{
 		UINT vk = 0, fsModifiers = 0;
 		const cJSON* key = NULL;
 		const char* keyname = NULL;
-		hk = cJSON_GetArrayItem(mHotkeyJson, i);
-		if (!hk)
-		{
-			FeAddLog(0, L"Hotkey %d not found.\r\n", i);
-			continue;
-		}
+		HOTKEY_ENTRY* pEntry = &mHotkeys[i++];
 		key = cJSON_GetObjectItem(hk, "key");
 		if (!key)
 		{
-			FeAddLog(0, L"Hotkey %d no key.\r\n", i);
+			FeAddLog(0, L"Hotkey %d no key.\r\n", i - 1);
 			continue;
 		}
 		keyname = cJSON_GetStringValue(key);
 		if (!keyname)
 		{
-			FeAddLog(0, L"Hotkey %d invalid key.\r\n", i);
+			FeAddLog(0, L"Hotkey %d invalid key.\r\n", i - 1);
 			continue;
 		}
 		vk = FeStrToKey(keyname, &fsModifiers);
 		if (vk == 0)
 		{
-			FeAddLog(0, L"Hotkey %d invalid string %S.\r\n", i, keyname);
+			FeAddLog(0, L"Hotkey %d invalid string %S.\r\n", i - 1, keyname);
 			continue;
 		}
+		pEntry->ullData = (((UINT64)fsModifiers) << 32U) | vk;
+		pEntry->uHash = GetHotkeyHash(hk);
+		if (ClaimOldId(pOld, szOld, pEntry))
+			mHotkeyItem[pEntry->uId] = i;
+		else
+			pEntry->uId = MAX_HOTKEY_ID + 1;
+	}
+	/* new and changed items take the free ids */
+	for (i = 0; i < mHotkeyCount; i++)
+	{
+		HOTKEY_ENTRY* pEntry = &mHotkeys[i];
+		if (pEntry->ullData == 0 || pEntry->uId <= MAX_HOTKEY_ID)
+			continue;
+		while (uNextId <= MAX_HOTKEY_ID && mHotkeyItem[uNextId])
+			uNextId++;
+		if (uNextId > MAX_HOTKEY_ID)
+		{
+			FeAddLog(0, L"Hotkey %d no free id.\r\n", i);
+			pEntry->ullData = 0;
+			continue;
+		}
+		pEntry->uId = uNextId;
+		mHotkeyItem[uNextId] = i + 1;
+	}
+	for (i = 0; i < mHotkeyCount; i++)
+	{
+		HOTKEY_ENTRY* pEntry = &mHotkeys[i];
+		UINT fsModifiers = (UINT)(pEntry->ullData >> 32);
+		UINT vk = (UINT)(pEntry->ullData & 0xFFFFFFFF);
+		if (pEntry->ullData == 0)
+			continue;
 		wkey = FeKeyToStr(fsModifiers, vk);
-		if (!RegisterHotKey(NULL, i, fsModifiers, vk))
+		if (!RegisterHotKey(NULL, pEntry->uId, fsModifiers, vk))
 		{
-			mHotkeyData[i] = 0;
-			FeAddLog(0, L"Register hotkey %d %s failed.\r\n", i, wkey);
+			mHotkeyItem[pEntry->uId] = 0;
+			pEntry->ullData = 0;
+			FeAddLog(0, L"Register hotkey %u %s failed.\r\n", pEntry->uId, wkey);
 			continue;
 		}
-		mHotkeyData[i] = (((UINT64)fsModifiers) << 32U) | vk;
-		FeAddLog(0, L"Register hotkey %d %s OK.\r\n", i, wkey);
+		FeAddLog(0, L"Register hotkey %u %s OK.\r\n", pEntry->uId, wkey);
 	}
+out:
+	free(pOld);
 }
 
 VOID
 FeListHotkey(HWND hWnd)
 {
-	int i;
+	int i = 0;
+	const cJSON* hk;
 	FeClearLog(2);
 	ShowWindow(hWnd, SW_RESTORE);
 	FeAddLog(2, L"Hotkeys:\r\n");
-	for (i = 0; i < mHotkeyCount; i++)
+	if (!mHotkeys)
+		return;
+	cJSON_ArrayForEach(hk, mHotkeyJson)
 	{
-		const cJSON* hk = cJSON_GetArrayItem(mHotkeyJson, i);
 		WCHAR* wn;
-		if (mHotkeyData[i] == 0)
+		UINT64 ullData = mHotkeys[i++].ullData;
+		if (ullData == 0)
 			continue;
 		wn = FeUtf8ToWcs(cJSON_GetStringValue(cJSON_GetObjectItem(hk, "note")));
 		FeAddLog(2, L"%s%s%s\r\n",
-			FeKeyToStr(mHotkeyData[i] >> 32, mHotkeyData[i] & 0xFFFFFFFF),
+			FeKeyToStr((UINT)(ullData >> 32), (UINT)(ullData & 0xFFFFFFFF)),
 			wn ? L", " : L"", wn ? wn : L"");
 		if (wn)
 			free(wn);
@@ -96,12 +242,8 @@ FeListHotkey(HWND hWnd)
 VOID
 FeHandleHotkey(const MSG* msg)
 {
-	const cJSON* hk = NULL;
-	int id = (int)msg->wParam;
-	if (msg->message != WM_HOTKEY || !mHotkeyJson)
-		return;
-	hk = cJSON_GetArrayItem(mHotkeyJson, id);
-	if (!hk)
+	UINT_PTR id = msg->wParam;
+	if (msg->message != WM_HOTKEY || id > MAX_HOTKEY_ID || mHotkeyItem[id] == 0)
 		return;
-	FeParseConfig(hk);
+	FeRunAction(mHotkeyActions, mHotkeyItem[id] - 1);
 }
@@ -0,0 +1,199 @@
+﻿// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "imgenc.h"
+
+#define QOI_OP_INDEX 0x00
+#define QOI_OP_DIFF 0x40
+#define QOI_OP_LUMA 0x80
+#define QOI_OP_RUN 0xC0
+#define QOI_OP_RGB 0xFE
+
+#define QOI_BUFFER_SIZE 0x10000
+/* room for a run and QOI_OP_RGB, or a run and the end marker */
+#define QOI_BUFFER_SLACK 9
+
+static const FE_IMAGE_WRITER mWriters[] =
+{
+	{ L"png", L"PNG (*.png)\0*.png\0", FeStreamPngBgrx },
+	{ L"qoi", L"QOI (*.qoi)\0*.qoi\0", FeStreamQoiBgrx },
+	{ L"bmp", L"BMP (*.bmp)\0*.bmp\0", FeStreamBmpBgrx },
+};
+
+const FE_IMAGE_WRITER* FeGetImageWriter(LPCWSTR lpName)
+{
+	UINT i;
+	for (i = 0; lpName && i < ARRAYSIZE(mWriters); i++)
+	{
+		if (_wcsicmp(lpName, mWriters[i].lpName) == 0)
+			return &mWriters[i];
+	}
+	return &mWriters[0];
+}
+
+static VOID PutBe32(UINT8* p, UINT32 v)
+{
+	p[0] = (UINT8)(v >> 24);
+	p[1] = (UINT8)(v >> 16);
+	p[2] = (UINT8)(v >> 8);
+	p[3] = (UINT8)v;
+}
+
+static VOID PutLe32(UINT8* p, UINT32 v)
+{
+	p[0] = (UINT8)v;
+	p[1] = (UINT8)(v >> 8);
+	p[2] = (UINT8)(v >> 16);
+	p[3] = (UINT8)(v >> 24);
+}
+
+UINT FeStreamQoiBgrx(FE_PNG_ENCODER* pEncoder, FE_PNG_WRITE pfnWrite, PVOID pContext,
+	size_t* pszOut, const UINT8* pBgrx, UINT w, UINT h, size_t szStride, FE_PNG_PROFILE uProfile)
+{
+	UINT x, y;
+	UINT uError = 0;
+	UINT uRun = 0;
+	size_t szOut = 0;
+	size_t n = 14;
+	/* ARGB, the alpha is always 255 */
+	UINT32 Index[64] = { 0 };
+	UINT32 uPrev = 0xFF000000;
+	UINT8* pBuf;
+	UNREFERENCED_PARAMETER(pEncoder);
+	UNREFERENCED_PARAMETER(uProfile);
+	if (w == 0 || h == 0)
+		return 93;
+	/* the limit of the reference decoder */
+	if ((UINT64)w * h >= 400000000)
+		return 92;
+	pBuf = malloc(QOI_BUFFER_SIZE);
+	if (!pBuf)
+		return 83;
+	memcpy(pBuf, "qoif", 4);
+	PutBe32(pBuf + 4, w);
+	PutBe32(pBuf + 8, h);
+	pBuf[12] = 3;
+	pBuf[13] = 0;
+	for (y = 0; y < h && uError == 0; y++)
+	{
+		const UINT8* p = pBgrx + y * szStride;
+		for (x = 0; x < w; x++, p += 4)
+		{
+			UINT32 uPixel = 0xFF000000 | ((UINT32)p[2] << 16) | ((UINT32)p[1] << 8) | p[0];
+			UINT uHash;
+			if (n > QOI_BUFFER_SIZE - QOI_BUFFER_SLACK)
+			{
+				if (!pfnWrite(pContext, pBuf, n))
+				{
+					uError = 79;
+					break;
+				}
+				szOut += n;
+				n = 0;
+			}
+			if (uPixel == uPrev)
+			{
+				if (++uRun == 62)
+				{
+					pBuf[n++] = (UINT8)(QOI_OP_RUN | (uRun - 1));
+					uRun = 0;
+				}
+				continue;
+			}
+			if (uRun)
+			{
+				pBuf[n++] = (UINT8)(QOI_OP_RUN | (uRun - 1));
+				uRun = 0;
+			}
+			uHash = (p[2] * 3 + p[1] * 5 + p[0] * 7 + 255 * 11) % 64;
+			if (Index[uHash] == uPixel)
+				pBuf[n++] = (UINT8)(QOI_OP_INDEX | uHash);
+			else
+			{
+				signed char dr = (signed char)(p[2] - (UINT8)(uPrev >> 16));
+				signed char dg = (signed char)(p[1] - (UINT8)(uPrev >> 8));
+				signed char db = (signed char)(p[0] - (UINT8)uPrev);
+				signed char dr_dg = (signed char)(dr - dg);
+				signed char db_dg = (signed char)(db - dg);
+				Index[uHash] = uPixel;
+				if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1)
+					pBuf[n++] = (UINT8)(QOI_OP_DIFF | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2));
+				else if (dg >= -32 && dg <= 31 && dr_dg >= -8 && dr_dg <= 7 && db_dg >= -8 && db_dg <= 7)
+				{
+					pBuf[n++] = (UINT8)(QOI_OP_LUMA | (dg + 32));
+					pBuf[n++] = (UINT8)((dr_dg + 8) << 4 | (db_dg + 8));
+				}
+				else
+				{
+					pBuf[n++] = QOI_OP_RGB;
+					pBuf[n++] = p[2];
+					pBuf[n++] = p[1];
+					pBuf[n++] = p[0];
+				}
+			}
+			uPrev = uPixel;
+		}
+	}
+	if (uError == 0 && n > QOI_BUFFER_SIZE - QOI_BUFFER_SLACK)
+	{
+		if (!pfnWrite(pContext, pBuf, n))
+			uError = 79;
+		szOut += n;
+		n = 0;
+	}
+	if (uError == 0)
+	{
+		if (uRun)
+			pBuf[n++] = (UINT8)(QOI_OP_RUN | (uRun - 1));
+		memcpy(pBuf + n, "\0\0\0\0\0\0\0\1", 8);
+		n += 8;
+		if (!pfnWrite(pContext, pBuf, n))
+			uError = 79;
+		szOut += n;
+	}
+	free(pBuf);
+	if (pszOut)
+		*pszOut = szOut;
+	return uError;
+}
+
+UINT FeStreamBmpBgrx(FE_PNG_ENCODER* pEncoder, FE_PNG_WRITE pfnWrite, PVOID pContext,
+	size_t* pszOut, const UINT8* pBgrx, UINT w, UINT h, size_t szStride, FE_PNG_PROFILE uProfile)
+{
+	UINT y;
+	/* BITMAPFILEHEADER and BITMAPINFOHEADER */
+	UINT8 Header[54] = { 'B', 'M' };
+	size_t szRow = (size_t)w * 4;
+	UNREFERENCED_PARAMETER(pEncoder);
+	UNREFERENCED_PARAMETER(uProfile);
+	if (w == 0 || h == 0)
+		return 93;
+	if (w > 0x7FFFFFFF / 4 || h > 0x7FFFFFFF || szRow * h > 0xFFFFFFFF - sizeof(Header))
+		return 77;
+	PutLe32(Header + 2, (UINT32)(sizeof(Header) + szRow * h));
+	PutLe32(Header + 10, (UINT32)sizeof(Header));
+	PutLe32(Header + 14, 40);
+	PutLe32(Header + 18, w);
+	/* negative for top-down rows */
+	PutLe32(Header + 22, (UINT32)-(INT)h);
+	Header[26] = 1;
+	Header[28] = 32;
+	PutLe32(Header + 34, (UINT32)(szRow * h));
+	if (!pfnWrite(pContext, Header, sizeof(Header)))
+		return 79;
+	if (szStride == szRow)
+	{
+		if (!pfnWrite(pContext, pBgrx, szRow * h))
+			return 79;
+	}
+	else
+	{
+		for (y = 0; y < h; y++)
+		{
+			if (!pfnWrite(pContext, pBgrx + y * szStride, szRow))
+				return 79;
+		}
+	}
+	if (pszOut)
+		*pszOut = sizeof(Header) + szRow * h;
+	return 0;
+}
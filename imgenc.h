@@ -0,0 +1,38 @@
+﻿// SPDX-License-Identifier: GPL-3.0-or-later
+#pragma once
+
+#include "fe.h"
+#include "pngenc.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* like FeStreamPngBgrx, the formats without settings ignore pEncoder and uProfile */
+typedef UINT (*FE_IMAGE_STREAM)(FE_PNG_ENCODER* pEncoder, FE_PNG_WRITE pfnWrite, PVOID pContext,
+	size_t* pszOut, const UINT8* pBgrx, UINT w, UINT h, size_t szStride, FE_PNG_PROFILE uProfile);
+
+typedef struct _FE_IMAGE_WRITER
+{
+	/* the "Format" value, and the extension without the dot */
+	LPCWSTR lpName;
+	/* for the save dialog, double null terminated */
+	LPCWSTR lpFilter;
+	FE_IMAGE_STREAM pfnStream;
+} FE_IMAGE_WRITER;
+
+/* PNG unless lpName is "qoi" or "bmp" */
+const FE_IMAGE_WRITER* FeGetImageWriter(LPCWSTR lpName);
+
+/* lossless QOI, RGB channels, in one pass */
+UINT FeStreamQoiBgrx(FE_PNG_ENCODER* pEncoder, FE_PNG_WRITE pfnWrite, PVOID pContext,
+	size_t* pszOut, const UINT8* pBgrx, UINT w, UINT h, size_t szStride, FE_PNG_PROFILE uProfile);
+
+/* uncompressed top-down 32-bit BMP, the rows are written as they are */
+UINT FeStreamBmpBgrx(FE_PNG_ENCODER* pEncoder, FE_PNG_WRITE pfnWrite, PVOID pContext,
+	size_t* pszOut, const UINT8* pBgrx, UINT w, UINT h, size_t szStride, FE_PNG_PROFILE uProfile);
+
+#ifdef __cplusplus
+}
+#endif
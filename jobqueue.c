@@ -0,0 +1,96 @@
+﻿// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "fe.h"
+#include "utils.h"
+#include "jobqueue.h"
+
+#define JOB_QUEUE_SIZE 8
+
+static SRWLOCK mLock = SRWLOCK_INIT;
+static CONDITION_VARIABLE mCond = CONDITION_VARIABLE_INIT;
+static FE_JOB* mJobs[JOB_QUEUE_SIZE];
+static UINT mHead;
+static UINT mCount;
+static BOOL mBusy;
+static BOOL mExit;
+static HANDLE mThread;
+
+static DWORD WINAPI JobQueueThread(LPVOID lpParameter)
+{
+	FE_JOB* pJob;
+	UNREFERENCED_PARAMETER(lpParameter);
+	for (;;)
+	{
+		AcquireSRWLockExclusive(&mLock);
+		mBusy = FALSE;
+		while (mCount == 0 && !mExit)
+			SleepConditionVariableSRW(&mCond, &mLock, INFINITE, 0);
+		if (mCount == 0)
+		{
+			ReleaseSRWLockExclusive(&mLock);
+			break;
+		}
+		pJob = mJobs[mHead];
+		mHead = (mHead + 1) % JOB_QUEUE_SIZE;
+		mCount--;
+		mBusy = TRUE;
+		ReleaseSRWLockExclusive(&mLock);
+
+		pJob->llStarted = FeGetTimestamp();
+		pJob->pfnRun(pJob);
+		pJob->llFinished = FeGetTimestamp();
+		if (!PostMessageW(gWnd, WM_FE_JOB_DONE, 0, (LPARAM)pJob))
+			pJob->pfnDone(pJob);
+	}
+	return 0;
+}
+
+BOOL FeSubmitJob(FE_JOB* pJob)
+{
+	BOOL bRet = FALSE;
+	AcquireSRWLockExclusive(&mLock);
+	if (!mThread && !mExit)
+		mThread = CreateThread(NULL, 0, JobQueueThread, NULL, 0, NULL);
+	if (mThread && !mExit && mCount < JOB_QUEUE_SIZE)
+	{
+		pJob->uDepth = mCount + (mBusy ? 1 : 0);
+		pJob->llQueued = FeGetTimestamp();
+		mJobs[(mHead + mCount) % JOB_QUEUE_SIZE] = pJob;
+		mCount++;
+		WakeConditionVariable(&mCond);
+		bRet = TRUE;
+	}
+	ReleaseSRWLockExclusive(&mLock);
+	return bRet;
+}
+
+UINT FeGetJobQueueDepth(VOID)
+{
+	UINT uDepth;
+	AcquireSRWLockShared(&mLock);
+	uDepth = mCount + (mBusy ? 1 : 0);
+	ReleaseSRWLockShared(&mLock);
+	return uDepth;
+}
+
+VOID FeCompleteJob(LPARAM lParam)
+{
+	FE_JOB* pJob = (FE_JOB*)lParam;
+	pJob->pfnDone(pJob);
+}
+
+VOID FeStopJobQueue(VOID)
+{
+	HANDLE hThread;
+	AcquireSRWLockExclusive(&mLock);
+	mExit = TRUE;
+	hThread = mThread;
+	mThread = NULL;
+	WakeConditionVariable(&mCond);
+	ReleaseSRWLockExclusive(&mLock);
+	if (!hThread)
+		return;
+	// remaining jobs are drained, their completion runs on the worker once the window is gone
+	WaitForSingleObject(hThread, INFINITE);
+	CloseHandle(hThread);
+}
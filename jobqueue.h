@@ -0,0 +1,37 @@
+﻿// SPDX-License-Identifier: GPL-3.0-or-later
+#pragma once
+
+#include "fe.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+typedef struct _FE_JOB FE_JOB;
+
+/* pfnRun runs on the background thread, pfnDone on the UI thread afterwards */
+typedef VOID (*FE_JOB_PROC)(FE_JOB* pJob);
+
+struct _FE_JOB
+{
+	FE_JOB_PROC pfnRun;
+	FE_JOB_PROC pfnDone;
+	/* jobs ahead of this one, including the running one, at submit time */
+	UINT uDepth;
+	UINT64 llQueued;
+	UINT64 llStarted;
+	UINT64 llFinished;
+};
+
+BOOL FeSubmitJob(FE_JOB* pJob);
+
+UINT FeGetJobQueueDepth(VOID);
+
+VOID FeCompleteJob(LPARAM lParam);
+
+VOID FeStopJobQueue(VOID);
+
+#ifdef __cplusplus
+}
+#endif
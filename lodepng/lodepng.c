@@ -1234,6 +1234,184 @@ static unsigned getTreeInflateDynamic(HuffmanTree* tree_ll, HuffmanTree* tree_d,
   return error;
 }
 
+/*
+The fast inflate loop keeps 64 bits of input in a size_t, so it is only used where size_t has 64 bits.
+It runs while at least 8 input bytes are left, which lets it refill the bit buffer without bounds checks,
+and leaves the end of the block to the loop in inflateHuffmanBlock. corpus_bench_stock defines
+FE_LODEPNG_STOCK_INFLATE to measure the decoder without it.
+*/
+#if (defined(_WIN64) || defined(__LP64__) || defined(_LP64)) && !defined(FE_LODEPNG_STOCK_INFLATE)
+#define LODEPNG_FAST_INFLATE
+#endif
+
+#ifdef LODEPNG_FAST_INFLATE
+#define FAST_INFLATE_MASK ((1u << FIRSTBITS) - 1u)
+/*room for the longest match, plus the 8 byte chunks of a match copy running past its end*/
+#define FAST_INFLATE_RESERVE (258u + 8u)
+
+/*
+Entries of the fast tables combine the symbol with the base and extra bits of a length or distance:
+bits 0-3: code length, 0 if the code is longer than FIRSTBITS and needs the secondary table
+bits 4-7: extra bits
+bits 8-9: 0 literal, 1 length or distance, 2 end code, 3 invalid symbol
+bits 16-31: the literal, the length or distance base, or the error code of an invalid symbol
+*/
+#define FAST_KIND_LITERAL 0u
+#define FAST_KIND_MATCH 1u
+#define FAST_KIND_END 2u
+#define FAST_KIND_INVALID 3u
+
+static unsigned fastEntryLL(unsigned symbol, unsigned len) {
+  if(symbol <= 255) return (symbol << 16u) | len;
+  if(symbol == 256) return (FAST_KIND_END << 8u) | len;
+  if(symbol >= FIRST_LENGTH_CODE_INDEX && symbol <= LAST_LENGTH_CODE_INDEX) {
+    return (LENGTHBASE[symbol - FIRST_LENGTH_CODE_INDEX] << 16u) |
+           (LENGTHEXTRA[symbol - FIRST_LENGTH_CODE_INDEX] << 4u) | (FAST_KIND_MATCH << 8u) | len;
+  }
+  return (16u << 16u) | (FAST_KIND_INVALID << 8u) | len; /*error: tried to read disallowed huffman symbol*/
+}
+
+static unsigned fastEntryD(unsigned symbol, unsigned len) {
+  if(symbol <= 29) return (DISTANCEBASE[symbol] << 16u) | (DISTANCEEXTRA[symbol] << 4u) | (FAST_KIND_MATCH << 8u) | len;
+  /*error: invalid distance code (30-31 are never used), or disallowed huffman symbol*/
+  return ((symbol <= 31 ? 18u : 16u) << 16u) | (FAST_KIND_INVALID << 8u) | len;
+}
+
+static void fastTableMake(unsigned* table, const HuffmanTree* tree, int distance) {
+  unsigned i;
+  for(i = 0; i <= FAST_INFLATE_MASK; ++i) {
+    unsigned l = tree->table_len[i];
+    if(l > FIRSTBITS) table[i] = 0;
+    else if(distance) table[i] = fastEntryD(tree->table_value[i], l);
+    else table[i] = fastEntryLL(tree->table_value[i], l);
+  }
+}
+
+/*the entry of a code longer than FIRSTBITS, like huffmanDecodeSymbol does it*/
+static unsigned fastEntrySlow(const HuffmanTree* tree, size_t bits, int distance) {
+  unsigned code = (unsigned)(bits & FAST_INFLATE_MASK);
+  unsigned l = tree->table_len[code];
+  unsigned index = tree->table_value[code] + (unsigned)((bits >> FIRSTBITS) & ((1u << (l - FIRSTBITS)) - 1u));
+  if(distance) return fastEntryD(tree->table_value[index], tree->table_len[index]);
+  return fastEntryLL(tree->table_value[index], tree->table_len[index]);
+}
+
+static LODEPNG_INLINE size_t fastRead64(const unsigned char* p) {
+  return (size_t)p[0] | ((size_t)p[1] << 8u) | ((size_t)p[2] << 16u) | ((size_t)p[3] << 24u) |
+         ((size_t)p[4] << 32u) | ((size_t)p[5] << 40u) | ((size_t)p[6] << 48u) | ((size_t)p[7] << 56u);
+}
+
+/*decode symbols of the block until its end code or until fewer than 8 input bytes are left*/
+static unsigned inflateHuffmanFast(ucvector* out, LodePNGBitReader* reader, const HuffmanTree* tree_ll,
+                                   const HuffmanTree* tree_d, size_t max_output_size, int* done) {
+  unsigned error = 0;
+  unsigned fast_ll[FAST_INFLATE_MASK + 1];
+  unsigned fast_d[FAST_INFLATE_MASK + 1];
+  const unsigned char* in = reader->data;
+  size_t inpos = reader->bp >> 3u;
+  size_t bits = 0;
+  unsigned bitcount = 0;
+  unsigned drop = (unsigned)(reader->bp & 7u);
+
+  if(inpos + 8u > reader->size) return 0;
+  fastTableMake(fast_ll, tree_ll, 0);
+  fastTableMake(fast_d, tree_d, 1);
+
+  while(inpos + 8u <= reader->size) {
+    unsigned entry, len, extra;
+    size_t length, distance;
+    unsigned char* dst;
+
+    if(out->allocsize - out->size < FAST_INFLATE_RESERVE) {
+      if(!ucvector_reserve(out, out->size + FAST_INFLATE_RESERVE)) ERROR_BREAK(83); /*alloc fail*/
+    }
+    /*refill to 56-63 bits, at least 49 after the first drop. A length code with its distance needs at most
+    15 + 5 + 15 + 13 bits, so one refill covers a whole match*/
+    bits |= fastRead64(in + inpos) << bitcount;
+    inpos += (63u - bitcount) >> 3u;
+    bitcount |= 56u;
+    bits >>= drop;
+    bitcount -= drop;
+    drop = 0;
+
+    entry = fast_ll[bits & FAST_INFLATE_MASK];
+    if(entry != 0 && ((entry >> 8u) & 3u) == FAST_KIND_LITERAL) {
+      /*up to 3 literals of at most FIRSTBITS bits per refill*/
+      len = entry & 15u;
+      bits >>= len;
+      bitcount -= len;
+      out->data[out->size++] = (unsigned char)(entry >> 16u);
+      entry = fast_ll[bits & FAST_INFLATE_MASK];
+      if(entry == 0 || ((entry >> 8u) & 3u) != FAST_KIND_LITERAL) continue;
+      len = entry & 15u;
+      bits >>= len;
+      bitcount -= len;
+      out->data[out->size++] = (unsigned char)(entry >> 16u);
+      entry = fast_ll[bits & FAST_INFLATE_MASK];
+      if(entry == 0 || ((entry >> 8u) & 3u) != FAST_KIND_LITERAL) continue;
+      len = entry & 15u;
+      bits >>= len;
+      bitcount -= len;
+      out->data[out->size++] = (unsigned char)(entry >> 16u);
+      continue;
+    }
+    if(entry == 0) entry = fastEntrySlow(tree_ll, bits, 0);
+    len = entry & 15u;
+    bits >>= len;
+    bitcount -= len;
+    if(((entry >> 8u) & 3u) == FAST_KIND_LITERAL) {
+      out->data[out->size++] = (unsigned char)(entry >> 16u);
+      continue;
+    }
+    if(((entry >> 8u) & 3u) == FAST_KIND_END) {
+      *done = 1;
+      break;
+    }
+    if(((entry >> 8u) & 3u) == FAST_KIND_INVALID) ERROR_BREAK(entry >> 16u);
+
+    extra = (entry >> 4u) & 15u;
+    length = (entry >> 16u) + (unsigned)(bits & ((1u << extra) - 1u));
+    bits >>= extra;
+    bitcount -= extra;
+
+    entry = fast_d[bits & FAST_INFLATE_MASK];
+    if(entry == 0) entry = fastEntrySlow(tree_d, bits, 1);
+    if(((entry >> 8u) & 3u) == FAST_KIND_INVALID) ERROR_BREAK(entry >> 16u);
+    len = entry & 15u;
+    extra = (entry >> 4u) & 15u;
+    bits >>= len;
+    distance = (entry >> 16u) + (unsigned)(bits & ((1u << extra) - 1u));
+    bits >>= extra;
+    bitcount -= len + extra;
+
+    if(distance > out->size) ERROR_BREAK(52); /*too long backward distance*/
+    dst = out->data + out->size;
+    out->size += length;
+    if(distance >= 8) {
+      /*the 8 byte chunks never overlap and may run up to 7 bytes past the match*/
+      const unsigned char* src = dst - distance;
+      unsigned char* end = dst + length;
+      do {
+        lodepng_memcpy(dst, src, 8);
+        dst += 8;
+        src += 8;
+      } while(dst < end);
+    } else if(distance == 1) {
+      lodepng_memset(dst, dst[-1], length);
+    } else {
+      const unsigned char* src = dst - distance;
+      size_t i;
+      for(i = 0; i != length; ++i) dst[i] = src[i];
+    }
+    if(max_output_size && out->size > max_output_size) ERROR_BREAK(109); /*error, larger than max size*/
+  }
+
+  /*give the bits which were read ahead back to the bit reader*/
+  reader->bp = (inpos << 3u) - bitcount + drop;
+  return error;
+}
+#endif /*LODEPNG_FAST_INFLATE*/
+
 /*inflate a block with dynamic of fixed Huffman tree. btype must be 1 or 2.*/
 static unsigned inflateHuffmanBlock(ucvector* out, LodePNGBitReader* reader,
                                     unsigned btype, size_t max_output_size) {
@@ -1251,6 +1429,13 @@ static unsigned inflateHuffmanBlock(ucvector* out, LodePNGBitReader* reader,
   if(btype == 1) error = getTreeInflateFixed(&tree_ll, &tree_d);
   else /*if(btype == 2)*/ error = getTreeInflateDynamic(&tree_ll, &tree_d, reader);
 
+#ifdef LODEPNG_FAST_INFLATE
+  /*the loop below finishes the last bytes of the input*/
+  if(!error) error = inflateHuffmanFast(out, reader, &tree_ll, &tree_d, max_output_size, &done);
+  if(!error && out->allocsize - out->size < reserved_size) {
+    if(!ucvector_reserve(out, out->size + reserved_size)) error = 83; /*alloc fail*/
+  }
+#endif /*LODEPNG_FAST_INFLATE*/
 
   while(!error && !done) /*decode all symbols until end reached, breaks at end code*/ {
     /*code_ll is literal, length or end code*/
@@ -1493,10 +1678,58 @@ typedef struct Hash {
   int* headz; /*similar to head, but for chainz*/
   unsigned short* chainz; /*those with same amount of zeros*/
   unsigned short* zeros; /*length of zeros streak, used as a second hash chain*/
+
+  /*LMF_HASHCHAIN4: the other arrays are not allocated*/
+  struct HashLink* links; /*HASH4_NUM_VALUES heads, followed by the chain of windowsize links*/
+  /*LMF_HASHCHAIN4: link positions at or below base are left from an earlier input and read as empty*/
+  unsigned base;
+  size_t lastsize; /*size of the input of the current use, base moves past it on the next one*/
 } Hash;
 
-static unsigned hash_init(Hash* hash, unsigned windowsize) {
+/*the 4-byte hash of LMF_HASHCHAIN4 uses more bits since collisions are costlier than for 3 bytes*/
+#define HASH4_BITS 15u
+#define HASH4_NUM_VALUES (1u << HASH4_BITS)
+
+/*a link to position pos - 1 (0 if none), key holds the 4 bytes there*/
+typedef struct HashLink {
+  unsigned pos;
+  unsigned key;
+} HashLink;
+
+/*forgets all positions before the tables are used for an input of insize bytes*/
+static void hash_reset(Hash* hash, unsigned windowsize, size_t insize) {
   unsigned i;
+  if(hash->links) {
+    /*every position of the last use is at most base + lastsize, so moving base past them is enough.
+    Only when the positions would wrap around the heads are cleared, a chain link is always written
+    before it is followed*/
+    if(hash->lastsize < 0xffffffffu - hash->base && insize <= 0xffffffffu - hash->base - hash->lastsize) {
+      hash->base += (unsigned)hash->lastsize;
+    } else {
+      lodepng_memset(hash->links, 0, sizeof(HashLink) * HASH4_NUM_VALUES);
+      hash->base = 0;
+    }
+    hash->lastsize = insize;
+    return;
+  }
+
+  /*initialize hash table*/
+  for(i = 0; i != HASH_NUM_VALUES; ++i) hash->head[i] = -1;
+  for(i = 0; i != windowsize; ++i) hash->val[i] = -1;
+  for(i = 0; i != windowsize; ++i) hash->chain[i] = i; /*same value as index indicates uninitialized*/
+
+  for(i = 0; i <= MAX_SUPPORTED_DEFLATE_LENGTH; ++i) hash->headz[i] = -1;
+  for(i = 0; i != windowsize; ++i) hash->chainz[i] = i; /*same value as index indicates uninitialized*/
+}
+
+static unsigned hash_init(Hash* hash, unsigned windowsize, unsigned matcher) {
+  lodepng_memset(hash, 0, sizeof(*hash));
+  if(matcher == LMF_HASHCHAIN4) {
+    hash->links = (HashLink*)lodepng_malloc(sizeof(HashLink) * (HASH4_NUM_VALUES + windowsize));
+    if(!hash->links) return 83; /*alloc fail*/
+    lodepng_memset(hash->links, 0, sizeof(HashLink) * HASH4_NUM_VALUES);
+    return 0;
+  }
   hash->head = (int*)lodepng_malloc(sizeof(int) * HASH_NUM_VALUES);
   hash->val = (int*)lodepng_malloc(sizeof(int) * windowsize);
   hash->chain = (unsigned short*)lodepng_malloc(sizeof(unsigned short) * windowsize);
@@ -1509,18 +1742,12 @@ static unsigned hash_init(Hash* hash, unsigned windowsize) {
     return 83; /*alloc fail*/
   }
 
-  /*initialize hash table*/
-  for(i = 0; i != HASH_NUM_VALUES; ++i) hash->head[i] = -1;
-  for(i = 0; i != windowsize; ++i) hash->val[i] = -1;
-  for(i = 0; i != windowsize; ++i) hash->chain[i] = i; /*same value as index indicates uninitialized*/
-
-  for(i = 0; i <= MAX_SUPPORTED_DEFLATE_LENGTH; ++i) hash->headz[i] = -1;
-  for(i = 0; i != windowsize; ++i) hash->chainz[i] = i; /*same value as index indicates uninitialized*/
-
+  hash_reset(hash, windowsize, 0);
   return 0;
 }
 
 static void hash_cleanup(Hash* hash) {
+  lodepng_free(hash->links);
   lodepng_free(hash->head);
   lodepng_free(hash->val);
   lodepng_free(hash->chain);
@@ -1572,6 +1799,46 @@ static void updateHashChain(Hash* hash, size_t wpos, unsigned hashval, unsigned
   hash->headz[numzeros] = (int)wpos;
 }
 
+static unsigned readKey4(const unsigned char* data) {
+  return (unsigned)data[0] | ((unsigned)data[1] << 8u) | ((unsigned)data[2] << 16u) | ((unsigned)data[3] << 24u);
+}
+
+static unsigned getHash4(unsigned key) {
+  /*multiplicative hash, the top bits are the best mixed*/
+  return (unsigned)((key * 2654435761u) & 0xffffffffu) >> (32u - HASH4_BITS);
+}
+
+/*inserts pos, which must have 4 bytes of input from it on, into the LMF_HASHCHAIN4 chains*/
+static void updateHash4(Hash* hash, const unsigned char* in, size_t pos, unsigned windowsize) {
+  HashLink* head;
+  unsigned key = readKey4(&in[pos]);
+  head = &hash->links[getHash4(key)];
+  hash->links[HASH4_NUM_VALUES + (pos & (windowsize - 1))] = *head;
+  head->pos = (unsigned)pos + 1u + hash->base;
+  head->key = key;
+}
+
+/*Inserts the positions [inpos, inend) into the hash chains without encoding them, so that
+the data before the start of a partial deflate stream can be used as dictionary.*/
+static void hash_prime(Hash* hash, const unsigned char* in, size_t inpos, size_t inend, unsigned windowsize) {
+  size_t pos;
+  unsigned numzeros = 0;
+  if(hash->links) {
+    for(pos = inpos; pos + 4 <= inend; ++pos) updateHash4(hash, in, pos, windowsize);
+    return;
+  }
+  for(pos = inpos; pos < inend; ++pos) {
+    unsigned hashval = getHash(in, inend, pos);
+    if(hashval == 0) {
+      if(numzeros == 0) numzeros = countZeros(in, inend, pos);
+      else if(pos + numzeros > inend || in[pos + numzeros - 1] != 0) --numzeros;
+    } else {
+      numzeros = 0;
+    }
+    updateHashChain(hash, pos & (windowsize - 1), hashval, (unsigned short)numzeros);
+  }
+}
+
 /*
 LZ77-encode the data. Return value is error code. The input are raw bytes, the output
 is in the form of unsigned integers with codes representing for example literal bytes, or
@@ -1730,20 +1997,141 @@ static unsigned encodeLZ77(uivector* out, Hash* hash,
   return error;
 }
 
+/*length of the match between in[pos] and in[pos - distance], at most maxlength*/
+static unsigned matchLength(const unsigned char* in, size_t pos, size_t distance, unsigned maxlength) {
+  const unsigned char* foreptr = &in[pos];
+  const unsigned char* backptr = &in[pos - distance];
+  const unsigned char* lastptr = foreptr + maxlength;
+  while(foreptr != lastptr && *backptr == *foreptr) {
+    ++backptr;
+    ++foreptr;
+  }
+  return (unsigned)(foreptr - &in[pos]);
+}
+
+/*longest match at pos for LMF_HASHCHAIN4, pos must not be inserted yet. Returns the length, 0 if none*/
+static unsigned findMatch4(const Hash* hash, const unsigned char* in, size_t pos, size_t insize,
+                           unsigned windowsize, unsigned chainlength, unsigned nicematch,
+                           unsigned longrange, unsigned* distance) {
+  unsigned key = readKey4(&in[pos]);
+  unsigned maxlength = insize - pos < MAX_SUPPORTED_DEFLATE_LENGTH ?
+                       (unsigned)(insize - pos) : MAX_SUPPORTED_DEFLATE_LENGTH;
+  unsigned length = 0;
+  const HashLink* link = &hash->links[getHash4(key)];
+  size_t prevpos = pos;
+
+  if(nicematch > maxlength) nicematch = maxlength;
+  *distance = 0;
+  while(chainlength-- != 0 && link->pos > hash->base) {
+    size_t linkpos = (size_t)(link->pos - hash->base) - 1u;
+    /*links only point backwards, anything else was overwritten by a newer position*/
+    if(linkpos >= prevpos || pos - linkpos > windowsize) break;
+    if(link->key == key) {
+      unsigned current = matchLength(in, pos, pos - linkpos, maxlength);
+      if(current > length) {
+        length = current;
+        *distance = (unsigned)(pos - linkpos);
+        if(length >= nicematch) break;
+      }
+    }
+    prevpos = linkpos;
+    link = &hash->links[HASH4_NUM_VALUES + (linkpos & (windowsize - 1))];
+  }
+  /*the chain runs from near to far, so the long range distance only wins when it is strictly longer.
+  It is not limited by windowsize, which only sizes the chains, the input before pos is all there*/
+  if(length < nicematch && longrange != 0 && longrange <= 32768 && longrange <= pos
+     && readKey4(&in[pos - longrange]) == key) {
+    unsigned current = matchLength(in, pos, longrange, maxlength);
+    if(current > length) {
+      length = current;
+      *distance = longrange;
+    }
+  }
+  return length;
+}
+
+/*
+LZ77-encode the data with LMF_HASHCHAIN4, same output format as encodeLZ77. Only matches
+of 4 bytes or more are found, in exchange a candidate costs one compare of the key kept in
+the link instead of a walk over the input.
+*/
+static unsigned encodeLZ77Chain4(uivector* out, Hash* hash,
+                                 const unsigned char* in, size_t inpos, size_t insize,
+                                 const LodePNGCompressSettings* settings) {
+  size_t pos, end;
+  unsigned i;
+  unsigned windowsize = settings->windowsize;
+  unsigned chainlength = settings->chainlength;
+  unsigned nicematch = settings->nicematch;
+  unsigned minmatch = settings->minmatch < 4 ? 4 : settings->minmatch;
+  unsigned length, distance;
+
+  if(windowsize == 0 || windowsize > 32768) return 60; /*error: windowsize smaller/larger than allowed*/
+  if((windowsize & (windowsize - 1)) != 0) return 90; /*error: must be power of two*/
+  if(chainlength == 0) chainlength = windowsize >= 8192 ? 1024 : windowsize / 8u;
+  if(chainlength == 0) chainlength = 1;
+  if(nicematch > MAX_SUPPORTED_DEFLATE_LENGTH) nicematch = MAX_SUPPORTED_DEFLATE_LENGTH;
+
+  /*the last 3 bytes have no key of their own and are always literals*/
+  end = insize >= 3 ? insize - 3 : 0;
+  for(pos = inpos; pos < end; ++pos) {
+    length = findMatch4(hash, in, pos, insize, windowsize, chainlength, nicematch, settings->longrange, &distance);
+    updateHash4(hash, in, pos, windowsize);
+
+    if(settings->lazymatching && length >= minmatch && length < nicematch && pos + 1 < end) {
+      unsigned lazydistance;
+      unsigned lazylength = findMatch4(hash, in, pos + 1, insize, windowsize, chainlength, nicematch,
+                                       settings->longrange, &lazydistance);
+      if(lazylength > length) {
+        /*the next position has the better match, emit this byte as literal*/
+        if(!uivector_push_back(out, in[pos])) return 83; /*alloc fail*/
+        ++pos;
+        updateHash4(hash, in, pos, windowsize);
+        length = lazylength;
+        distance = lazydistance;
+      }
+    }
+
+    if(length < minmatch) {
+      if(!uivector_push_back(out, in[pos])) return 83; /*alloc fail*/
+      continue;
+    }
+    addLengthDistance(out, length, distance);
+    for(i = 1; i < length; ++i) {
+      ++pos;
+      if(pos < end) updateHash4(hash, in, pos, windowsize);
+    }
+  }
+  for(; pos < insize; ++pos) {
+    if(!uivector_push_back(out, in[pos])) return 83; /*alloc fail*/
+  }
+  return 0;
+}
+
+static unsigned encodeLZ77Settings(uivector* out, Hash* hash,
+                                   const unsigned char* in, size_t inpos, size_t insize,
+                                   const LodePNGCompressSettings* settings) {
+  if(hash->links) return encodeLZ77Chain4(out, hash, in, inpos, insize, settings);
+  return encodeLZ77(out, hash, in, inpos, insize, settings->windowsize,
+                    settings->minmatch, settings->nicematch, settings->lazymatching);
+}
+
 /* /////////////////////////////////////////////////////////////////////////// */
 
-static unsigned deflateNoCompression(ucvector* out, const unsigned char* data, size_t datasize) {
+static unsigned deflateNoCompression(ucvector* out, const unsigned char* data, size_t datasize,
+                                     unsigned final) {
   /*non compressed deflate block data: 1 bit BFINAL,2 bits BTYPE,(5 bits): it jumps to start of next byte,
   2 bytes LEN, 2 bytes NLEN, LEN bytes literal DATA*/
 
   size_t i, numdeflateblocks = (datasize + 65534u) / 65535u;
   unsigned datapos = 0;
+  if(numdeflateblocks == 0) numdeflateblocks = 1; /*an empty stream still needs its final block*/
   for(i = 0; i != numdeflateblocks; ++i) {
     unsigned BFINAL, BTYPE, LEN, NLEN;
     unsigned char firstbyte;
     size_t pos = out->size;
 
-    BFINAL = (i == numdeflateblocks - 1);
+    BFINAL = final && (i == numdeflateblocks - 1);
     BTYPE = 0;
 
     LEN = 65535;
@@ -1856,8 +2244,7 @@ static unsigned deflateDynamic(LodePNGBitWriter* writer, Hash* hash,
     lodepng_memset(frequencies_cl, 0, NUM_CODE_LENGTH_CODES * sizeof(*frequencies_cl));
 
     if(settings->use_lz77) {
-      error = encodeLZ77(&lz77_encoded, hash, data, datapos, dataend, settings->windowsize,
-                         settings->minmatch, settings->nicematch, settings->lazymatching);
+      error = encodeLZ77Settings(&lz77_encoded, hash, data, datapos, dataend, settings);
       if(error) break;
     } else {
       if(!uivector_resize(&lz77_encoded, datasize)) ERROR_BREAK(83 /*alloc fail*/);
@@ -2042,8 +2429,7 @@ static unsigned deflateFixed(LodePNGBitWriter* writer, Hash* hash,
     if(settings->use_lz77) /*LZ77 encoded*/ {
       uivector lz77_encoded;
       uivector_init(&lz77_encoded);
-      error = encodeLZ77(&lz77_encoded, hash, data, datapos, dataend, settings->windowsize,
-                         settings->minmatch, settings->nicematch, settings->lazymatching);
+      error = encodeLZ77Settings(&lz77_encoded, hash, data, datapos, dataend, settings);
       if(!error) writeLZ77data(writer, &lz77_encoded, &tree_ll, &tree_d);
       uivector_cleanup(&lz77_encoded);
     } else /*no LZ77, but still will be Huffman compressed*/ {
@@ -2062,47 +2448,109 @@ static unsigned deflateFixed(LodePNGBitWriter* writer, Hash* hash,
   return error;
 }
 
-static unsigned lodepng_deflatev(ucvector* out, const unsigned char* in, size_t insize,
-                                 const LodePNGCompressSettings* settings) {
+struct LodePNGHash {
+  Hash hash;
+  unsigned windowsize;
+  unsigned chain4; /*whether the tables are those of LMF_HASHCHAIN4*/
+};
+
+LodePNGHash* lodepng_hash_new(unsigned windowsize, unsigned matcher) {
+  LodePNGHash* cache;
+  if(windowsize == 0 || windowsize > 32768 || (windowsize & (windowsize - 1)) != 0) return 0;
+  cache = (LodePNGHash*)lodepng_malloc(sizeof(LodePNGHash));
+  if(!cache) return 0;
+  cache->windowsize = windowsize;
+  cache->chain4 = (matcher == LMF_HASHCHAIN4);
+  if(hash_init(&cache->hash, windowsize, matcher)) {
+    lodepng_hash_delete(cache);
+    return 0;
+  }
+  return cache;
+}
+
+void lodepng_hash_delete(LodePNGHash* cache) {
+  if(!cache) return;
+  hash_cleanup(&cache->hash);
+  lodepng_free(cache);
+}
+
+/*deflates in[inpos..insize), see lodepng_deflate_part. Uses the tables of cache if they fit the settings*/
+static unsigned lodepng_deflatev_part(ucvector* out, const unsigned char* in, size_t inpos, size_t insize,
+                                      const LodePNGCompressSettings* settings, unsigned final,
+                                      LodePNGHash* cache) {
   unsigned error = 0;
   size_t i, blocksize, numdeflateblocks;
-  Hash hash;
+  size_t datasize = insize - inpos;
+  Hash local;
+  Hash* hash = &local;
   LodePNGBitWriter writer;
 
   LodePNGBitWriter_init(&writer, out);
 
+  if(inpos > insize) return 114; /*invalid range*/
   if(settings->btype > 2) return 61;
-  else if(settings->btype == 0) return deflateNoCompression(out, in, insize);
-  else if(settings->btype == 1) blocksize = insize;
+  else if(settings->btype == 0) return deflateNoCompression(out, in + inpos, datasize, final);
+  else if(settings->btype == 1) blocksize = datasize;
   else /*if(settings->btype == 2)*/ {
     /*on PNGs, deflate blocks of 65-262k seem to give most dense encoding*/
-    blocksize = insize / 8u + 8;
+    blocksize = datasize / 8u + 8;
     if(blocksize < 65536) blocksize = 65536;
     if(blocksize > 262144) blocksize = 262144;
   }
 
-  numdeflateblocks = (insize + blocksize - 1) / blocksize;
+  numdeflateblocks = (datasize + blocksize - 1) / blocksize;
   if(numdeflateblocks == 0) numdeflateblocks = 1;
 
-  error = hash_init(&hash, settings->windowsize);
+  if(cache && cache->windowsize == settings->windowsize
+     && cache->chain4 == (settings->matcher == LMF_HASHCHAIN4)) {
+    hash = &cache->hash;
+    hash_reset(hash, settings->windowsize, insize);
+  } else {
+    error = hash_init(&local, settings->windowsize, settings->matcher);
+  }
+
+  if(!error && inpos > 0) {
+    /*the window before inpos acts as dictionary*/
+    size_t dictstart = inpos > settings->windowsize ? inpos - settings->windowsize : 0;
+    hash_prime(hash, in, dictstart, inpos, settings->windowsize);
+  }
 
   if(!error) {
     for(i = 0; i != numdeflateblocks && !error; ++i) {
-      unsigned final = (i == numdeflateblocks - 1);
-      size_t start = i * blocksize;
+      unsigned lastblock = (i == numdeflateblocks - 1);
+      size_t start = inpos + i * blocksize;
       size_t end = start + blocksize;
       if(end > insize) end = insize;
 
-      if(settings->btype == 1) error = deflateFixed(&writer, &hash, in, start, end, settings, final);
-      else if(settings->btype == 2) error = deflateDynamic(&writer, &hash, in, start, end, settings, final);
+      if(settings->btype == 1) error = deflateFixed(&writer, hash, in, start, end, settings, final && lastblock);
+      else if(settings->btype == 2) error = deflateDynamic(&writer, hash, in, start, end, settings, final && lastblock);
+    }
+  }
+
+  if(!error && !final) {
+    /*sync flush: an empty non-final stored block brings the stream to a byte boundary*/
+    size_t pos;
+    writeBits(&writer, 0, 3);
+    pos = out->size;
+    if(!ucvector_resize(out, pos + 4)) error = 83; /*alloc fail*/
+    else {
+      out->data[pos + 0] = 0;
+      out->data[pos + 1] = 0;
+      out->data[pos + 2] = 255;
+      out->data[pos + 3] = 255;
     }
   }
 
-  hash_cleanup(&hash);
+  if(hash == &local) hash_cleanup(&local);
 
   return error;
 }
 
+static unsigned lodepng_deflatev(ucvector* out, const unsigned char* in, size_t insize,
+                                 const LodePNGCompressSettings* settings) {
+  return lodepng_deflatev_part(out, in, 0, insize, settings, 1, 0);
+}
+
 unsigned lodepng_deflate(unsigned char** out, size_t* outsize,
                          const unsigned char* in, size_t insize,
                          const LodePNGCompressSettings* settings) {
@@ -2113,6 +2561,23 @@ unsigned lodepng_deflate(unsigned char** out, size_t* outsize,
   return error;
 }
 
+unsigned lodepng_deflate_part(unsigned char** out, size_t* outsize,
+                              const unsigned char* in, size_t inpos, size_t insize,
+                              const LodePNGCompressSettings* settings, unsigned final) {
+  return lodepng_deflate_part_hash(out, outsize, in, inpos, insize, settings, final, 0);
+}
+
+unsigned lodepng_deflate_part_hash(unsigned char** out, size_t* outsize,
+                                   const unsigned char* in, size_t inpos, size_t insize,
+                                   const LodePNGCompressSettings* settings, unsigned final,
+                                   LodePNGHash* hash) {
+  ucvector v = ucvector_init(*out, *outsize);
+  unsigned error = lodepng_deflatev_part(&v, in, inpos, insize, settings, final, hash);
+  *out = v.data;
+  *outsize = v.size;
+  return error;
+}
+
 static unsigned deflate(unsigned char** out, size_t* outsize,
                         const unsigned char* in, size_t insize,
                         const LodePNGCompressSettings* settings) {
@@ -2131,6 +2596,7 @@ static unsigned deflate(unsigned char** out, size_t* outsize,
 /* / Adler32                                                                / */
 /* ////////////////////////////////////////////////////////////////////////// */
 
+#ifndef LODEPNG_NO_COMPILE_ADLER32
 static unsigned update_adler32(unsigned adler, const unsigned char* data, unsigned len) {
   unsigned s1 = adler & 0xffffu;
   unsigned s2 = (adler >> 16u) & 0xffffu;
@@ -2150,6 +2616,14 @@ static unsigned update_adler32(unsigned adler, const unsigned char* data, unsign
 
   return (s2 << 16u) | s1;
 }
+#else /* !LODEPNG_NO_COMPILE_ADLER32 */
+/*Update the running adler32 (initially 1) with the bytes data[0..length-1].*/
+unsigned lodepng_update_adler32(unsigned adler, const unsigned char* data, size_t length);
+
+static unsigned update_adler32(unsigned adler, const unsigned char* data, unsigned len) {
+  return lodepng_update_adler32(adler, data, len);
+}
+#endif /* !LODEPNG_NO_COMPILE_ADLER32 */
 
 /*Return the adler32 of the bytes data[0..len-1]*/
 static unsigned adler32(const unsigned char* data, unsigned len) {
@@ -2228,8 +2702,8 @@ static unsigned zlib_decompress(unsigned char** out, size_t* outsize, size_t exp
   } else {
     ucvector v = ucvector_init(*out, *outsize);
     if(expected_size) {
-      /*reserve the memory to avoid intermediate reallocations*/
-      ucvector_resize(&v, *outsize + expected_size);
+      /*reserve the memory to avoid intermediate reallocations, inflate wants room for a match past the end*/
+      ucvector_resize(&v, *outsize + expected_size + 266u);
       v.size = *outsize;
     }
     error = lodepng_zlib_decompressv(&v, in, insize, settings);
@@ -2329,13 +2803,17 @@ void lodepng_compress_settings_init(LodePNGCompressSettings* settings) {
   settings->minmatch = 3;
   settings->nicematch = 128;
   settings->lazymatching = 1;
+  settings->matcher = LMF_HASH3;
+  settings->chainlength = 0;
+  settings->longrange = 0;
 
   settings->custom_zlib = 0;
   settings->custom_deflate = 0;
   settings->custom_context = 0;
 }
 
-const LodePNGCompressSettings lodepng_default_compress_settings = {2, 1, DEFAULT_WINDOWSIZE, 3, 128, 1, 0, 0, 0};
+const LodePNGCompressSettings lodepng_default_compress_settings = {2, 1, DEFAULT_WINDOWSIZE, 3, 128, 1, LMF_HASH3, 0, 0,
+                                                                  0, 0, 0};
 
 
 #endif /*LODEPNG_COMPILE_ENCODER*/
@@ -4089,6 +4567,13 @@ unsigned lodepng_inspect(unsigned* w, unsigned* h, LodePNGState* state,
   return state->error;
 }
 
+#ifdef LODEPNG_CUSTOM_UNFILTER
+/*Unfilter a scanline like unfilterScanline does. Return 1 if recon was written, 0 to leave the
+scanline to the code below, which must be the case for invalid filter types.*/
+unsigned lodepng_unfilter_scanline(unsigned char* recon, const unsigned char* scanline, const unsigned char* precon,
+                                   size_t bytewidth, unsigned char filterType, size_t length);
+#endif /*LODEPNG_CUSTOM_UNFILTER*/
+
 static unsigned unfilterScanline(unsigned char* recon, const unsigned char* scanline, const unsigned char* precon,
                                  size_t bytewidth, unsigned char filterType, size_t length) {
   /*
@@ -4101,6 +4586,9 @@ static unsigned unfilterScanline(unsigned char* recon, const unsigned char* scan
   */
 
   size_t i;
+#ifdef LODEPNG_CUSTOM_UNFILTER
+  if(filterType != 0 && lodepng_unfilter_scanline(recon, scanline, precon, bytewidth, filterType, length)) return 0;
+#endif /*LODEPNG_CUSTOM_UNFILTER*/
   switch(filterType) {
     case 0:
       for(i = 0; i != length; ++i) recon[i] = scanline[i];
@@ -5465,6 +5953,84 @@ static size_t ilog2i(size_t i) {
   return i * l + ((i - (1u << l)) << 1u);
 }
 
+#ifdef LODEPNG_CUSTOM_FILTER
+/*Filter a scanline like lodepng_filter_scanline does, writing the filter type byte to out[0]. Return 1
+if out was written, 0 to leave the scanline to lodepng_filter_scanline. The chosen filter type must be
+the one lodepng_filter_scanline would choose.*/
+unsigned lodepng_custom_filter_scanline(unsigned char* out, const unsigned char* scanline,
+                                        const unsigned char* prevline, size_t length, size_t bytewidth,
+                                        LodePNGFilterStrategy strategy);
+#endif /*LODEPNG_CUSTOM_FILTER*/
+
+unsigned char lodepng_filter_scanline(unsigned char* out, const unsigned char* scanline,
+                                      const unsigned char* prevline, size_t length, size_t bytewidth,
+                                      LodePNGFilterStrategy strategy, unsigned char* attempt[5]) {
+  size_t x;
+  unsigned char type, bestType = 0;
+
+#ifdef LODEPNG_CUSTOM_FILTER
+  if(lodepng_custom_filter_scanline(out, scanline, prevline, length, bytewidth, strategy)) return out[0];
+#endif /*LODEPNG_CUSTOM_FILTER*/
+
+  if(strategy == LFS_MINSUM) {
+    size_t smallest = 0;
+    /*try the 5 filter types*/
+    for(type = 0; type != 5; ++type) {
+      size_t sum = 0;
+      filterScanline(attempt[type], scanline, prevline, length, bytewidth, type);
+
+      /*calculate the sum of the result*/
+      if(type == 0) {
+        for(x = 0; x != length; ++x) sum += (unsigned char)(attempt[type][x]);
+      } else {
+        for(x = 0; x != length; ++x) {
+          /*For differences, each byte should be treated as signed, values above 127 are negative
+          (converted to signed char). Filtertype 0 isn't a difference though, so use unsigned there.
+          This means filtertype 0 is almost never chosen, but that is justified.*/
+          unsigned char s = attempt[type][x];
+          sum += s < 128 ? s : (255U - s);
+        }
+      }
+
+      /*check if this is smallest sum (or if type == 0 it's the first case so always store the values)*/
+      if(type == 0 || sum < smallest) {
+        bestType = type;
+        smallest = sum;
+      }
+    }
+  } else if(strategy == LFS_ENTROPY) {
+    size_t bestSum = 0;
+    unsigned count[256];
+    /*try the 5 filter types*/
+    for(type = 0; type != 5; ++type) {
+      size_t sum = 0;
+      filterScanline(attempt[type], scanline, prevline, length, bytewidth, type);
+      lodepng_memset(count, 0, 256 * sizeof(*count));
+      for(x = 0; x != length; ++x) ++count[attempt[type][x]];
+      ++count[type]; /*the filter type itself is part of the scanline*/
+      for(x = 0; x != 256; ++x) {
+        sum += ilog2i(count[x]);
+      }
+      /*check if this is smallest sum (or if type == 0 it's the first case so always store the values)*/
+      if(type == 0 || sum > bestSum) {
+        bestType = type;
+        bestSum = sum;
+      }
+    }
+  } else {
+    /*fixed filter type, other strategies are not supported per scanline and use filter type 0*/
+    type = (strategy >= LFS_ZERO && strategy <= LFS_FOUR) ? (unsigned char)strategy : 0;
+    out[0] = type;
+    filterScanline(&out[1], scanline, prevline, length, bytewidth, type);
+    return type;
+  }
+
+  /*now fill the out values*/
+  out[0] = bestType; /*the first byte of a scanline will be the filter type*/
+  lodepng_memcpy(&out[1], attempt[bestType], length);
+  return bestType;
+}
+
 static unsigned filter(unsigned char* out, const unsigned char* in, unsigned w, unsigned h,
                        const LodePNGColorMode* color, const LodePNGEncoderSettings* settings) {
   /*
@@ -5511,58 +6077,10 @@ static unsigned filter(unsigned char* out, const unsigned char* in, unsigned w,
       filterScanline(&out[outindex + 1], &in[inindex], prevline, linebytes, bytewidth, type);
       prevline = &in[inindex];
     }
-  } else if(strategy == LFS_MINSUM) {
+  } else if(strategy == LFS_MINSUM || strategy == LFS_ENTROPY) {
     /*adaptive filtering*/
     unsigned char* attempt[5]; /*five filtering attempts, one for each filter type*/
-    size_t smallest = 0;
-    unsigned char type, bestType = 0;
-
-    for(type = 0; type != 5; ++type) {
-      attempt[type] = (unsigned char*)lodepng_malloc(linebytes);
-      if(!attempt[type]) error = 83; /*alloc fail*/
-    }
-
-    if(!error) {
-      for(y = 0; y != h; ++y) {
-        /*try the 5 filter types*/
-        for(type = 0; type != 5; ++type) {
-          size_t sum = 0;
-          filterScanline(attempt[type], &in[y * linebytes], prevline, linebytes, bytewidth, type);
-
-          /*calculate the sum of the result*/
-          if(type == 0) {
-            for(x = 0; x != linebytes; ++x) sum += (unsigned char)(attempt[type][x]);
-          } else {
-            for(x = 0; x != linebytes; ++x) {
-              /*For differences, each byte should be treated as signed, values above 127 are negative
-              (converted to signed char). Filtertype 0 isn't a difference though, so use unsigned there.
-              This means filtertype 0 is almost never chosen, but that is justified.*/
-              unsigned char s = attempt[type][x];
-              sum += s < 128 ? s : (255U - s);
-            }
-          }
-
-          /*check if this is smallest sum (or if type == 0 it's the first case so always store the values)*/
-          if(type == 0 || sum < smallest) {
-            bestType = type;
-            smallest = sum;
-          }
-        }
-
-        prevline = &in[y * linebytes];
-
-        /*now fill the out values*/
-        out[y * (linebytes + 1)] = bestType; /*the first byte of a scanline will be the filter type*/
-        for(x = 0; x != linebytes; ++x) out[y * (linebytes + 1) + 1 + x] = attempt[bestType][x];
-      }
-    }
-
-    for(type = 0; type != 5; ++type) lodepng_free(attempt[type]);
-  } else if(strategy == LFS_ENTROPY) {
-    unsigned char* attempt[5]; /*five filtering attempts, one for each filter type*/
-    size_t bestSum = 0;
-    unsigned type, bestType = 0;
-    unsigned count[256];
+    unsigned char type;
 
     for(type = 0; type != 5; ++type) {
       attempt[type] = (unsigned char*)lodepng_malloc(linebytes);
@@ -5571,28 +6089,9 @@ static unsigned filter(unsigned char* out, const unsigned char* in, unsigned w,
 
     if(!error) {
       for(y = 0; y != h; ++y) {
-        /*try the 5 filter types*/
-        for(type = 0; type != 5; ++type) {
-          size_t sum = 0;
-          filterScanline(attempt[type], &in[y * linebytes], prevline, linebytes, bytewidth, type);
-          lodepng_memset(count, 0, 256 * sizeof(*count));
-          for(x = 0; x != linebytes; ++x) ++count[attempt[type][x]];
-          ++count[type]; /*the filter type itself is part of the scanline*/
-          for(x = 0; x != 256; ++x) {
-            sum += ilog2i(count[x]);
-          }
-          /*check if this is smallest sum (or if type == 0 it's the first case so always store the values)*/
-          if(type == 0 || sum > bestSum) {
-            bestType = type;
-            bestSum = sum;
-          }
-        }
-
+        lodepng_filter_scanline(&out[y * (linebytes + 1)], &in[y * linebytes], prevline,
+                                linebytes, bytewidth, strategy, attempt);
         prevline = &in[y * linebytes];
-
-        /*now fill the out values*/
-        out[y * (linebytes + 1)] = bestType; /*the first byte of a scanline will be the filter type*/
-        for(x = 0; x != linebytes; ++x) out[y * (linebytes + 1) + 1 + x] = attempt[bestType][x];
       }
     }
 
@@ -6282,6 +6781,7 @@ const char* lodepng_error_text(unsigned code) {
     /*max ICC size limit can be configured in LodePNGDecoderSettings. This error prevents
     unreasonable memory consumption when decoding due to impossibly large ICC profile*/
     case 113: return "ICC profile unreasonably large";
+    case 114: return "start position of partial deflate data is beyond its end";
   }
   return "unknown error code";
 }
@@ -28,9 +28,23 @@ freely, subject to the following restrictions:
 
 #include <string.h> /*for size_t*/
 
+/*fe only encodes, the Linux tests define FE_LODEPNG_DECODER to check what it writes*/
+#ifndef FE_LODEPNG_DECODER
 #define LODEPNG_NO_COMPILE_DECODER
+#endif
 #define LODEPNG_NO_COMPILE_DISK
 #define LODEPNG_NO_COMPILE_ERROR_TEXT
+#define LODEPNG_NO_COMPILE_CRC
+#define LODEPNG_NO_COMPILE_ADLER32
+/*test_filter builds a second lodepng with FE_LODEPNG_SCALAR_FILTER to compare against,
+corpus_bench_scalar one with FE_LODEPNG_SCALAR_UNFILTER to measure the decoder without the hook*/
+#ifndef FE_LODEPNG_SCALAR_UNFILTER
+#define LODEPNG_CUSTOM_UNFILTER
+#endif
+#ifndef FE_LODEPNG_SCALAR_FILTER
+#define LODEPNG_CUSTOM_FILTER
+#endif
+#define LODEPNG_NO_COMPILE_ALLOCATORS
 
 extern const char* LODEPNG_VERSION_STRING;
 
@@ -41,7 +55,11 @@ The "NO_COMPILE" defines are designed to be used to pass as defines to the
 compiler command to disable them without modifying this header, e.g.
 -DLODEPNG_NO_COMPILE_ZLIB for gcc.
 In addition to those below, you can also define LODEPNG_NO_COMPILE_CRC to
-allow implementing a custom lodepng_crc32.
+allow implementing a custom lodepng_crc32, LODEPNG_NO_COMPILE_ADLER32 to
+allow implementing a custom lodepng_update_adler32, LODEPNG_CUSTOM_UNFILTER
+to let a custom lodepng_unfilter_scanline take scanlines before the decoder,
+and LODEPNG_CUSTOM_FILTER to let a custom lodepng_custom_filter_scanline take
+scanlines before lodepng_filter_scanline.
 */
 /*deflate & zlib. If disabled, you must specify alternative zlib functions in
 the custom_zlib field of the compress and decompress settings*/
@@ -329,6 +347,15 @@ void lodepng_decompress_settings_init(LodePNGDecompressSettings* settings);
 Settings for zlib compression. Tweaking these settings tweaks the balance
 between speed and compression ratio.
 */
+/*The LZ77 match finders of the encoder*/
+typedef enum LodePNGMatchFinder {
+  /*hash of 3 bytes plus a second chain for runs of zeros, the original lodepng matcher*/
+  LMF_HASH3 = 0,
+  /*hash of 4 bytes, each link stores the 4 bytes it points to so most candidates are
+  rejected without touching the input, the chain walk is bounded by chainlength*/
+  LMF_HASHCHAIN4 = 1
+} LodePNGMatchFinder;
+
 typedef struct LodePNGCompressSettings LodePNGCompressSettings;
 struct LodePNGCompressSettings /*deflate = compress*/ {
   /*LZ77 related settings*/
@@ -338,6 +365,13 @@ struct LodePNGCompressSettings /*deflate = compress*/ {
   unsigned minmatch; /*minimum lz77 length. 3 is normally best, 6 can be better for some PNGs. Default: 0*/
   unsigned nicematch; /*stop searching if >= this length found. Set to 258 for best compression. Default: 128*/
   unsigned lazymatching; /*use lazy matching: better compression but a bit slower. Default: true*/
+  unsigned matcher; /*LodePNGMatchFinder used for LZ77. Default: LMF_HASH3*/
+  /*LMF_HASHCHAIN4 only: maximum candidates tried per position, 0 to derive it from windowsize. Default: 0*/
+  unsigned chainlength;
+  /*LMF_HASHCHAIN4 only: distance that is also tried when the hash chain gives up, e.g. the
+  length of a filtered scanline to catch repeated rows. It may exceed windowsize, since it
+  reads the input directly, but not 32768. 0 disables it. Default: 0*/
+  unsigned longrange;
 
   /*use custom zlib encoder instead of built in one (default: null)*/
   unsigned (*custom_zlib)(unsigned char**, size_t*,
@@ -785,6 +819,18 @@ typedef struct LodePNGEncoderSettings {
 } LodePNGEncoderSettings;
 
 void lodepng_encoder_settings_init(LodePNGEncoderSettings* settings);
+
+/*
+Filters a single scanline of a non-interlaced image with bitdepth 8 or higher, for custom encoders
+that produce the IDAT data themselves. Writes the filter type byte followed by length filtered bytes
+to out. prevline is the unfiltered previous scanline, or NULL for the first scanline. bytewidth is
+the amount of bytes per pixel. strategy can be LFS_ZERO to LFS_FOUR, LFS_MINSUM or LFS_ENTROPY, other
+strategies use filter type 0. attempt must point to five buffers of length bytes each, they are only
+used as scratch space by the adaptive strategies. Returns the chosen filter type.
+*/
+unsigned char lodepng_filter_scanline(unsigned char* out, const unsigned char* scanline,
+                                      const unsigned char* prevline, size_t length, size_t bytewidth,
+                                      LodePNGFilterStrategy strategy, unsigned char* attempt[5]);
 #endif /*LODEPNG_COMPILE_ENCODER*/
 
 
@@ -993,6 +1039,35 @@ unsigned lodepng_deflate(unsigned char** out, size_t* outsize,
                          const unsigned char* in, size_t insize,
                          const LodePNGCompressSettings* settings);
 
+/*
+Compress in[inpos..insize) with deflate as one part of a larger stream, e.g. to split the work
+over multiple threads. Up to windowsize bytes before inpos are used as dictionary, so the part
+may refer back into the data of the previous part. If final is 0, the last block does not get
+the BFINAL bit and an empty stored block is appended (a "sync flush"), so the output ends on a
+byte boundary and the next part can be concatenated to it directly.
+Appends to the out buffer like lodepng_deflate. Custom deflate functions are not used.
+*/
+unsigned lodepng_deflate_part(unsigned char** out, size_t* outsize,
+                              const unsigned char* in, size_t inpos, size_t insize,
+                              const LodePNGCompressSettings* settings, unsigned final);
+
+/*
+LZ77 hash tables kept from one lodepng_deflate_part_hash call to the next, so repeated parts
+skip allocating and clearing them. They are made for one windowsize and matcher, a call with
+other settings uses temporary tables as usual. Only one thread may use them at a time.
+Returns NULL on alloc fail or an invalid windowsize.
+*/
+typedef struct LodePNGHash LodePNGHash;
+LodePNGHash* lodepng_hash_new(unsigned windowsize, unsigned matcher);
+void lodepng_hash_delete(LodePNGHash* hash);
+
+/*lodepng_deflate_part with the tables of hash, which may be NULL. The output is the same as
+with fresh tables, it does not depend on what hash was used for before.*/
+unsigned lodepng_deflate_part_hash(unsigned char** out, size_t* outsize,
+                                   const unsigned char* in, size_t inpos, size_t insize,
+                                   const LodePNGCompressSettings* settings, unsigned final,
+                                   LodePNGHash* hash);
+
 #endif /*LODEPNG_COMPILE_ENCODER*/
 #endif /*LODEPNG_COMPILE_ZLIB*/
 
@@ -1399,6 +1474,9 @@ can encode the colors of all pixels without information loss.
    true for proper compression.
 *) windowsize: the window size used by the LZ77 encoder (1 - 32768). Has value
    2048 by default, but can be set to 32768 for better, but slow, compression.
+*) matcher: LMF_HASH3 (default) or LMF_HASHCHAIN4. The latter only finds matches
+   of 4 bytes or more but walks its chains much faster, its search depth is set
+   with chainlength and longrange adds one fixed distance to try after the chain.
 *) force_palette: if colortype is 2 or 6, you can make the encoder write a PLTE
    chunk if force_palette is true. This can used as suggested palette to convert
    to by viewers that don't support more than 256 colors (if those still exist)
@@ -0,0 +1,1330 @@
+﻿// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "fe.h"
+#include "utils.h"
+#include "pngenc.h"
+#include "swizzle.h"
+#include "checksum.h"
+#include "arena.h"
+
+/*
+ * The scanlines are split into horizontal stripes which are filtered and
+ * deflated by a pool of workers, pigz style. Every stripe but the last ends
+ * with a sync flush so the parts can simply be concatenated, and the adler32
+ * of the stripes are combined into the one of the whole zlib stream.
+ *
+ * FeEncodePngBgrx feeds the workers straight from the captured BGRX pixels:
+ * each scanline is packed to RGB into a row buffer and filtered into the
+ * stripe, so no full frame copy is made besides the compressed output. It
+ * never scans the colors, only FeEncodePng lets lodepng pick the smallest
+ * color type.
+ *
+ * FeStreamPngBgrx hands each stripe to the caller as soon as the ones before
+ * it are done, cut into IDAT chunks of PNG_IDAT_SIZE, and frees it. Only the
+ * stripes in flight are held in memory, not the whole compressed image.
+ *
+ * FE_PNG_DELTA keeps the previous frame and its compressed stripes. A stripe
+ * only depends on its own rows, the rows of its deflate dictionary and the
+ * one above those for the filter, so when none of them changed the old
+ * output is written again as is and the file is the same as a full encode.
+ *
+ * FE_APNG streams an animation the same way. Each frame after the first only
+ * covers the bounding box of the tiles which changed, its fdAT chunks carry
+ * a sequence number in front of the zlib data. The delay of a frame is known
+ * when the next one arrives, so its fcTL is patched then, and acTL gets the
+ * frame count when the animation is closed.
+ *
+ * lodepng is built with LODEPNG_NO_COMPILE_ALLOCATORS. A job takes arenas
+ * from a pool: one for its own tables, and two per worker, one for the
+ * temporaries of a stripe, rewound after each stripe, and one its output is
+ * copied to. They go back to the pool when the job is freed, so repeated
+ * captures of the same size allocate nothing. Delta jobs keep their stripes
+ * past the job and stay on the heap.
+ *
+ * FE_PNG_ENCODER keeps all that from one encode to the next: its worker
+ * threads wait for the next job instead of being created for each one, and
+ * each keeps its arenas and LZ77 tables, which are reset rather than
+ * allocated and cleared again. The calling thread is worker 0.
+ */
+
+#define PNG_STRIPE_SIZE 0x100000
+#define PNG_MAX_THREADS 32
+#define PNG_IDAT_SIZE 0x10000
+/* the job arena, then the scratch and output arenas of each worker */
+#define PNG_MAX_ARENAS (PNG_MAX_THREADS * 2 + 1)
+
+typedef struct _PNG_STRIPE
+{
+	UINT uFirst;
+	UINT uLast;
+	UINT8* pData;
+	size_t szData;
+	UINT uAdler;
+	UINT uError;
+	BOOL bDone;
+	/* pData is the output of an unchanged stripe of the previous frame */
+	BOOL bCached;
+} PNG_STRIPE;
+
+typedef struct _PNG_STREAM
+{
+	FE_PNG_WRITE pfnWrite;
+	PVOID pContext;
+	/* serializes the writes, stripes go out in order */
+	SRWLOCK Lock;
+	UINT uNext;
+	UINT uAdler;
+	UINT uError;
+	size_t szWritten;
+	size_t szChunk;
+	/* 4 to write fdAT chunks numbered from uSequence, 0 for IDAT */
+	size_t szPrefix;
+	UINT uSequence;
+	/* length, type, sequence number, PNG_IDAT_SIZE bytes of data and the CRC */
+	UINT8 Chunk[PNG_IDAT_SIZE + 16];
+} PNG_STREAM;
+
+typedef struct _PNG_JOB
+{
+	/* filtered scanlines, or NULL when reading pBgrx */
+	const UINT8* pIn;
+	const UINT8* pBgrx;
+	size_t szStride;
+	size_t szLine;
+	size_t szPixel;
+	LodePNGFilterStrategy uFilter;
+	LodePNGCompressSettings Zlib;
+	PNG_STRIPE* pStripes;
+	UINT uStripes;
+	volatile LONG lNext;
+	/* NULL to keep all stripes until PngWriteZlib */
+	PNG_STREAM* pStream;
+	/* streamed stripes are not freed, FE_PNG_DELTA takes them over */
+	BOOL bKeepStripes;
+	FE_ARENA* pArenas[PNG_MAX_ARENAS];
+	volatile LONG lWorkers;
+	/* owns the arenas, NULL when they come from the pool */
+	FE_PNG_ENCODER* pEncoder;
+} PNG_JOB;
+
+typedef struct _PNG_WORKER
+{
+	UINT8* pAttempt[5];
+	UINT8* pRows[2];
+	/* NULL on the heap */
+	FE_ARENA* pScratch;
+	FE_ARENA* pOutput;
+	/* NULL for temporary tables */
+	LodePNGHash* pHash;
+} PNG_WORKER;
+
+/* what a worker of an FE_PNG_ENCODER keeps from one job to the next */
+typedef struct _PNG_SLOT
+{
+	FE_PNG_ENCODER* pEncoder;
+	UINT uIndex;
+	/* the last round its thread has seen */
+	UINT uRound;
+	FE_ARENA* pScratch;
+	FE_ARENA* pOutput;
+	LodePNGHash* pHash;
+	unsigned uHashWindow;
+	unsigned uHashMatcher;
+} PNG_SLOT;
+
+struct _FE_PNG_ENCODER
+{
+	SRWLOCK Lock;
+	/* the threads wait on Start for the next round, the caller on Done for uBusy to reach 0 */
+	CONDITION_VARIABLE Start;
+	CONDITION_VARIABLE Done;
+	PNG_JOB* pJob;
+	UINT uRound;
+	/* slots 1 to uWanted take part in the round */
+	UINT uWanted;
+	UINT uBusy;
+	BOOL bExit;
+	UINT uThreads;
+	HANDLE hThreads[PNG_MAX_THREADS];
+	PNG_SLOT Slots[PNG_MAX_THREADS];
+	/* tables of the job */
+	FE_ARENA* pArena;
+};
+
+/* acTL and fcTL with their chunk headers and CRC */
+#define APNG_ACTL_SIZE (8 + 12)
+#define APNG_FCTL_SIZE (26 + 12)
+
+struct _FE_APNG
+{
+	FE_PNG_PATCH pfnPatch;
+	UINT uWidth;
+	UINT uHeight;
+	FE_PNG_PROFILE uProfile;
+	UINT uFrames;
+	/* the previous frame, uWidth * 4 bytes per row, and its tile map */
+	UINT8* pFrame;
+	UINT8* pTiles;
+	/* fcTL of the last frame, written again with its delay */
+	UINT8 Fctl[APNG_FCTL_SIZE];
+	size_t szFctl;
+	UINT uTime;
+	PNG_STREAM Stream;
+	/* NULL when it could not be made, the frames start their own threads then */
+	FE_PNG_ENCODER* pEncoder;
+};
+
+struct _FE_PNG_DELTA
+{
+	UINT uWidth;
+	UINT uHeight;
+	FE_PNG_PROFILE uProfile;
+	/* BGRX rows of the previous frame, uWidth * 4 bytes each */
+	UINT8* pFrame;
+	UINT8* pTiles;
+	/* NULL until a frame was encoded */
+	PNG_STRIPE* pStripes;
+	UINT uStripes;
+};
+
+/* arenas of finished jobs */
+static SRWLOCK mArenaLock = SRWLOCK_INIT;
+static FE_ARENA* mArenas[PNG_MAX_ARENAS];
+static UINT mFreeArenas;
+
+static FE_ARENA* PngAcquireArena(VOID)
+{
+	FE_ARENA* pArena = NULL;
+	AcquireSRWLockExclusive(&mArenaLock);
+	if (mFreeArenas > 0)
+		pArena = mArenas[--mFreeArenas];
+	ReleaseSRWLockExclusive(&mArenaLock);
+	if (!pArena)
+		pArena = FeCreateArena();
+	return pArena;
+}
+
+static VOID PngReleaseArena(FE_ARENA* pArena)
+{
+	if (!pArena)
+		return;
+	FeResetArena(pArena);
+	AcquireSRWLockExclusive(&mArenaLock);
+	if (mFreeArenas < PNG_MAX_ARENAS)
+	{
+		mArenas[mFreeArenas++] = pArena;
+		pArena = NULL;
+	}
+	ReleaseSRWLockExclusive(&mArenaLock);
+	FeFreeArena(pArena);
+}
+
+VOID FeFreePngArenas(VOID)
+{
+	AcquireSRWLockExclusive(&mArenaLock);
+	while (mFreeArenas > 0)
+		FeFreeArena(mArenas[--mFreeArenas]);
+	ReleaseSRWLockExclusive(&mArenaLock);
+}
+
+/* zeroed memory living as long as the job */
+static PVOID PngJobAlloc(PNG_JOB* pJob, size_t szSize)
+{
+	PVOID p;
+	if (!pJob->pArenas[0])
+		return calloc(1, szSize);
+	p = FeArenaAlloc(pJob->pArenas[0], szSize);
+	if (p)
+		ZeroMemory(p, szSize);
+	return p;
+}
+
+static VOID PngJobFree(PNG_JOB* pJob, PVOID p)
+{
+	if (!pJob->pArenas[0])
+		free(p);
+}
+
+static UINT PngGetThreadCount(VOID)
+{
+	SYSTEM_INFO si;
+	GetSystemInfo(&si);
+	if (si.dwNumberOfProcessors < 1)
+		return 1;
+	if (si.dwNumberOfProcessors > PNG_MAX_THREADS)
+		return PNG_MAX_THREADS;
+	return si.dwNumberOfProcessors;
+}
+
+static VOID PngStreamWrite(PNG_STREAM* pStream, const UINT8* pData, size_t szData)
+{
+	if (pStream->uError)
+		return;
+	if (!pStream->pfnWrite(pStream->pContext, pData, szData))
+		pStream->uError = 79;
+	pStream->szWritten += szData;
+}
+
+static VOID PngStreamFlush(PNG_STREAM* pStream)
+{
+	UINT8* p = pStream->Chunk;
+	size_t szData = pStream->szPrefix + pStream->szChunk;
+	if (pStream->szChunk == 0)
+		return;
+	p[0] = (UINT8)(szData >> 24);
+	p[1] = (UINT8)(szData >> 16);
+	p[2] = (UINT8)(szData >> 8);
+	p[3] = (UINT8)szData;
+	if (pStream->szPrefix)
+	{
+		memcpy(p + 4, "fdAT", 4);
+		p[8] = (UINT8)(pStream->uSequence >> 24);
+		p[9] = (UINT8)(pStream->uSequence >> 16);
+		p[10] = (UINT8)(pStream->uSequence >> 8);
+		p[11] = (UINT8)pStream->uSequence;
+		pStream->uSequence++;
+	}
+	else
+		memcpy(p + 4, "IDAT", 4);
+	lodepng_chunk_generate_crc(p);
+	PngStreamWrite(pStream, p, szData + 12);
+	pStream->szChunk = 0;
+}
+
+/* append zlib stream bytes, emitting an IDAT chunk whenever one is full */
+static VOID PngStreamAppend(PNG_STREAM* pStream, const UINT8* pData, size_t szData)
+{
+	while (szData > 0 && !pStream->uError)
+	{
+		size_t n = min(szData, PNG_IDAT_SIZE - pStream->szChunk);
+		memcpy(pStream->Chunk + 8 + pStream->szPrefix + pStream->szChunk, pData, n);
+		pStream->szChunk += n;
+		pData += n;
+		szData -= n;
+		if (pStream->szChunk == PNG_IDAT_SIZE)
+			PngStreamFlush(pStream);
+	}
+}
+
+/* mark pDone finished and write out the stripes that are next in line */
+static VOID PngStreamStripes(PNG_JOB* pJob, PNG_STRIPE* pDone)
+{
+	PNG_STREAM* pStream = pJob->pStream;
+	AcquireSRWLockExclusive(&pStream->Lock);
+	pDone->bDone = TRUE;
+	while (pStream->uNext < pJob->uStripes && pJob->pStripes[pStream->uNext].bDone)
+	{
+		PNG_STRIPE* pStripe = &pJob->pStripes[pStream->uNext];
+		if (pStripe->uError && !pStream->uError)
+			pStream->uError = pStripe->uError;
+		PngStreamAppend(pStream, pStripe->pData, pStripe->szData);
+		pStream->uAdler = FeAdler32Combine(pStream->uAdler, pStripe->uAdler,
+			(pStripe->uLast - pStripe->uFirst) * pJob->szLine);
+		if (!pJob->bKeepStripes)
+		{
+			lodepng_free(pStripe->pData);
+			pStripe->pData = NULL;
+		}
+		pStream->uNext++;
+	}
+	ReleaseSRWLockExclusive(&pStream->Lock);
+}
+
+static const UINT8* PngGetScanline(const PNG_JOB* pJob, UINT y, UINT8* pRow)
+{
+	if (!pJob->pBgrx)
+		return pJob->pIn + y * pJob->szLine + 1;
+	FePackBgrx(pRow, pJob->pBgrx + y * pJob->szStride, (pJob->szLine - 1) / 3);
+	return pRow;
+}
+
+/* scanlines in the deflate window before the stripe, they are filtered as well. There is
+ * at least one, which is what the long range match of LMF_HASHCHAIN4 reads */
+static UINT PngGetDictRows(const PNG_JOB* pJob, const PNG_STRIPE* pStripe)
+{
+	UINT uDict = (UINT)((pJob->Zlib.windowsize + pJob->szLine - 1) / pJob->szLine);
+	return min(uDict, pStripe->uFirst);
+}
+
+static VOID PngDeflateStripe(PNG_JOB* pJob, PNG_STRIPE* pStripe, PNG_WORKER* pWorker)
+{
+	UINT y, uDict;
+	UINT8* pBuf = NULL;
+	const UINT8* pLine;
+	const UINT8* pPrev = NULL;
+	size_t szLine = pJob->szLine;
+	BOOL bFinal = (pStripe == &pJob->pStripes[pJob->uStripes - 1]);
+
+	if (pJob->szPixel == 0)
+	{
+		/* keep the filtering of the input, it is its own dictionary */
+		pStripe->uError = lodepng_deflate_part_hash(&pStripe->pData, &pStripe->szData, pJob->pIn,
+			pStripe->uFirst * szLine, pStripe->uLast * szLine, &pJob->Zlib, bFinal, pWorker->pHash);
+		pStripe->uAdler = FeAdler32(1, pJob->pIn + pStripe->uFirst * szLine,
+			(pStripe->uLast - pStripe->uFirst) * szLine);
+		return;
+	}
+
+	uDict = PngGetDictRows(pJob, pStripe);
+	pBuf = lodepng_malloc((pStripe->uLast - pStripe->uFirst + uDict) * szLine);
+	if (!pBuf)
+	{
+		pStripe->uError = 83;
+		return;
+	}
+	y = pStripe->uFirst - uDict;
+	if (y > 0)
+		pPrev = PngGetScanline(pJob, y - 1, pWorker->pRows[(y - 1) & 1]);
+	for (; y < pStripe->uLast; y++)
+	{
+		pLine = PngGetScanline(pJob, y, pWorker->pRows[y & 1]);
+		lodepng_filter_scanline(pBuf + (y - pStripe->uFirst + uDict) * szLine, pLine,
+			pPrev, szLine - 1, pJob->szPixel, pJob->uFilter, pWorker->pAttempt);
+		pPrev = pLine;
+	}
+	pStripe->uError = lodepng_deflate_part_hash(&pStripe->pData, &pStripe->szData, pBuf,
+		uDict * szLine, (pStripe->uLast - pStripe->uFirst + uDict) * szLine, &pJob->Zlib, bFinal,
+		pWorker->pHash);
+	pStripe->uAdler = FeAdler32(1, pBuf + uDict * szLine, (pStripe->uLast - pStripe->uFirst) * szLine);
+	lodepng_free(pBuf);
+}
+
+static VOID PngEncodeStripe(PNG_JOB* pJob, PNG_STRIPE* pStripe, PNG_WORKER* pWorker)
+{
+	UINT8* pData;
+	FE_ARENA_MARK mark;
+	if (!pWorker->pScratch)
+	{
+		PngDeflateStripe(pJob, pStripe, pWorker);
+		return;
+	}
+	FeGetArenaMark(pWorker->pScratch, &mark);
+	PngDeflateStripe(pJob, pStripe, pWorker);
+	/* the output outlives the temporaries next to it */
+	if (pStripe->pData)
+	{
+		pData = FeArenaAlloc(pWorker->pOutput, pStripe->szData);
+		if (pData)
+			memcpy(pData, pStripe->pData, pStripe->szData);
+		else if (!pStripe->uError)
+			pStripe->uError = 83;
+		pStripe->pData = pData;
+	}
+	FeRewindArena(pWorker->pScratch, &mark);
+}
+
+/* the tables of the slot, made again when the job has other settings */
+static LodePNGHash* PngGetSlotHash(PNG_SLOT* pSlot, const LodePNGCompressSettings* pZlib)
+{
+	FE_ARENA* pPrev;
+	if (pSlot->pHash && pSlot->uHashWindow == pZlib->windowsize && pSlot->uHashMatcher == pZlib->matcher)
+		return pSlot->pHash;
+	lodepng_hash_delete(pSlot->pHash);
+	/* on the heap, the tables outlive the job and FeEncodePng may have an arena set */
+	pPrev = FeSetThreadArena(NULL);
+	pSlot->pHash = lodepng_hash_new(pZlib->windowsize, pZlib->matcher);
+	FeSetThreadArena(pPrev);
+	pSlot->uHashWindow = pZlib->windowsize;
+	pSlot->uHashMatcher = pZlib->matcher;
+	return pSlot->pHash;
+}
+
+/* take stripes until none are left, pSlot is NULL for a thread of this job only */
+static VOID PngRunWorker(PNG_JOB* pJob, PNG_SLOT* pSlot)
+{
+	UINT i;
+	LONG lStripe;
+	PNG_WORKER worker = { 0 };
+	FE_ARENA* pPrev;
+	BOOL bOk = TRUE;
+
+	if (!pJob->bKeepStripes)
+	{
+		LONG lWorker = InterlockedIncrement(&pJob->lWorkers) - 1;
+		if (pSlot)
+		{
+			if (!pSlot->pScratch)
+				pSlot->pScratch = FeCreateArena();
+			if (!pSlot->pOutput)
+				pSlot->pOutput = FeCreateArena();
+			worker.pScratch = pSlot->pScratch;
+			worker.pOutput = pSlot->pOutput;
+		}
+		else
+		{
+			worker.pScratch = PngAcquireArena();
+			worker.pOutput = PngAcquireArena();
+		}
+		/* the stripes are read until the job is freed */
+		pJob->pArenas[lWorker * 2 + 1] = worker.pScratch;
+		pJob->pArenas[lWorker * 2 + 2] = worker.pOutput;
+		if (!worker.pOutput)
+			worker.pScratch = NULL;
+	}
+	if (pSlot && pJob->Zlib.btype != 0)
+		worker.pHash = PngGetSlotHash(pSlot, &pJob->Zlib);
+	pPrev = FeSetThreadArena(worker.pScratch);
+	for (i = 0; i < 5 && pJob->szPixel; i++)
+	{
+		worker.pAttempt[i] = lodepng_malloc(pJob->szLine);
+		if (!worker.pAttempt[i])
+			bOk = FALSE;
+	}
+	for (i = 0; i < 2 && pJob->pBgrx; i++)
+	{
+		worker.pRows[i] = lodepng_malloc(pJob->szLine);
+		if (!worker.pRows[i])
+			bOk = FALSE;
+	}
+	while ((lStripe = InterlockedIncrement(&pJob->lNext) - 1) < (LONG)pJob->uStripes)
+	{
+		if (!bOk)
+			pJob->pStripes[lStripe].uError = 83;
+		else if (!pJob->pStripes[lStripe].bCached)
+			PngEncodeStripe(pJob, &pJob->pStripes[lStripe], &worker);
+		if (pJob->pStream)
+			PngStreamStripes(pJob, &pJob->pStripes[lStripe]);
+	}
+	for (i = 0; i < 5; i++)
+		lodepng_free(worker.pAttempt[i]);
+	for (i = 0; i < 2; i++)
+		lodepng_free(worker.pRows[i]);
+	FeSetThreadArena(pPrev);
+}
+
+static DWORD WINAPI PngWorkerThread(LPVOID lpParameter)
+{
+	PngRunWorker(lpParameter, NULL);
+	return 0;
+}
+
+static DWORD WINAPI PngSlotThread(LPVOID lpParameter)
+{
+	PNG_SLOT* pSlot = lpParameter;
+	FE_PNG_ENCODER* pEncoder = pSlot->pEncoder;
+
+	AcquireSRWLockExclusive(&pEncoder->Lock);
+	for (;;)
+	{
+		while (pSlot->uRound == pEncoder->uRound && !pEncoder->bExit)
+			SleepConditionVariableSRW(&pEncoder->Start, &pEncoder->Lock, INFINITE, 0);
+		if (pEncoder->bExit)
+			break;
+		pSlot->uRound = pEncoder->uRound;
+		if (pSlot->uIndex > pEncoder->uWanted)
+			continue;
+		ReleaseSRWLockExclusive(&pEncoder->Lock);
+		PngRunWorker(pEncoder->pJob, pSlot);
+		AcquireSRWLockExclusive(&pEncoder->Lock);
+		if (--pEncoder->uBusy == 0)
+			WakeConditionVariable(&pEncoder->Done);
+	}
+	ReleaseSRWLockExclusive(&pEncoder->Lock);
+	return 0;
+}
+
+FE_PNG_ENCODER* FeCreatePngEncoder(VOID)
+{
+	UINT i;
+	FE_PNG_ENCODER* pEncoder = calloc(1, sizeof(FE_PNG_ENCODER));
+	if (!pEncoder)
+		return NULL;
+	InitializeSRWLock(&pEncoder->Lock);
+	InitializeConditionVariable(&pEncoder->Start);
+	InitializeConditionVariable(&pEncoder->Done);
+	for (i = 0; i < PNG_MAX_THREADS; i++)
+	{
+		pEncoder->Slots[i].pEncoder = pEncoder;
+		pEncoder->Slots[i].uIndex = i;
+	}
+	return pEncoder;
+}
+
+VOID FeFreePngEncoder(FE_PNG_ENCODER* pEncoder)
+{
+	UINT i;
+	if (!pEncoder)
+		return;
+	AcquireSRWLockExclusive(&pEncoder->Lock);
+	pEncoder->bExit = TRUE;
+	WakeAllConditionVariable(&pEncoder->Start);
+	ReleaseSRWLockExclusive(&pEncoder->Lock);
+	if (pEncoder->uThreads)
+		WaitForMultipleObjects(pEncoder->uThreads, pEncoder->hThreads, TRUE, INFINITE);
+	for (i = 0; i < pEncoder->uThreads; i++)
+		CloseHandle(pEncoder->hThreads[i]);
+	for (i = 0; i < PNG_MAX_THREADS; i++)
+	{
+		FeFreeArena(pEncoder->Slots[i].pScratch);
+		FeFreeArena(pEncoder->Slots[i].pOutput);
+		lodepng_hash_delete(pEncoder->Slots[i].pHash);
+	}
+	FeFreeArena(pEncoder->pArena);
+	free(pEncoder);
+}
+
+/* run the job on the calling thread and uHelpers threads of the encoder */
+static VOID PngRunEncoder(FE_PNG_ENCODER* pEncoder, PNG_JOB* pJob, UINT uHelpers)
+{
+	/* the threads are started as they are first needed, slot 0 is the caller */
+	while (pEncoder->uThreads < uHelpers)
+	{
+		PNG_SLOT* pSlot = &pEncoder->Slots[pEncoder->uThreads + 1];
+		HANDLE hThread;
+		pSlot->uRound = pEncoder->uRound;
+		hThread = CreateThread(NULL, 0, PngSlotThread, pSlot, 0, NULL);
+		if (!hThread)
+			break;
+		pEncoder->hThreads[pEncoder->uThreads++] = hThread;
+	}
+	uHelpers = min(uHelpers, pEncoder->uThreads);
+	if (uHelpers == 0)
+	{
+		PngRunWorker(pJob, &pEncoder->Slots[0]);
+		return;
+	}
+
+	AcquireSRWLockExclusive(&pEncoder->Lock);
+	pEncoder->pJob = pJob;
+	pEncoder->uWanted = uHelpers;
+	pEncoder->uBusy = uHelpers;
+	pEncoder->uRound++;
+	WakeAllConditionVariable(&pEncoder->Start);
+	ReleaseSRWLockExclusive(&pEncoder->Lock);
+
+	PngRunWorker(pJob, &pEncoder->Slots[0]);
+
+	AcquireSRWLockExclusive(&pEncoder->Lock);
+	while (pEncoder->uBusy > 0)
+		SleepConditionVariableSRW(&pEncoder->Done, &pEncoder->Lock, INFINITE, 0);
+	pEncoder->pJob = NULL;
+	ReleaseSRWLockExclusive(&pEncoder->Lock);
+}
+
+static UINT PngInitStripes(PNG_JOB* pJob, UINT uHeight)
+{
+	UINT i, uRows;
+
+	/* a match one scanline up catches the rows that repeat */
+	if (pJob->Zlib.matcher == LMF_HASHCHAIN4 && pJob->Zlib.longrange == 0)
+		pJob->Zlib.longrange = (unsigned)pJob->szLine;
+	uRows = (UINT)(PNG_STRIPE_SIZE / pJob->szLine);
+	if (uRows < 1)
+		uRows = 1;
+	pJob->uStripes = (uHeight + uRows - 1) / uRows;
+	if (pJob->bKeepStripes)
+		pJob->pArenas[0] = NULL;
+	else if (!pJob->pEncoder)
+		pJob->pArenas[0] = PngAcquireArena();
+	else
+	{
+		if (!pJob->pEncoder->pArena)
+			pJob->pEncoder->pArena = FeCreateArena();
+		pJob->pArenas[0] = pJob->pEncoder->pArena;
+	}
+	pJob->pStripes = PngJobAlloc(pJob, pJob->uStripes * sizeof(PNG_STRIPE));
+	if (!pJob->pStripes)
+		return 83;
+	for (i = 0; i < pJob->uStripes; i++)
+	{
+		pJob->pStripes[i].uFirst = i * uRows;
+		pJob->pStripes[i].uLast = min(uHeight, (i + 1) * uRows);
+	}
+	return 0;
+}
+
+/* run the job on the calling thread and uThreads - 1 threads started for it */
+static VOID PngRunThreads(PNG_JOB* pJob, UINT uThreads)
+{
+	UINT i;
+	HANDLE hThreads[PNG_MAX_THREADS];
+
+	for (i = 0; i + 1 < uThreads; i++)
+	{
+		hThreads[i] = CreateThread(NULL, 0, PngWorkerThread, pJob, 0, NULL);
+		if (!hThreads[i])
+			break;
+	}
+	uThreads = i;
+	PngWorkerThread(pJob);
+	if (uThreads)
+		WaitForMultipleObjects(uThreads, hThreads, TRUE, INFINITE);
+	for (i = 0; i < uThreads; i++)
+		CloseHandle(hThreads[i]);
+}
+
+static UINT PngRunStripes(PNG_JOB* pJob, UINT uThreads, size_t* pszZlib)
+{
+	UINT i, uDirty;
+	UINT uError = 0;
+
+	if (uThreads == 0)
+		uThreads = PngGetThreadCount();
+	for (i = 0, uDirty = 0; i < pJob->uStripes; i++)
+	{
+		if (!pJob->pStripes[i].bCached)
+			uDirty++;
+	}
+	/* no threads for the cached stripes, the calling thread still writes them */
+	if (uThreads > uDirty)
+		uThreads = max(uDirty, 1);
+	if (uThreads > PNG_MAX_THREADS)
+		uThreads = PNG_MAX_THREADS;
+	/* the calling thread is a worker as well */
+	if (pJob->pEncoder)
+		PngRunEncoder(pJob->pEncoder, pJob, uThreads - 1);
+	else
+		PngRunThreads(pJob, uThreads);
+
+	/* zlib header and adler32 */
+	*pszZlib = 6;
+	for (i = 0; i < pJob->uStripes; i++)
+	{
+		if (pJob->pStripes[i].uError && !uError)
+			uError = pJob->pStripes[i].uError;
+		*pszZlib += pJob->pStripes[i].szData;
+	}
+	return uError;
+}
+
+static UINT PngRunJob(PNG_JOB* pJob, UINT uHeight, UINT uThreads, size_t* pszZlib)
+{
+	UINT uError = PngInitStripes(pJob, uHeight);
+	if (uError)
+		return uError;
+	return PngRunStripes(pJob, uThreads, pszZlib);
+}
+
+static VOID PngWriteZlib(const PNG_JOB* pJob, UINT8* p)
+{
+	UINT i;
+	UINT uAdler = 1;
+	/* CM 8, CINFO 7, no dictionary, FCHECK */
+	*p++ = 0x78;
+	*p++ = 0x01;
+	for (i = 0; i < pJob->uStripes; i++)
+	{
+		const PNG_STRIPE* pStripe = &pJob->pStripes[i];
+		memcpy(p, pStripe->pData, pStripe->szData);
+		p += pStripe->szData;
+		uAdler = FeAdler32Combine(uAdler, pStripe->uAdler,
+			(pStripe->uLast - pStripe->uFirst) * pJob->szLine);
+	}
+	*p++ = (UINT8)(uAdler >> 24);
+	*p++ = (UINT8)(uAdler >> 16);
+	*p++ = (UINT8)(uAdler >> 8);
+	*p++ = (UINT8)uAdler;
+}
+
+static VOID PngFreeJob(PNG_JOB* pJob)
+{
+	UINT i;
+	for (i = 0; i < pJob->uStripes && pJob->pStripes; i++)
+		lodepng_free(pJob->pStripes[i].pData);
+	PngJobFree(pJob, pJob->pStripes);
+	for (i = 0; i < PNG_MAX_ARENAS; i++)
+	{
+		if (!pJob->pEncoder)
+			PngReleaseArena(pJob->pArenas[i]);
+		else if (pJob->pArenas[i])
+			FeResetArena(pJob->pArenas[i]);
+	}
+}
+
+unsigned FePngZlibCompress(unsigned char** out, size_t* outsize,
+	const unsigned char* in, size_t insize, const LodePNGCompressSettings* settings)
+{
+	UINT i;
+	UINT uError;
+	size_t szZlib = 0;
+	PNG_JOB job = { 0 };
+	const FE_PNG_ZLIB* pCtx = settings->custom_context;
+
+	job.Zlib = *settings;
+	job.Zlib.custom_zlib = NULL;
+	job.Zlib.custom_deflate = NULL;
+	job.Zlib.custom_context = NULL;
+	if (pCtx)
+		job.pEncoder = pCtx->pEncoder;
+	if (!pCtx || pCtx->uHeight == 0 || insize % pCtx->uHeight)
+		return lodepng_zlib_compress(out, outsize, in, insize, &job.Zlib);
+
+	job.pIn = in;
+	job.szLine = insize / pCtx->uHeight;
+	job.uFilter = pCtx->uFilter;
+	/* only refilter truecolor scanlines which lodepng left unfiltered */
+	if (job.uFilter != LFS_ZERO && job.szLine - 1 == (size_t)pCtx->uWidth * 4)
+		job.szPixel = 4;
+	else if (job.uFilter != LFS_ZERO && job.szLine - 1 == (size_t)pCtx->uWidth * 3)
+		job.szPixel = 3;
+	for (i = 0; i < pCtx->uHeight && job.szPixel; i++)
+	{
+		if (in[i * job.szLine] != 0)
+			job.szPixel = 0;
+	}
+
+	*out = NULL;
+	*outsize = 0;
+	uError = PngRunJob(&job, pCtx->uHeight, pCtx->uThreads, &szZlib);
+	if (!uError)
+	{
+		*out = lodepng_malloc(szZlib);
+		if (!*out)
+			uError = 83;
+	}
+	if (!uError)
+	{
+		PngWriteZlib(&job, *out);
+		*outsize = szZlib;
+	}
+	PngFreeJob(&job);
+	return uError;
+}
+
+static UINT8* PngWriteChunk(UINT8* p, const char* szType, const UINT8* pData, size_t szData)
+{
+	p[0] = (UINT8)(szData >> 24);
+	p[1] = (UINT8)(szData >> 16);
+	p[2] = (UINT8)(szData >> 8);
+	p[3] = (UINT8)szData;
+	memcpy(p + 4, szType, 4);
+	if (pData)
+		memcpy(p + 8, pData, szData);
+	lodepng_chunk_generate_crc(p);
+	return p + szData + 12;
+}
+
+static VOID PngSetProfile(FE_PNG_PROFILE uProfile, LodePNGCompressSettings* pZlib,
+	LodePNGFilterStrategy* pFilter)
+{
+	lodepng_compress_settings_init(pZlib);
+	switch (uProfile)
+	{
+	case FE_PNG_FAST:
+		/* rows repeat a lot on a desktop, up is as good as any single filter */
+		*pFilter = LFS_TWO;
+		pZlib->windowsize = 1024;
+		pZlib->nicematch = 32;
+		pZlib->lazymatching = 0;
+		pZlib->matcher = LMF_HASHCHAIN4;
+		pZlib->chainlength = 16;
+		break;
+	case FE_PNG_MAX:
+		*pFilter = LFS_ENTROPY;
+		pZlib->windowsize = 32768;
+		pZlib->nicematch = 258;
+		break;
+	default:
+		*pFilter = LFS_MINSUM;
+		pZlib->matcher = LMF_HASHCHAIN4;
+		break;
+	}
+}
+
+FE_PNG_PROFILE FeGetPngProfile(LPCWSTR lpName)
+{
+	if (!lpName)
+		return FE_PNG_BALANCED;
+	if (_wcsicmp(lpName, L"fast") == 0)
+		return FE_PNG_FAST;
+	if (_wcsicmp(lpName, L"max") == 0)
+		return FE_PNG_MAX;
+	return FE_PNG_BALANCED;
+}
+
+UINT FeEncodePng(FE_PNG_ENCODER* pEncoder, UINT8** ppPng, size_t* pszPng,
+	const UINT8* pRgba, UINT w, UINT h, FE_PNG_PROFILE uProfile)
+{
+	UINT uError;
+	LodePNGState state;
+	FE_PNG_ZLIB ctx = { 0 };
+	UINT8* pPng = NULL;
+	size_t szPng = 0;
+	FE_ARENA* pArena = PngAcquireArena();
+	FE_ARENA* pPrev = FeSetThreadArena(pArena);
+
+	*ppPng = NULL;
+	*pszPng = 0;
+	ctx.uWidth = w;
+	ctx.uHeight = h;
+	ctx.pEncoder = pEncoder;
+	lodepng_state_init(&state);
+	PngSetProfile(uProfile, &state.encoder.zlibsettings, &ctx.uFilter);
+	/* the stripe workers do the filtering */
+	state.encoder.filter_strategy = LFS_ZERO;
+	state.encoder.zlibsettings.custom_zlib = FePngZlibCompress;
+	state.encoder.zlibsettings.custom_context = &ctx;
+	uError = lodepng_encode(&pPng, &szPng, pRgba, w, h, &state);
+	lodepng_state_cleanup(&state);
+	FeSetThreadArena(pPrev);
+
+	/* out of the arena, the caller frees it */
+	if (!uError)
+	{
+		*ppPng = malloc(szPng);
+		if (!*ppPng)
+			uError = 83;
+	}
+	if (!uError)
+	{
+		memcpy(*ppPng, pPng, szPng);
+		*pszPng = szPng;
+	}
+	lodepng_free(pPng);
+	PngReleaseArena(pArena);
+	return uError;
+}
+
+/* signature and IHDR of an 8-bit RGB image, PNG_HEADER_SIZE bytes */
+#define PNG_HEADER_SIZE (8 + 25)
+
+static UINT8* PngWriteHeader(UINT8* p, UINT w, UINT h)
+{
+	UINT8 ihdr[13] = { 0 };
+	static const UINT8 sig[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+	memcpy(p, sig, sizeof(sig));
+	ihdr[0] = (UINT8)(w >> 24);
+	ihdr[1] = (UINT8)(w >> 16);
+	ihdr[2] = (UINT8)(w >> 8);
+	ihdr[3] = (UINT8)w;
+	ihdr[4] = (UINT8)(h >> 24);
+	ihdr[5] = (UINT8)(h >> 16);
+	ihdr[6] = (UINT8)(h >> 8);
+	ihdr[7] = (UINT8)h;
+	ihdr[8] = 8; /* bit depth */
+	ihdr[9] = LCT_RGB;
+	return PngWriteChunk(p + sizeof(sig), "IHDR", ihdr, sizeof(ihdr));
+}
+
+static VOID PngInitBgrxJob(PNG_JOB* pJob, FE_PNG_ENCODER* pEncoder, const UINT8* pBgrx, UINT w,
+	size_t szStride, FE_PNG_PROFILE uProfile)
+{
+	pJob->pEncoder = pEncoder;
+	pJob->pBgrx = pBgrx;
+	pJob->szStride = szStride;
+	pJob->szLine = (size_t)w * 3 + 1;
+	pJob->szPixel = 3;
+	PngSetProfile(uProfile, &pJob->Zlib, &pJob->uFilter);
+}
+
+UINT FeEncodePngBgrx(FE_PNG_ENCODER* pEncoder, UINT8** ppPng, size_t* pszPng,
+	const UINT8* pBgrx, UINT w, UINT h, size_t szStride, FE_PNG_PROFILE uProfile)
+{
+	UINT uError;
+	UINT8* p;
+	size_t szZlib = 0;
+	PNG_JOB job = { 0 };
+
+	*ppPng = NULL;
+	*pszPng = 0;
+	if (w == 0 || h == 0)
+		return 93;
+	PngInitBgrxJob(&job, pEncoder, pBgrx, w, szStride, uProfile);
+
+	uError = PngRunJob(&job, h, 0, &szZlib);
+	if (!uError && szZlib > 0x7FFFFFFF)
+		uError = 77;
+	if (!uError)
+	{
+		*ppPng = malloc(PNG_HEADER_SIZE + 12 + szZlib + 12);
+		if (!*ppPng)
+			uError = 83;
+	}
+	if (!uError)
+	{
+		/* IDAT and IEND */
+		*pszPng = PNG_HEADER_SIZE + 12 + szZlib + 12;
+		p = PngWriteHeader(*ppPng, w, h);
+		PngWriteZlib(&job, p + 8);
+		p = PngWriteChunk(p, "IDAT", NULL, szZlib);
+		PngWriteChunk(p, "IEND", NULL, 0);
+	}
+	PngFreeJob(&job);
+	return uError;
+}
+
+static VOID PngInitStream(PNG_STREAM* pStream, FE_PNG_WRITE pfnWrite, PVOID pContext)
+{
+	pStream->pfnWrite = pfnWrite;
+	pStream->pContext = pContext;
+	InitializeSRWLock(&pStream->Lock);
+}
+
+/* run a job with its stripes set up, its zlib stream goes out as IDAT or fdAT chunks */
+static UINT PngStreamZlib(PNG_JOB* pJob, PNG_STREAM* pStream)
+{
+	UINT uError;
+	UINT8 buf[4];
+	size_t szZlib = 0;
+	pStream->uNext = 0;
+	pStream->uAdler = 1;
+	pJob->pStream = pStream;
+
+	/* CM 8, CINFO 7, no dictionary, FCHECK */
+	buf[0] = 0x78;
+	buf[1] = 0x01;
+	PngStreamAppend(pStream, buf, 2);
+	uError = PngRunStripes(pJob, 0, &szZlib);
+	if (!uError)
+		uError = pStream->uError;
+	if (!uError)
+	{
+		buf[0] = (UINT8)(pStream->uAdler >> 24);
+		buf[1] = (UINT8)(pStream->uAdler >> 16);
+		buf[2] = (UINT8)(pStream->uAdler >> 8);
+		buf[3] = (UINT8)pStream->uAdler;
+		PngStreamAppend(pStream, buf, 4);
+		PngStreamFlush(pStream);
+		uError = pStream->uError;
+	}
+	pJob->pStream = NULL;
+	return uError;
+}
+
+/* write the PNG around the zlib stream of a job with its stripes set up */
+static UINT PngStreamJob(PNG_JOB* pJob, FE_PNG_WRITE pfnWrite, PVOID pContext, size_t* pszPng,
+	UINT w, UINT h)
+{
+	UINT uError;
+	UINT8 buf[PNG_HEADER_SIZE];
+	PNG_STREAM* pStream = PngJobAlloc(pJob, sizeof(PNG_STREAM));
+	if (!pStream)
+		return 83;
+	PngInitStream(pStream, pfnWrite, pContext);
+
+	PngWriteHeader(buf, w, h);
+	PngStreamWrite(pStream, buf, PNG_HEADER_SIZE);
+	uError = PngStreamZlib(pJob, pStream);
+	if (!uError)
+	{
+		PngWriteChunk(buf, "IEND", NULL, 0);
+		PngStreamWrite(pStream, buf, 12);
+		uError = pStream->uError;
+	}
+	if (pszPng)
+		*pszPng = pStream->szWritten;
+	PngJobFree(pJob, pStream);
+	return uError;
+}
+
+UINT FeStreamPngBgrx(FE_PNG_ENCODER* pEncoder, FE_PNG_WRITE pfnWrite, PVOID pContext,
+	size_t* pszPng, const UINT8* pBgrx, UINT w, UINT h, size_t szStride, FE_PNG_PROFILE uProfile)
+{
+	UINT uError;
+	PNG_JOB job = { 0 };
+
+	if (pszPng)
+		*pszPng = 0;
+	if (w == 0 || h == 0)
+		return 93;
+	PngInitBgrxJob(&job, pEncoder, pBgrx, w, szStride, uProfile);
+	uError = PngInitStripes(&job, h);
+	if (!uError)
+		uError = PngStreamJob(&job, pfnWrite, pContext, pszPng, w, h);
+	PngFreeJob(&job);
+	return uError;
+}
+
+FE_PNG_DELTA* FeCreatePngDelta(VOID)
+{
+	return calloc(1, sizeof(FE_PNG_DELTA));
+}
+
+/* forget the previous frame, the next one is encoded in full */
+static VOID PngResetDelta(FE_PNG_DELTA* pDelta)
+{
+	UINT i;
+	for (i = 0; i < pDelta->uStripes && pDelta->pStripes; i++)
+		lodepng_free(pDelta->pStripes[i].pData);
+	free(pDelta->pStripes);
+	free(pDelta->pFrame);
+	free(pDelta->pTiles);
+	ZeroMemory(pDelta, sizeof(FE_PNG_DELTA));
+}
+
+VOID FeFreePngDelta(FE_PNG_DELTA* pDelta)
+{
+	if (!pDelta)
+		return;
+	PngResetDelta(pDelta);
+	free(pDelta);
+}
+
+/* move the output of the stripes whose input did not change over to the job */
+static VOID PngReuseStripes(FE_PNG_DELTA* pDelta, PNG_JOB* pJob, FE_PNG_DELTA_STATS* pStats)
+{
+	UINT i, uFirst, uLast;
+	UINT uCols = (pDelta->uWidth + FE_TILE_SIZE - 1) / FE_TILE_SIZE;
+	for (i = 0; i < pJob->uStripes; i++)
+	{
+		PNG_STRIPE* pStripe = &pJob->pStripes[i];
+		uFirst = pStripe->uFirst - PngGetDictRows(pJob, pStripe);
+		if (uFirst > 0)
+			uFirst--;
+		/* the tile rows covering uFirst to uLast are contiguous in the map */
+		uFirst = uFirst / FE_TILE_SIZE * uCols;
+		uLast = (pStripe->uLast + FE_TILE_SIZE - 1) / FE_TILE_SIZE * uCols;
+		if (memchr(pDelta->pTiles + uFirst, 1, uLast - uFirst))
+			continue;
+		pStripe->pData = pDelta->pStripes[i].pData;
+		pStripe->szData = pDelta->pStripes[i].szData;
+		pStripe->uAdler = pDelta->pStripes[i].uAdler;
+		pStripe->bCached = TRUE;
+		pDelta->pStripes[i].pData = NULL;
+		pStats->uDirtyStripes--;
+	}
+}
+
+/* keep the changed tile rows of the frame for the next diff */
+static VOID PngCopyDirtyRows(FE_PNG_DELTA* pDelta, const UINT8* pBgrx, size_t szStride)
+{
+	UINT y, t;
+	UINT uCols = (pDelta->uWidth + FE_TILE_SIZE - 1) / FE_TILE_SIZE;
+	size_t szRow = (size_t)pDelta->uWidth * 4;
+	for (t = 0; t * FE_TILE_SIZE < pDelta->uHeight; t++)
+	{
+		if (!memchr(pDelta->pTiles + t * uCols, 1, uCols))
+			continue;
+		for (y = t * FE_TILE_SIZE; y < min(pDelta->uHeight, (t + 1) * FE_TILE_SIZE); y++)
+			memcpy(pDelta->pFrame + y * szRow, pBgrx + y * szStride, szRow);
+	}
+}
+
+UINT FeStreamPngDelta(FE_PNG_ENCODER* pEncoder, FE_PNG_DELTA* pDelta, FE_PNG_WRITE pfnWrite,
+	PVOID pContext, size_t* pszPng, const UINT8* pBgrx, UINT w, UINT h, size_t szStride,
+	FE_PNG_PROFILE uProfile, FE_PNG_DELTA_STATS* pStats)
+{
+	UINT i;
+	UINT uError;
+	PNG_JOB job = { 0 };
+	UINT uTiles = ((w + FE_TILE_SIZE - 1) / FE_TILE_SIZE) * ((h + FE_TILE_SIZE - 1) / FE_TILE_SIZE);
+
+	ZeroMemory(pStats, sizeof(FE_PNG_DELTA_STATS));
+	if (pszPng)
+		*pszPng = 0;
+	if (w == 0 || h == 0)
+		return 93;
+	if (pDelta->uWidth != w || pDelta->uHeight != h || pDelta->uProfile != uProfile)
+		PngResetDelta(pDelta);
+	PngInitBgrxJob(&job, pEncoder, pBgrx, w, szStride, uProfile);
+	job.bKeepStripes = TRUE;
+	uError = PngInitStripes(&job, h);
+	if (uError)
+		return uError;
+	pStats->uTiles = uTiles;
+	pStats->uStripes = job.uStripes;
+	pStats->uDirtyStripes = job.uStripes;
+
+	if (!pDelta->pStripes)
+	{
+		pDelta->pFrame = malloc((size_t)w * 4 * h);
+		pDelta->pTiles = malloc(uTiles);
+		if (!pDelta->pFrame || !pDelta->pTiles)
+		{
+			PngResetDelta(pDelta);
+			PngFreeJob(&job);
+			return 83;
+		}
+		pDelta->uWidth = w;
+		pDelta->uHeight = h;
+		pDelta->uProfile = uProfile;
+		memset(pDelta->pTiles, 1, uTiles);
+		pStats->uDirtyTiles = uTiles;
+	}
+	else
+	{
+		pStats->uDirtyTiles = FeDiffTiles(pDelta->pTiles, pDelta->pFrame, (size_t)w * 4,
+			pBgrx, szStride, w, h);
+		PngReuseStripes(pDelta, &job, pStats);
+	}
+	PngCopyDirtyRows(pDelta, pBgrx, szStride);
+
+	uError = PngStreamJob(&job, pfnWrite, pContext, pszPng, w, h);
+	for (i = 0; i < pDelta->uStripes && pDelta->pStripes; i++)
+		lodepng_free(pDelta->pStripes[i].pData);
+	free(pDelta->pStripes);
+	pDelta->pStripes = job.pStripes;
+	pDelta->uStripes = job.uStripes;
+	if (uError)
+		PngResetDelta(pDelta);
+	return uError;
+}
+
+static UINT8* PngPutUint32(UINT8* p, UINT uValue)
+{
+	p[0] = (UINT8)(uValue >> 24);
+	p[1] = (UINT8)(uValue >> 16);
+	p[2] = (UINT8)(uValue >> 8);
+	p[3] = (UINT8)uValue;
+	return p + 4;
+}
+
+static VOID ApngPatch(FE_APNG* pApng, size_t szOffset, const UINT8* pData, size_t szData)
+{
+	if (pApng->Stream.uError)
+		return;
+	if (!pApng->pfnPatch(pApng->Stream.pContext, szOffset, pData, szData))
+		pApng->Stream.uError = 79;
+}
+
+static VOID ApngWriteActl(FE_APNG* pApng, UINT8* p)
+{
+	UINT8 actl[8] = { 0 };
+	/* num_frames, then num_plays 0 for an endless loop */
+	PngPutUint32(actl, pApng->uFrames);
+	PngWriteChunk(p, "acTL", actl, sizeof(actl));
+}
+
+/* the delay runs from the frame to the next one, in milliseconds */
+static VOID ApngSetDelay(FE_APNG* pApng, UINT uTime)
+{
+	UINT uDelay = uTime - pApng->uTime;
+	UINT8* p = pApng->Fctl + 8;
+	if (uDelay > 0xFFFF)
+		uDelay = 0xFFFF;
+	p[20] = (UINT8)(uDelay >> 8);
+	p[21] = (UINT8)uDelay;
+	p[22] = (UINT8)(1000 >> 8);
+	p[23] = (UINT8)(1000 & 0xFF);
+	lodepng_chunk_generate_crc(pApng->Fctl);
+}
+
+FE_APNG* FeCreateApng(FE_PNG_WRITE pfnWrite, FE_PNG_PATCH pfnPatch, PVOID pContext,
+	UINT w, UINT h, FE_PNG_PROFILE uProfile)
+{
+	UINT8 buf[PNG_HEADER_SIZE + APNG_ACTL_SIZE];
+	UINT uTiles = ((w + FE_TILE_SIZE - 1) / FE_TILE_SIZE) * ((h + FE_TILE_SIZE - 1) / FE_TILE_SIZE);
+	FE_APNG* pApng;
+	if (w == 0 || h == 0)
+		return NULL;
+	pApng = calloc(1, sizeof(FE_APNG));
+	if (!pApng)
+		return NULL;
+	pApng->pFrame = malloc((size_t)w * 4 * h);
+	pApng->pTiles = malloc(uTiles);
+	if (!pApng->pFrame || !pApng->pTiles)
+	{
+		free(pApng->pFrame);
+		free(pApng->pTiles);
+		free(pApng);
+		return NULL;
+	}
+	pApng->pfnPatch = pfnPatch;
+	pApng->uWidth = w;
+	pApng->uHeight = h;
+	pApng->uProfile = uProfile;
+	pApng->pEncoder = FeCreatePngEncoder();
+	PngInitStream(&pApng->Stream, pfnWrite, pContext);
+	PngWriteHeader(buf, w, h);
+	ApngWriteActl(pApng, buf + PNG_HEADER_SIZE);
+	PngStreamWrite(&pApng->Stream, buf, sizeof(buf));
+	return pApng;
+}
+
+/* bounding box of the changed tiles in pixels, FALSE if there are none */
+static BOOL ApngGetDirtyRect(const FE_APNG* pApng, UINT* x, UINT* y, UINT* w, UINT* h)
+{
+	UINT tx, ty;
+	UINT uCols = (pApng->uWidth + FE_TILE_SIZE - 1) / FE_TILE_SIZE;
+	UINT uRows = (pApng->uHeight + FE_TILE_SIZE - 1) / FE_TILE_SIZE;
+	UINT uLeft = uCols, uTop = uRows, uRight = 0, uBottom = 0;
+	for (ty = 0; ty < uRows; ty++)
+	{
+		for (tx = 0; tx < uCols; tx++)
+		{
+			if (!pApng->pTiles[ty * uCols + tx])
+				continue;
+			uLeft = min(uLeft, tx);
+			uRight = max(uRight, tx + 1);
+			uTop = min(uTop, ty);
+			uBottom = ty + 1;
+		}
+	}
+	if (uRight == 0)
+		return FALSE;
+	*x = uLeft * FE_TILE_SIZE;
+	*y = uTop * FE_TILE_SIZE;
+	*w = min(pApng->uWidth, uRight * FE_TILE_SIZE) - *x;
+	*h = min(pApng->uHeight, uBottom * FE_TILE_SIZE) - *y;
+	return TRUE;
+}
+
+UINT FeAddApngFrame(FE_APNG* pApng, const UINT8* pBgrx, size_t szStride, UINT uTime,
+	BOOL* pbChanged)
+{
+	UINT i;
+	UINT uError;
+	UINT x = 0, y = 0, w = pApng->uWidth, h = pApng->uHeight;
+	UINT8 fctl[26] = { 0 };
+	UINT8* p;
+	PNG_JOB job = { 0 };
+
+	*pbChanged = FALSE;
+	if (pApng->Stream.uError)
+		return pApng->Stream.uError;
+	if (pApng->uFrames > 0)
+	{
+		/* an unchanged frame only extends the delay of the last one */
+		if (FeDiffTiles(pApng->pTiles, pApng->pFrame, (size_t)pApng->uWidth * 4,
+			pBgrx, szStride, pApng->uWidth, pApng->uHeight) == 0)
+			return 0;
+		ApngGetDirtyRect(pApng, &x, &y, &w, &h);
+		ApngSetDelay(pApng, uTime);
+		ApngPatch(pApng, pApng->szFctl, pApng->Fctl, APNG_FCTL_SIZE);
+	}
+	*pbChanged = TRUE;
+	for (i = y; i < y + h; i++)
+		memcpy(pApng->pFrame + ((size_t)i * pApng->uWidth + x) * 4, pBgrx + i * szStride + x * 4,
+			(size_t)w * 4);
+
+	/* dispose_op none and blend_op source, the rest of the canvas stays */
+	p = PngPutUint32(fctl, pApng->Stream.uSequence++);
+	p = PngPutUint32(p, w);
+	p = PngPutUint32(p, h);
+	p = PngPutUint32(p, x);
+	PngPutUint32(p, y);
+	PngWriteChunk(pApng->Fctl, "fcTL", fctl, sizeof(fctl));
+	pApng->uTime = uTime;
+	ApngSetDelay(pApng, uTime);
+	pApng->szFctl = pApng->Stream.szWritten;
+	PngStreamWrite(&pApng->Stream, pApng->Fctl, APNG_FCTL_SIZE);
+
+	/* the first frame is the default image in IDAT */
+	pApng->Stream.szPrefix = pApng->uFrames ? 4 : 0;
+	PngInitBgrxJob(&job, pApng->pEncoder, pBgrx + y * szStride + x * 4, w, szStride, pApng->uProfile);
+	uError = PngInitStripes(&job, h);
+	if (!uError)
+		uError = PngStreamZlib(&job, &pApng->Stream);
+	PngFreeJob(&job);
+	if (uError && !pApng->Stream.uError)
+		pApng->Stream.uError = uError;
+	pApng->uFrames++;
+	return uError;
+}
+
+UINT FeCloseApng(FE_APNG* pApng, UINT uTime, size_t* pszPng)
+{
+	UINT uError;
+	UINT8 buf[APNG_ACTL_SIZE];
+
+	if (pApng->uFrames == 0 && !pApng->Stream.uError)
+		pApng->Stream.uError = 48;
+	if (uTime > pApng->uTime)
+	{
+		ApngSetDelay(pApng, uTime);
+		ApngPatch(pApng, pApng->szFctl, pApng->Fctl, APNG_FCTL_SIZE);
+	}
+	ApngWriteActl(pApng, buf);
+	ApngPatch(pApng, PNG_HEADER_SIZE, buf, APNG_ACTL_SIZE);
+	PngWriteChunk(buf, "IEND", NULL, 0);
+	PngStreamWrite(&pApng->Stream, buf, 12);
+
+	uError = pApng->Stream.uError;
+	if (pszPng)
+		*pszPng = pApng->Stream.szWritten;
+	FeFreePngEncoder(pApng->pEncoder);
+	free(pApng->pFrame);
+	free(pApng->pTiles);
+	free(pApng);
+	return uError;
+}
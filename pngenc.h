@@ -0,0 +1,107 @@
+﻿// SPDX-License-Identifier: GPL-3.0-or-later
+#pragma once
+
+#include "fe.h"
+#include "lodepng/lodepng.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+typedef enum _FE_PNG_PROFILE
+{
+	/* cheap fixed filter, short window and greedy matching */
+	FE_PNG_FAST = 0,
+	/* minimum sum filter with the lodepng default matcher */
+	FE_PNG_BALANCED,
+	/* color type reduction, entropy filter and the full window */
+	FE_PNG_MAX,
+} FE_PNG_PROFILE;
+
+/* worker threads with their arenas and LZ77 tables, kept from one encode to the next,
+ * for one encode at a time. The functions taking one make do without when it is NULL */
+typedef struct _FE_PNG_ENCODER FE_PNG_ENCODER;
+
+FE_PNG_ENCODER* FeCreatePngEncoder(VOID);
+
+VOID FeFreePngEncoder(FE_PNG_ENCODER* pEncoder);
+
+/* custom_context of FePngZlibCompress */
+typedef struct _FE_PNG_ZLIB
+{
+	UINT uWidth;
+	UINT uHeight;
+	/* filter applied by the stripe workers, lodepng itself must use LFS_ZERO */
+	LodePNGFilterStrategy uFilter;
+	/* 0 for one worker per processor */
+	UINT uThreads;
+	FE_PNG_ENCODER* pEncoder;
+} FE_PNG_ZLIB;
+
+unsigned FePngZlibCompress(unsigned char** out, size_t* outsize,
+	const unsigned char* in, size_t insize, const LodePNGCompressSettings* settings);
+
+FE_PNG_PROFILE FeGetPngProfile(LPCWSTR lpName);
+
+UINT FeEncodePng(FE_PNG_ENCODER* pEncoder, UINT8** ppPng, size_t* pszPng,
+	const UINT8* pRgba, UINT w, UINT h, FE_PNG_PROFILE uProfile);
+
+/* encode top-down BGRX rows as an 8-bit RGB PNG without converting the frame first */
+UINT FeEncodePngBgrx(FE_PNG_ENCODER* pEncoder, UINT8** ppPng, size_t* pszPng,
+	const UINT8* pBgrx, UINT w, UINT h, size_t szStride, FE_PNG_PROFILE uProfile);
+
+/* receives the PNG file in order, returns FALSE to abort the encoding */
+typedef BOOL (*FE_PNG_WRITE)(PVOID pContext, const UINT8* pData, size_t szData);
+
+/* like FeEncodePngBgrx, but the file is passed to pfnWrite while it is encoded */
+UINT FeStreamPngBgrx(FE_PNG_ENCODER* pEncoder, FE_PNG_WRITE pfnWrite, PVOID pContext,
+	size_t* pszPng, const UINT8* pBgrx, UINT w, UINT h, size_t szStride, FE_PNG_PROFILE uProfile);
+
+/* previous frame of a capture sequence and its compressed stripes */
+typedef struct _FE_PNG_DELTA FE_PNG_DELTA;
+
+typedef struct _FE_PNG_DELTA_STATS
+{
+	/* FE_TILE_SIZE square tiles which differ from the previous frame */
+	UINT uTiles;
+	UINT uDirtyTiles;
+	/* stripes deflated again, the others were copied */
+	UINT uStripes;
+	UINT uDirtyStripes;
+} FE_PNG_DELTA_STATS;
+
+FE_PNG_DELTA* FeCreatePngDelta(VOID);
+
+VOID FeFreePngDelta(FE_PNG_DELTA* pDelta);
+
+/* like FeStreamPngBgrx, but only the stripes touching changed tiles are encoded again,
+ * a new size or profile starts over with a full frame */
+UINT FeStreamPngDelta(FE_PNG_ENCODER* pEncoder, FE_PNG_DELTA* pDelta, FE_PNG_WRITE pfnWrite,
+	PVOID pContext, size_t* pszPng, const UINT8* pBgrx, UINT w, UINT h, size_t szStride,
+	FE_PNG_PROFILE uProfile, FE_PNG_DELTA_STATS* pStats);
+
+/* rewrites szData bytes at szOffset of the file, returns FALSE on failure */
+typedef BOOL (*FE_PNG_PATCH)(PVOID pContext, size_t szOffset, const UINT8* pData, size_t szData);
+
+/* animated PNG written frame by frame, see FeCreateApng */
+typedef struct _FE_APNG FE_APNG;
+
+/* write the header of a w x h animation, pfnPatch fixes up the chunks written earlier */
+FE_APNG* FeCreateApng(FE_PNG_WRITE pfnWrite, FE_PNG_PATCH pfnPatch, PVOID pContext,
+	UINT w, UINT h, FE_PNG_PROFILE uProfile);
+
+/* append a frame shown uTime milliseconds into the animation, only the region which
+ * changed from the last frame is encoded, *pbChanged is FALSE if nothing did */
+UINT FeAddApngFrame(FE_APNG* pApng, const UINT8* pBgrx, size_t szStride, UINT uTime,
+	BOOL* pbChanged);
+
+/* end the animation at uTime milliseconds and free pApng, 48 if it has no frames */
+UINT FeCloseApng(FE_APNG* pApng, UINT uTime, size_t* pszPng);
+
+/* release the arenas kept for the next encode */
+VOID FeFreePngArenas(VOID);
+
+#ifdef __cplusplus
+}
+#endif
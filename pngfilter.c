@@ -0,0 +1,479 @@
+﻿// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "fe.h"
+#include "utils.h"
+#include "pngfilter.h"
+#include "lodepng/lodepng.h"
+
+/*
+ * PNG scanline unfilter for 8-bit RGB and RGBA rows, lodepng is built with
+ * LODEPNG_CUSTOM_UNFILTER and hands those rows here, everything else stays
+ * on its scalar code. Up runs 16 or 32 bytes per step, Sub is a prefix sum
+ * over 4 pixels, Avg and Paeth carry one pixel at a time in a vector
+ * register, Paeth in 16-bit lanes as in libpng.
+ *
+ * The encoder side has no carried dependency, every filter runs 16 bytes
+ * per step. With LODEPNG_CUSTOM_FILTER the minimum sum and entropy
+ * heuristics score all five filter types in one pass over the row and only
+ * the chosen type is written out, the choice matches lodepng byte for byte.
+ */
+
+#if defined(_M_IX86) || defined(_M_X64)
+#define PNGFILTER_X86
+#include <immintrin.h>
+#endif
+
+typedef VOID (*UNFILTER_PROC)(UINT8* pDst, const UINT8* pSrc, const UINT8* pPrev,
+	size_t szBpp, size_t szLength);
+typedef VOID (*FILTER_PROC)(UINT8* pOut, const UINT8* pLine, const UINT8* pPrev,
+	size_t szBpp, size_t szLength, UINT uType);
+typedef UINT (*SELECT_PROC)(const UINT8* pLine, const UINT8* pPrev, size_t szBpp, size_t szLength);
+
+/* indexed by filter type, NULL for types left to lodepng */
+static UNFILTER_PROC mUnfilter[5];
+static FILTER_PROC mFilter;
+static SELECT_PROC mMinSum;
+static SELECT_PROC mEntropy;
+static INIT_ONCE mInitOnce = INIT_ONCE_STATIC_INIT;
+
+#ifdef PNGFILTER_X86
+/* same as lodepng's paethPredictor */
+static UINT8 PaethScalar(UINT a, UINT b, UINT c)
+{
+	UINT pa = b > c ? b - c : c - b;
+	UINT pb = a > c ? a - c : c - a;
+	UINT pc = (a + b > c + c) ? a + b - c - c : c + c - a - b;
+	if (pb < pa)
+	{
+		a = b;
+		pa = pb;
+	}
+	return (UINT8)(pc < pa ? c : a);
+}
+
+/* byte i of pLine filtered with uType, for the row edges */
+static UINT8 FilterByte(const UINT8* pLine, const UINT8* pPrev, size_t szBpp, size_t i, UINT uType)
+{
+	UINT x = pLine[i];
+	UINT a = i >= szBpp ? pLine[i - szBpp] : 0;
+	UINT b = pPrev[i];
+	UINT c = i >= szBpp ? pPrev[i - szBpp] : 0;
+	switch (uType)
+	{
+	case 1:
+		return (UINT8)(x - a);
+	case 2:
+		return (UINT8)(x - b);
+	case 3:
+		return (UINT8)(x - ((a + b) >> 1));
+	case 4:
+		return (UINT8)(x - PaethScalar(a, b, c));
+	}
+	return (UINT8)x;
+}
+
+/* integer approximation of i * log2(i), same as lodepng's ilog2i */
+static size_t ILog2i(size_t i)
+{
+	size_t l = 0;
+	size_t v = i;
+	if (i == 0)
+		return 0;
+	while (v >= 2)
+	{
+		v >>= 1;
+		l++;
+	}
+	return i * l + ((i - ((size_t)1 << l)) << 1);
+}
+
+static __m128i LoadPixel(const UINT8* p, size_t szBpp)
+{
+	UINT u = (UINT)p[0] | ((UINT)p[1] << 8) | ((UINT)p[2] << 16);
+	if (szBpp == 4)
+		u |= (UINT)p[3] << 24;
+	return _mm_cvtsi32_si128((int)u);
+}
+
+static VOID StorePixel(UINT8* p, __m128i v, size_t szBpp)
+{
+	UINT u = (UINT)_mm_cvtsi128_si32(v);
+	p[0] = (UINT8)u;
+	p[1] = (UINT8)(u >> 8);
+	p[2] = (UINT8)(u >> 16);
+	if (szBpp == 4)
+		p[3] = (UINT8)(u >> 24);
+}
+
+static VOID UnfilterUpSse2(UINT8* pDst, const UINT8* pSrc, const UINT8* pPrev,
+	size_t szBpp, size_t szLength)
+{
+	size_t i;
+	UNREFERENCED_PARAMETER(szBpp);
+	for (i = 0; i + 16 <= szLength; i += 16)
+	{
+		__m128i x = _mm_loadu_si128((const __m128i*)(pSrc + i));
+		__m128i b = _mm_loadu_si128((const __m128i*)(pPrev + i));
+		_mm_storeu_si128((__m128i*)(pDst + i), _mm_add_epi8(x, b));
+	}
+	for (; i < szLength; i++)
+		pDst[i] = (UINT8)(pSrc[i] + pPrev[i]);
+}
+
+static FE_TARGET("avx2") VOID UnfilterUpAvx2(UINT8* pDst, const UINT8* pSrc, const UINT8* pPrev,
+	size_t szBpp, size_t szLength)
+{
+	size_t i;
+	for (i = 0; i + 32 <= szLength; i += 32)
+	{
+		__m256i x = _mm256_loadu_si256((const __m256i*)(pSrc + i));
+		__m256i b = _mm256_loadu_si256((const __m256i*)(pPrev + i));
+		_mm256_storeu_si256((__m256i*)(pDst + i), _mm256_add_epi8(x, b));
+	}
+	_mm256_zeroupper();
+	UnfilterUpSse2(pDst + i, pSrc + i, pPrev + i, szBpp, szLength - i);
+}
+
+/* each pixel adds all earlier ones in its block of 4, then the carry from the last block */
+static VOID UnfilterSubSse2(UINT8* pDst, const UINT8* pSrc, const UINT8* pPrev,
+	size_t szBpp, size_t szLength)
+{
+	size_t i = 0;
+	__m128i a = _mm_setzero_si128();
+	UNREFERENCED_PARAMETER(pPrev);
+	if (szBpp == 4)
+	{
+		for (; i + 16 <= szLength; i += 16)
+		{
+			__m128i x = _mm_loadu_si128((const __m128i*)(pSrc + i));
+			x = _mm_add_epi8(x, _mm_slli_si128(x, 4));
+			x = _mm_add_epi8(x, _mm_slli_si128(x, 8));
+			x = _mm_add_epi8(x, _mm_shuffle_epi32(a, _MM_SHUFFLE(3, 3, 3, 3)));
+			_mm_storeu_si128((__m128i*)(pDst + i), x);
+			a = x;
+		}
+		a = _mm_srli_si128(a, 12);
+	}
+	else
+	{
+		const __m128i mask = _mm_cvtsi32_si128(0xFFFFFF);
+		// 16 bytes are read but only 12 stored, pDst may be pSrc
+		for (; i + 16 <= szLength; i += 12)
+		{
+			__m128i x = _mm_loadu_si128((const __m128i*)(pSrc + i));
+			__m128i c = _mm_or_si128(a, _mm_slli_si128(a, 3));
+			x = _mm_add_epi8(x, _mm_slli_si128(x, 3));
+			x = _mm_add_epi8(x, _mm_slli_si128(x, 6));
+			x = _mm_add_epi8(x, _mm_or_si128(c, _mm_slli_si128(c, 6)));
+			_mm_storel_epi64((__m128i*)(pDst + i), x);
+			StorePixel(pDst + i + 8, _mm_srli_si128(x, 8), 4);
+			a = _mm_and_si128(_mm_srli_si128(x, 9), mask);
+		}
+	}
+	for (; i + szBpp <= szLength; i += szBpp)
+	{
+		a = _mm_add_epi8(a, LoadPixel(pSrc + i, szBpp));
+		StorePixel(pDst + i, a, szBpp);
+	}
+}
+
+static VOID UnfilterAvgSse2(UINT8* pDst, const UINT8* pSrc, const UINT8* pPrev,
+	size_t szBpp, size_t szLength)
+{
+	size_t i;
+	const __m128i one = _mm_set1_epi8(1);
+	__m128i a = _mm_setzero_si128();
+	for (i = 0; i + szBpp <= szLength; i += szBpp)
+	{
+		__m128i b = LoadPixel(pPrev + i, szBpp);
+		// pavgb rounds up, take the carry back off
+		__m128i avg = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one));
+		a = _mm_add_epi8(LoadPixel(pSrc + i, szBpp), avg);
+		StorePixel(pDst + i, a, szBpp);
+	}
+}
+
+/* Paeth predictor of 16-bit lanes, ties favour a over b over c,
+ * three vector arguments at most for 32-bit MSVC */
+static __m128i PaethSse2(__m128i a, __m128i b, __m128i c)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i pa = _mm_sub_epi16(b, c);
+	__m128i pb = _mm_sub_epi16(a, c);
+	__m128i pc = _mm_add_epi16(pa, pb);
+	__m128i s, n;
+	pa = _mm_max_epi16(pa, _mm_sub_epi16(zero, pa));
+	pb = _mm_max_epi16(pb, _mm_sub_epi16(zero, pb));
+	pc = _mm_max_epi16(pc, _mm_sub_epi16(zero, pc));
+	s = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+	pb = _mm_cmpeq_epi16(s, pb);
+	pa = _mm_cmpeq_epi16(s, pa);
+	n = _mm_or_si128(_mm_and_si128(pb, b), _mm_andnot_si128(pb, c));
+	return _mm_or_si128(_mm_and_si128(pa, a), _mm_andnot_si128(pa, n));
+}
+
+static FE_TARGET("ssse3") __m128i PaethSsse3(__m128i a, __m128i b, __m128i c)
+{
+	__m128i pa = _mm_sub_epi16(b, c);
+	__m128i pb = _mm_sub_epi16(a, c);
+	__m128i pc = _mm_abs_epi16(_mm_add_epi16(pa, pb));
+	__m128i s, n;
+	pa = _mm_abs_epi16(pa);
+	pb = _mm_abs_epi16(pb);
+	s = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+	pb = _mm_cmpeq_epi16(s, pb);
+	pa = _mm_cmpeq_epi16(s, pa);
+	n = _mm_or_si128(_mm_and_si128(pb, b), _mm_andnot_si128(pb, c));
+	return _mm_or_si128(_mm_and_si128(pa, a), _mm_andnot_si128(pa, n));
+}
+
+static VOID UnfilterPaethSse2(UINT8* pDst, const UINT8* pSrc, const UINT8* pPrev,
+	size_t szBpp, size_t szLength)
+{
+	size_t i;
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i lo = _mm_set1_epi16(0xFF);
+	__m128i a = zero;
+	__m128i c = zero;
+	for (i = 0; i + szBpp <= szLength; i += szBpp)
+	{
+		__m128i b = _mm_unpacklo_epi8(LoadPixel(pPrev + i, szBpp), zero);
+		__m128i x = _mm_unpacklo_epi8(LoadPixel(pSrc + i, szBpp), zero);
+		a = _mm_and_si128(_mm_add_epi16(x, PaethSse2(a, b, c)), lo);
+		StorePixel(pDst + i, _mm_packus_epi16(a, a), szBpp);
+		c = b;
+	}
+}
+
+static FE_TARGET("ssse3") VOID UnfilterPaethSsse3(UINT8* pDst, const UINT8* pSrc, const UINT8* pPrev,
+	size_t szBpp, size_t szLength)
+{
+	size_t i;
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i lo = _mm_set1_epi16(0xFF);
+	__m128i a = zero;
+	__m128i c = zero;
+	for (i = 0; i + szBpp <= szLength; i += szBpp)
+	{
+		__m128i b = _mm_unpacklo_epi8(LoadPixel(pPrev + i, szBpp), zero);
+		__m128i x = _mm_unpacklo_epi8(LoadPixel(pSrc + i, szBpp), zero);
+		a = _mm_and_si128(_mm_add_epi16(x, PaethSsse3(a, b, c)), lo);
+		StorePixel(pDst + i, _mm_packus_epi16(a, a), szBpp);
+		c = b;
+	}
+}
+
+/* 16 bytes of pLine filtered with uType, pLine and pPrev point at least szBpp bytes into the row */
+static __m128i FilterVector(const UINT8* pLine, const UINT8* pPrev, size_t szBpp, UINT uType)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i x = _mm_loadu_si128((const __m128i*)pLine);
+	__m128i a, b, c, lo, hi;
+	switch (uType)
+	{
+	case 1:
+		return _mm_sub_epi8(x, _mm_loadu_si128((const __m128i*)(pLine - szBpp)));
+	case 2:
+		return _mm_sub_epi8(x, _mm_loadu_si128((const __m128i*)pPrev));
+	case 3:
+		a = _mm_loadu_si128((const __m128i*)(pLine - szBpp));
+		b = _mm_loadu_si128((const __m128i*)pPrev);
+		c = _mm_and_si128(_mm_xor_si128(a, b), _mm_set1_epi8(1));
+		return _mm_sub_epi8(x, _mm_sub_epi8(_mm_avg_epu8(a, b), c));
+	case 4:
+		a = _mm_loadu_si128((const __m128i*)(pLine - szBpp));
+		b = _mm_loadu_si128((const __m128i*)pPrev);
+		c = _mm_loadu_si128((const __m128i*)(pPrev - szBpp));
+		lo = PaethSse2(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero), _mm_unpacklo_epi8(c, zero));
+		hi = PaethSse2(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero), _mm_unpackhi_epi8(c, zero));
+		return _mm_sub_epi8(x, _mm_packus_epi16(lo, hi));
+	}
+	return x;
+}
+
+static VOID FilterSse2(UINT8* pOut, const UINT8* pLine, const UINT8* pPrev,
+	size_t szBpp, size_t szLength, UINT uType)
+{
+	size_t i;
+	for (i = 0; i < szBpp && i < szLength; i++)
+		pOut[i] = FilterByte(pLine, pPrev, szBpp, i, uType);
+	for (; i + 16 <= szLength; i += 16)
+		_mm_storeu_si128((__m128i*)(pOut + i), FilterVector(pLine + i, pPrev + i, szBpp, uType));
+	for (; i < szLength; i++)
+		pOut[i] = FilterByte(pLine, pPrev, szBpp, i, uType);
+}
+
+/* lodepng scores type 0 by its unsigned sum and the others as signed bytes,
+ * where a negative s costs 255 - s, not 256 - s */
+static VOID MinSumBytes(UINT64 ullSum[5], const UINT8* pLine, const UINT8* pPrev,
+	size_t szBpp, size_t i, size_t szEnd)
+{
+	UINT t;
+	for (; i < szEnd; i++)
+	{
+		ullSum[0] += pLine[i];
+		for (t = 1; t < 5; t++)
+		{
+			UINT8 s = FilterByte(pLine, pPrev, szBpp, i, t);
+			ullSum[t] += s < 128 ? s : 255U - s;
+		}
+	}
+}
+
+static UINT MinSumSse2(const UINT8* pLine, const UINT8* pPrev, size_t szBpp, size_t szLength)
+{
+	size_t i;
+	UINT t, uBest = 0;
+	UINT64 ullSum[5] = { 0 };
+	UINT64 ullLanes[2];
+	const __m128i zero = _mm_setzero_si128();
+	__m128i sum[5];
+	for (t = 0; t < 5; t++)
+		sum[t] = zero;
+
+	i = min(szBpp, szLength);
+	MinSumBytes(ullSum, pLine, pPrev, szBpp, 0, i);
+	for (; i + 16 <= szLength; i += 16)
+	{
+		sum[0] = _mm_add_epi64(sum[0], _mm_sad_epu8(_mm_loadu_si128((const __m128i*)(pLine + i)), zero));
+		for (t = 1; t < 5; t++)
+		{
+			__m128i v = FilterVector(pLine + i, pPrev + i, szBpp, t);
+			v = _mm_xor_si128(v, _mm_cmpgt_epi8(zero, v));
+			sum[t] = _mm_add_epi64(sum[t], _mm_sad_epu8(v, zero));
+		}
+	}
+	MinSumBytes(ullSum, pLine, pPrev, szBpp, i, szLength);
+
+	for (t = 0; t < 5; t++)
+	{
+		_mm_storeu_si128((__m128i*)ullLanes, sum[t]);
+		ullSum[t] += ullLanes[0] + ullLanes[1];
+		if (ullSum[t] < ullSum[uBest])
+			uBest = t;
+	}
+	return uBest;
+}
+
+static UINT EntropySse2(const UINT8* pLine, const UINT8* pPrev, size_t szBpp, size_t szLength)
+{
+	size_t i, j;
+	UINT t, uBest = 0;
+	size_t szBest = 0;
+	UINT uCount[5][256];
+	UINT8 aBlock[16];
+	ZeroMemory(uCount, sizeof(uCount));
+
+	for (i = 0; i < szBpp && i < szLength; i++)
+	{
+		for (t = 0; t < 5; t++)
+			uCount[t][FilterByte(pLine, pPrev, szBpp, i, t)]++;
+	}
+	for (; i + 16 <= szLength; i += 16)
+	{
+		for (t = 0; t < 5; t++)
+		{
+			_mm_storeu_si128((__m128i*)aBlock, FilterVector(pLine + i, pPrev + i, szBpp, t));
+			for (j = 0; j < 16; j++)
+				uCount[t][aBlock[j]]++;
+		}
+	}
+	for (; i < szLength; i++)
+	{
+		for (t = 0; t < 5; t++)
+			uCount[t][FilterByte(pLine, pPrev, szBpp, i, t)]++;
+	}
+
+	for (t = 0; t < 5; t++)
+	{
+		size_t szSum = 0;
+		// the filter type byte is part of the scanline
+		uCount[t][t]++;
+		for (j = 0; j < 256; j++)
+			szSum += ILog2i(uCount[t][j]);
+		if (t == 0 || szSum > szBest)
+		{
+			uBest = t;
+			szBest = szSum;
+		}
+	}
+	return uBest;
+}
+#endif
+
+static BOOL CALLBACK InitFilter(PINIT_ONCE pInitOnce, PVOID pParameter, PVOID* ppContext)
+{
+	UINT uFeatures = FeGetCpuFeatures();
+	UNREFERENCED_PARAMETER(pInitOnce);
+	UNREFERENCED_PARAMETER(pParameter);
+	UNREFERENCED_PARAMETER(ppContext);
+
+#ifdef PNGFILTER_X86
+	if (uFeatures & FE_CPU_SSE2)
+	{
+		mUnfilter[1] = UnfilterSubSse2;
+		mUnfilter[2] = UnfilterUpSse2;
+		mUnfilter[3] = UnfilterAvgSse2;
+		mUnfilter[4] = UnfilterPaethSse2;
+		mFilter = FilterSse2;
+		mMinSum = MinSumSse2;
+		mEntropy = EntropySse2;
+	}
+	if (uFeatures & FE_CPU_SSSE3)
+		mUnfilter[4] = UnfilterPaethSsse3;
+	if (uFeatures & FE_CPU_AVX2)
+		mUnfilter[2] = UnfilterUpAvx2;
+#else
+	UNREFERENCED_PARAMETER(uFeatures);
+#endif
+	return TRUE;
+}
+
+BOOL FeUnfilterRow(UINT8* pDst, const UINT8* pSrc, const UINT8* pPrev,
+	size_t szBpp, UINT uType, size_t szLength)
+{
+	// the first row of Up, Avg and Paeth is rare enough to leave to the caller
+	if ((szBpp != 3 && szBpp != 4) || uType > 4 || (!pPrev && uType != 1))
+		return FALSE;
+	InitOnceExecuteOnce(&mInitOnce, InitFilter, NULL, NULL);
+	if (!mUnfilter[uType])
+		return FALSE;
+	mUnfilter[uType](pDst, pSrc, pPrev, szBpp, szLength);
+	return TRUE;
+}
+
+BOOL FeFilterRow(UINT8* pOut, const UINT8* pLine, const UINT8* pPrev,
+	size_t szBpp, UINT uStrategy, size_t szLength)
+{
+	UINT uType;
+	if (!pPrev || szBpp == 0)
+		return FALSE;
+	InitOnceExecuteOnce(&mInitOnce, InitFilter, NULL, NULL);
+	if (!mFilter)
+		return FALSE;
+	if (uStrategy == LFS_MINSUM)
+		uType = mMinSum(pLine, pPrev, szBpp, szLength);
+	else if (uStrategy == LFS_ENTROPY)
+		uType = mEntropy(pLine, pPrev, szBpp, szLength);
+	else if (uStrategy <= LFS_FOUR)
+		uType = uStrategy;
+	else
+		return FALSE;
+	pOut[0] = (UINT8)uType;
+	mFilter(pOut + 1, pLine, pPrev, szBpp, szLength, uType);
+	return TRUE;
+}
+
+/* hooks for lodepng */
+
+unsigned lodepng_unfilter_scanline(unsigned char* recon, const unsigned char* scanline,
+	const unsigned char* precon, size_t bytewidth, unsigned char filterType, size_t length)
+{
+	return FeUnfilterRow(recon, scanline, precon, bytewidth, filterType, length);
+}
+
+unsigned lodepng_custom_filter_scanline(unsigned char* out, const unsigned char* scanline,
+	const unsigned char* prevline, size_t length, size_t bytewidth, LodePNGFilterStrategy strategy)
+{
+	return FeFilterRow(out, scanline, prevline, bytewidth, (UINT)strategy, length);
+}
@@ -0,0 +1,26 @@
+﻿// SPDX-License-Identifier: GPL-3.0-or-later
+#pragma once
+
+#include "fe.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* undo PNG filter uType (1 to 4) on one row of 8-bit pixels of szBpp bytes,
+ * pPrev is the previous unfiltered row, pDst may equal pSrc,
+ * return FALSE and leave pDst untouched if the row is not handled here */
+BOOL FeUnfilterRow(UINT8* pDst, const UINT8* pSrc, const UINT8* pPrev,
+	size_t szBpp, UINT uType, size_t szLength);
+
+/* filter one row of szLength bytes with pixels of szBpp bytes for lodepng's
+ * LodePNGFilterStrategy uStrategy, LFS_ZERO to LFS_ENTROPY, pPrev is the
+ * previous row, pOut gets the filter type byte then the filtered row,
+ * return FALSE and leave pOut untouched if the row is not handled here */
+BOOL FeFilterRow(UINT8* pOut, const UINT8* pLine, const UINT8* pPrev,
+	size_t szBpp, UINT uStrategy, size_t szLength);
+
+#ifdef __cplusplus
+}
+#endif
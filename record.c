@@ -0,0 +1,212 @@
+﻿// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "fe.h"
+#include "utils.h"
+#include "record.h"
+
+/*
+ * The capture thread fills a ring of preallocated frames on a fixed clock and
+ * never waits for the encoder: when every frame is still queued the tick is
+ * dropped. The encoder thread drains the ring in order into the APNG, where
+ * frames which did not change only extend the delay of the previous one.
+ */
+
+#define RECORD_RING_SIZE 4
+
+typedef struct _RECORD_FRAME
+{
+	UINT8* pBgrx;
+	UINT64 llCapture;
+} RECORD_FRAME;
+
+struct _FE_RECORD
+{
+	FE_RECORD_CAPTURE pfnCapture;
+	PVOID pCapture;
+	FE_APNG* pApng;
+	UINT uWidth;
+	UINT uHeight;
+	double dInterval;
+	UINT64 llStart;
+	SRWLOCK Lock;
+	/* wakes the encoder when a frame is queued, and both threads to stop */
+	CONDITION_VARIABLE Queued;
+	CONDITION_VARIABLE Stop;
+	RECORD_FRAME Ring[RECORD_RING_SIZE];
+	UINT uHead;
+	UINT uCount;
+	BOOL bStop;
+	UINT uError;
+	FE_RECORD_STATS Stats;
+	HANDLE hCapture;
+	HANDLE hEncoder;
+};
+
+static DWORD WINAPI RecordCaptureThread(LPVOID lpParameter)
+{
+	UINT64 llTick = 0;
+	double dLeft;
+	BOOL bOk;
+	RECORD_FRAME* pFrame;
+	FE_RECORD* pRecord = lpParameter;
+
+	AcquireSRWLockExclusive(&pRecord->Lock);
+	for (;;)
+	{
+		dLeft = (double)llTick * pRecord->dInterval - FeElapsedMs(pRecord->llStart, FeGetTimestamp());
+		if (pRecord->bStop)
+			break;
+		if (dLeft > 0)
+		{
+			SleepConditionVariableSRW(&pRecord->Stop, &pRecord->Lock, (DWORD)dLeft + 1, 0);
+			continue;
+		}
+		/* a slow capture skips the ticks it missed */
+		llTick = (UINT64)(FeElapsedMs(pRecord->llStart, FeGetTimestamp()) / pRecord->dInterval) + 1;
+		if (pRecord->uCount == RECORD_RING_SIZE)
+		{
+			pRecord->Stats.uDropped++;
+			continue;
+		}
+		/* the encoder does not touch the frames past uCount */
+		pFrame = &pRecord->Ring[(pRecord->uHead + pRecord->uCount) % RECORD_RING_SIZE];
+		ReleaseSRWLockExclusive(&pRecord->Lock);
+		bOk = pRecord->pfnCapture(pRecord->pCapture, pFrame->pBgrx, pRecord->uWidth, pRecord->uHeight);
+		pFrame->llCapture = FeGetTimestamp();
+		AcquireSRWLockExclusive(&pRecord->Lock);
+		if (!bOk)
+			continue;
+		pRecord->uCount++;
+		pRecord->Stats.uCaptured++;
+		WakeConditionVariable(&pRecord->Queued);
+	}
+	ReleaseSRWLockExclusive(&pRecord->Lock);
+	return 0;
+}
+
+static DWORD WINAPI RecordEncoderThread(LPVOID lpParameter)
+{
+	UINT uError;
+	BOOL bChanged;
+	double dLatency;
+	RECORD_FRAME* pFrame;
+	FE_RECORD* pRecord = lpParameter;
+
+	AcquireSRWLockExclusive(&pRecord->Lock);
+	for (;;)
+	{
+		while (pRecord->uCount == 0 && !pRecord->bStop)
+			SleepConditionVariableSRW(&pRecord->Queued, &pRecord->Lock, INFINITE, 0);
+		/* the frames queued before the stop are still written */
+		if (pRecord->uCount == 0)
+			break;
+		pFrame = &pRecord->Ring[pRecord->uHead];
+		ReleaseSRWLockExclusive(&pRecord->Lock);
+		uError = FeAddApngFrame(pRecord->pApng, pFrame->pBgrx, (size_t)pRecord->uWidth * 4,
+			(UINT)FeElapsedMs(pRecord->llStart, pFrame->llCapture), &bChanged);
+		dLatency = FeElapsedMs(pFrame->llCapture, FeGetTimestamp());
+		AcquireSRWLockExclusive(&pRecord->Lock);
+		pRecord->uHead = (pRecord->uHead + 1) % RECORD_RING_SIZE;
+		pRecord->uCount--;
+		if (uError && !pRecord->uError)
+			pRecord->uError = uError;
+		if (bChanged)
+			pRecord->Stats.uChanged++;
+		pRecord->Stats.dLatency += dLatency;
+		if (dLatency > pRecord->Stats.dMaxLatency)
+			pRecord->Stats.dMaxLatency = dLatency;
+	}
+	ReleaseSRWLockExclusive(&pRecord->Lock);
+	return 0;
+}
+
+static VOID RecordFree(FE_RECORD* pRecord)
+{
+	UINT i;
+	for (i = 0; i < RECORD_RING_SIZE; i++)
+		free(pRecord->Ring[i].pBgrx);
+	free(pRecord);
+}
+
+FE_RECORD* FeStartRecord(FE_RECORD_CAPTURE pfnCapture, PVOID pCapture,
+	FE_PNG_WRITE pfnWrite, FE_PNG_PATCH pfnPatch, PVOID pContext,
+	UINT w, UINT h, UINT uFps, FE_PNG_PROFILE uProfile)
+{
+	UINT i;
+	FE_RECORD* pRecord = calloc(1, sizeof(FE_RECORD));
+	if (!pRecord)
+		return NULL;
+	pRecord->pfnCapture = pfnCapture;
+	pRecord->pCapture = pCapture;
+	pRecord->uWidth = w;
+	pRecord->uHeight = h;
+	pRecord->dInterval = 1000.0 / (uFps ? uFps : 1);
+	InitializeSRWLock(&pRecord->Lock);
+	InitializeConditionVariable(&pRecord->Queued);
+	InitializeConditionVariable(&pRecord->Stop);
+	for (i = 0; i < RECORD_RING_SIZE; i++)
+	{
+		pRecord->Ring[i].pBgrx = malloc((size_t)w * 4 * h);
+		if (!pRecord->Ring[i].pBgrx)
+			goto fail;
+	}
+	pRecord->pApng = FeCreateApng(pfnWrite, pfnPatch, pContext, w, h, uProfile);
+	if (!pRecord->pApng)
+		goto fail;
+
+	pRecord->llStart = FeGetTimestamp();
+	pRecord->hEncoder = CreateThread(NULL, 0, RecordEncoderThread, pRecord, 0, NULL);
+	if (!pRecord->hEncoder)
+		goto fail;
+	pRecord->hCapture = CreateThread(NULL, 0, RecordCaptureThread, pRecord, 0, NULL);
+	if (!pRecord->hCapture)
+	{
+		FeStopRecord(pRecord, NULL, NULL);
+		return NULL;
+	}
+	return pRecord;
+fail:
+	if (pRecord->pApng)
+		FeCloseApng(pRecord->pApng, 0, NULL);
+	RecordFree(pRecord);
+	return NULL;
+}
+
+VOID FeGetRecordStats(FE_RECORD* pRecord, FE_RECORD_STATS* pStats)
+{
+	UINT uEncoded;
+	AcquireSRWLockShared(&pRecord->Lock);
+	*pStats = pRecord->Stats;
+	/* the frames still in the ring are not counted */
+	uEncoded = pStats->uCaptured - pRecord->uCount;
+	ReleaseSRWLockShared(&pRecord->Lock);
+	if (uEncoded)
+		pStats->dLatency /= uEncoded;
+}
+
+UINT FeStopRecord(FE_RECORD* pRecord, size_t* pszPng, FE_RECORD_STATS* pStats)
+{
+	UINT uError;
+	/* the queued frames are encoded after this, the last one ends here */
+	UINT uEnd = (UINT)FeElapsedMs(pRecord->llStart, FeGetTimestamp());
+	AcquireSRWLockExclusive(&pRecord->Lock);
+	pRecord->bStop = TRUE;
+	WakeConditionVariable(&pRecord->Stop);
+	WakeConditionVariable(&pRecord->Queued);
+	ReleaseSRWLockExclusive(&pRecord->Lock);
+	if (pRecord->hCapture)
+	{
+		WaitForSingleObject(pRecord->hCapture, INFINITE);
+		CloseHandle(pRecord->hCapture);
+	}
+	WaitForSingleObject(pRecord->hEncoder, INFINITE);
+	CloseHandle(pRecord->hEncoder);
+
+	if (pStats)
+		FeGetRecordStats(pRecord, pStats);
+	uError = FeCloseApng(pRecord->pApng, uEnd, pszPng);
+	if (!uError)
+		uError = pRecord->uError;
+	RecordFree(pRecord);
+	return uError;
+}
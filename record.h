@@ -0,0 +1,43 @@
+﻿// SPDX-License-Identifier: GPL-3.0-or-later
+#pragma once
+
+#include "fe.h"
+#include "pngenc.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* fills a frame of top-down BGRX rows, w * 4 bytes each, returns FALSE to skip it */
+typedef BOOL (*FE_RECORD_CAPTURE)(PVOID pContext, UINT8* pBgrx, UINT w, UINT h);
+
+typedef struct _FE_RECORD FE_RECORD;
+
+typedef struct _FE_RECORD_STATS
+{
+	UINT uCaptured;
+	/* ticks skipped because every frame buffer was waiting for the encoder */
+	UINT uDropped;
+	/* captured frames which differed from the one before */
+	UINT uChanged;
+	/* from the capture of a frame until it is written, in milliseconds */
+	double dLatency;
+	double dMaxLatency;
+} FE_RECORD_STATS;
+
+/* capture w x h frames uFps times a second on one thread and encode them into an
+ * APNG on another, see FeCreateApng for the callbacks */
+FE_RECORD* FeStartRecord(FE_RECORD_CAPTURE pfnCapture, PVOID pCapture,
+	FE_PNG_WRITE pfnWrite, FE_PNG_PATCH pfnPatch, PVOID pContext,
+	UINT w, UINT h, UINT uFps, FE_PNG_PROFILE uProfile);
+
+/* average latency of the frames encoded so far */
+VOID FeGetRecordStats(FE_RECORD* pRecord, FE_RECORD_STATS* pStats);
+
+/* stop capturing, encode the frames still queued, close the APNG and free pRecord */
+UINT FeStopRecord(FE_RECORD* pRecord, size_t* pszPng, FE_RECORD_STATS* pStats);
+
+#ifdef __cplusplus
+}
+#endif
@@ -2,21 +2,65 @@
 
 #include "fe.h"
 #include "utils.h"
-#include "lodepng/lodepng.h"
+#include "pngenc.h"
+#include "jobqueue.h"
+#include "swizzle.h"
+#include "record.h"
+#include "capture.h"
+#include "clipboard.h"
+#include "imgenc.h"
 
 #include <commdlg.h>
 
-static void GetScreenXY(LPCWSTR str, int* x, int* y, int* w, int* h)
+typedef struct _MONITOR_QUERY
 {
-	RECT rec = { 0 };
-	if (!str || _wcsicmp(str, L"all") == 0)
+	/* 1 for the first monitor enumerated */
+	int nIndex;
+	RECT rc;
+	BOOL bFound;
+} MONITOR_QUERY;
+
+static BOOL CALLBACK FindMonitorProc(HMONITOR hMonitor, HDC hdc, LPRECT lprc, LPARAM lParam)
+{
+	MONITOR_QUERY* pQuery = (MONITOR_QUERY*)lParam;
+	UNREFERENCED_PARAMETER(hMonitor);
+	UNREFERENCED_PARAMETER(hdc);
+	if (--pQuery->nIndex > 0)
+		return TRUE;
+	pQuery->rc = *lprc;
+	pQuery->bFound = TRUE;
+	return FALSE;
+}
+
+/* "x,y,w,h" in virtual screen coordinates */
+static BOOL ParseScreenRect(LPCWSTR str, RECT* rec)
+{
+	int i;
+	LONG v[4];
+	WCHAR* end;
+	for (i = 0; i < 4; i++)
 	{
-		*x = GetSystemMetrics(SM_XVIRTUALSCREEN);
-		*y = GetSystemMetrics(SM_YVIRTUALSCREEN);
-		*w = GetSystemMetrics(SM_CXVIRTUALSCREEN) - (*x);
-		*h = GetSystemMetrics(SM_CYVIRTUALSCREEN) - (*y);
-		return;
+		v[i] = wcstol(str, &end, 10);
+		if (end == str || (i < 3 && *end != L','))
+			return FALSE;
+		str = end + 1;
 	}
+	rec->left = v[0];
+	rec->top = v[1];
+	rec->right = v[0] + v[2];
+	rec->bottom = v[1] + v[3];
+	return TRUE;
+}
+
+/* returns TRUE when the area lies on the virtual screen and can be read from the desktop buffer */
+static BOOL GetScreenXY(LPCWSTR str, int* x, int* y, int* w, int* h)
+{
+	BOOL bDesktop = TRUE;
+	RECT rec = { 0 };
+	RECT desk;
+	FeGetVirtualScreen(&desk);
+	if (!str || _wcsicmp(str, L"all") == 0)
+		rec = desk;
 	else if (_wcsicmp(str, L"current") == 0)
 	{
 		HWND hWnd = GetForegroundWindow();
@@ -24,6 +68,22 @@ static void GetScreenXY(LPCWSTR str, int* x, int* y, int* w, int* h)
 			goto fallback;
 		if (GetWindowRect(hWnd, &rec) == FALSE)
 			goto fallback;
+		bDesktop = FALSE;
+	}
+	else if (_wcsnicmp(str, L"rect:", 5) == 0)
+	{
+		if (!ParseScreenRect(&str[5], &rec) || !IntersectRect(&rec, &rec, &desk))
+			goto fallback;
+	}
+	else if (_wcsnicmp(str, L"monitor:", 8) == 0)
+	{
+		MONITOR_QUERY query = { 0 };
+		query.nIndex = (int)wcstol(&str[8], NULL, 10);
+		if (query.nIndex < 1)
+			goto fallback;
+		EnumDisplayMonitors(NULL, NULL, FindMonitorProc, (LPARAM)&query);
+		if (!query.bFound || !IntersectRect(&rec, &query.rc, &desk))
+			goto fallback;
 	}
 	else
 		goto fallback;
@@ -32,87 +92,179 @@ static void GetScreenXY(LPCWSTR str, int* x, int* y, int* w, int* h)
 	*y = rec.top;
 	*w = rec.right - rec.left;
 	*h = rec.bottom - rec.top;
-	return;
+	return bDesktop;
 fallback:
 	*x = 0;
 	*y = 0;
 	*w = GetSystemMetrics(SM_CXSCREEN);
 	*h = GetSystemMetrics(SM_CYSCREEN);
+	return FALSE;
 }
 
-#pragma pack(1)
-typedef struct _RGBA_PIXEL
+typedef struct _SCREENSHOT_JOB
 {
-	UINT8 b;
-	UINT8 g;
-	UINT8 r;
-	UINT8 a;
-} RGBA_PIXEL;
-#pragma pack()
+	FE_JOB Job;
+	HBITMAP hBitmap;
+	/* the pixels are held in mCapture, hBitmap is NULL */
+	BOOL bDesktop;
+	/* top-down BGRX rows of the DIB section */
+	UINT8* pPixels;
+	size_t szStride;
+	UINT w;
+	UINT h;
+	BOOL bRet;
+	FE_PNG_PROFILE uProfile;
+	const FE_IMAGE_WRITER* pWriter;
+	BOOL bDelta;
+	FE_PNG_DELTA_STATS Delta;
+	size_t szPng;
+	UINT64 llCapture;
+	UINT64 llEncoded;
+	WCHAR FilePath[MAX_PATH];
+} SCREENSHOT_JOB;
 
-static BOOL BmpToPng(HANDLE hf, HDC hDC, HBITMAP hBitmap, UINT w, UINT h)
+/* previous delta screenshot, only used by the job thread */
+static FE_PNG_DELTA* mDelta;
+/* encoder threads and tables kept warm for the next screenshot, only used by the job thread */
+static FE_PNG_ENCODER* mEncoder;
+/* virtual screen buffer, each screenshot only blits its own area,
+ * one taken while it is still held falls back to its own bitmap */
+static FE_CAPTURE* mCapture;
+
+static BOOL WritePng(LPCWSTR lpPath, const UINT8* png, size_t szPng)
 {
-	BOOL bRet = FALSE;
-	DWORD dwPng = 0;
-	size_t i, szImg, szPng = 0;
-	RGBA_PIXEL* raw = NULL;
-	UCHAR* png = NULL;
-	BITMAPINFOHEADER bmi = { 0 };
-	bmi.biSize = sizeof(BITMAPINFOHEADER);
-	bmi.biPlanes = 1;
-	bmi.biBitCount = 32;
-	bmi.biWidth = w;
-	bmi.biHeight = -((LONG)h);
-	bmi.biCompression = BI_RGB;
-	bmi.biSizeImage = 0;
-	szImg = ((UINT64)w) * h;
-	raw = calloc(szImg, sizeof(RGBA_PIXEL));
-	if (!raw)
+	BOOL bRet;
+	DWORD dwPng = (DWORD)szPng;
+	HANDLE hf = CreateFileW(lpPath, GENERIC_WRITE, 0, NULL,
+		CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (!hf || hf == INVALID_HANDLE_VALUE)
+		return FALSE;
+	bRet = WriteFile(hf, png, dwPng, &dwPng, NULL);
+	CloseHandle(hf);
+	return bRet;
+}
+
+static BOOL WritePngPart(PVOID pContext, const UINT8* pData, size_t szData)
+{
+	DWORD dwData = 0;
+	if (!WriteFile((HANDLE)pContext, pData, (DWORD)szData, &dwData, NULL))
 		return FALSE;
-	GetDIBits(hDC, hBitmap, 0, h, raw, (BITMAPINFO*)&bmi, DIB_RGB_COLORS);
-	for (i = 0; i < szImg; i++)
+	return dwData == szData;
+}
+
+static BOOL PatchPngPart(PVOID pContext, size_t szOffset, const UINT8* pData, size_t szData)
+{
+	BOOL bRet;
+	LARGE_INTEGER liPos = { 0 };
+	liPos.QuadPart = (LONGLONG)szOffset;
+	if (!SetFilePointerEx((HANDLE)pContext, liPos, NULL, FILE_BEGIN))
+		return FALSE;
+	bRet = WritePngPart(pContext, pData, szData);
+	liPos.QuadPart = 0;
+	return SetFilePointerEx((HANDLE)pContext, liPos, NULL, FILE_END) && bRet;
+}
+
+static VOID StreamScreenShot(SCREENSHOT_JOB* pShot)
+{
+	UINT uError;
+	HANDLE hf = CreateFileW(pShot->FilePath, GENERIC_WRITE, 0, NULL,
+		CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (!hf || hf == INVALID_HANDLE_VALUE)
+		return;
+	if (pShot->bDelta)
+		uError = FeStreamPngDelta(mEncoder, mDelta, WritePngPart, hf, &pShot->szPng,
+			pShot->pPixels, pShot->w, pShot->h, pShot->szStride, pShot->uProfile, &pShot->Delta);
+	else
+		uError = pShot->pWriter->pfnStream(mEncoder, WritePngPart, hf, &pShot->szPng, pShot->pPixels,
+			pShot->w, pShot->h, pShot->szStride, pShot->uProfile);
+	CloseHandle(hf);
+	if (uError != 0)
+		DeleteFileW(pShot->FilePath);
+	pShot->bRet = (uError == 0);
+}
+
+/* lodepng wants packed RGBA, the rows are moved down in place */
+static VOID PackScreenShot(SCREENSHOT_JOB* pShot)
+{
+	FeSwizzleRows(pShot->pPixels, pShot->w, pShot->h, pShot->szStride);
+	pShot->szStride = (size_t)pShot->w * 4;
+}
+
+static VOID RunScreenShotJob(FE_JOB* pJob)
+{
+	UINT uError;
+	UCHAR* png = NULL;
+	SCREENSHOT_JOB* pShot = (SCREENSHOT_JOB*)pJob;
+
+	if (!mEncoder)
+		mEncoder = FeCreatePngEncoder();
+	if (pShot->bDelta && !mDelta)
+		mDelta = FeCreatePngDelta();
+	if (!mDelta)
+		pShot->bDelta = FALSE;
+	/* the delta encoder keeps the stripes of the previous frame, even for max,
+	 * and the other formats have no profiles */
+	if (pShot->uProfile != FE_PNG_MAX || pShot->bDelta || pShot->pWriter->pfnStream != FeStreamPngBgrx)
 	{
-		UINT8 tmp = raw[i].b;
-		raw[i].b = raw[i].r;
-		raw[i].r = tmp;
-		raw[i].a = 0xFF;
+		/* encoding and writing overlap, the write stage stays empty */
+		StreamScreenShot(pShot);
+		pShot->llEncoded = FeGetTimestamp();
+		return;
 	}
-	if (lodepng_encode32(&png, &szPng, (const UINT8*)raw, w, h) != 0)
+	/* let lodepng reduce the color type */
+	PackScreenShot(pShot);
+	uError = FeEncodePng(mEncoder, &png, &pShot->szPng, pShot->pPixels,
+		pShot->w, pShot->h, pShot->uProfile);
+	if (uError != 0)
 	{
-		free(raw);
-		return FALSE;
+		pShot->llEncoded = FeGetTimestamp();
+		return;
 	}
-	free(raw);
-	dwPng = (DWORD)szPng;
-	bRet = WriteFile(hf, png, dwPng, &dwPng, NULL);
+	pShot->llEncoded = FeGetTimestamp();
+	pShot->bRet = WritePng(pShot->FilePath, png, pShot->szPng);
 	free(png);
-	return bRet;
 }
 
-BOOL SaveScreenShot(LPCWSTR lpSave, HDC hDC, HBITMAP hBitmap, UINT w, UINT h)
+static VOID FreeScreenShotJob(SCREENSHOT_JOB* pShot)
+{
+	if (pShot->hBitmap)
+		DeleteObject(pShot->hBitmap);
+	if (pShot->bDesktop)
+		FeReleaseCapture(mCapture);
+	free(pShot);
+}
+
+static VOID DoneScreenShotJob(FE_JOB* pJob)
+{
+	SCREENSHOT_JOB* pShot = (SCREENSHOT_JOB*)pJob;
+	FeAddLog(0, L"Screenshot %s %s, %Iu bytes, queue %u\r\n",
+		pShot->FilePath, pShot->bRet ? L"saved" : L"failed", pShot->szPng, pJob->uDepth);
+	FeAddLog(0, L"capture %.1f ms, wait %.1f ms, encode %.1f ms, write %.1f ms\r\n",
+		FeElapsedMs(pShot->llCapture, pJob->llQueued),
+		FeElapsedMs(pJob->llQueued, pJob->llStarted),
+		FeElapsedMs(pJob->llStarted, pShot->llEncoded),
+		FeElapsedMs(pShot->llEncoded, pJob->llFinished));
+	if (pShot->bDelta && pShot->Delta.uTiles)
+		FeAddLog(0, L"delta %u/%u tiles (%.1f%%), %u/%u stripes encoded\r\n",
+			pShot->Delta.uDirtyTiles, pShot->Delta.uTiles,
+			100.0 * pShot->Delta.uDirtyTiles / pShot->Delta.uTiles,
+			pShot->Delta.uDirtyStripes, pShot->Delta.uStripes);
+	FreeScreenShotJob(pShot);
+}
+
+static BOOL GetScreenShotPath(LPCWSTR lpSave, const FE_IMAGE_WRITER* pWriter, WCHAR* FilePath)
 {
-	BOOL bRet = FALSE;
-	HANDLE hf = INVALID_HANDLE_VALUE;
-	WCHAR FilePath[MAX_PATH];
 	SYSTEMTIME st;
 	GetSystemTime(&st);
-	if (!lpSave || _wcsicmp(lpSave, L"clipboard") == 0)
-	{
-		OpenClipboard(NULL);
-		EmptyClipboard();
-		SetClipboardData(CF_BITMAP, hBitmap);
-		CloseClipboard();
-		return TRUE;
-	}
-	else if (_wcsicmp(lpSave, L"ask") == 0)
+	if (_wcsicmp(lpSave, L"ask") == 0)
 	{
 		OPENFILENAMEW ofn;
-		swprintf(FilePath, MAX_PATH, L"ScreenShot-%u%u%u%u%u%u.png",
-			st.wYear, st.wMonth, st.wDay, st.wHour, st.wMinute, st.wSecond);
+		swprintf(FilePath, MAX_PATH, L"ScreenShot-%u%u%u%u%u%u.%s",
+			st.wYear, st.wMonth, st.wDay, st.wHour, st.wMinute, st.wSecond, pWriter->lpName);
 		ZeroMemory(&ofn, sizeof(ofn));
 		ofn.lStructSize = sizeof(ofn);
 		ofn.hwndOwner = gWnd;
-		ofn.lpstrFilter = L"PNG (*.png)\0*.png\0";
+		ofn.lpstrFilter = pWriter->lpFilter;
 		ofn.nFilterIndex = 1;
 		ofn.lpstrFile = FilePath;
 		ofn.nMaxFile = MAX_PATH;
@@ -120,55 +272,326 @@ BOOL SaveScreenShot(LPCWSTR lpSave, HDC hDC, HBITMAP hBitmap, UINT w, UINT h)
 		ofn.nMaxFileTitle = 0;
 		ofn.lpstrInitialDir = NULL;
 		ofn.Flags = OFN_CREATEPROMPT | OFN_OVERWRITEPROMPT;
-		ofn.lpstrDefExt = L"png";
-		bRet = GetSaveFileNameW(&ofn);
-		if (bRet == FALSE)
-			return bRet;
+		ofn.lpstrDefExt = pWriter->lpName;
+		return GetSaveFileNameW(&ofn);
 	}
-	else
+	swprintf(FilePath, MAX_PATH, L"%s-%u%u%u%u%u%u.%s", lpSave,
+		st.wYear, st.wMonth, st.wDay, st.wHour, st.wMinute, st.wSecond, pWriter->lpName);
+	return TRUE;
+}
+
+static HBITMAP CaptureScreen(int x, int y, int w, int h, UINT8** ppPixels)
+{
+	HBITMAP hBitmap = FeCreateScreenBitmap(w, h, ppPixels);
+	if (hBitmap && !FeBlitScreen(hBitmap, 0, 0, x, y, w, h))
 	{
-		swprintf(FilePath, MAX_PATH, L"%s-%u%u%u%u%u%u.png", lpSave,
-			st.wYear, st.wMonth, st.wDay, st.wHour, st.wMinute, st.wSecond);
+		DeleteObject(hBitmap);
+		hBitmap = NULL;
 	}
+	return hBitmap;
+}
 
-	hf = CreateFileW(FilePath, GENERIC_WRITE, 0, NULL,
-		CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
-	if (!hf || hf == INVALID_HANDLE_VALUE)
+/* the screenshot on the clipboard and its bitmap, owned until WM_DESTROYCLIPBOARD */
+static FE_CLIP* mClip;
+static HBITMAP mClipBitmap;
+/* encodes the PNG format on the job queue, or on the UI thread when WM_RENDERFORMAT comes first */
+static FE_PNG_ENCODER* mClipEncoder;
+static UINT mClipPng;
+
+static UINT GetClipFormat(FE_CLIP_FORMAT uFormat)
+{
+	return uFormat == FE_CLIP_PNG ? mClipPng : CF_DIBV5;
+}
+
+static BOOL OfferClipboard(PVOID pContext)
+{
+	BOOL bRet;
+	UINT i;
+	UNREFERENCED_PARAMETER(pContext);
+	if (!OpenClipboard(gWnd))
 		return FALSE;
-	bRet = BmpToPng(hf, hDC, hBitmap, w, h);
-	CloseHandle(hf);
+	bRet = EmptyClipboard();
+	// no data yet, WM_RENDERFORMAT asks for it
+	for (i = 0; bRet && i < FE_CLIP_FORMATS; i++)
+		SetClipboardData(GetClipFormat((FE_CLIP_FORMAT)i), NULL);
+	CloseClipboard();
 	return bRet;
 }
 
-BOOL FeGetScreenShot(LPCWSTR lpScreen, LPCWSTR lpSave)
+static PVOID AllocClipboard(PVOID pContext, size_t szData)
 {
-	int x = 0, y = 0, w = 0, h = 0;
-	HDC hScreen = NULL;
-	HDC hDC = NULL;
-	HBITMAP hBitmap = NULL;
-	BOOL bRet = FALSE;
+	HGLOBAL hMem;
+	PVOID pData;
+	UNREFERENCED_PARAMETER(pContext);
+	hMem = GlobalAlloc(GMEM_MOVEABLE, szData);
+	if (!hMem)
+		return NULL;
+	pData = GlobalLock(hMem);
+	if (!pData)
+		GlobalFree(hMem);
+	return pData;
+}
 
-	GetScreenXY(lpScreen, &x, &y, &w, &h);
-	FeAddLog(0, L"x=%d, y=%d, w=%d, h=%d\r\n", x, y, w, h);
-	hScreen = GetDC(NULL);
-	hDC = CreateCompatibleDC(hScreen);
-	if (!hDC)
-		goto out;
-	hBitmap = CreateCompatibleBitmap(hScreen, w, h);
+static BOOL SetClipboard(PVOID pContext, FE_CLIP_FORMAT uFormat, PVOID pData)
+{
+	HGLOBAL hMem = GlobalHandle(pData);
+	UNREFERENCED_PARAMETER(pContext);
+	GlobalUnlock(hMem);
+	if (SetClipboardData(GetClipFormat(uFormat), hMem))
+		return TRUE;
+	GlobalFree(hMem);
+	return FALSE;
+}
+
+static const FE_CLIP_OPS mClipOps = { OfferClipboard, AllocClipboard, SetClipboard };
+
+VOID FeDestroyClipboard(VOID)
+{
+	FeFreeClip(mClip);
+	mClip = NULL;
+	if (mClipBitmap)
+		DeleteObject(mClipBitmap);
+	mClipBitmap = NULL;
+}
+
+VOID FeRenderClipboard(UINT uFormat)
+{
+	UINT i;
+	if (!mClip)
+		return;
+	for (i = 0; i < FE_CLIP_FORMATS; i++)
+	{
+		if (GetClipFormat((FE_CLIP_FORMAT)i) == uFormat)
+			FeRenderClip(mClip, (FE_CLIP_FORMAT)i);
+	}
+}
+
+VOID FeRenderAllClipboard(VOID)
+{
+	if (!mClip || !OpenClipboard(gWnd))
+		return;
+	if (GetClipboardOwner() == gWnd)
+		FeRenderAllClip(mClip);
+	CloseClipboard();
+}
+
+static BOOL CopyScreenShot(int x, int y, int w, int h, FE_PNG_PROFILE uProfile)
+{
+	HBITMAP hBitmap;
+	UINT8* pPixels = NULL;
+
+	if (!mClipPng)
+		mClipPng = RegisterClipboardFormatW(L"PNG");
+	if (!mClipEncoder)
+		mClipEncoder = FeCreatePngEncoder();
+	hBitmap = CaptureScreen(x, y, w, h, &pPixels);
 	if (!hBitmap)
-		goto out;
-	SelectObject(hDC, hBitmap);
-	bRet = BitBlt(hDC, 0, 0, w, h, hScreen, x, y, SRCCOPY);
-	if (bRet != TRUE)
-		goto out;
-
-	bRet = SaveScreenShot(lpSave, hDC, hBitmap, w, h);
-
-out:
-	if (hDC)
-		DeleteDC(hDC);
-	if (hBitmap)
+		return FALSE;
+	// EmptyClipboard drops the previous screenshot through WM_DESTROYCLIPBOARD
+	FeDestroyClipboard();
+	mClip = FeOfferClip(&mClipOps, NULL, mClipEncoder, pPixels, w, h, (size_t)w * 4, uProfile);
+	if (!mClip)
+	{
 		DeleteObject(hBitmap);
+		return FALSE;
+	}
+	mClipBitmap = hBitmap;
+	return TRUE;
+}
+
+BOOL FeGetScreenShot(LPCWSTR lpScreen, LPCWSTR lpSave, LPCWSTR lpCompression, LPCWSTR lpFormat, BOOL bDelta)
+{
+	int x = 0, y = 0, w = 0, h = 0;
+	BOOL bDesktop;
+	SCREENSHOT_JOB* pShot = NULL;
+
+	bDesktop = GetScreenXY(lpScreen, &x, &y, &w, &h);
+	FeAddLog(0, L"x=%d, y=%d, w=%d, h=%d\r\n", x, y, w, h);
+	if (w <= 0 || h <= 0)
+		return FALSE;
+	if (!lpSave || _wcsicmp(lpSave, L"clipboard") == 0)
+		return CopyScreenShot(x, y, w, h, FeGetPngProfile(lpCompression));
+
+	pShot = calloc(1, sizeof(SCREENSHOT_JOB));
+	if (!pShot)
+		return FALSE;
+	pShot->Job.pfnRun = RunScreenShotJob;
+	pShot->Job.pfnDone = DoneScreenShotJob;
+	pShot->w = w;
+	pShot->h = h;
+	pShot->uProfile = FeGetPngProfile(lpCompression);
+	pShot->pWriter = FeGetImageWriter(lpFormat);
+	pShot->bDelta = bDelta && pShot->pWriter->pfnStream == FeStreamPngBgrx;
+	pShot->llCapture = FeGetTimestamp();
+	if (bDesktop && !mCapture)
+		mCapture = FeCreateGdiCapture();
+	if (bDesktop && mCapture)
+		pShot->pPixels = FeGrabCapture(mCapture, x, y, w, h, &pShot->szStride);
+	if (pShot->pPixels)
+		pShot->bDesktop = TRUE;
+	else
+	{
+		pShot->hBitmap = CaptureScreen(x, y, w, h, &pShot->pPixels);
+		pShot->szStride = (size_t)w * 4;
+	}
+	if (!(pShot->bDesktop || pShot->hBitmap) || !GetScreenShotPath(lpSave, pShot->pWriter, pShot->FilePath))
+	{
+		FreeScreenShotJob(pShot);
+		return FALSE;
+	}
+	if (!FeSubmitJob(&pShot->Job))
+	{
+		FeAddLog(0, L"Screenshot queue full, %u pending.\r\n", FeGetJobQueueDepth());
+		FreeScreenShotJob(pShot);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+typedef struct _RECORD_JOB
+{
+	FE_JOB Job;
+	FE_RECORD* pRecord;
+	HANDLE hFile;
+	/* memory DC with the DIB section selected, used by the capture thread */
+	HDC hDC;
+	HBITMAP hBitmap;
+	HGDIOBJ hOld;
+	UINT8* pPixels;
+	int x;
+	int y;
+	UINT uError;
+	size_t szPng;
+	FE_RECORD_STATS Stats;
+	WCHAR FilePath[MAX_PATH];
+} RECORD_JOB;
+
+/* the running recording, the next FeToggleRecord stops it */
+static RECORD_JOB* mRecord;
+
+static BOOL CaptureRecordFrame(PVOID pContext, UINT8* pBgrx, UINT w, UINT h)
+{
+	BOOL bRet;
+	RECORD_JOB* pRec = pContext;
+	HDC hScreen = GetDC(NULL);
+	bRet = BitBlt(pRec->hDC, 0, 0, w, h, hScreen, pRec->x, pRec->y, SRCCOPY);
 	ReleaseDC(NULL, hScreen);
+	GdiFlush();
+	if (bRet)
+		memcpy(pBgrx, pRec->pPixels, (size_t)w * 4 * h);
 	return bRet;
 }
+
+static VOID FreeRecordJob(RECORD_JOB* pRec)
+{
+	if (pRec->hFile && pRec->hFile != INVALID_HANDLE_VALUE)
+		CloseHandle(pRec->hFile);
+	if (pRec->hDC)
+	{
+		SelectObject(pRec->hDC, pRec->hOld);
+		DeleteDC(pRec->hDC);
+	}
+	if (pRec->hBitmap)
+		DeleteObject(pRec->hBitmap);
+	free(pRec);
+}
+
+static VOID RunStopRecordJob(FE_JOB* pJob)
+{
+	RECORD_JOB* pRec = (RECORD_JOB*)pJob;
+	pRec->uError = FeStopRecord(pRec->pRecord, &pRec->szPng, &pRec->Stats);
+	CloseHandle(pRec->hFile);
+	pRec->hFile = NULL;
+	if (pRec->uError != 0)
+		DeleteFileW(pRec->FilePath);
+}
+
+static VOID DoneStopRecordJob(FE_JOB* pJob)
+{
+	RECORD_JOB* pRec = (RECORD_JOB*)pJob;
+	FeAddLog(0, L"Record %s %s, %Iu bytes\r\n",
+		pRec->FilePath, pRec->uError ? L"failed" : L"saved", pRec->szPng);
+	FeAddLog(0, L"%u frames, %u changed, %u dropped, latency %.1f ms, max %.1f ms\r\n",
+		pRec->Stats.uCaptured, pRec->Stats.uChanged, pRec->Stats.uDropped,
+		pRec->Stats.dLatency, pRec->Stats.dMaxLatency);
+	FreeRecordJob(pRec);
+}
+
+static VOID StopRecord(BOOL bWait)
+{
+	RECORD_JOB* pRec = mRecord;
+	mRecord = NULL;
+	// the queued frames are encoded in the background
+	if (bWait || !FeSubmitJob(&pRec->Job))
+	{
+		RunStopRecordJob(&pRec->Job);
+		DoneStopRecordJob(&pRec->Job);
+	}
+}
+
+BOOL FeToggleRecord(LPCWSTR lpScreen, LPCWSTR lpSave, LPCWSTR lpCompression, UINT uFps)
+{
+	int w = 0, h = 0;
+	RECORD_JOB* pRec = NULL;
+
+	if (mRecord)
+	{
+		StopRecord(FALSE);
+		return TRUE;
+	}
+	if (!lpSave || _wcsicmp(lpSave, L"clipboard") == 0)
+	{
+		FeAddLog(0, L"Record needs a file to save to.\r\n");
+		return FALSE;
+	}
+	pRec = calloc(1, sizeof(RECORD_JOB));
+	if (!pRec)
+		return FALSE;
+	pRec->Job.pfnRun = RunStopRecordJob;
+	pRec->Job.pfnDone = DoneStopRecordJob;
+	GetScreenXY(lpScreen, &pRec->x, &pRec->y, &w, &h);
+	FeAddLog(0, L"x=%d, y=%d, w=%d, h=%d, %u fps\r\n", pRec->x, pRec->y, w, h, uFps);
+	if (w <= 0 || h <= 0 || !GetScreenShotPath(lpSave, FeGetImageWriter(NULL), pRec->FilePath))
+		goto fail;
+	pRec->hBitmap = CaptureScreen(pRec->x, pRec->y, w, h, &pRec->pPixels);
+	if (!pRec->hBitmap)
+		goto fail;
+	pRec->hDC = CreateCompatibleDC(NULL);
+	if (!pRec->hDC)
+		goto fail;
+	pRec->hOld = SelectObject(pRec->hDC, pRec->hBitmap);
+	pRec->hFile = CreateFileW(pRec->FilePath, GENERIC_WRITE, 0, NULL,
+		CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (!pRec->hFile || pRec->hFile == INVALID_HANDLE_VALUE)
+		goto fail;
+	pRec->pRecord = FeStartRecord(CaptureRecordFrame, pRec, WritePngPart, PatchPngPart, pRec->hFile,
+		w, h, min(max(uFps, 1), 60), FeGetPngProfile(lpCompression));
+	if (!pRec->pRecord)
+	{
+		CloseHandle(pRec->hFile);
+		pRec->hFile = NULL;
+		DeleteFileW(pRec->FilePath);
+		goto fail;
+	}
+	mRecord = pRec;
+	return TRUE;
+fail:
+	FreeRecordJob(pRec);
+	return FALSE;
+}
+
+VOID FeFreeScreenShotCache(VOID)
+{
+	if (mRecord)
+		StopRecord(TRUE);
+	FeFreePngDelta(mDelta);
+	mDelta = NULL;
+	FeFreePngEncoder(mEncoder);
+	mEncoder = NULL;
+	FeFreeCapture(mCapture);
+	mCapture = NULL;
+	FeDestroyClipboard();
+	FeFreePngEncoder(mClipEncoder);
+	mClipEncoder = NULL;
+	FeFreePngArenas();
+}
@@ -0,0 +1,283 @@
+﻿// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "fe.h"
+#include "utils.h"
+#include "swizzle.h"
+
+#if defined(_M_IX86) || defined(_M_X64)
+#define SWIZZLE_X86
+#include <immintrin.h>
+#endif
+
+#define ALPHA_MASK 0xFF000000U
+
+typedef VOID (*SWIZZLE_PROC)(UINT8* pDst, const UINT8* pSrc, size_t szPixels);
+typedef BOOL (*DIFF_PROC)(const UINT8* pOld, const UINT8* pNew, size_t szBytes);
+
+static SWIZZLE_PROC mSwizzle;
+static SWIZZLE_PROC mPack;
+static DIFF_PROC mDiff;
+static INIT_ONCE mInitOnce = INIT_ONCE_STATIC_INIT;
+
+static VOID SwizzleScalar(UINT8* pDst, const UINT8* pSrc, size_t szPixels)
+{
+	size_t i;
+	for (i = 0; i < szPixels; i++)
+	{
+		UINT8 b = pSrc[i * 4];
+		UINT8 g = pSrc[i * 4 + 1];
+		UINT8 r = pSrc[i * 4 + 2];
+		pDst[i * 4] = r;
+		pDst[i * 4 + 1] = g;
+		pDst[i * 4 + 2] = b;
+		pDst[i * 4 + 3] = 0xFF;
+	}
+}
+
+static VOID PackScalar(UINT8* pDst, const UINT8* pSrc, size_t szPixels)
+{
+	size_t i;
+	for (i = 0; i < szPixels; i++)
+	{
+		pDst[i * 3] = pSrc[i * 4 + 2];
+		pDst[i * 3 + 1] = pSrc[i * 4 + 1];
+		pDst[i * 3 + 2] = pSrc[i * 4];
+	}
+}
+
+static BOOL DiffScalar(const UINT8* pOld, const UINT8* pNew, size_t szBytes)
+{
+	return memcmp(pOld, pNew, szBytes) != 0;
+}
+
+#ifdef SWIZZLE_X86
+static VOID SwizzleSse2(UINT8* pDst, const UINT8* pSrc, size_t szPixels)
+{
+	size_t i;
+	const __m128i ag = _mm_set1_epi32((int)0xFF00FF00U);
+	const __m128i lo = _mm_set1_epi32(0xFF);
+	const __m128i alpha = _mm_set1_epi32((int)ALPHA_MASK);
+	for (i = 0; i + 4 <= szPixels; i += 4)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i*)(pSrc + i * 4));
+		__m128i rb = _mm_or_si128(_mm_and_si128(_mm_srli_epi32(v, 16), lo),
+			_mm_slli_epi32(_mm_and_si128(v, lo), 16));
+		v = _mm_or_si128(_mm_or_si128(_mm_and_si128(v, ag), rb), alpha);
+		_mm_storeu_si128((__m128i*)(pDst + i * 4), v);
+	}
+	SwizzleScalar(pDst + i * 4, pSrc + i * 4, szPixels - i);
+}
+
+static FE_TARGET("ssse3") VOID SwizzleSsse3(UINT8* pDst, const UINT8* pSrc, size_t szPixels)
+{
+	size_t i;
+	const __m128i shuf = _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+	const __m128i alpha = _mm_set1_epi32((int)ALPHA_MASK);
+	for (i = 0; i + 8 <= szPixels; i += 8)
+	{
+		__m128i v0 = _mm_loadu_si128((const __m128i*)(pSrc + i * 4));
+		__m128i v1 = _mm_loadu_si128((const __m128i*)(pSrc + i * 4 + 16));
+		v0 = _mm_or_si128(_mm_shuffle_epi8(v0, shuf), alpha);
+		v1 = _mm_or_si128(_mm_shuffle_epi8(v1, shuf), alpha);
+		_mm_storeu_si128((__m128i*)(pDst + i * 4), v0);
+		_mm_storeu_si128((__m128i*)(pDst + i * 4 + 16), v1);
+	}
+	SwizzleScalar(pDst + i * 4, pSrc + i * 4, szPixels - i);
+}
+
+static FE_TARGET("avx2") VOID SwizzleAvx2(UINT8* pDst, const UINT8* pSrc, size_t szPixels)
+{
+	size_t i;
+	const __m256i shuf = _mm256_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+		2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+	const __m256i alpha = _mm256_set1_epi32((int)ALPHA_MASK);
+	for (i = 0; i + 16 <= szPixels; i += 16)
+	{
+		__m256i v0 = _mm256_loadu_si256((const __m256i*)(pSrc + i * 4));
+		__m256i v1 = _mm256_loadu_si256((const __m256i*)(pSrc + i * 4 + 32));
+		v0 = _mm256_or_si256(_mm256_shuffle_epi8(v0, shuf), alpha);
+		v1 = _mm256_or_si256(_mm256_shuffle_epi8(v1, shuf), alpha);
+		_mm256_storeu_si256((__m256i*)(pDst + i * 4), v0);
+		_mm256_storeu_si256((__m256i*)(pDst + i * 4 + 32), v1);
+	}
+	// avoid the AVX-SSE transition penalty in the caller
+	_mm256_zeroupper();
+	SwizzleSse2(pDst + i * 4, pSrc + i * 4, szPixels - i);
+}
+
+static FE_TARGET("ssse3") VOID PackSsse3(UINT8* pDst, const UINT8* pSrc, size_t szPixels)
+{
+	size_t i;
+	const __m128i shuf = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+	for (i = 0; i + 16 <= szPixels; i += 16)
+	{
+		// four pixels become 12 bytes, three stores take 16 pixels
+		__m128i v0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(pSrc + i * 4)), shuf);
+		__m128i v1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(pSrc + i * 4 + 16)), shuf);
+		__m128i v2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(pSrc + i * 4 + 32)), shuf);
+		__m128i v3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(pSrc + i * 4 + 48)), shuf);
+		_mm_storeu_si128((__m128i*)(pDst + i * 3),
+			_mm_or_si128(v0, _mm_slli_si128(v1, 12)));
+		_mm_storeu_si128((__m128i*)(pDst + i * 3 + 16),
+			_mm_or_si128(_mm_srli_si128(v1, 4), _mm_slli_si128(v2, 8)));
+		_mm_storeu_si128((__m128i*)(pDst + i * 3 + 32),
+			_mm_or_si128(_mm_srli_si128(v2, 8), _mm_slli_si128(v3, 4)));
+	}
+	PackScalar(pDst + i * 3, pSrc + i * 4, szPixels - i);
+}
+
+static BOOL DiffSse2(const UINT8* pOld, const UINT8* pNew, size_t szBytes)
+{
+	size_t i;
+	for (i = 0; i + 32 <= szBytes; i += 32)
+	{
+		__m128i v0 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(pOld + i)),
+			_mm_loadu_si128((const __m128i*)(pNew + i)));
+		__m128i v1 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(pOld + i + 16)),
+			_mm_loadu_si128((const __m128i*)(pNew + i + 16)));
+		if (_mm_movemask_epi8(_mm_and_si128(v0, v1)) != 0xFFFF)
+			return TRUE;
+	}
+	return DiffScalar(pOld + i, pNew + i, szBytes - i);
+}
+
+static FE_TARGET("avx2") BOOL DiffAvx2(const UINT8* pOld, const UINT8* pNew, size_t szBytes)
+{
+	size_t i;
+	BOOL bDiff = FALSE;
+	// a tile row is 128 bytes, test it in one go
+	for (i = 0; i + 64 <= szBytes && !bDiff; i += 64)
+	{
+		__m256i v0 = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(pOld + i)),
+			_mm256_loadu_si256((const __m256i*)(pNew + i)));
+		__m256i v1 = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(pOld + i + 32)),
+			_mm256_loadu_si256((const __m256i*)(pNew + i + 32)));
+		v0 = _mm256_or_si256(v0, v1);
+		bDiff = !_mm256_testz_si256(v0, v0);
+	}
+	_mm256_zeroupper();
+	if (bDiff)
+		return TRUE;
+	return DiffSse2(pOld + i, pNew + i, szBytes - i);
+}
+
+static SWIZZLE_PROC SwizzleSelect(VOID)
+{
+	UINT uFeatures = FeGetCpuFeatures();
+	if (uFeatures & FE_CPU_AVX2)
+		return SwizzleAvx2;
+	if (uFeatures & FE_CPU_SSSE3)
+		return SwizzleSsse3;
+	if (uFeatures & FE_CPU_SSE2)
+		return SwizzleSse2;
+	return SwizzleScalar;
+}
+
+static SWIZZLE_PROC PackSelect(VOID)
+{
+	if (FeGetCpuFeatures() & FE_CPU_SSSE3)
+		return PackSsse3;
+	return PackScalar;
+}
+
+static DIFF_PROC DiffSelect(VOID)
+{
+	UINT uFeatures = FeGetCpuFeatures();
+	if (uFeatures & FE_CPU_AVX2)
+		return DiffAvx2;
+	if (uFeatures & FE_CPU_SSE2)
+		return DiffSse2;
+	return DiffScalar;
+}
+#else
+static SWIZZLE_PROC SwizzleSelect(VOID)
+{
+	return SwizzleScalar;
+}
+
+static SWIZZLE_PROC PackSelect(VOID)
+{
+	return PackScalar;
+}
+
+static DIFF_PROC DiffSelect(VOID)
+{
+	return DiffScalar;
+}
+#endif
+
+static BOOL CALLBACK InitSwizzle(PINIT_ONCE pInitOnce, PVOID pParameter, PVOID* ppContext)
+{
+	UNREFERENCED_PARAMETER(pInitOnce);
+	UNREFERENCED_PARAMETER(pParameter);
+	UNREFERENCED_PARAMETER(ppContext);
+	mSwizzle = SwizzleSelect();
+	mPack = PackSelect();
+	mDiff = DiffSelect();
+	return TRUE;
+}
+
+VOID FeSwizzleBgra(UINT8* pDst, const UINT8* pSrc, size_t szPixels)
+{
+	InitOnceExecuteOnce(&mInitOnce, InitSwizzle, NULL, NULL);
+	mSwizzle(pDst, pSrc, szPixels);
+}
+
+VOID FeSwizzleRows(UINT8* pPixels, UINT w, UINT h, size_t szStride)
+{
+	UINT y;
+	size_t szRow = (size_t)w * 4;
+	InitOnceExecuteOnce(&mInitOnce, InitSwizzle, NULL, NULL);
+	if (szStride == szRow)
+	{
+		mSwizzle(pPixels, pPixels, (size_t)w * h);
+		return;
+	}
+	for (y = 0; y < h; y++)
+	{
+		UINT8* pRow = pPixels + y * szRow;
+		memmove(pRow, pPixels + y * szStride, szRow);
+		mSwizzle(pRow, pRow, w);
+	}
+}
+
+VOID FePackBgrx(UINT8* pDst, const UINT8* pSrc, size_t szPixels)
+{
+	InitOnceExecuteOnce(&mInitOnce, InitSwizzle, NULL, NULL);
+	mPack(pDst, pSrc, szPixels);
+}
+
+UINT FeDiffTiles(UINT8* pMap, const UINT8* pOld, size_t szOldStride,
+	const UINT8* pNew, size_t szNewStride, UINT w, UINT h)
+{
+	UINT x, y, uTile;
+	UINT uDirty = 0;
+	UINT uCols = (w + FE_TILE_SIZE - 1) / FE_TILE_SIZE;
+	InitOnceExecuteOnce(&mInitOnce, InitSwizzle, NULL, NULL);
+
+	for (uTile = 0; uTile * FE_TILE_SIZE < h; uTile++, pMap += uCols)
+	{
+		UINT uLast = min(h, (uTile + 1) * FE_TILE_SIZE);
+		UINT uClean = uCols;
+		ZeroMemory(pMap, uCols);
+		for (y = uTile * FE_TILE_SIZE; y < uLast && uClean; y++)
+		{
+			const UINT8* pA = pOld + y * szOldStride;
+			const UINT8* pB = pNew + y * szNewStride;
+			for (x = 0; x < uCols; x++)
+			{
+				// a tile stops being compared at its first differing row
+				if (pMap[x])
+					continue;
+				if (mDiff(pA + x * FE_TILE_SIZE * 4, pB + x * FE_TILE_SIZE * 4,
+					(size_t)(min(w, (x + 1) * FE_TILE_SIZE) - x * FE_TILE_SIZE) * 4))
+				{
+					pMap[x] = 1;
+					uClean--;
+				}
+			}
+		}
+		uDirty += uCols - uClean;
+	}
+	return uDirty;
+}
@@ -0,0 +1,29 @@
+﻿// SPDX-License-Identifier: GPL-3.0-or-later
+#pragma once
+
+#include "fe.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* BGRA/BGRX pixels to RGBA with alpha forced to 0xFF, pDst may equal pSrc */
+VOID FeSwizzleBgra(UINT8* pDst, const UINT8* pSrc, size_t szPixels);
+
+/* h rows of w BGRX pixels, szStride bytes apart, to packed RGBA rows in place */
+VOID FeSwizzleRows(UINT8* pPixels, UINT w, UINT h, size_t szStride);
+
+/* BGRX pixels to packed RGB, pDst must not overlap pSrc */
+VOID FePackBgrx(UINT8* pDst, const UINT8* pSrc, size_t szPixels);
+
+#define FE_TILE_SIZE 32
+
+/* compare two frames of 4-byte pixels in FE_TILE_SIZE square tiles, row by row,
+ * set each byte of pMap to 1 if its tile differs, return the number of such tiles */
+UINT FeDiffTiles(UINT8* pMap, const UINT8* pOld, size_t szOldStride,
+	const UINT8* pNew, size_t szNewStride, UINT w, UINT h);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,22 @@
+﻿// SPDX-License-Identifier: GPL-3.0-or-later
+#pragma once
+
+/* the MSVC cpuid intrinsics in terms of the GCC ones */
+
+#include <cpuid.h>
+#include <immintrin.h>
+
+#undef __cpuid
+#define __cpuid ShimCpuid
+#define __cpuidex ShimCpuidex
+
+/* newer cpuid.h has a __cpuidex of its own, hence the renames */
+static inline void ShimCpuidex(int info[4], int leaf, int subleaf)
+{
+	__cpuid_count(leaf, subleaf, info[0], info[1], info[2], info[3]);
+}
+
+static inline void ShimCpuid(int info[4], int leaf)
+{
+	ShimCpuidex(info, leaf, 0);
+}
@@ -0,0 +1,340 @@
+﻿// SPDX-License-Identifier: GPL-3.0-or-later
+
+/* the utils.c functions the portable modules call, for the Linux builds, and the
+ * handlers of action.c, which record the call instead of acting */
+
+#include "fe.h"
+#include "utils.h"
+
+#include <stdarg.h>
+#include <ctype.h>
+
+HWND gWnd;
+
+SHIM_CALL gShimCall;
+
+#define SHIM_MSG_QUEUE_SIZE 256
+
+static pthread_mutex_t mMsgLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t mMsgCond = PTHREAD_COND_INITIALIZER;
+static MSG mMsgs[SHIM_MSG_QUEUE_SIZE];
+static UINT mMsgHead;
+static UINT mMsgCount;
+static BOOL mFailPost;
+static BOOL mQuietLog;
+
+#define SHIM_HOTKEY_IDS 0xC000
+
+/* modifiers << 32 | vk of each id */
+static UINT64 mHotKeys[SHIM_HOTKEY_IDS];
+
+BOOL PostMessageW(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
+{
+	BOOL bRet = FALSE;
+	pthread_mutex_lock(&mMsgLock);
+	if (!mFailPost && mMsgCount < SHIM_MSG_QUEUE_SIZE)
+	{
+		MSG* pMsg = &mMsgs[(mMsgHead + mMsgCount) % SHIM_MSG_QUEUE_SIZE];
+		ZeroMemory(pMsg, sizeof(MSG));
+		pMsg->hwnd = hWnd;
+		pMsg->message = uMsg;
+		pMsg->wParam = wParam;
+		pMsg->lParam = lParam;
+		mMsgCount++;
+		pthread_cond_signal(&mMsgCond);
+		bRet = TRUE;
+	}
+	pthread_mutex_unlock(&mMsgLock);
+	return bRet;
+}
+
+BOOL GetMessageW(MSG* pMsg, HWND hWnd, UINT uMsgFilterMin, UINT uMsgFilterMax)
+{
+	UNREFERENCED_PARAMETER(hWnd);
+	UNREFERENCED_PARAMETER(uMsgFilterMin);
+	UNREFERENCED_PARAMETER(uMsgFilterMax);
+	pthread_mutex_lock(&mMsgLock);
+	while (mMsgCount == 0)
+		pthread_cond_wait(&mMsgCond, &mMsgLock);
+	*pMsg = mMsgs[mMsgHead];
+	mMsgHead = (mMsgHead + 1) % SHIM_MSG_QUEUE_SIZE;
+	mMsgCount--;
+	pthread_mutex_unlock(&mMsgLock);
+	return TRUE;
+}
+
+VOID ShimFailPostMessage(BOOL bFail)
+{
+	pthread_mutex_lock(&mMsgLock);
+	mFailPost = bFail;
+	pthread_mutex_unlock(&mMsgLock);
+}
+
+/* %s takes a wide string in the Windows CRT and a narrow one in glibc */
+static VOID WidenFormat(WCHAR* pOut, size_t szOut, LPCWSTR fmt)
+{
+	size_t i = 0;
+	while (*fmt && i + 2 < szOut)
+	{
+		if (*fmt != L'%')
+		{
+			pOut[i++] = *fmt++;
+			continue;
+		}
+		pOut[i++] = *fmt++;
+		while (*fmt && wcschr(L"-+ #0123456789.*", *fmt) && i + 2 < szOut)
+			pOut[i++] = *fmt++;
+		if (*fmt == L's' || *fmt == L'c')
+			pOut[i++] = L'l';
+		if (*fmt)
+			pOut[i++] = *fmt++;
+	}
+	pOut[i] = L'\0';
+}
+
+VOID ShimQuietLog(BOOL bQuiet)
+{
+	mQuietLog = bQuiet;
+}
+
+VOID FeAddLog(INT lvl, LPCWSTR fmt, ...)
+{
+	WCHAR Format[512];
+	va_list args;
+	UNREFERENCED_PARAMETER(lvl);
+	if (mQuietLog)
+		return;
+	WidenFormat(Format, ARRAYSIZE(Format), fmt);
+	va_start(args, fmt);
+	vfwprintf(stderr, Format, args);
+	va_end(args);
+}
+
+UINT64 FeGetTimestamp(VOID)
+{
+	LARGE_INTEGER li;
+	QueryPerformanceCounter(&li);
+	return (UINT64)li.QuadPart;
+}
+
+double FeElapsedMs(UINT64 llStart, UINT64 llEnd)
+{
+	LARGE_INTEGER liFreq;
+	QueryPerformanceFrequency(&liFreq);
+	return (double)(llEnd - llStart) * 1000.0 / (double)liFreq.QuadPart;
+}
+
+VOID FeClearLog(INT lvl)
+{
+	UNREFERENCED_PARAMETER(lvl);
+}
+
+int MultiByteToWideChar(UINT uCodePage, DWORD dwFlags, LPCSTR lpStr, int cbStr, LPWSTR lpWide, int cchWide)
+{
+	const UINT8* p = (const UINT8*)lpStr;
+	const UINT8* pEnd;
+	int n = 0;
+	UNREFERENCED_PARAMETER(uCodePage);
+	UNREFERENCED_PARAMETER(dwFlags);
+	if (cbStr < 0)
+		cbStr = (int)strlen(lpStr) + 1;
+	pEnd = p + cbStr;
+	while (p < pEnd)
+	{
+		UINT c = *p++;
+		UINT uMore = c >= 0xF0 ? 3 : c >= 0xE0 ? 2 : c >= 0xC0 ? 1 : 0;
+		if (c >= 0x80 && c < 0xC0)
+			c = 0xFFFD;
+		else if (uMore)
+		{
+			c &= 0x3F >> uMore;
+			for (; uMore && p < pEnd && (*p & 0xC0) == 0x80; uMore--)
+				c = (c << 6) | (*p++ & 0x3F);
+			if (uMore)
+				c = 0xFFFD;
+		}
+		if (lpWide)
+		{
+			if (n >= cchWide)
+				return 0;
+			lpWide[n] = (WCHAR)c;
+		}
+		n++;
+	}
+	return n;
+}
+
+BOOL RegisterHotKey(HWND hWnd, int id, UINT fsModifiers, UINT vk)
+{
+	UNREFERENCED_PARAMETER(hWnd);
+	if (id < 0 || id >= SHIM_HOTKEY_IDS || vk == 0)
+		return FALSE;
+	mHotKeys[id] = ((UINT64)fsModifiers << 32) | vk;
+	return TRUE;
+}
+
+BOOL UnregisterHotKey(HWND hWnd, int id)
+{
+	UNREFERENCED_PARAMETER(hWnd);
+	if (id < 0 || id >= SHIM_HOTKEY_IDS || mHotKeys[id] == 0)
+		return FALSE;
+	mHotKeys[id] = 0;
+	return TRUE;
+}
+
+UINT ShimGetHotKey(int id, UINT* pModifiers)
+{
+	if (id < 0 || id >= SHIM_HOTKEY_IDS)
+		return 0;
+	if (pModifiers)
+		*pModifiers = (UINT)(mHotKeys[id] >> 32);
+	return (UINT)mHotKeys[id];
+}
+
+/* modifiers as in utils.c, the key is a single character or a number */
+UINT FeStrToKey(LPCSTR pName, UINT* pModifiers)
+{
+	UINT fsModifiers = MOD_NOREPEAT;
+	LPCSTR p = pName;
+	for (; p && *p;)
+	{
+		if (_strnicmp(p, "Ctrl-", 5) == 0)
+		{
+			p += 5;
+			fsModifiers |= MOD_CONTROL;
+		}
+		else if (_strnicmp(p, "Shift-", 6) == 0)
+		{
+			p += 6;
+			fsModifiers |= MOD_SHIFT;
+		}
+		else if (_strnicmp(p, "Alt-", 4) == 0)
+		{
+			p += 4;
+			fsModifiers |= MOD_ALT;
+		}
+		else if (_strnicmp(p, "Win-", 4) == 0)
+		{
+			p += 4;
+			fsModifiers |= MOD_WIN;
+		}
+		else
+			break;
+	}
+	if (pModifiers)
+		*pModifiers = fsModifiers;
+	if (!p || !*p)
+		return 0;
+	if (p[1] == '\0' && (p[0] < '0' || p[0] > '9'))
+		return (UINT)toupper((UCHAR)p[0]);
+	return (UINT)strtoul(p, NULL, 0);
+}
+
+LPCWSTR FeKeyToStr(UINT fsModifiers, UINT vk)
+{
+	static WCHAR keyname[64];
+	swprintf(keyname, ARRAYSIZE(keyname), L"%ls%ls%ls%ls0x%08x",
+		fsModifiers & MOD_CONTROL ? L"Ctrl-" : L"",
+		fsModifiers & MOD_SHIFT ? L"Shift-" : L"",
+		fsModifiers & MOD_ALT ? L"Alt-" : L"",
+		fsModifiers & MOD_WIN ? L"Win-" : L"", vk);
+	return keyname;
+}
+
+WCHAR* FeUtf8ToWcs(LPCSTR str)
+{
+	WCHAR* val;
+	int sz;
+	if (!str)
+		return NULL;
+	sz = MultiByteToWideChar(CP_UTF8, 0, str, -1, NULL, 0);
+	if (sz <= 0)
+		return NULL;
+	val = calloc(1ULL + sz, sizeof(WCHAR));
+	if (!val)
+		return NULL;
+	MultiByteToWideChar(CP_UTF8, 0, str, -1, val, sz);
+	return val;
+}
+
+WORD FeStrToShow(LPCSTR sw)
+{
+	WORD wCmdShow = SW_NORMAL;
+	if (!sw || _stricmp(sw, "normal") == 0)
+		wCmdShow = SW_NORMAL;
+	else if (_stricmp(sw, "hide") == 0)
+		wCmdShow = SW_HIDE;
+	else if (_stricmp(sw, "min") == 0)
+		wCmdShow = SW_FORCEMINIMIZE;
+	else if (_stricmp(sw, "max") == 0)
+		wCmdShow = SW_MAXIMIZE;
+	else if (_stricmp(sw, "restore") == 0)
+		wCmdShow = SW_RESTORE;
+	else if (_stricmp(sw, "show") == 0)
+		wCmdShow = SW_SHOW;
+	return wCmdShow;
+}
+
+static VOID ShimRecordCall(const char* pName, LPCWSTR lpArg0, LPCWSTR lpArg1, LPCWSTR lpArg2, LPCWSTR lpArg3,
+	INT nArg0, INT nArg1, INT nArg2)
+{
+	gShimCall.pName = pName;
+	gShimCall.lpArgs[0] = lpArg0;
+	gShimCall.lpArgs[1] = lpArg1;
+	gShimCall.lpArgs[2] = lpArg2;
+	gShimCall.lpArgs[3] = lpArg3;
+	gShimCall.nArgs[0] = nArg0;
+	gShimCall.nArgs[1] = nArg1;
+	gShimCall.nArgs[2] = nArg2;
+	gShimCall.uCalls++;
+}
+
+BOOL FeExec(LPCWSTR pCmd, WORD wShowWindow, BOOL bWinLogon, BOOL bWait)
+{
+	ShimRecordCall("FeExec", pCmd, NULL, NULL, NULL, wShowWindow, bWinLogon, bWait);
+	return TRUE;
+}
+
+VOID FeShellExec(LPCWSTR lpOperation, LPCWSTR lpFile, LPCWSTR lpParameters, LPCWSTR lpDirectory, INT nShowCmd)
+{
+	ShimRecordCall("FeShellExec", lpOperation, lpFile, lpParameters, lpDirectory, nShowCmd, 0, 0);
+}
+
+void FeKillProcessByName(LPCWSTR pName, UINT uExitCode)
+{
+	ShimRecordCall("FeKillProcessByName", pName, NULL, NULL, NULL, (INT)uExitCode, 0, 0);
+}
+
+void FeKillProcessById(DWORD dwProcessId, UINT uExitCode)
+{
+	ShimRecordCall("FeKillProcessById", NULL, NULL, NULL, NULL, (INT)dwProcessId, (INT)uExitCode, 0);
+}
+
+LONG FeSetResolution(LPCWSTR pMonitor, LPCWSTR pResolution, DWORD dwFlags)
+{
+	ShimRecordCall("FeSetResolution", pMonitor, pResolution, NULL, NULL, (INT)dwFlags, 0, 0);
+	return 0;
+}
+
+VOID FeShowWindowByTitle(LPCWSTR pFileName, INT nCmdHide, INT nCmdShow)
+{
+	ShimRecordCall("FeShowWindowByTitle", pFileName, NULL, NULL, NULL, nCmdHide, nCmdShow, 0);
+}
+
+BOOL FeGetScreenShot(LPCWSTR lpScreen, LPCWSTR lpSave, LPCWSTR lpCompression, LPCWSTR lpFormat, BOOL bDelta)
+{
+	ShimRecordCall("FeGetScreenShot", lpScreen, lpSave, lpCompression, lpFormat, bDelta, 0, 0);
+	return TRUE;
+}
+
+BOOL FeToggleRecord(LPCWSTR lpScreen, LPCWSTR lpSave, LPCWSTR lpCompression, UINT uFps)
+{
+	ShimRecordCall("FeToggleRecord", lpScreen, lpSave, lpCompression, NULL, (INT)uFps, 0, 0);
+	return TRUE;
+}
+
+HRESULT FeCreateShortcut(LPCWSTR pTarget, LPCWSTR pLnkPath, LPCWSTR pParam, LPCWSTR pIcon, INT id, INT sw)
+{
+	ShimRecordCall("FeCreateShortcut", pTarget, pLnkPath, pParam, pIcon, id, sw, 0);
+	return S_OK;
+}
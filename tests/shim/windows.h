@@ -0,0 +1,455 @@
+﻿// SPDX-License-Identifier: GPL-3.0-or-later
+#pragma once
+
+/* the part of the Win32 API used by the portable modules, on top of pthreads,
+ * so that they build unmodified for the Linux tests and benchmarks */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <wchar.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+typedef int BOOL;
+typedef int INT;
+typedef unsigned int UINT;
+typedef int32_t LONG;
+typedef uint32_t ULONG;
+typedef uint32_t DWORD;
+typedef uint16_t WORD;
+typedef uint8_t BYTE;
+typedef char CHAR;
+typedef unsigned char UCHAR;
+typedef unsigned short USHORT;
+typedef wchar_t WCHAR;
+typedef int8_t INT8;
+typedef int16_t INT16;
+typedef int32_t INT32;
+typedef int64_t INT64;
+typedef uint8_t UINT8;
+typedef uint16_t UINT16;
+typedef uint32_t UINT32;
+typedef uint64_t UINT64;
+typedef int64_t LONG64;
+typedef int64_t LONGLONG;
+typedef uint64_t ULONGLONG;
+typedef intptr_t INT_PTR;
+typedef uintptr_t UINT_PTR;
+typedef intptr_t LONG_PTR;
+typedef uintptr_t ULONG_PTR;
+typedef size_t SIZE_T;
+typedef int32_t HRESULT;
+
+#define VOID void
+typedef void* PVOID;
+typedef void* LPVOID;
+typedef const void* LPCVOID;
+typedef char* LPSTR;
+typedef const char* LPCSTR;
+typedef wchar_t* LPWSTR;
+typedef const wchar_t* LPCWSTR;
+typedef LPCWSTR LPCTSTR;
+
+typedef void* HANDLE;
+typedef void* HWND;
+typedef void* HDC;
+typedef void* HBITMAP;
+typedef void* HGDIOBJ;
+typedef void* HGLOBAL;
+typedef void* HINSTANCE;
+typedef void* HMENU;
+typedef void* HICON;
+typedef void* HMONITOR;
+
+typedef UINT_PTR WPARAM;
+typedef LONG_PTR LPARAM;
+typedef LONG_PTR LRESULT;
+
+#define TRUE 1
+#define FALSE 0
+#define WINAPI
+#define CALLBACK
+#define INFINITE 0xFFFFFFFF
+#define MAX_PATH 260
+#define S_OK ((HRESULT)0)
+#define E_FAIL ((HRESULT)0x80004005)
+
+#ifndef __cplusplus
+#define min(a, b) (((a) < (b)) ? (a) : (b))
+#define max(a, b) (((a) > (b)) ? (a) : (b))
+#endif
+
+#define UNREFERENCED_PARAMETER(x) (void)(x)
+#define ARRAYSIZE(a) (sizeof(a) / sizeof((a)[0]))
+#define ZeroMemory(p, n) memset((p), 0, (n))
+#define CopyMemory(d, s, n) memcpy((d), (s), (n))
+
+#define __declspec(x) __declspec_##x
+#define __declspec_thread __thread
+
+#define _wcsicmp wcscasecmp
+#define _stricmp strcasecmp
+#define _strnicmp strncasecmp
+
+typedef union _LARGE_INTEGER
+{
+	struct
+	{
+		DWORD LowPart;
+		LONG HighPart;
+	};
+	LONGLONG QuadPart;
+} LARGE_INTEGER;
+
+typedef struct _RECT
+{
+	LONG left;
+	LONG top;
+	LONG right;
+	LONG bottom;
+} RECT;
+
+typedef struct _POINT
+{
+	LONG x;
+	LONG y;
+} POINT;
+
+typedef struct _MSG
+{
+	HWND hwnd;
+	UINT message;
+	WPARAM wParam;
+	LPARAM lParam;
+	DWORD time;
+	POINT pt;
+} MSG;
+
+typedef struct _TREEITEM* HTREEITEM;
+
+typedef struct _CIEXYZTRIPLE
+{
+	LONG Values[9];
+} CIEXYZTRIPLE;
+
+typedef struct _BITMAPV5HEADER
+{
+	DWORD bV5Size;
+	LONG bV5Width;
+	LONG bV5Height;
+	WORD bV5Planes;
+	WORD bV5BitCount;
+	DWORD bV5Compression;
+	DWORD bV5SizeImage;
+	LONG bV5XPelsPerMeter;
+	LONG bV5YPelsPerMeter;
+	DWORD bV5ClrUsed;
+	DWORD bV5ClrImportant;
+	DWORD bV5RedMask;
+	DWORD bV5GreenMask;
+	DWORD bV5BlueMask;
+	DWORD bV5AlphaMask;
+	DWORD bV5CSType;
+	CIEXYZTRIPLE bV5Endpoints;
+	DWORD bV5GammaRed;
+	DWORD bV5GammaGreen;
+	DWORD bV5GammaBlue;
+	DWORD bV5Intent;
+	DWORD bV5ProfileData;
+	DWORD bV5ProfileSize;
+	DWORD bV5Reserved;
+} BITMAPV5HEADER;
+
+#define BI_BITFIELDS 3
+#define LCS_sRGB 0x73524742
+#define LCS_GM_IMAGES 4
+
+#define WM_HOTKEY 0x0312
+#define WM_APP 0x8000
+
+#define MOD_ALT 0x0001
+#define MOD_CONTROL 0x0002
+#define MOD_SHIFT 0x0004
+#define MOD_WIN 0x0008
+#define MOD_NOREPEAT 0x4000
+
+#define SW_HIDE 0
+#define SW_NORMAL 1
+#define SW_MAXIMIZE 3
+#define SW_SHOW 5
+#define SW_RESTORE 9
+#define SW_FORCEMINIMIZE 11
+
+#define CDS_UPDATEREGISTRY 0x00000001
+
+#define CP_UTF8 65001
+
+/* UTF-8 only, invalid sequences become U+FFFD as without MB_ERR_INVALID_CHARS */
+int MultiByteToWideChar(UINT uCodePage, DWORD dwFlags, LPCSTR lpStr, int cbStr, LPWSTR lpWide, int cchWide);
+
+static inline BOOL ShowWindow(HWND hWnd, int nCmdShow)
+{
+	UNREFERENCED_PARAMETER(hWnd);
+	UNREFERENCED_PARAMETER(nCmdShow);
+	return TRUE;
+}
+
+/* the registered hotkeys are kept in shim.c, ShimGetHotKey returns the vk of id or 0 */
+BOOL RegisterHotKey(HWND hWnd, int id, UINT fsModifiers, UINT vk);
+
+BOOL UnregisterHotKey(HWND hWnd, int id);
+
+UINT ShimGetHotKey(int id, UINT* pModifiers);
+
+/* posted messages wait in a queue in shim.c until GetMessageW takes them,
+ * ShimFailPostMessage makes the posts fail as if the window was destroyed */
+BOOL PostMessageW(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam);
+
+BOOL GetMessageW(MSG* pMsg, HWND hWnd, UINT uMsgFilterMin, UINT uMsgFilterMax);
+
+VOID ShimFailPostMessage(BOOL bFail);
+
+/* FeAddLog prints to stderr unless quiet */
+VOID ShimQuietLog(BOOL bQuiet);
+
+/* the handlers the actions run only record their last call, string arguments as they are
+ * passed and the rest as numbers, in the order of the parameters */
+typedef struct _SHIM_CALL
+{
+	const char* pName;
+	LPCWSTR lpArgs[4];
+	INT nArgs[3];
+	UINT uCalls;
+} SHIM_CALL;
+
+extern SHIM_CALL gShimCall;
+
+typedef struct _SYSTEM_INFO
+{
+	DWORD dwNumberOfProcessors;
+} SYSTEM_INFO;
+
+/* NPROC overrides the processor count to test other thread counts */
+static inline VOID GetSystemInfo(SYSTEM_INFO* si)
+{
+	const char* p = getenv("NPROC");
+	si->dwNumberOfProcessors = p ? (DWORD)atoi(p) : (DWORD)sysconf(_SC_NPROCESSORS_ONLN);
+}
+
+static inline BOOL QueryPerformanceCounter(LARGE_INTEGER* li)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	li->QuadPart = (LONGLONG)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+	return TRUE;
+}
+
+static inline BOOL QueryPerformanceFrequency(LARGE_INTEGER* li)
+{
+	li->QuadPart = 1000000000LL;
+	return TRUE;
+}
+
+static inline VOID Sleep(DWORD dwMs)
+{
+	usleep(dwMs * 1000);
+}
+
+static inline LONG InterlockedIncrement(volatile LONG* p)
+{
+	return __atomic_add_fetch(p, 1, __ATOMIC_SEQ_CST);
+}
+
+static inline LONG InterlockedDecrement(volatile LONG* p)
+{
+	return __atomic_sub_fetch(p, 1, __ATOMIC_SEQ_CST);
+}
+
+static inline LONG InterlockedExchange(volatile LONG* p, LONG v)
+{
+	return __atomic_exchange_n(p, v, __ATOMIC_SEQ_CST);
+}
+
+static inline LONG InterlockedCompareExchange(volatile LONG* p, LONG v, LONG c)
+{
+	return __sync_val_compare_and_swap(p, c, v);
+}
+
+static inline LONG64 InterlockedIncrement64(volatile LONG64* p)
+{
+	return __atomic_add_fetch(p, 1, __ATOMIC_SEQ_CST);
+}
+
+static inline LONG64 InterlockedCompareExchange64(volatile LONG64* p, LONG64 v, LONG64 c)
+{
+	return __sync_val_compare_and_swap(p, c, v);
+}
+
+/* threads are the only handles, WaitFor*Object joins and CloseHandle frees */
+typedef DWORD (WINAPI *LPTHREAD_START_ROUTINE)(LPVOID);
+
+typedef struct _SHIM_THREAD
+{
+	pthread_t Thread;
+	BOOL bJoined;
+	LPTHREAD_START_ROUTINE pfnStart;
+	LPVOID pParam;
+} SHIM_THREAD;
+
+static void* ShimThread(void* p)
+{
+	SHIM_THREAD* pThread = p;
+	pThread->pfnStart(pThread->pParam);
+	return NULL;
+}
+
+static inline HANDLE CreateThread(PVOID pAttr, SIZE_T szStack, LPTHREAD_START_ROUTINE pfnStart,
+	LPVOID pParam, DWORD dwFlags, DWORD* pId)
+{
+	SHIM_THREAD* pThread = calloc(1, sizeof(SHIM_THREAD));
+	UNREFERENCED_PARAMETER(pAttr);
+	UNREFERENCED_PARAMETER(szStack);
+	UNREFERENCED_PARAMETER(dwFlags);
+	UNREFERENCED_PARAMETER(pId);
+	if (!pThread)
+		return NULL;
+	pThread->pfnStart = pfnStart;
+	pThread->pParam = pParam;
+	if (pthread_create(&pThread->Thread, NULL, ShimThread, pThread) != 0)
+	{
+		free(pThread);
+		return NULL;
+	}
+	return pThread;
+}
+
+static inline DWORD WaitForMultipleObjects(DWORD dwCount, const HANDLE* pHandles, BOOL bAll, DWORD dwMs)
+{
+	DWORD i;
+	UNREFERENCED_PARAMETER(bAll);
+	UNREFERENCED_PARAMETER(dwMs);
+	for (i = 0; i < dwCount; i++)
+	{
+		SHIM_THREAD* pThread = pHandles[i];
+		if (!pThread->bJoined)
+			pthread_join(pThread->Thread, NULL);
+		pThread->bJoined = TRUE;
+	}
+	return 0;
+}
+
+static inline DWORD WaitForSingleObject(HANDLE h, DWORD dwMs)
+{
+	return WaitForMultipleObjects(1, &h, TRUE, dwMs);
+}
+
+static inline BOOL CloseHandle(HANDLE h)
+{
+	SHIM_THREAD* pThread = h;
+	if (!pThread->bJoined)
+		pthread_detach(pThread->Thread);
+	free(pThread);
+	return TRUE;
+}
+
+/* shared acquisitions are exclusive, which is enough for the callers */
+typedef struct _SRWLOCK
+{
+	pthread_mutex_t Mutex;
+} SRWLOCK, *PSRWLOCK;
+
+#define SRWLOCK_INIT { PTHREAD_MUTEX_INITIALIZER }
+
+static inline VOID InitializeSRWLock(PSRWLOCK pLock)
+{
+	pthread_mutex_init(&pLock->Mutex, NULL);
+}
+
+static inline VOID AcquireSRWLockExclusive(PSRWLOCK pLock)
+{
+	pthread_mutex_lock(&pLock->Mutex);
+}
+
+static inline VOID ReleaseSRWLockExclusive(PSRWLOCK pLock)
+{
+	pthread_mutex_unlock(&pLock->Mutex);
+}
+
+static inline VOID AcquireSRWLockShared(PSRWLOCK pLock)
+{
+	pthread_mutex_lock(&pLock->Mutex);
+}
+
+static inline VOID ReleaseSRWLockShared(PSRWLOCK pLock)
+{
+	pthread_mutex_unlock(&pLock->Mutex);
+}
+
+typedef struct _CONDITION_VARIABLE
+{
+	pthread_cond_t Cond;
+} CONDITION_VARIABLE, *PCONDITION_VARIABLE;
+
+#define CONDITION_VARIABLE_INIT { PTHREAD_COND_INITIALIZER }
+
+static inline VOID InitializeConditionVariable(PCONDITION_VARIABLE pCond)
+{
+	pthread_cond_init(&pCond->Cond, NULL);
+}
+
+static inline VOID WakeConditionVariable(PCONDITION_VARIABLE pCond)
+{
+	pthread_cond_signal(&pCond->Cond);
+}
+
+static inline VOID WakeAllConditionVariable(PCONDITION_VARIABLE pCond)
+{
+	pthread_cond_broadcast(&pCond->Cond);
+}
+
+static inline BOOL SleepConditionVariableSRW(PCONDITION_VARIABLE pCond, PSRWLOCK pLock, DWORD dwMs, ULONG uFlags)
+{
+	struct timespec ts;
+	UNREFERENCED_PARAMETER(uFlags);
+	if (dwMs == INFINITE)
+		return pthread_cond_wait(&pCond->Cond, &pLock->Mutex) == 0;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_sec += dwMs / 1000;
+	ts.tv_nsec += (long)(dwMs % 1000) * 1000000L;
+	if (ts.tv_nsec >= 1000000000L)
+	{
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000L;
+	}
+	return pthread_cond_timedwait(&pCond->Cond, &pLock->Mutex, &ts) == 0;
+}
+
+typedef struct _INIT_ONCE
+{
+	pthread_mutex_t Mutex;
+	volatile BOOL bDone;
+} INIT_ONCE, *PINIT_ONCE;
+
+#define INIT_ONCE_STATIC_INIT { PTHREAD_MUTEX_INITIALIZER, FALSE }
+
+typedef BOOL (CALLBACK *PINIT_ONCE_FN)(PINIT_ONCE pInitOnce, PVOID pParam, PVOID* ppContext);
+
+static inline BOOL InitOnceExecuteOnce(PINIT_ONCE pInitOnce, PINIT_ONCE_FN pfnInit, PVOID pParam, PVOID* ppContext)
+{
+	BOOL bRet = TRUE;
+	if (__atomic_load_n(&pInitOnce->bDone, __ATOMIC_ACQUIRE))
+		return TRUE;
+	pthread_mutex_lock(&pInitOnce->Mutex);
+	if (!pInitOnce->bDone)
+	{
+		bRet = pfnInit(pInitOnce, pParam, ppContext);
+		if (bRet)
+			__atomic_store_n(&pInitOnce->bDone, TRUE, __ATOMIC_RELEASE);
+	}
+	pthread_mutex_unlock(&pInitOnce->Mutex);
+	return bRet;
+}
@@ -0,0 +1,5 @@
+﻿// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "test.h"
+
+UINT gTestFailures;
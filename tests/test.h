@@ -0,0 +1,21 @@
+﻿// SPDX-License-Identifier: GPL-3.0-or-later
+#pragma once
+
+#include "fe.h"
+
+#include <stdio.h>
+
+/* failed checks are printed and counted, main returns FE_TEST_RESULT */
+extern UINT gTestFailures;
+
+#define FE_CHECK(x) \
+	do \
+	{ \
+		if (!(x)) \
+		{ \
+			printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #x); \
+			gTestFailures++; \
+		} \
+	} while (0)
+
+#define FE_TEST_RESULT (gTestFailures ? 1 : 0)
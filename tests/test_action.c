@@ -0,0 +1,156 @@
+﻿// SPDX-License-Identifier: GPL-3.0-or-later
+
+/* FeCompileActions on a config with every action type: the typed records, the converted
+ * strings and the parsed flags, the indices of entries without an action, and FeRunAction
+ * passing them to the handlers, which the shim records */
+
+#include "fe.h"
+#include "utils.h"
+#include "action.h"
+#include "test.h"
+
+static const char mConfig[] =
+	"["
+	"{\"key\":\"Ctrl-A\",\"exec\":\"notepad.exe \\\"%TEMP%\\\\a.txt\\\"\",\"window\":\"max\"},"
+	"{\"key\":\"Ctrl-B\",\"kill\":\"pid=0x1234\"},"
+	"{\"kill\":\"explorer.exe\"},"
+	"{\"resolution\":\"1920x1080\",\"monitor\":\"\\\\\\\\.\\\\DISPLAY1\"},"
+	"{\"find\":\"记事本\"},"
+	"{\"note\":\"no action\"},"
+	"{\"screenshot\":\"0\",\"save\":\"clipboard\",\"format\":\"qoi\",\"delta\":true},"
+	"{\"record\":\"1\",\"save\":\"C:\\\\rec.png\",\"compression\":\"fast\"},"
+	"{\"record\":\"2\",\"fps\":30},"
+	"{\"shell\":\"open\",\"file\":\"https://example.com/\",\"window\":\"hide\"},"
+	"{\"shortcut\":\"link\"},"
+	"{\"shortcut\":\"Fe\",\"file\":\"fe.exe\",\"args\":\"-s\",\"icon\":\"fe.ico\",\"id\":3,\"window\":\"min\"},"
+	"{\"exec\":\"first\",\"kill\":\"second\"},"
+	"{\"exec\":42}"
+	"]";
+
+static BOOL SameString(LPCWSTR lpA, LPCWSTR lpB)
+{
+	if (!lpA || !lpB)
+		return lpA == lpB;
+	return wcscmp(lpA, lpB) == 0;
+}
+
+/* the handler was called once, with these arguments */
+static BOOL Ran(const FE_ACTION_TABLE* pTable, UINT uIndex, const char* pName, LPCWSTR lpArg0, LPCWSTR lpArg1,
+	LPCWSTR lpArg2, LPCWSTR lpArg3, INT nArg0, INT nArg1, INT nArg2)
+{
+	UINT uCalls = gShimCall.uCalls;
+	ZeroMemory(&gShimCall, sizeof(SHIM_CALL));
+	gShimCall.uCalls = uCalls;
+	if (!FeRunAction(pTable, uIndex) || gShimCall.uCalls != uCalls + 1 || !gShimCall.pName)
+		return FALSE;
+	return strcmp(gShimCall.pName, pName) == 0
+		&& SameString(gShimCall.lpArgs[0], lpArg0) && SameString(gShimCall.lpArgs[1], lpArg1)
+		&& SameString(gShimCall.lpArgs[2], lpArg2) && SameString(gShimCall.lpArgs[3], lpArg3)
+		&& gShimCall.nArgs[0] == nArg0 && gShimCall.nArgs[1] == nArg1 && gShimCall.nArgs[2] == nArg2;
+}
+
+static VOID TestCompile(VOID)
+{
+	UINT i;
+	const FE_ACTION* a;
+	cJSON* pJson = cJSON_Parse(mConfig);
+	FE_ACTION_TABLE* pTable = FeCompileActions(pJson);
+	FE_CHECK(pJson && pTable);
+	if (!pTable)
+		return;
+	FE_CHECK(pTable->uCount == (UINT)cJSON_GetArraySize(pJson) && pTable->uCount == 14);
+	a = pTable->pActions;
+	/* the strings are part of the table, after the records */
+	for (i = 0; i < pTable->uCount; i++)
+	{
+		if (a[i].lpValue)
+			FE_CHECK((const void*)a[i].lpValue >= (const void*)(a + pTable->uCount));
+	}
+
+	FE_CHECK(a[0].uType == FE_ACTION_EXEC && SameString(a[0].lpValue, L"notepad.exe \"%TEMP%\\a.txt\""));
+	FE_CHECK(a[0].u.Exec.wShow == SW_MAXIMIZE);
+	FE_CHECK(Ran(pTable, 0, "FeExec", a[0].lpValue, NULL, NULL, NULL, SW_MAXIMIZE, FALSE, FALSE));
+
+	FE_CHECK(a[1].uType == FE_ACTION_KILL && a[1].u.Kill.dwPid == 0x1234);
+	FE_CHECK(Ran(pTable, 1, "FeKillProcessById", NULL, NULL, NULL, NULL, 0x1234, 1, 0));
+	FE_CHECK(a[2].uType == FE_ACTION_KILL && a[2].u.Kill.dwPid == 0);
+	FE_CHECK(Ran(pTable, 2, "FeKillProcessByName", L"explorer.exe", NULL, NULL, NULL, 1, 0, 0));
+
+	FE_CHECK(a[3].uType == FE_ACTION_RESOLUTION && SameString(a[3].u.Resolution.lpMonitor, L"\\\\.\\DISPLAY1"));
+	FE_CHECK(Ran(pTable, 3, "FeSetResolution", L"\\\\.\\DISPLAY1", L"1920x1080", NULL, NULL,
+		CDS_UPDATEREGISTRY, 0, 0));
+
+	/* UTF-8 to UTF-16, and the default flags */
+	FE_CHECK(a[4].uType == FE_ACTION_FIND && SameString(a[4].lpValue, L"\u8BB0\u4E8B\u672C"));
+	FE_CHECK(a[4].u.Find.wHide == SW_HIDE && a[4].u.Find.wShow == SW_RESTORE);
+	FE_CHECK(Ran(pTable, 4, "FeShowWindowByTitle", L"\u8BB0\u4E8B\u672C", NULL, NULL, NULL,
+		SW_HIDE, SW_RESTORE, 0));
+
+	/* keeps its place, so the next index is still the next item */
+	FE_CHECK(a[5].uType == FE_ACTION_NONE && a[5].lpValue == NULL);
+	FE_CHECK(!FeRunAction(pTable, 5));
+
+	FE_CHECK(a[6].uType == FE_ACTION_SCREENSHOT && a[6].u.Screenshot.bDelta);
+	FE_CHECK(a[6].u.Screenshot.lpCompression == NULL);
+	FE_CHECK(Ran(pTable, 6, "FeGetScreenShot", L"0", L"clipboard", NULL, L"qoi", TRUE, 0, 0));
+
+	FE_CHECK(a[7].uType == FE_ACTION_RECORD && a[7].u.Record.uFps == 5);
+	FE_CHECK(Ran(pTable, 7, "FeToggleRecord", L"1", L"C:\\rec.png", L"fast", NULL, 5, 0, 0));
+	FE_CHECK(a[8].uType == FE_ACTION_RECORD && a[8].u.Record.uFps == 30);
+	FE_CHECK(Ran(pTable, 8, "FeToggleRecord", L"2", NULL, NULL, NULL, 30, 0, 0));
+
+	FE_CHECK(a[9].uType == FE_ACTION_SHELL && a[9].u.Shell.wShow == SW_HIDE);
+	FE_CHECK(Ran(pTable, 9, "FeShellExec", L"open", L"https://example.com/", NULL, NULL, SW_HIDE, 0, 0));
+
+	/* nothing to link to */
+	FE_CHECK(a[10].uType == FE_ACTION_NONE);
+	FE_CHECK(!FeRunAction(pTable, 10));
+	FE_CHECK(a[11].uType == FE_ACTION_SHORTCUT && a[11].u.Shortcut.nId == 3);
+	FE_CHECK(Ran(pTable, 11, "FeCreateShortcut", L"fe.exe", L"Fe", L"-s", L"fe.ico", 3, SW_FORCEMINIMIZE, 0));
+
+	/* the first action key in the order of CompileAction wins */
+	FE_CHECK(a[12].uType == FE_ACTION_EXEC && SameString(a[12].lpValue, L"first"));
+	/* not a string */
+	FE_CHECK(a[13].uType == FE_ACTION_NONE);
+
+	FE_CHECK(!FeRunAction(pTable, pTable->uCount));
+	FE_CHECK(!FeRunAction(NULL, 0));
+	FeFreeActions(pTable);
+	cJSON_Delete(pJson);
+}
+
+/* the records and strings do not point into the JSON, which the config may free */
+static VOID TestOwnStrings(VOID)
+{
+	cJSON* pJson = cJSON_Parse("[{\"exec\":\"a.exe\"},{\"shell\":\"open\",\"file\":\"b.txt\"}]");
+	FE_ACTION_TABLE* pTable = FeCompileActions(pJson);
+	cJSON_Delete(pJson);
+	FE_CHECK(pTable && pTable->uCount == 2);
+	if (!pTable)
+		return;
+	FE_CHECK(Ran(pTable, 0, "FeExec", L"a.exe", NULL, NULL, NULL, SW_NORMAL, FALSE, FALSE));
+	FE_CHECK(Ran(pTable, 1, "FeShellExec", L"open", L"b.txt", NULL, NULL, SW_NORMAL, 0, 0));
+	FeFreeActions(pTable);
+}
+
+static VOID TestNotArray(VOID)
+{
+	cJSON* pObject = cJSON_Parse("{\"exec\":\"a.exe\"}");
+	cJSON* pEmpty = cJSON_Parse("[]");
+	FE_ACTION_TABLE* pTable = FeCompileActions(pEmpty);
+	FE_CHECK(FeCompileActions(NULL) == NULL);
+	FE_CHECK(FeCompileActions(pObject) == NULL);
+	FE_CHECK(pTable && pTable->uCount == 0);
+	FE_CHECK(!FeRunAction(pTable, 0));
+	FeFreeActions(pTable);
+	cJSON_Delete(pObject);
+	cJSON_Delete(pEmpty);
+}
+
+int main(void)
+{
+	TestCompile();
+	TestOwnStrings();
+	TestNotArray();
+	return FE_TEST_RESULT;
+}
@@ -0,0 +1,214 @@
+﻿// SPDX-License-Identifier: GPL-3.0-or-later
+
+/* the arena behind lodepng_malloc: blocks are aligned, the top block grows and pops in
+ * place, marks and resets hand the same memory back, blocks cross between the heap and
+ * the arena and between threads, and a repeated encode needs next to no heap */
+
+#include "fe.h"
+#include "utils.h"
+#include "pngenc.h"
+#include "arena.h"
+#include "test.h"
+
+#define TEST_ALIGN (2 * sizeof(PVOID))
+
+static BOOL IsAligned(const void* p)
+{
+	return ((size_t)p & (TEST_ALIGN - 1)) == 0;
+}
+
+static VOID TestBlocks(VOID)
+{
+	UINT i;
+	UINT8* p;
+	UINT8* q;
+	UINT8* r;
+	FE_ARENA_MARK mark;
+	FE_ARENA* pArena = FeCreateArena();
+	FE_CHECK(pArena != NULL);
+	if (!pArena)
+		return;
+	FE_CHECK(FeSetThreadArena(pArena) == NULL);
+
+	for (i = 0; i < 64; i++)
+	{
+		p = lodepng_malloc(i);
+		FE_CHECK(p && IsAligned(p));
+	}
+	/* the top block grows in place and keeps its contents */
+	p = lodepng_malloc(100);
+	memset(p, 0x5A, 100);
+	q = lodepng_realloc(p, 5000);
+	FE_CHECK(q == p && q[0] == 0x5A && q[99] == 0x5A);
+	/* a block below the top moves when it grows */
+	r = lodepng_malloc(16);
+	q = lodepng_realloc(p, 10000);
+	FE_CHECK(q != p && q[0] == 0x5A && q[99] == 0x5A);
+	/* freeing the top hands its space to the next block */
+	lodepng_free(q);
+	FE_CHECK(lodepng_malloc(32) == q);
+	/* freeing a block in the middle does nothing */
+	lodepng_free(r);
+	FE_CHECK(lodepng_malloc(16) != r);
+
+	FeGetArenaMark(pArena, &mark);
+	p = lodepng_malloc(1000);
+	lodepng_malloc(3000);
+	FeRewindArena(pArena, &mark);
+	FE_CHECK(lodepng_malloc(1000) == p);
+
+	/* larger than a chunk */
+	p = lodepng_malloc(3 << 20);
+	FE_CHECK(p && IsAligned(p));
+	memset(p, 1, 3 << 20);
+	FE_CHECK(lodepng_malloc((size_t)-1 - 4) == NULL);
+	FE_CHECK(lodepng_realloc(p, (size_t)-1 - 4) == NULL);
+
+	FE_CHECK(FeSetThreadArena(NULL) == pArena);
+	FeFreeArena(pArena);
+}
+
+/* after a reset the same work fits in the one merged chunk */
+static VOID TestReset(VOID)
+{
+	UINT i, k;
+	UINT64 ullAllocs = 0;
+	FE_ARENA* pArena = FeCreateArena();
+	FE_CHECK(pArena != NULL);
+	if (!pArena)
+		return;
+	FeSetThreadArena(pArena);
+	for (k = 0; k < 3; k++)
+	{
+		UINT64 ullStart = FeGetHeapAllocs();
+		UINT8* p = NULL;
+		for (i = 0; i < 40; i++)
+			lodepng_malloc(100000 + i);
+		/* a vector growing by doubling, as lodepng's ucvector does */
+		for (i = 64; i <= (1 << 22); i *= 2)
+			p = lodepng_realloc(p, i);
+		FE_CHECK(p != NULL);
+		FeResetArena(pArena);
+		ullAllocs = FeGetHeapAllocs() - ullStart;
+		printf("round %u: %llu heap allocations\n", k, (unsigned long long)ullAllocs);
+	}
+	FE_CHECK(ullAllocs == 0);
+	FeSetThreadArena(NULL);
+	FeFreeArena(pArena);
+}
+
+/* heap blocks survive the arena being set, arena blocks move out to the heap */
+static VOID TestHeap(VOID)
+{
+	UINT8* p;
+	UINT8* q;
+	FE_ARENA* pArena = FeCreateArena();
+	FE_CHECK(pArena != NULL);
+	if (!pArena)
+		return;
+	p = lodepng_malloc(64);
+	FE_CHECK(p && IsAligned(p));
+	memset(p, 7, 64);
+	FeSetThreadArena(pArena);
+	q = lodepng_realloc(p, 128);
+	FE_CHECK(q && q != p && q[63] == 7);
+	FeSetThreadArena(NULL);
+	p = lodepng_realloc(q, 256);
+	FE_CHECK(p && p != q && p[0] == 7 && p[63] == 7);
+	lodepng_free(p);
+	p = lodepng_realloc(NULL, 10);
+	FE_CHECK(p != NULL);
+	lodepng_free(p);
+	lodepng_free(NULL);
+	FeFreeArena(pArena);
+}
+
+typedef struct _TEST_THREAD
+{
+	pthread_t Thread;
+	UINT8* pBlock;
+	UINT8* pMoved;
+} TEST_THREAD;
+
+static void* OtherThread(void* p)
+{
+	TEST_THREAD* pThread = p;
+	/* another thread's arena block, freed from a thread without one, then moved */
+	pThread->pMoved = lodepng_realloc(pThread->pBlock, 4096);
+	return NULL;
+}
+
+static VOID TestThreads(VOID)
+{
+	TEST_THREAD thread = { 0 };
+	UINT8* pNext;
+	FE_ARENA* pArena = FeCreateArena();
+	FE_CHECK(pArena != NULL);
+	if (!pArena)
+		return;
+	FeSetThreadArena(pArena);
+	thread.pBlock = lodepng_malloc(100);
+	memset(thread.pBlock, 3, 100);
+	pthread_create(&thread.Thread, NULL, OtherThread, &thread);
+	pthread_join(thread.Thread, NULL);
+	FE_CHECK(thread.pMoved && thread.pMoved[99] == 3);
+	/* the block stays owned by the arena, only this thread may pop it */
+	pNext = lodepng_malloc(16);
+	FE_CHECK(pNext != thread.pBlock);
+	FeSetThreadArena(NULL);
+	lodepng_free(thread.pMoved);
+	FeFreeArena(pArena);
+}
+
+/* the pooled arenas make a repeated encode cheap and leave the output unchanged */
+static VOID TestEncode(VOID)
+{
+	UINT i, k;
+	UINT w = 1920, h = 1080;
+	UINT uSeed = 5;
+	UINT8* pFirst = NULL;
+	size_t szFirst = 0;
+	UINT64 ullAllocs = 0;
+	UINT8* pBgrx = malloc((size_t)w * h * 4);
+	FE_PNG_ENCODER* pEncoder = FeCreatePngEncoder();
+	FE_CHECK(pBgrx && pEncoder);
+	if (!pBgrx || !pEncoder)
+		return;
+	for (i = 0; i < w * h * 4; i++)
+	{
+		uSeed = uSeed * 1103515245 + 12345;
+		pBgrx[i] = (UINT8)((i / 4000) * 3 + ((uSeed >> 28) & 1));
+	}
+	for (k = 0; k < 3; k++)
+	{
+		UINT8* pPng = NULL;
+		size_t szPng = 0;
+		UINT64 ullStart = FeGetHeapAllocs();
+		FE_CHECK(FeEncodePngBgrx(pEncoder, &pPng, &szPng, pBgrx, w, h, (size_t)w * 4, FE_PNG_BALANCED) == 0);
+		ullAllocs = FeGetHeapAllocs() - ullStart;
+		printf("encode %u: %zu bytes, %llu heap allocations\n", k, szPng, (unsigned long long)ullAllocs);
+		if (k == 0)
+		{
+			pFirst = pPng;
+			szFirst = szPng;
+			continue;
+		}
+		FE_CHECK(szPng == szFirst && memcmp(pPng, pFirst, szPng) == 0);
+		free(pPng);
+	}
+	FE_CHECK(ullAllocs <= 4);
+	free(pFirst);
+	FeFreePngEncoder(pEncoder);
+	FeFreePngArenas();
+	free(pBgrx);
+}
+
+int main(void)
+{
+	TestBlocks();
+	TestReset();
+	TestHeap();
+	TestThreads();
+	TestEncode();
+	return FE_TEST_RESULT;
+}
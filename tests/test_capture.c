@@ -0,0 +1,94 @@
+﻿// SPDX-License-Identifier: GPL-3.0-or-later
+
+/* the capture interface on the memory backend: a held frame blocks the next grab until it
+ * is released from any thread, areas off the screen are refused, the area comes back at
+ * its place in the frame buffer, and every grab changes one small block */
+
+#include "fe.h"
+#include "utils.h"
+#include "capture.h"
+#include "swizzle.h"
+#include "test.h"
+
+#define TEST_WIDTH 800
+#define TEST_HEIGHT 600
+
+static void* ReleaseThread(void* p)
+{
+	FeReleaseCapture(p);
+	return NULL;
+}
+
+static VOID TestBusy(FE_CAPTURE* pCapture)
+{
+	pthread_t thread;
+	size_t szStride = 0;
+	UINT8* pRow = FeGrabCapture(pCapture, 0, 0, TEST_WIDTH, TEST_HEIGHT, &szStride);
+	FE_CHECK(pRow != NULL && szStride == TEST_WIDTH * 4);
+	FE_CHECK(FeGrabCapture(pCapture, 0, 0, 10, 10, &szStride) == NULL);
+	/* the encoder releases the frame from its own thread */
+	pthread_create(&thread, NULL, ReleaseThread, pCapture);
+	pthread_join(thread, NULL);
+	FE_CHECK(FeGrabCapture(pCapture, 0, 0, 10, 10, &szStride) != NULL);
+	FeReleaseCapture(pCapture);
+
+	/* a refused area does not hold the capture */
+	FE_CHECK(FeGrabCapture(pCapture, -1, 0, 10, 10, &szStride) == NULL);
+	FE_CHECK(FeGrabCapture(pCapture, 0, 0, TEST_WIDTH + 1, 10, &szStride) == NULL);
+	FE_CHECK(FeGrabCapture(pCapture, 0, TEST_HEIGHT - 5, 10, 10, &szStride) == NULL);
+	FE_CHECK(FeGrabCapture(pCapture, 0, 0, 0, 10, &szStride) == NULL);
+	FE_CHECK(FeGrabCapture(pCapture, 0, 0, 10, 10, &szStride) != NULL);
+	FeReleaseCapture(pCapture);
+}
+
+static VOID TestFrames(FE_CAPTURE* pCapture)
+{
+	UINT i;
+	size_t szStride = 0;
+	size_t szFrame = (size_t)TEST_WIDTH * TEST_HEIGHT * 4;
+	UINT uTiles = ((TEST_WIDTH + FE_TILE_SIZE - 1) / FE_TILE_SIZE) * ((TEST_HEIGHT + FE_TILE_SIZE - 1) / FE_TILE_SIZE);
+	UINT8* pMap = malloc(uTiles);
+	UINT8* pLast = malloc(szFrame);
+	UINT8* pBase;
+	UINT8* pRow;
+	FE_CHECK(pMap && pLast);
+	if (!pMap || !pLast)
+		return;
+	pBase = FeGrabCapture(pCapture, 0, 0, TEST_WIDTH, TEST_HEIGHT, &szStride);
+	FE_CHECK(pBase != NULL);
+	if (!pBase)
+		return;
+	memcpy(pLast, pBase, szFrame);
+	FeReleaseCapture(pCapture);
+	for (i = 0; i < 20; i++)
+	{
+		UINT uDirty;
+		pRow = FeGrabCapture(pCapture, 0, 0, TEST_WIDTH, TEST_HEIGHT, &szStride);
+		FE_CHECK(pRow == pBase);
+		/* a 48 pixel block touches 3 x 3 tiles at most */
+		uDirty = FeDiffTiles(pMap, pLast, szStride, pRow, szStride, TEST_WIDTH, TEST_HEIGHT);
+		FE_CHECK(uDirty > 0 && uDirty <= 9);
+		memcpy(pLast, pRow, szFrame);
+		FeReleaseCapture(pCapture);
+	}
+	/* an area is copied into its place in the frame buffer */
+	pRow = FeGrabCapture(pCapture, 100, 50, 300, 200, &szStride);
+	FE_CHECK(pRow == pBase + 50 * szStride + 100 * 4);
+	FeReleaseCapture(pCapture);
+	free(pMap);
+	free(pLast);
+}
+
+int main(void)
+{
+	FE_CAPTURE* pCapture = FeCreateMemoryCapture(TEST_WIDTH, TEST_HEIGHT);
+	FE_CHECK(FeCreateMemoryCapture(0, 10) == NULL);
+	FE_CHECK(pCapture != NULL);
+	if (!pCapture)
+		return FE_TEST_RESULT;
+	TestBusy(pCapture);
+	TestFrames(pCapture);
+	FeFreeCapture(pCapture);
+	FeFreeCapture(NULL);
+	return FE_TEST_RESULT;
+}
@@ -0,0 +1,131 @@
+﻿// SPDX-License-Identifier: GPL-3.0-or-later
+
+/* the dispatched CRC32 and adler32 against bytewise reference versions on random buffers
+ * of every small length and offset, with the first calls made from several threads */
+
+#include "fe.h"
+#include "utils.h"
+#include "checksum.h"
+#include "test.h"
+
+#define TEST_THREADS 8
+#define TEST_SIZE (1 << 20)
+
+static UINT mCrcTable[256];
+static UINT8* mData;
+
+static UINT RefCrc32(const UINT8* pData, size_t szData)
+{
+	size_t i;
+	UINT uCrc = 0xFFFFFFFFU;
+	for (i = 0; i < szData; i++)
+		uCrc = mCrcTable[(uCrc ^ pData[i]) & 0xFF] ^ (uCrc >> 8);
+	return ~uCrc;
+}
+
+static UINT RefAdler32(const UINT8* pData, size_t szData)
+{
+	size_t i;
+	UINT a = 1, b = 0;
+	for (i = 0; i < szData; i++)
+	{
+		a = (a + pData[i]) % 65521;
+		b = (b + a) % 65521;
+	}
+	return (b << 16) | a;
+}
+
+typedef struct _RACE
+{
+	pthread_t Thread;
+	UINT uFeatures;
+	UINT uCrc;
+	UINT uAdler;
+} RACE;
+
+static void* RaceThread(void* p)
+{
+	RACE* pRace = p;
+	pRace->uFeatures = FeGetCpuFeatures();
+	pRace->uCrc = FeCrc32(0, mData, TEST_SIZE);
+	pRace->uAdler = FeAdler32(1, mData, TEST_SIZE);
+	return NULL;
+}
+
+/* every thread sees the dispatch finished, with the same features */
+static VOID TestFirstCalls(VOID)
+{
+	UINT i;
+	RACE Races[TEST_THREADS];
+	UINT uCrc = RefCrc32(mData, TEST_SIZE);
+	UINT uAdler = RefAdler32(mData, TEST_SIZE);
+	for (i = 0; i < TEST_THREADS; i++)
+		pthread_create(&Races[i].Thread, NULL, RaceThread, &Races[i]);
+	for (i = 0; i < TEST_THREADS; i++)
+	{
+		pthread_join(Races[i].Thread, NULL);
+		FE_CHECK(Races[i].uFeatures == Races[0].uFeatures);
+		FE_CHECK(Races[i].uCrc == uCrc);
+		FE_CHECK(Races[i].uAdler == uAdler);
+	}
+	printf("cpu features 0x%x\n", Races[0].uFeatures);
+}
+
+static VOID TestLengths(VOID)
+{
+	size_t n, szOff;
+	for (n = 0; n < 20000; n += (n < 300) ? 1 : 997)
+	{
+		for (szOff = 0; szOff < 3; szOff++)
+		{
+			const UINT8* p = mData + szOff;
+			size_t szHead = n / 3;
+			UINT uCrc = RefCrc32(p, n);
+			UINT uAdler = RefAdler32(p, n);
+			FE_CHECK(FeCrc32(0, p, n) == uCrc);
+			FE_CHECK(FeAdler32(1, p, n) == uAdler);
+			FE_CHECK(FeCrc32(FeCrc32(0, p, szHead), p + szHead, n - szHead) == uCrc);
+			FE_CHECK(FeAdler32Combine(FeAdler32(1, p, szHead), FeAdler32(1, p + szHead, n - szHead),
+				n - szHead) == uAdler);
+		}
+	}
+}
+
+/* 0xFF bytes are the worst case for the deferred adler32 modulo */
+static VOID TestAllOnes(VOID)
+{
+	UINT8* pOnes = malloc(TEST_SIZE);
+	FE_CHECK(pOnes != NULL);
+	if (!pOnes)
+		return;
+	memset(pOnes, 0xFF, TEST_SIZE);
+	FE_CHECK(FeAdler32(1, pOnes, TEST_SIZE) == RefAdler32(pOnes, TEST_SIZE));
+	FE_CHECK(FeCrc32(0, pOnes, TEST_SIZE) == RefCrc32(pOnes, TEST_SIZE));
+	free(pOnes);
+}
+
+int main(void)
+{
+	UINT i, j;
+	UINT uSeed = 3;
+	for (i = 0; i < 256; i++)
+	{
+		UINT r = i;
+		for (j = 0; j < 8; j++)
+			r = (r & 1) ? (r >> 1) ^ 0xEDB88320U : r >> 1;
+		mCrcTable[i] = r;
+	}
+	mData = malloc(TEST_SIZE + 3);
+	if (!mData)
+		return 1;
+	for (i = 0; i < TEST_SIZE + 3; i++)
+	{
+		uSeed = uSeed * 1103515245 + 12345;
+		mData[i] = (UINT8)(uSeed >> 24);
+	}
+	TestFirstCalls();
+	TestLengths();
+	TestAllOnes();
+	free(mData);
+	return FE_TEST_RESULT;
+}
@@ -0,0 +1,627 @@
+﻿// SPDX-License-Identifier: GPL-3.0-or-later
+
+/* the changes fe makes to cJSON: every function which changes the members of an object
+ * drops its lookup index, and the lookups agree with a linear search after each of them;
+ * an arena parse, in place or not, gives the tree and the errors of cJSON_Parse */
+
+#include "fe.h"
+#include "cJSON/cJSON.h"
+#include "test.h"
+
+#include <ctype.h>
+
+#define TEST_MEMBERS 20
+
+typedef VOID (*TEST_MUTATE)(cJSON* pObject);
+
+typedef struct _TEST_MUTATOR
+{
+	const char* pName;
+	TEST_MUTATE pfnMutate;
+} TEST_MUTATOR;
+
+/* what cJSON_GetObjectItem did before the index */
+static cJSON* FindLinear(const cJSON* pObject, const char* pName, BOOL bCase)
+{
+	cJSON* pItem;
+	for (pItem = pObject->child; pItem; pItem = pItem->next)
+	{
+		const unsigned char* a = (const unsigned char*)pName;
+		const unsigned char* b = (const unsigned char*)pItem->string;
+		if (!b)
+			continue;
+		if (bCase)
+		{
+			if (strcmp(pName, pItem->string) == 0)
+				return pItem;
+			continue;
+		}
+		for (; *a && tolower(*a) == tolower(*b); a++, b++)
+			;
+		if (tolower(*a) == tolower(*b))
+			return pItem;
+	}
+	return NULL;
+}
+
+static BOOL CheckName(const cJSON* pObject, const char* pName)
+{
+	return cJSON_GetObjectItem(pObject, pName) == FindLinear(pObject, pName, FALSE)
+		&& cJSON_GetObjectItemCaseSensitive(pObject, pName) == FindLinear(pObject, pName, TRUE)
+		&& cJSON_HasObjectItem(pObject, pName) == (FindLinear(pObject, pName, FALSE) != NULL);
+}
+
+/* every member in three cases, and names which are not there */
+static BOOL CheckLookups(const cJSON* pObject)
+{
+	static const char* Others[] = { "new", "NEW", "moved", "Replaced", "", "Key", "Key100" };
+	UINT i;
+	char Name[32];
+	const cJSON* pItem;
+	for (pItem = pObject->child; pItem; pItem = pItem->next)
+	{
+		size_t j;
+		if (!pItem->string || strlen(pItem->string) >= sizeof(Name))
+			continue;
+		strcpy(Name, pItem->string);
+		if (!CheckName(pObject, Name))
+			return FALSE;
+		for (j = 0; Name[j]; j++)
+			Name[j] = (char)toupper((unsigned char)Name[j]);
+		if (!CheckName(pObject, Name))
+			return FALSE;
+		for (j = 0; Name[j]; j++)
+			Name[j] = (char)tolower((unsigned char)Name[j]);
+		if (!CheckName(pObject, Name))
+			return FALSE;
+	}
+	for (i = 0; i < ARRAYSIZE(Others); i++)
+	{
+		if (!CheckName(pObject, Others[i]))
+			return FALSE;
+	}
+	return TRUE;
+}
+
+/* Key0 to Key19, and key5 again after them, so a lookup of key5 finds the first */
+static cJSON* CreateObject(UINT uMembers)
+{
+	UINT i;
+	char Name[16];
+	cJSON* pObject = cJSON_CreateObject();
+	for (i = 0; i < uMembers; i++)
+	{
+		snprintf(Name, sizeof(Name), "Key%u", i);
+		cJSON_AddNumberToObject(pObject, Name, i);
+	}
+	cJSON_AddStringToObject(pObject, "key5", "second");
+	return pObject;
+}
+
+static VOID AddItem(cJSON* pObject)
+{
+	cJSON_AddItemToObject(pObject, "new", cJSON_CreateNull());
+}
+
+static VOID AddItemCS(cJSON* pObject)
+{
+	cJSON_AddItemToObjectCS(pObject, "NEW", cJSON_CreateNull());
+}
+
+static cJSON mShared;
+
+static VOID AddReference(cJSON* pObject)
+{
+	cJSON_AddItemReferenceToObject(pObject, "new", &mShared);
+}
+
+static VOID AddNull(cJSON* pObject)
+{
+	cJSON_AddNullToObject(pObject, "new");
+}
+
+static VOID AddTrue(cJSON* pObject)
+{
+	cJSON_AddTrueToObject(pObject, "new");
+}
+
+static VOID AddFalse(cJSON* pObject)
+{
+	cJSON_AddFalseToObject(pObject, "new");
+}
+
+static VOID AddBool(cJSON* pObject)
+{
+	cJSON_AddBoolToObject(pObject, "new", TRUE);
+}
+
+static VOID AddNumber(cJSON* pObject)
+{
+	cJSON_AddNumberToObject(pObject, "new", 1.0);
+}
+
+static VOID AddString(cJSON* pObject)
+{
+	cJSON_AddStringToObject(pObject, "new", "value");
+}
+
+static VOID AddRaw(cJSON* pObject)
+{
+	cJSON_AddRawToObject(pObject, "new", "[1]");
+}
+
+static VOID AddObject(cJSON* pObject)
+{
+	cJSON_AddObjectToObject(pObject, "new");
+}
+
+static VOID AddArray(cJSON* pObject)
+{
+	cJSON_AddArrayToObject(pObject, "new");
+}
+
+/* a member of another object still has its name */
+static cJSON* TakeMember(VOID)
+{
+	cJSON* pOther = cJSON_CreateObject();
+	cJSON* pItem;
+	cJSON_AddStringToObject(pOther, "moved", "value");
+	pItem = cJSON_DetachItemFromObject(pOther, "moved");
+	cJSON_Delete(pOther);
+	return pItem;
+}
+
+/* the item is the caller's when it was not added */
+static VOID KeepOrDelete(cJSON_bool bAdded, cJSON* pItem)
+{
+	if (!bAdded)
+		cJSON_Delete(pItem);
+}
+
+static VOID AddToArray(cJSON* pObject)
+{
+	cJSON* pItem = TakeMember();
+	KeepOrDelete(cJSON_AddItemToArray(pObject, pItem), pItem);
+}
+
+static VOID InsertFirst(cJSON* pObject)
+{
+	cJSON* pItem = TakeMember();
+	KeepOrDelete(cJSON_InsertItemInArray(pObject, 0, pItem), pItem);
+}
+
+static VOID InsertPastEnd(cJSON* pObject)
+{
+	cJSON* pItem = TakeMember();
+	KeepOrDelete(cJSON_InsertItemInArray(pObject, 100, pItem), pItem);
+}
+
+static VOID DetachViaPointer(cJSON* pObject)
+{
+	cJSON_Delete(cJSON_DetachItemViaPointer(pObject, cJSON_GetObjectItem(pObject, "Key7")));
+}
+
+static VOID DetachFromArray(cJSON* pObject)
+{
+	cJSON_Delete(cJSON_DetachItemFromArray(pObject, 0));
+}
+
+/* the first key5, so the second is found next */
+static VOID DetachFromObject(cJSON* pObject)
+{
+	cJSON_Delete(cJSON_DetachItemFromObject(pObject, "KEY5"));
+}
+
+static VOID DetachFromObjectCS(cJSON* pObject)
+{
+	cJSON_Delete(cJSON_DetachItemFromObjectCaseSensitive(pObject, "Key5"));
+}
+
+static VOID DeleteFromArray(cJSON* pObject)
+{
+	cJSON_DeleteItemFromArray(pObject, 5);
+}
+
+static VOID DeleteFromObject(cJSON* pObject)
+{
+	cJSON_DeleteItemFromObject(pObject, "key5");
+}
+
+static VOID DeleteFromObjectCS(cJSON* pObject)
+{
+	cJSON_DeleteItemFromObjectCaseSensitive(pObject, "Key13");
+}
+
+static VOID ReplaceViaPointer(cJSON* pObject)
+{
+	cJSON* pItem = TakeMember();
+	KeepOrDelete(cJSON_ReplaceItemViaPointer(pObject, cJSON_GetObjectItem(pObject, "Key3"), pItem), pItem);
+}
+
+static VOID ReplaceInArray(cJSON* pObject)
+{
+	cJSON* pItem = TakeMember();
+	KeepOrDelete(cJSON_ReplaceItemInArray(pObject, 2, pItem), pItem);
+}
+
+/* the member takes the name as given, in another case */
+static VOID ReplaceInObject(cJSON* pObject)
+{
+	cJSON* pItem = cJSON_CreateTrue();
+	KeepOrDelete(cJSON_ReplaceItemInObject(pObject, "KEY4", pItem), pItem);
+}
+
+static VOID ReplaceInObjectCS(cJSON* pObject)
+{
+	cJSON* pItem = cJSON_CreateTrue();
+	KeepOrDelete(cJSON_ReplaceItemInObjectCaseSensitive(pObject, "Key5", pItem), pItem);
+}
+
+static const TEST_MUTATOR mMutators[] =
+{
+	{ "cJSON_AddItemToObject", AddItem },
+	{ "cJSON_AddItemToObjectCS", AddItemCS },
+	{ "cJSON_AddItemReferenceToObject", AddReference },
+	{ "cJSON_AddNullToObject", AddNull },
+	{ "cJSON_AddTrueToObject", AddTrue },
+	{ "cJSON_AddFalseToObject", AddFalse },
+	{ "cJSON_AddBoolToObject", AddBool },
+	{ "cJSON_AddNumberToObject", AddNumber },
+	{ "cJSON_AddStringToObject", AddString },
+	{ "cJSON_AddRawToObject", AddRaw },
+	{ "cJSON_AddObjectToObject", AddObject },
+	{ "cJSON_AddArrayToObject", AddArray },
+	{ "cJSON_AddItemToArray", AddToArray },
+	{ "cJSON_InsertItemInArray", InsertFirst },
+	{ "cJSON_InsertItemInArray past the end", InsertPastEnd },
+	{ "cJSON_DetachItemViaPointer", DetachViaPointer },
+	{ "cJSON_DetachItemFromArray", DetachFromArray },
+	{ "cJSON_DetachItemFromObject", DetachFromObject },
+	{ "cJSON_DetachItemFromObjectCaseSensitive", DetachFromObjectCS },
+	{ "cJSON_DeleteItemFromArray", DeleteFromArray },
+	{ "cJSON_DeleteItemFromObject", DeleteFromObject },
+	{ "cJSON_DeleteItemFromObjectCaseSensitive", DeleteFromObjectCS },
+	{ "cJSON_ReplaceItemViaPointer", ReplaceViaPointer },
+	{ "cJSON_ReplaceItemInArray", ReplaceInArray },
+	{ "cJSON_ReplaceItemInObject", ReplaceInObject },
+	{ "cJSON_ReplaceItemInObjectCaseSensitive", ReplaceInObjectCS },
+};
+
+/* an indexed object, and one which becomes wide enough for an index */
+static VOID TestMutators(VOID)
+{
+	UINT i, j;
+	static const UINT Sizes[] = { TEST_MEMBERS, CJSON_INDEX_MIN_ITEMS - 2 };
+	mShared.type = cJSON_Number;
+	for (i = 0; i < ARRAYSIZE(mMutators); i++)
+	{
+		for (j = 0; j < ARRAYSIZE(Sizes); j++)
+		{
+			cJSON* pObject = CreateObject(Sizes[j]);
+			BOOL bBefore = CheckLookups(pObject);
+			BOOL bIndexed = pObject->index != NULL;
+			mMutators[i].pfnMutate(pObject);
+			if (!bBefore || !bIndexed || pObject->index != NULL || !CheckLookups(pObject))
+			{
+				printf("%s on %u members: %s\n", mMutators[i].pName, Sizes[j] + 1,
+					bIndexed && pObject->index != NULL ? "index kept" : "lookup differs");
+				gTestFailures++;
+			}
+			cJSON_Delete(pObject);
+		}
+	}
+}
+
+static UINT TestRandom(UINT* pSeed)
+{
+	*pSeed = *pSeed * 1103515245 + 12345;
+	return *pSeed >> 16;
+}
+
+/* the mutators in random order on one object, with lookups in between so the index is
+ * rebuilt, and new members named like old ones in other cases */
+static VOID TestRandomMutations(VOID)
+{
+	UINT i;
+	UINT uSeed = 11;
+	char Name[16];
+	cJSON* pObject = CreateObject(TEST_MEMBERS);
+	for (i = 0; i < 2000; i++)
+	{
+		UINT r = TestRandom(&uSeed);
+		snprintf(Name, sizeof(Name), (r & 1) ? "KEY%u" : "key%u", (r >> 1) % (TEST_MEMBERS + 8));
+		if (r % 5 == 0)
+			cJSON_AddNumberToObject(pObject, Name, i);
+		else if (r % 5 == 1)
+			cJSON_DeleteItemFromObject(pObject, Name);
+		else if (r % 5 == 2)
+		{
+			cJSON* pItem = cJSON_CreateNumber(i);
+			KeepOrDelete(cJSON_ReplaceItemInObject(pObject, Name, pItem), pItem);
+		}
+		else
+			mMutators[r % ARRAYSIZE(mMutators)].pfnMutate(pObject);
+		if (!CheckLookups(pObject))
+		{
+			printf("round %u: lookup differs\n", i);
+			gTestFailures++;
+			break;
+		}
+	}
+	cJSON_Delete(pObject);
+}
+
+/* a reference shares the members but is never indexed, a copy has an index of its own */
+static VOID TestReferenceAndCopy(VOID)
+{
+	cJSON* pObject = CreateObject(TEST_MEMBERS);
+	cJSON* pReference;
+	cJSON* pCopy;
+	FE_CHECK(CheckLookups(pObject) && pObject->index != NULL);
+	pReference = cJSON_CreateObjectReference(pObject->child);
+	pCopy = cJSON_Duplicate(pObject, TRUE);
+	FE_CHECK(pReference && pCopy);
+	if (!pReference || !pCopy)
+		return;
+	/* cJSON_CreateObjectReference takes the member list */
+	FE_CHECK(pReference->index == NULL && pCopy->index == NULL);
+	FE_CHECK(CheckLookups(pReference) && pReference->index == NULL);
+	FE_CHECK(CheckLookups(pCopy) && pCopy->index != NULL && pCopy->index != pObject->index);
+	cJSON_DeleteItemFromObject(pObject, "Key1");
+	FE_CHECK(CheckLookups(pObject) && CheckLookups(pCopy));
+	FE_CHECK(cJSON_GetObjectItem(pCopy, "key1") != NULL);
+	cJSON_Delete(pReference);
+	cJSON_Delete(pCopy);
+	cJSON_Delete(pObject);
+}
+
+/* what the parsers are given besides the printed trees: escapes, white space, nesting */
+static const char* mTexts[] =
+{
+	"{\"hotkeys\":[{\"name\":\"Screenshot\",\"hotkey\":\"Ctrl+Alt+S\",\"type\":\"screenshot\"},"
+	"{\"name\":\"Shell\",\"hotkey\":\"Win+Shift+1\",\"type\":\"exec\",\"args\":[\"cmd.exe\",\"/c\",\"dir\"]}],"
+	"\"numbers\":[0,-1,1.5,-0.25,1e300,2E-3,123456789],\"flags\":[true,false,null],\"empty\":{},\"none\":[]}",
+	" \t\r\n{ \"a\" : [ 1 , { \"b\" : \"c\" } ] , \"A\" : \"upper\" , \"a\" : \"again\" } \n",
+	"{\"esc\":\"tab\\tquote\\\" slash\\/ back\\\\ \\b\\f\\n\\r\",\"\\u00e9t\\u00E9\":\"\\ud83d\\ude00\\u4e2d\"}",
+	"{\"\\\"\\\\\\n\":\"\\u0041\\u0000x\",\"k\\ud834\\udd1e\":[\"\\ud834\\udd1e\\ud834\\udd1e\",\"\",\"\\\\\"],\"\":\"plain\"}",
+	"[[[[[[[[[[\"deep\"]]]]]]]]]]",
+	"\"only a string\"",
+	"-12.5e-3",
+	"\xEF\xBB\xBF{\"bom\":true}",
+	/* failures */
+	"{\"a\":1,}", "[1 2]", "{\"a\" 1}", "{\"a\":tru}", "\"\\x\"", "\"\\ud800\"", "{1:2}", "[", "",
+	/* cJSON_Parse stops after a value and ignores what follows */
+	"{\"a\":1} trailing", "1 2"
+};
+
+/* a copy of one of the texts above to free with cJSON_free, or a wide object printed with and without formatting */
+static char* GetText(UINT i)
+{
+	char* pText;
+	cJSON* pTree;
+	if (i < ARRAYSIZE(mTexts))
+	{
+		pText = cJSON_malloc(strlen(mTexts[i]) + 1);
+		if (pText)
+			strcpy(pText, mTexts[i]);
+		return pText;
+	}
+	pTree = cJSON_CreateObject();
+	cJSON_AddItemToObject(pTree, "Wide", CreateObject(CJSON_INDEX_MIN_ITEMS * 3));
+	cJSON_AddItemToObject(pTree, "Small", CreateObject(3));
+	cJSON_AddItemToObject(pTree, "List", cJSON_CreateArray());
+	cJSON_AddItemToArray(cJSON_GetObjectItem(pTree, "List"), CreateObject(CJSON_INDEX_MIN_ITEMS));
+	pText = (i == ARRAYSIZE(mTexts)) ? cJSON_Print(pTree) : cJSON_PrintUnformatted(pTree);
+	cJSON_Delete(pTree);
+	return pText;
+}
+
+#define TEST_TEXTS (ARRAYSIZE(mTexts) + 2)
+
+/* objects of an arena tree are indexed by the parse, before any lookup */
+static BOOL CheckArenaTree(const cJSON* pItem)
+{
+	for (; pItem; pItem = pItem->next)
+	{
+		if (cJSON_IsObject(pItem) && (pItem->index == NULL || !CheckLookups(pItem)))
+			return FALSE;
+		if (!CheckArenaTree(pItem->child))
+			return FALSE;
+	}
+	return TRUE;
+}
+
+/* both trees print the same, or both parses fail at the same place */
+static BOOL SameParse(const char* pText, cJSON* pHeap, size_t szHeapError, cJSON* pArena,
+	size_t szArenaError)
+{
+	BOOL bSame;
+	char* pOne;
+	char* pTwo;
+	if (!pHeap || !pArena)
+	{
+		if (pHeap || pArena || szHeapError != szArenaError)
+			printf("%.40s: %p at %zu, arena %p at %zu\n", pText, (void*)pHeap, szHeapError,
+				(void*)pArena, szArenaError);
+		return !pHeap && !pArena && szHeapError == szArenaError;
+	}
+	pOne = cJSON_PrintUnformatted(pHeap);
+	pTwo = cJSON_PrintUnformatted(pArena);
+	bSame = pOne && pTwo && strcmp(pOne, pTwo) == 0;
+	if (!bSame)
+		printf("%.40s: prints differ\n", pText);
+	cJSON_free(pOne);
+	cJSON_free(pTwo);
+	return bSame;
+}
+
+/* parses szText bytes of pText, copied to a buffer of their own so a read past them shows */
+static BOOL CheckArenaParse(const char* pText, size_t szText)
+{
+	BOOL bSame;
+	size_t szHeapError, szArenaError;
+	cJSON* pHeap;
+	cJSON* pArena;
+	char* pCopy = malloc(szText + 1);
+	if (!pCopy)
+		return FALSE;
+	memcpy(pCopy, pText, szText);
+	pCopy[szText] = '\0';
+	pHeap = cJSON_Parse(pCopy);
+	szHeapError = pHeap ? 0 : (size_t)(cJSON_GetErrorPtr() - pCopy);
+	pArena = cJSON_ParseArena(pCopy);
+	szArenaError = pArena ? 0 : (size_t)(cJSON_GetErrorPtr() - pCopy);
+	bSame = SameParse(pCopy, pHeap, szHeapError, pArena, szArenaError) && CheckArenaTree(pArena);
+	cJSON_Delete(pHeap);
+	cJSON_DeleteArena(pArena);
+	free(pCopy);
+	return bSame;
+}
+
+static UINT mAllocsLeft;
+
+static void* CJSON_CDECL FailingMalloc(size_t sz)
+{
+	if (mAllocsLeft == 0)
+		return NULL;
+	mAllocsLeft--;
+	return malloc(sz);
+}
+
+/* every text whole and cut at every length, and an arena which runs out of memory at
+ * each of its chunks */
+static VOID TestArenaParity(VOID)
+{
+	UINT i;
+	cJSON_Hooks hooks = { FailingMalloc, free };
+	for (i = 0; i < TEST_TEXTS; i++)
+	{
+		size_t j;
+		char* pText = GetText(i);
+		FE_CHECK(pText != NULL);
+		if (!pText)
+			continue;
+		FE_CHECK(CheckArenaParse(pText, strlen(pText)));
+		for (j = 0; j < strlen(pText); j++)
+		{
+			if (!CheckArenaParse(pText, j))
+			{
+				printf("text %u cut at %zu\n", i, j);
+				gTestFailures++;
+				break;
+			}
+		}
+		cJSON_free(pText);
+	}
+
+	for (i = 0; i < 100; i++)
+	{
+		char* pText = GetText(TEST_TEXTS - 1);
+		cJSON* pTree;
+		FE_CHECK(pText != NULL);
+		if (!pText)
+			break;
+		mAllocsLeft = i;
+		cJSON_InitHooks(&hooks);
+		pTree = cJSON_ParseArena(pText);
+		cJSON_InitHooks(NULL);
+		FE_CHECK(pTree != NULL || mAllocsLeft == 0);
+		if (pTree)
+			FE_CHECK(CheckArenaTree(pTree));
+		cJSON_DeleteArena(pTree);
+		cJSON_free(pText);
+		if (pTree)
+			break;
+	}
+	FE_CHECK(i > 0 && i < 100);
+
+	FE_CHECK(cJSON_ParseArena(NULL) == NULL);
+	cJSON_DeleteArena(NULL);
+}
+
+/* the strings of an in situ tree are decoded into the text */
+static BOOL InText(const char* pString, const char* pText, size_t szText)
+{
+	return !pString || (pString >= pText && pString + strlen(pString) <= pText + szText);
+}
+
+static BOOL CheckInSituTree(const cJSON* pItem, const char* pText, size_t szText)
+{
+	for (; pItem; pItem = pItem->next)
+	{
+		if (!InText(pItem->string, pText, szText) || !InText(pItem->valuestring, pText, szText))
+			return FALSE;
+		if (cJSON_IsObject(pItem) && (pItem->index == NULL || !CheckLookups(pItem)))
+			return FALSE;
+		if (!CheckInSituTree(pItem->child, pText, szText))
+			return FALSE;
+	}
+	return TRUE;
+}
+
+/* as CheckArenaParse, on a writable copy of exactly szText bytes and its terminator */
+static BOOL CheckInSituParse(const char* pText, size_t szText)
+{
+	BOOL bSame;
+	size_t szHeapError, szInSituError;
+	cJSON* pHeap;
+	cJSON* pInSitu;
+	char* pCopy = malloc(szText + 1);
+	char* pWritable = malloc(szText + 1);
+	if (!pCopy || !pWritable)
+	{
+		free(pCopy);
+		free(pWritable);
+		return FALSE;
+	}
+	memcpy(pCopy, pText, szText);
+	pCopy[szText] = '\0';
+	memcpy(pWritable, pCopy, szText + 1);
+	pHeap = cJSON_Parse(pCopy);
+	szHeapError = pHeap ? 0 : (size_t)(cJSON_GetErrorPtr() - pCopy);
+	pInSitu = cJSON_ParseArenaInSitu(pWritable);
+	szInSituError = pInSitu ? 0 : (size_t)(cJSON_GetErrorPtr() - pWritable);
+	bSame = SameParse(pCopy, pHeap, szHeapError, pInSitu, szInSituError)
+		&& CheckInSituTree(pInSitu, pWritable, szText);
+	cJSON_Delete(pHeap);
+	cJSON_DeleteArena(pInSitu);
+	free(pCopy);
+	free(pWritable);
+	return bSame;
+}
+
+/* the same texts decoded in place */
+static VOID TestInSituParity(VOID)
+{
+	UINT i;
+	for (i = 0; i < TEST_TEXTS; i++)
+	{
+		size_t j;
+		char* pText = GetText(i);
+		FE_CHECK(pText != NULL);
+		if (!pText)
+			continue;
+		FE_CHECK(CheckInSituParse(pText, strlen(pText)));
+		for (j = 0; j < strlen(pText); j++)
+		{
+			if (!CheckInSituParse(pText, j))
+			{
+				printf("text %u cut at %zu\n", i, j);
+				gTestFailures++;
+				break;
+			}
+		}
+		cJSON_free(pText);
+	}
+	FE_CHECK(cJSON_ParseArenaInSitu(NULL) == NULL);
+}
+
+int main(void)
+{
+	TestMutators();
+	TestRandomMutations();
+	TestReferenceAndCopy();
+	TestArenaParity();
+	TestInSituParity();
+	return FE_TEST_RESULT;
+}
@@ -0,0 +1,352 @@
+﻿// SPDX-License-Identifier: GPL-3.0-or-later
+
+/* FE_CLIP through fake clipboard ops and the real job queue: nothing is encoded until the
+ * PNG is rendered and the DIB never needs it, a render queues the encode and waits for it,
+ * rendering everything on exit sets each format once, a full queue leaves the encode to
+ * the render, and a clip freed before its job is done never reads the freed pixels */
+
+#include "fe.h"
+#include "utils.h"
+#include "pngenc.h"
+#include "jobqueue.h"
+#include "clipboard.h"
+#include "test.h"
+
+#define TEST_WIDTH 640
+#define TEST_HEIGHT 360
+
+typedef struct _TEST_CLIPBOARD
+{
+	BOOL bFailOffer;
+	UINT uOffers;
+	UINT uSets[FE_CLIP_FORMATS];
+	UINT8* pData[FE_CLIP_FORMATS];
+	size_t szData[FE_CLIP_FORMATS];
+} TEST_CLIPBOARD;
+
+/* blocks the worker until the gate opens */
+typedef struct _TEST_GATE
+{
+	FE_JOB Job;
+	pthread_mutex_t Lock;
+	pthread_cond_t Cond;
+	BOOL bOpen;
+	BOOL bReached;
+} TEST_GATE;
+
+/* the UI thread frees the pixels, which must not be read after FeFreeClip */
+static UINT8* mPixels;
+
+static BOOL OfferTest(PVOID pContext)
+{
+	TEST_CLIPBOARD* pBoard = pContext;
+	pBoard->uOffers++;
+	return !pBoard->bFailOffer;
+}
+
+/* the size is kept in front of the block, as GlobalSize does */
+static PVOID AllocTest(PVOID pContext, size_t szData)
+{
+	size_t* p = malloc(sizeof(size_t) + szData);
+	UNREFERENCED_PARAMETER(pContext);
+	if (!p)
+		return NULL;
+	*p = szData;
+	return p + 1;
+}
+
+static BOOL SetTest(PVOID pContext, FE_CLIP_FORMAT uFormat, PVOID pData)
+{
+	TEST_CLIPBOARD* pBoard = pContext;
+	size_t* p = (size_t*)pData - 1;
+	pBoard->uSets[uFormat]++;
+	free(pBoard->pData[uFormat]);
+	pBoard->pData[uFormat] = malloc(*p);
+	pBoard->szData[uFormat] = *p;
+	if (pBoard->pData[uFormat])
+		memcpy(pBoard->pData[uFormat], pData, *p);
+	free(p);
+	return TRUE;
+}
+
+static const FE_CLIP_OPS mOps = { OfferTest, AllocTest, SetTest };
+
+static VOID RunGate(FE_JOB* pJob)
+{
+	TEST_GATE* pGate = (TEST_GATE*)pJob;
+	pthread_mutex_lock(&pGate->Lock);
+	pGate->bReached = TRUE;
+	pthread_cond_broadcast(&pGate->Cond);
+	while (!pGate->bOpen)
+		pthread_cond_wait(&pGate->Cond, &pGate->Lock);
+	pthread_mutex_unlock(&pGate->Lock);
+}
+
+static VOID DoneGate(FE_JOB* pJob)
+{
+	UNREFERENCED_PARAMETER(pJob);
+}
+
+static VOID CloseGate(TEST_GATE* pGate)
+{
+	ZeroMemory(pGate, sizeof(TEST_GATE));
+	pGate->Job.pfnRun = RunGate;
+	pGate->Job.pfnDone = DoneGate;
+	pthread_mutex_init(&pGate->Lock, NULL);
+	pthread_cond_init(&pGate->Cond, NULL);
+	FE_CHECK(FeSubmitJob(&pGate->Job));
+	pthread_mutex_lock(&pGate->Lock);
+	while (!pGate->bReached)
+		pthread_cond_wait(&pGate->Cond, &pGate->Lock);
+	pthread_mutex_unlock(&pGate->Lock);
+}
+
+static VOID OpenGate(TEST_GATE* pGate)
+{
+	pthread_mutex_lock(&pGate->Lock);
+	pGate->bOpen = TRUE;
+	pthread_cond_broadcast(&pGate->Cond);
+	pthread_mutex_unlock(&pGate->Lock);
+}
+
+/* the part of the message loop in fe.c which completes jobs */
+static VOID PumpJobs(UINT uCount)
+{
+	MSG msg;
+	while (uCount-- > 0)
+	{
+		GetMessageW(&msg, NULL, 0, 0);
+		FE_CHECK(msg.message == WM_FE_JOB_DONE);
+		if (msg.message == WM_FE_JOB_DONE)
+			FeCompleteJob(msg.lParam);
+	}
+	/* the worker counts as busy until it goes back for the next job */
+	while (FeGetJobQueueDepth() != 0)
+		Sleep(1);
+}
+
+static UINT8* MakePixels(UINT w, UINT h)
+{
+	size_t i;
+	UINT uSeed = w + h;
+	UINT8* pBgrx = malloc((size_t)w * h * 4);
+	for (i = 0; pBgrx && i < (size_t)w * h * 4; i++)
+	{
+		uSeed = uSeed * 1103515245 + 12345;
+		pBgrx[i] = (UINT8)((i / 2000) * 7 + ((uSeed >> 29) & 3));
+	}
+	return pBgrx;
+}
+
+static BOOL CheckPng(const TEST_CLIPBOARD* pBoard, const UINT8* pBgrx, UINT w, UINT h)
+{
+	UINT8* pPng = NULL;
+	size_t szPng = 0;
+	BOOL bRet = FeEncodePngBgrx(NULL, &pPng, &szPng, pBgrx, w, h, (size_t)w * 4, FE_PNG_FAST) == 0
+		&& pBoard->szData[FE_CLIP_PNG] == szPng && memcmp(pBoard->pData[FE_CLIP_PNG], pPng, szPng) == 0;
+	free(pPng);
+	return bRet;
+}
+
+static BOOL CheckDib(const TEST_CLIPBOARD* pBoard, const UINT8* pBgrx, UINT w, UINT h)
+{
+	UINT y;
+	const BITMAPV5HEADER* pHeader = (const BITMAPV5HEADER*)pBoard->pData[FE_CLIP_DIBV5];
+	const UINT8* pRows = pBoard->pData[FE_CLIP_DIBV5] + sizeof(BITMAPV5HEADER);
+	if (pBoard->szData[FE_CLIP_DIBV5] != sizeof(BITMAPV5HEADER) + (size_t)w * h * 4)
+		return FALSE;
+	if (pHeader->bV5Width != (LONG)w || pHeader->bV5Height != (LONG)h || pHeader->bV5BitCount != 32
+		|| pHeader->bV5Compression != BI_BITFIELDS || pHeader->bV5RedMask != 0x00FF0000)
+		return FALSE;
+	for (y = 0; y < h; y++)
+	{
+		if (memcmp(pRows + (size_t)(h - 1 - y) * w * 4, pBgrx + (size_t)y * w * 4, (size_t)w * 4) != 0)
+			return FALSE;
+	}
+	return TRUE;
+}
+
+static VOID FreeBoard(TEST_CLIPBOARD* pBoard)
+{
+	UINT i;
+	for (i = 0; i < FE_CLIP_FORMATS; i++)
+		free(pBoard->pData[i]);
+	ZeroMemory(pBoard, sizeof(TEST_CLIPBOARD));
+}
+
+/* a render on a thread of its own, so the test sees it wait */
+typedef struct _TEST_RENDER
+{
+	pthread_t Thread;
+	FE_CLIP* pClip;
+	FE_CLIP_FORMAT uFormat;
+	BOOL bRet;
+} TEST_RENDER;
+
+static PVOID RenderThread(PVOID pParam)
+{
+	TEST_RENDER* pRender = pParam;
+	pRender->bRet = FeRenderClip(pRender->pClip, pRender->uFormat);
+	return NULL;
+}
+
+/* nothing runs until WM_RENDERFORMAT asks for the PNG, the DIB never needs it */
+static VOID TestNoEncodeUntilRender(FE_PNG_ENCODER* pEncoder)
+{
+	TEST_CLIPBOARD board = { 0 };
+	FE_CLIP* pClip = FeOfferClip(&mOps, &board, pEncoder, mPixels, TEST_WIDTH, TEST_HEIGHT,
+		(size_t)TEST_WIDTH * 4, FE_PNG_FAST);
+	FE_CHECK(pClip != NULL && board.uOffers == 1);
+	if (!pClip)
+		return;
+	FE_CHECK(FeGetJobQueueDepth() == 0 && FeGetClipRendered(pClip) == 0);
+	FE_CHECK(FeRenderClip(pClip, FE_CLIP_DIBV5));
+	FE_CHECK(board.uSets[FE_CLIP_DIBV5] == 1 && CheckDib(&board, mPixels, TEST_WIDTH, TEST_HEIGHT));
+	FE_CHECK(FeGetJobQueueDepth() == 0 && board.uSets[FE_CLIP_PNG] == 0);
+	FE_CHECK(FeRenderClip(pClip, FE_CLIP_PNG));
+	FE_CHECK(board.uSets[FE_CLIP_PNG] == 1 && CheckPng(&board, mPixels, TEST_WIDTH, TEST_HEIGHT));
+	PumpJobs(1);
+	FE_CHECK(FeRenderClip(pClip, FE_CLIP_PNG));
+	FE_CHECK(FeGetJobQueueDepth() == 0 && board.uSets[FE_CLIP_PNG] == 1);
+	FE_CHECK(FeGetClipRendered(pClip) == 3);
+	FeFreeClip(pClip);
+	FreeBoard(&board);
+
+	/* a clip nobody pasted is never encoded */
+	pClip = FeOfferClip(&mOps, &board, pEncoder, mPixels, TEST_WIDTH, TEST_HEIGHT,
+		(size_t)TEST_WIDTH * 4, FE_PNG_FAST);
+	FE_CHECK(pClip != NULL);
+	FeFreeClip(pClip);
+	FE_CHECK(FeGetJobQueueDepth() == 0 && board.uSets[FE_CLIP_PNG] == 0);
+}
+
+/* WM_RENDERFORMAT puts the encode on the queue and waits for it behind other jobs */
+static VOID TestRenderWaits(FE_PNG_ENCODER* pEncoder)
+{
+	TEST_GATE gate;
+	TEST_RENDER render = { 0 };
+	TEST_CLIPBOARD board = { 0 };
+	FE_CLIP* pClip;
+	CloseGate(&gate);
+	pClip = FeOfferClip(&mOps, &board, pEncoder, mPixels, TEST_WIDTH, TEST_HEIGHT,
+		(size_t)TEST_WIDTH * 4, FE_PNG_FAST);
+	FE_CHECK(pClip != NULL);
+	if (!pClip)
+		return;
+	FE_CHECK(FeGetJobQueueDepth() == 1);
+	render.pClip = pClip;
+	render.uFormat = FE_CLIP_PNG;
+	pthread_create(&render.Thread, NULL, RenderThread, &render);
+	while (FeGetJobQueueDepth() < 2)
+		Sleep(1);
+	Sleep(20);
+	FE_CHECK(board.uSets[FE_CLIP_PNG] == 0);
+	OpenGate(&gate);
+	pthread_join(render.Thread, NULL);
+	FE_CHECK(render.bRet && board.uSets[FE_CLIP_PNG] == 1);
+	FE_CHECK(CheckPng(&board, mPixels, TEST_WIDTH, TEST_HEIGHT));
+	PumpJobs(2);
+	FeFreeClip(pClip);
+	FreeBoard(&board);
+}
+
+/* WM_RENDERALLFORMATS at exit encodes while the DIB is copied, and sets each format once */
+static VOID TestRenderAll(FE_PNG_ENCODER* pEncoder)
+{
+	TEST_CLIPBOARD board = { 0 };
+	FE_CLIP* pClip = FeOfferClip(&mOps, &board, pEncoder, mPixels, TEST_WIDTH, TEST_HEIGHT,
+		(size_t)TEST_WIDTH * 4, FE_PNG_FAST);
+	FE_CHECK(pClip != NULL);
+	if (!pClip)
+		return;
+	FE_CHECK(FeGetJobQueueDepth() == 0);
+	FeRenderAllClip(pClip);
+	FE_CHECK(FeGetClipRendered(pClip) == 3);
+	FE_CHECK(board.uSets[FE_CLIP_PNG] == 1 && CheckPng(&board, mPixels, TEST_WIDTH, TEST_HEIGHT));
+	FE_CHECK(board.uSets[FE_CLIP_DIBV5] == 1 && CheckDib(&board, mPixels, TEST_WIDTH, TEST_HEIGHT));
+	FeRenderAllClip(pClip);
+	FE_CHECK(board.uSets[FE_CLIP_PNG] == 1 && board.uSets[FE_CLIP_DIBV5] == 1);
+	PumpJobs(1);
+	FeFreeClip(pClip);
+	FreeBoard(&board);
+
+	/* the PNG was pasted before, only the DIB is left and nothing is encoded again */
+	pClip = FeOfferClip(&mOps, &board, pEncoder, mPixels, TEST_WIDTH, TEST_HEIGHT,
+		(size_t)TEST_WIDTH * 4, FE_PNG_FAST);
+	FE_CHECK(pClip && FeRenderClip(pClip, FE_CLIP_PNG));
+	PumpJobs(1);
+	FeRenderAllClip(pClip);
+	FE_CHECK(FeGetJobQueueDepth() == 0 && board.uSets[FE_CLIP_PNG] == 1 && board.uSets[FE_CLIP_DIBV5] == 1);
+	FeFreeClip(pClip);
+	FreeBoard(&board);
+}
+
+/* WM_DESTROYCLIPBOARD right after a large render, before the job's pfnDone, the pixels go
+ * right after */
+static VOID TestDestroyBeforeDone(FE_PNG_ENCODER* pEncoder)
+{
+	UINT w = 1920, h = 1080;
+	TEST_CLIPBOARD board = { 0 };
+	UINT8* pPixels = MakePixels(w, h);
+	FE_CLIP* pClip = FeOfferClip(&mOps, &board, pEncoder, pPixels, w, h, (size_t)w * 4, FE_PNG_BALANCED);
+	FE_CHECK(pClip != NULL);
+	if (!pClip)
+		return;
+	FE_CHECK(FeRenderClip(pClip, FE_CLIP_PNG));
+	FE_CHECK(board.uSets[FE_CLIP_PNG] == 1);
+	FeFreeClip(pClip);
+	free(pPixels);
+	PumpJobs(1);
+	FreeBoard(&board);
+}
+
+/* a full queue leaves the encode to the render, or a failed offer */
+static VOID TestNoJob(FE_PNG_ENCODER* pEncoder)
+{
+	UINT i;
+	TEST_GATE gate;
+	TEST_GATE Fillers[8];
+	TEST_CLIPBOARD board = { 0 };
+	FE_CLIP* pClip;
+	CloseGate(&gate);
+	for (i = 0; i < ARRAYSIZE(Fillers); i++)
+	{
+		ZeroMemory(&Fillers[i], sizeof(TEST_GATE));
+		Fillers[i].Job.pfnRun = DoneGate;
+		Fillers[i].Job.pfnDone = DoneGate;
+		FE_CHECK(FeSubmitJob(&Fillers[i].Job));
+	}
+	pClip = FeOfferClip(&mOps, &board, pEncoder, mPixels, TEST_WIDTH, TEST_HEIGHT,
+		(size_t)TEST_WIDTH * 4, FE_PNG_FAST);
+	FE_CHECK(pClip != NULL);
+	FE_CHECK(pClip && FeRenderClip(pClip, FE_CLIP_PNG));
+	FE_CHECK(FeGetJobQueueDepth() == 9);
+	FE_CHECK(CheckPng(&board, mPixels, TEST_WIDTH, TEST_HEIGHT));
+	FeFreeClip(pClip);
+	OpenGate(&gate);
+	PumpJobs(9);
+	FreeBoard(&board);
+
+	board.bFailOffer = TRUE;
+	FE_CHECK(FeOfferClip(&mOps, &board, pEncoder, mPixels, TEST_WIDTH, TEST_HEIGHT,
+		(size_t)TEST_WIDTH * 4, FE_PNG_FAST) == NULL);
+	FE_CHECK(board.uOffers == 1 && FeGetJobQueueDepth() == 0);
+}
+
+int main(void)
+{
+	FE_PNG_ENCODER* pEncoder = FeCreatePngEncoder();
+	mPixels = MakePixels(TEST_WIDTH, TEST_HEIGHT);
+	FE_CHECK(pEncoder && mPixels);
+	if (!pEncoder || !mPixels)
+		return FE_TEST_RESULT;
+	TestNoEncodeUntilRender(pEncoder);
+	TestRenderWaits(pEncoder);
+	TestRenderAll(pEncoder);
+	TestDestroyBeforeDone(pEncoder);
+	TestNoJob(pEncoder);
+	FeStopJobQueue();
+	FeFreePngEncoder(pEncoder);
+	free(mPixels);
+	return FE_TEST_RESULT;
+}
@@ -0,0 +1,191 @@
+﻿// SPDX-License-Identifier: GPL-3.0-or-later
+
+/* FeDiffTiles against a per pixel comparison, and FeStreamPngDelta over a synthetic
+ * capture sequence: every frame is the same file a full FeStreamPngBgrx writes, and the
+ * dirty tile and stripe counts follow what changed */
+
+#include "fe.h"
+#include "utils.h"
+#include "pngenc.h"
+#include "swizzle.h"
+#include "arena.h"
+#include "test.h"
+
+typedef struct _TEST_BUFFER
+{
+	UINT8* pData;
+	size_t szData;
+} TEST_BUFFER;
+
+static BOOL WriteBuffer(PVOID pContext, const UINT8* pData, size_t szData)
+{
+	TEST_BUFFER* pBuffer = pContext;
+	UINT8* p = realloc(pBuffer->pData, pBuffer->szData + szData);
+	if (!p)
+		return FALSE;
+	memcpy(p + pBuffer->szData, pData, szData);
+	pBuffer->pData = p;
+	pBuffer->szData += szData;
+	return TRUE;
+}
+
+static VOID FillFrame(UINT8* pBgrx, UINT w, UINT h)
+{
+	UINT x, y;
+	UINT uSeed = 1;
+	for (y = 0; y < h; y++)
+	{
+		for (x = 0; x < w; x++)
+		{
+			UINT8* q = pBgrx + ((size_t)y * w + x) * 4;
+			uSeed = uSeed * 1103515245 + 12345;
+			q[0] = (UINT8)((x / 64) * 20);
+			q[1] = (UINT8)((y / 32) * 10 + (uSeed >> 30));
+			q[2] = ((x / 8 + y / 16) % 7 == 0) ? 0 : 220;
+			q[3] = 0;
+		}
+	}
+}
+
+static VOID ChangeRect(UINT8* pBgrx, UINT w, UINT x0, UINT y0, UINT rw, UINT rh, UINT uSeed)
+{
+	UINT x, y;
+	for (y = y0; y < y0 + rh; y++)
+	{
+		for (x = x0; x < x0 + rw; x++)
+		{
+			UINT8* q = pBgrx + ((size_t)y * w + x) * 4;
+			q[0] = (UINT8)(q[0] + uSeed);
+			q[1] ^= (UINT8)(uSeed * 3 + 1);
+		}
+	}
+}
+
+static UINT RefDiffTiles(UINT8* pMap, const UINT8* pOld, const UINT8* pNew, UINT w, UINT h)
+{
+	UINT x, y, i;
+	UINT uDirty = 0;
+	UINT uCols = (w + FE_TILE_SIZE - 1) / FE_TILE_SIZE;
+	UINT uTiles = uCols * ((h + FE_TILE_SIZE - 1) / FE_TILE_SIZE);
+	ZeroMemory(pMap, uTiles);
+	for (y = 0; y < h; y++)
+	{
+		for (x = 0; x < w; x++)
+		{
+			size_t i4 = ((size_t)y * w + x) * 4;
+			if (memcmp(pOld + i4, pNew + i4, 4) != 0)
+				pMap[(y / FE_TILE_SIZE) * uCols + x / FE_TILE_SIZE] = 1;
+		}
+	}
+	for (i = 0; i < uTiles; i++)
+		uDirty += pMap[i];
+	return uDirty;
+}
+
+/* odd sizes, so the last tile column and row are partial */
+static VOID TestDiffTiles(UINT w, UINT h)
+{
+	UINT i, k;
+	size_t szFrame = (size_t)w * h * 4;
+	UINT uTiles = ((w + FE_TILE_SIZE - 1) / FE_TILE_SIZE) * ((h + FE_TILE_SIZE - 1) / FE_TILE_SIZE);
+	UINT8* pNew = malloc(szFrame);
+	UINT8* pOld = malloc(szFrame);
+	UINT8* pMap = malloc(uTiles);
+	UINT8* pRef = malloc(uTiles);
+	FE_CHECK(pNew && pOld && pMap && pRef);
+	if (!pNew || !pOld || !pMap || !pRef)
+		return;
+	FillFrame(pNew, w, h);
+	for (i = 0; i < 50; i++)
+	{
+		UINT uSeed = i * 7919 + 1;
+		memcpy(pOld, pNew, szFrame);
+		for (k = 0; k < i; k++)
+		{
+			uSeed = uSeed * 1103515245 + 12345;
+			pOld[(uSeed >> 3) % szFrame] ^= (UINT8)(1 + (uSeed & 7));
+		}
+		FE_CHECK(FeDiffTiles(pMap, pOld, (size_t)w * 4, pNew, (size_t)w * 4, w, h)
+			== RefDiffTiles(pRef, pOld, pNew, w, h));
+		FE_CHECK(memcmp(pMap, pRef, uTiles) == 0);
+	}
+	free(pNew);
+	free(pOld);
+	free(pMap);
+	free(pRef);
+}
+
+static BOOL DecodesTo(const TEST_BUFFER* pPng, const UINT8* pBgrx, UINT w, UINT h)
+{
+	size_t i;
+	UINT8* pOut = NULL;
+	unsigned dw, dh;
+	BOOL bRet = lodepng_decode24(&pOut, &dw, &dh, pPng->pData, pPng->szData) == 0 && dw == w && dh == h;
+	for (i = 0; bRet && i < (size_t)w * h; i++)
+		bRet = pOut[i * 3] == pBgrx[i * 4 + 2] && pOut[i * 3 + 1] == pBgrx[i * 4 + 1]
+			&& pOut[i * 3 + 2] == pBgrx[i * 4];
+	lodepng_free(pOut);
+	return bRet;
+}
+
+static VOID TestSequence(UINT w, UINT h, FE_PNG_PROFILE uProfile)
+{
+	UINT f;
+	FE_PNG_DELTA_STATS stats;
+	UINT8* pBgrx = malloc((size_t)w * h * 4);
+	FE_PNG_DELTA* pDelta = FeCreatePngDelta();
+	FE_PNG_ENCODER* pEncoder = FeCreatePngEncoder();
+	TEST_BUFFER resized = { 0 };
+	FE_CHECK(pBgrx && pDelta && pEncoder);
+	if (!pBgrx || !pDelta || !pEncoder)
+		return;
+	FillFrame(pBgrx, w, h);
+	for (f = 0; f < 10; f++)
+	{
+		TEST_BUFFER delta = { 0 }, full = { 0 };
+		size_t szPng = 0;
+		/* a clock, nothing, a window, everything, then a cursor */
+		if (f == 1 || f == 2)
+			ChangeRect(pBgrx, w, w - 200, h - 40, 150, 30, f);
+		else if (f == 4)
+			ChangeRect(pBgrx, w, 100, 100, 600, 400, 9);
+		else if (f == 5)
+			ChangeRect(pBgrx, w, 0, 0, w, h, 5);
+		else if (f >= 6)
+			ChangeRect(pBgrx, w, (f * 137) % (w - 40), (f * 71) % (h - 40), 20, 20, f);
+		FE_CHECK(FeStreamPngDelta(pEncoder, pDelta, WriteBuffer, &delta, &szPng, pBgrx, w, h,
+			(size_t)w * 4, uProfile, &stats) == 0);
+		FE_CHECK(FeStreamPngBgrx(pEncoder, WriteBuffer, &full, NULL, pBgrx, w, h, (size_t)w * 4,
+			uProfile) == 0);
+		FE_CHECK(szPng == delta.szData);
+		FE_CHECK(delta.szData == full.szData && memcmp(delta.pData, full.pData, full.szData) == 0);
+		FE_CHECK(DecodesTo(&delta, pBgrx, w, h));
+		if (f == 0 || f == 5)
+			FE_CHECK(stats.uDirtyTiles == stats.uTiles && stats.uDirtyStripes == stats.uStripes);
+		else if (f == 3)
+			FE_CHECK(stats.uDirtyTiles == 0 && stats.uDirtyStripes == 0);
+		else
+			FE_CHECK(stats.uDirtyTiles > 0 && stats.uDirtyTiles < stats.uTiles / 3);
+		printf("frame %u: %u/%u tiles, %u/%u stripes\n", f, stats.uDirtyTiles, stats.uTiles,
+			stats.uDirtyStripes, stats.uStripes);
+		free(delta.pData);
+		free(full.pData);
+	}
+	/* another size starts over with a full frame */
+	FE_CHECK(FeStreamPngDelta(pEncoder, pDelta, WriteBuffer, &resized, NULL, pBgrx, w / 2, h / 2,
+		(size_t)w * 4, uProfile, &stats) == 0);
+	FE_CHECK(stats.uDirtyTiles == stats.uTiles);
+	free(resized.pData);
+	FeFreePngDelta(pDelta);
+	FeFreePngEncoder(pEncoder);
+	free(pBgrx);
+}
+
+int main(void)
+{
+	TestDiffTiles(1001, 333);
+	TestDiffTiles(64, 64);
+	TestSequence(1280, 720, FE_PNG_FAST);
+	TestSequence(1280, 720, FE_PNG_BALANCED);
+	return FE_TEST_RESULT;
+}
@@ -0,0 +1,135 @@
+﻿// SPDX-License-Identifier: GPL-3.0-or-later
+
+/* the kept FE_PNG_ENCODER: with its threads, arenas and LZ77 tables reused over frames of
+ * changing size, profile and thread count the files are the same as one-off encodes, and
+ * deflate parts with reused hash tables are the same as with fresh ones */
+
+#include "fe.h"
+#include "utils.h"
+#include "pngenc.h"
+#include "arena.h"
+#include "test.h"
+
+static UINT TestRandom(UINT* pSeed)
+{
+	*pSeed = *pSeed * 1103515245 + 12345;
+	return *pSeed >> 16;
+}
+
+/* flat areas, text-like edges and some noise, different for every uSeed */
+static UINT8* MakeFrame(UINT w, UINT h, UINT uSeed)
+{
+	UINT x, y;
+	UINT8* pBgrx = malloc((size_t)w * h * 4);
+	if (!pBgrx)
+		return NULL;
+	for (y = 0; y < h; y++)
+	{
+		for (x = 0; x < w; x++)
+		{
+			UINT8* q = pBgrx + ((size_t)y * w + x) * 4;
+			q[0] = (UINT8)((x / 32 + uSeed) * 17);
+			q[1] = (UINT8)(((x + uSeed) / 6 + y / 11) % 5 == 0 ? 30 : 240);
+			q[2] = (UINT8)((y / 40) * 9 + (TestRandom(&uSeed) & 7));
+			q[3] = (UINT8)TestRandom(&uSeed);
+		}
+	}
+	return pBgrx;
+}
+
+static VOID TestFrames(VOID)
+{
+	static const UINT Sizes[][2] = { { 1280, 720 }, { 64, 64 }, { 1001, 333 }, { 1, 1 }, { 800, 600 } };
+	static const char* Threads[] = { "1", "4", "2" };
+	UINT i, t;
+	FE_PNG_PROFILE p;
+	FE_PNG_ENCODER* pEncoder = FeCreatePngEncoder();
+	FE_CHECK(pEncoder != NULL);
+	if (!pEncoder)
+		return;
+	for (t = 0; t < ARRAYSIZE(Threads); t++)
+	{
+		/* GetSystemInfo reads it for every encode */
+		setenv("NPROC", Threads[t], 1);
+		for (i = 0; i < ARRAYSIZE(Sizes); i++)
+		{
+			UINT w = Sizes[i][0], h = Sizes[i][1];
+			UINT8* pBgrx = MakeFrame(w, h, i + t * 7);
+			FE_CHECK(pBgrx != NULL);
+			if (!pBgrx)
+				continue;
+			for (p = FE_PNG_FAST; p <= FE_PNG_MAX; p++)
+			{
+				UINT8* pKept = NULL;
+				UINT8* pOnce = NULL;
+				size_t szKept = 0, szOnce = 0;
+				/* the max profile is slow, keep it to the small frames */
+				if (p == FE_PNG_MAX && (size_t)w * h > 400000)
+					continue;
+				FE_CHECK(FeEncodePngBgrx(pEncoder, &pKept, &szKept, pBgrx, w, h, (size_t)w * 4, p) == 0);
+				FE_CHECK(FeEncodePngBgrx(NULL, &pOnce, &szOnce, pBgrx, w, h, (size_t)w * 4, p) == 0);
+				FE_CHECK(szKept == szOnce && pKept && pOnce && memcmp(pKept, pOnce, szOnce) == 0);
+				free(pKept);
+				free(pOnce);
+				/* the RGBA entry point shares the encoder */
+				FE_CHECK(FeEncodePng(pEncoder, &pKept, &szKept, pBgrx, w, h, p) == 0);
+				FE_CHECK(FeEncodePng(NULL, &pOnce, &szOnce, pBgrx, w, h, p) == 0);
+				FE_CHECK(szKept == szOnce && pKept && pOnce && memcmp(pKept, pOnce, szOnce) == 0);
+				free(pKept);
+				free(pOnce);
+			}
+			free(pBgrx);
+		}
+		printf("%s threads: done\n", Threads[t]);
+	}
+	unsetenv("NPROC");
+	FeFreePngEncoder(pEncoder);
+	/* an encoder that never started a thread */
+	FeFreePngEncoder(FeCreatePngEncoder());
+	FeFreePngEncoder(NULL);
+}
+
+/* parts of random size and content, one hash table set for all of them */
+static VOID TestHash(unsigned matcher, unsigned windowsize)
+{
+	UINT i;
+	UINT uSeed = matcher * 31 + windowsize;
+	size_t szData = 1 << 19;
+	UINT8* pData = malloc(szData);
+	LodePNGCompressSettings settings;
+	LodePNGHash* pHash = lodepng_hash_new(windowsize, matcher);
+	FE_CHECK(pData && pHash);
+	if (!pData || !pHash)
+		return;
+	for (i = 0; i < szData; i++)
+		pData[i] = (UINT8)((i / 300) % 3 == 0 ? TestRandom(&uSeed) : (TestRandom(&uSeed) & 3) + i / 4000);
+	lodepng_compress_settings_init(&settings);
+	settings.matcher = matcher;
+	settings.windowsize = windowsize;
+	for (i = 0; i < 100; i++)
+	{
+		UINT8* pFresh = NULL;
+		UINT8* pReused = NULL;
+		size_t szFresh = 0, szReused = 0;
+		size_t szEnd = TestRandom(&uSeed) % szData + 1;
+		size_t szPos = (i % 4 == 0) ? 0 : TestRandom(&uSeed) % szEnd;
+		unsigned final = i & 1;
+		FE_CHECK(lodepng_deflate_part_hash(&pFresh, &szFresh, pData, szPos, szEnd, &settings, final, NULL) == 0);
+		FE_CHECK(lodepng_deflate_part_hash(&pReused, &szReused, pData, szPos, szEnd, &settings, final, pHash) == 0);
+		FE_CHECK(szFresh == szReused && memcmp(pFresh, pReused, szFresh) == 0);
+		lodepng_free(pFresh);
+		lodepng_free(pReused);
+	}
+	lodepng_hash_delete(pHash);
+	free(pData);
+}
+
+int main(void)
+{
+	TestFrames();
+	TestHash(LMF_HASH3, 2048);
+	TestHash(LMF_HASH3, 32768);
+	TestHash(LMF_HASHCHAIN4, 1024);
+	TestHash(LMF_HASHCHAIN4, 32768);
+	return FE_TEST_RESULT;
+}
@@ -0,0 +1,88 @@
+﻿// SPDX-License-Identifier: GPL-3.0-or-later
+
+/* FeFilterRow against lodepng's own scalar lodepng_filter_scanline, which this test
+ * links built without LODEPNG_CUSTOM_FILTER: for every strategy the filter type byte
+ * and the filtered row are the same, on noise, gradients and flat rows of every pixel
+ * size the encoder can hand it */
+
+#include "fe.h"
+#include "utils.h"
+#include "pngfilter.h"
+#include "lodepng/lodepng.h"
+#include "test.h"
+
+#define TEST_LENGTH 4099
+
+static UINT TestRandom(UINT* pSeed)
+{
+	*pSeed = *pSeed * 1103515245 + 12345;
+	return *pSeed >> 16;
+}
+
+/* uKind 0 noise, 1 a gradient with a little noise, 2 flat with a few edges */
+static VOID FillRow(UINT8* pRow, size_t szLength, size_t szBpp, UINT uKind, UINT* pSeed)
+{
+	size_t i;
+	UINT uBase = TestRandom(pSeed);
+	for (i = 0; i < szLength; i++)
+	{
+		if (uKind == 0)
+			pRow[i] = (UINT8)TestRandom(pSeed);
+		else if (uKind == 1)
+			pRow[i] = (UINT8)(uBase + i / szBpp + (TestRandom(pSeed) & 3));
+		else
+			pRow[i] = (UINT8)((TestRandom(pSeed) % 97 == 0) ? TestRandom(pSeed) : uBase);
+	}
+}
+
+static VOID TestRows(size_t szBpp)
+{
+	UINT s, k, t;
+	UINT uSeed = (UINT)szBpp;
+	UINT8* pPrev = malloc(TEST_LENGTH);
+	UINT8* pLine = malloc(TEST_LENGTH);
+	UINT8* pOut = malloc(TEST_LENGTH + 1);
+	UINT8* pRef = malloc(TEST_LENGTH + 1);
+	UINT8* Attempt[5];
+	for (t = 0; t < 5; t++)
+		Attempt[t] = malloc(TEST_LENGTH);
+	FE_CHECK(pPrev && pLine && pOut && pRef && Attempt[4]);
+	for (s = LFS_ZERO; s <= LFS_ENTROPY; s++)
+	{
+		UINT Chosen[5] = { 0 };
+		for (k = 0; k < 300; k++)
+		{
+			/* every length up to a few vectors, then longer rows */
+			size_t szLength = k < 100 ? szBpp * (k + 1) : szBpp * (1 + TestRandom(&uSeed) % (TEST_LENGTH / szBpp));
+			FillRow(pPrev, szLength, szBpp, k % 3, &uSeed);
+			FillRow(pLine, szLength, szBpp, (k / 3) % 3, &uSeed);
+			if (k % 5 == 0)
+				memcpy(pLine, pPrev, szLength);
+			FE_CHECK(FeFilterRow(pOut, pLine, pPrev, szBpp, s, szLength));
+			lodepng_filter_scanline(pRef, pLine, pPrev, szLength, szBpp, (LodePNGFilterStrategy)s, Attempt);
+			FE_CHECK(pOut[0] == pRef[0] && memcmp(pOut + 1, pRef + 1, szLength) == 0);
+			Chosen[pRef[0] % 5]++;
+		}
+		printf("bpp %zu strategy %u: types %u %u %u %u %u\n", szBpp, s, Chosen[0], Chosen[1],
+			Chosen[2], Chosen[3], Chosen[4]);
+	}
+	/* the first row and the strategies over the whole image stay with lodepng */
+	FE_CHECK(!FeFilterRow(pOut, pLine, NULL, szBpp, LFS_MINSUM, szBpp));
+	FE_CHECK(!FeFilterRow(pOut, pLine, pPrev, szBpp, LFS_BRUTE_FORCE, szBpp));
+	FE_CHECK(!FeFilterRow(pOut, pLine, pPrev, szBpp, LFS_PREDEFINED, szBpp));
+	for (t = 0; t < 5; t++)
+		free(Attempt[t]);
+	free(pPrev);
+	free(pLine);
+	free(pOut);
+	free(pRef);
+}
+
+int main(void)
+{
+	size_t szBpp;
+	/* gray to RGBA at 8 and 16 bits */
+	for (szBpp = 1; szBpp <= 8; szBpp++)
+		TestRows(szBpp);
+	return FE_TEST_RESULT;
+}
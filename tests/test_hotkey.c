@@ -0,0 +1,229 @@
+﻿// SPDX-License-Identifier: GPL-3.0-or-later
+
+/* hotkey.c against the shim RegisterHotKey: every entry with a key is registered under one
+ * id which runs its action, and a reload the way FeReloadConfig does it gives unchanged
+ * entries their ids back, so a WM_HOTKEY queued across it still runs the same action */
+
+#include "fe.h"
+#include "utils.h"
+#include "test.h"
+
+#define TEST_ENTRIES 1000
+#define TEST_IDS (MAX_HOTKEY_ID + 1)
+/* the key of an entry is Ctrl- and its tag plus this */
+#define TEST_VK 0x1000
+
+/* the tag of the entry each id runs, -1 for none */
+static INT mSnap[TEST_IDS];
+static INT mOldSnap[TEST_IDS];
+
+static VOID AddEntry(cJSON* pArray, const char* pKey, INT nKeyTag, INT nTag)
+{
+	char Value[32];
+	cJSON* pItem = cJSON_CreateObject();
+	if (pKey)
+		cJSON_AddStringToObject(pItem, "key", pKey);
+	else
+	{
+		snprintf(Value, sizeof(Value), "Ctrl-%d", TEST_VK + nKeyTag);
+		cJSON_AddStringToObject(pItem, "key", Value);
+	}
+	snprintf(Value, sizeof(Value), "cmd %d", nTag);
+	cJSON_AddStringToObject(pItem, "exec", Value);
+	cJSON_AddItemToArray(pArray, pItem);
+}
+
+static INT GetTag(const cJSON* pItem)
+{
+	return atoi(cJSON_GetStringValue(cJSON_GetObjectItem(pItem, "exec")) + 4);
+}
+
+/* the tag an id runs, -1 when it runs nothing */
+static INT Press(UINT message, UINT_PTR id)
+{
+	MSG msg = { 0 };
+	UINT uCalls = gShimCall.uCalls;
+	msg.message = message;
+	msg.wParam = id;
+	FeHandleHotkey(&msg);
+	if (gShimCall.uCalls == uCalls)
+		return -1;
+	if (strcmp(gShimCall.pName, "FeExec") != 0 || wcsncmp(gShimCall.lpArgs[0], L"cmd ", 4) != 0)
+		return -2;
+	return (INT)wcstol(gShimCall.lpArgs[0] + 4, NULL, 10);
+}
+
+/* press every id, each runs something exactly when it is registered */
+static UINT TakeSnapshot(VOID)
+{
+	UINT id;
+	UINT uRegistered = 0;
+	for (id = 0; id < TEST_IDS; id++)
+	{
+		UINT fsModifiers = 0;
+		UINT vk = ShimGetHotKey((int)id, &fsModifiers);
+		mSnap[id] = Press(WM_HOTKEY, id);
+		FE_CHECK((vk != 0) == (mSnap[id] >= 0));
+		if (vk == 0)
+			continue;
+		FE_CHECK(fsModifiers == (MOD_CONTROL | MOD_NOREPEAT));
+		uRegistered++;
+	}
+	return uRegistered;
+}
+
+static UINT CountTag(INT nTag)
+{
+	UINT id, n = 0;
+	for (id = 0; id < TEST_IDS; id++)
+		n += mSnap[id] == nTag;
+	return n;
+}
+
+static UINT FindTag(INT nTag)
+{
+	UINT id;
+	for (id = 0; id < TEST_IDS; id++)
+	{
+		if (mSnap[id] == nTag)
+			return id;
+	}
+	return TEST_IDS;
+}
+
+/* every entry of pArray is reachable through as many ids as it has copies */
+static VOID CheckReachable(const cJSON* pArray, UINT uRegistered)
+{
+	const cJSON* pItem;
+	UINT uKeyed = 0;
+	cJSON_ArrayForEach(pItem, pArray)
+	{
+		INT nTag = GetTag(pItem);
+		const cJSON* pOther;
+		UINT uCopies = 0;
+		if (nTag == 100 || nTag == 101)
+		{
+			FE_CHECK(CountTag(nTag) == 0);
+			continue;
+		}
+		cJSON_ArrayForEach(pOther, pArray)
+			uCopies += GetTag(pOther) == nTag;
+		FE_CHECK(CountTag(nTag) == uCopies);
+		uKeyed++;
+	}
+	FE_CHECK(uRegistered == uKeyed);
+}
+
+/* tags 0 to TEST_ENTRIES - 1, 100 without a key, 101 with an invalid one, 900 twice */
+static cJSON* CreateConfig(VOID)
+{
+	INT i;
+	cJSON* pArray = cJSON_CreateArray();
+	for (i = 0; i < TEST_ENTRIES; i++)
+	{
+		if (i == 100)
+		{
+			cJSON* pItem = cJSON_CreateObject();
+			cJSON_AddStringToObject(pItem, "exec", "cmd 100");
+			cJSON_AddItemToArray(pArray, pItem);
+		}
+		else if (i == 101)
+			AddEntry(pArray, "Ctrl-", 0, i);
+		else
+			AddEntry(pArray, NULL, i, i);
+	}
+	AddEntry(pArray, NULL, 900, 900);
+	return pArray;
+}
+
+/* a new entry at the front, the one of tag 500 runs 7500 now, tag 10 is gone */
+static cJSON* EditConfig(const cJSON* pOld)
+{
+	const cJSON* pItem;
+	cJSON* pArray = cJSON_CreateArray();
+	AddEntry(pArray, NULL, 5000, 5000);
+	cJSON_ArrayForEach(pItem, pOld)
+	{
+		INT nTag = GetTag(pItem);
+		if (nTag == 10)
+			continue;
+		if (nTag == 500)
+			AddEntry(pArray, NULL, 500, 7500);
+		else
+			cJSON_AddItemToArray(pArray, cJSON_Duplicate(pItem, TRUE));
+	}
+	return pArray;
+}
+
+static VOID TestReload(VOID)
+{
+	UINT id;
+	MSG msg;
+	UINT uOld30, uOld10;
+	cJSON* pOld = CreateConfig();
+	cJSON* pNew;
+
+	FeInitializeHotkey(pOld);
+	CheckReachable(pOld, TakeSnapshot());
+	memcpy(mOldSnap, mSnap, sizeof(mSnap));
+	uOld30 = FindTag(30);
+	uOld10 = FindTag(10);
+	FE_CHECK(uOld30 < TEST_IDS && uOld10 < TEST_IDS);
+	/* not a hotkey, or out of range */
+	FE_CHECK(Press(WM_APP, uOld30) == -1);
+	FE_CHECK(Press(WM_HOTKEY, MAX_HOTKEY_ID + 1) == -1);
+
+	/* pressed before the reload, handled after it */
+	PostMessageW(NULL, WM_HOTKEY, uOld30, 0);
+	pNew = EditConfig(pOld);
+	FeUnregisterHotkey();
+	cJSON_Delete(pOld);
+	FeInitializeHotkey(pNew);
+	GetMessageW(&msg, NULL, 0, 0);
+	FE_CHECK(Press(msg.message, msg.wParam) == 30);
+
+	CheckReachable(pNew, TakeSnapshot());
+	for (id = 0; id < TEST_IDS; id++)
+	{
+		/* unchanged, so the same id, the duplicate included */
+		if (mOldSnap[id] >= 0 && mOldSnap[id] != 10 && mOldSnap[id] != 500)
+			FE_CHECK(mSnap[id] == mOldSnap[id]);
+		/* the new and the changed entry take free ids, those of 10 and 500 among them */
+		if (mSnap[id] == 5000 || mSnap[id] == 7500)
+			FE_CHECK(mOldSnap[id] == -1 || mOldSnap[id] == 10 || mOldSnap[id] == 500);
+	}
+	FE_CHECK(mSnap[uOld10] == -1 || mSnap[uOld10] == 5000 || mSnap[uOld10] == 7500);
+
+	/* the same config again changes nothing */
+	memcpy(mOldSnap, mSnap, sizeof(mSnap));
+	FeUnregisterHotkey();
+	FeInitializeHotkey(pNew);
+	TakeSnapshot();
+	FE_CHECK(memcmp(mOldSnap, mSnap, sizeof(mSnap)) == 0);
+
+	FeUnregisterHotkey();
+	FE_CHECK(TakeSnapshot() == 0);
+	cJSON_Delete(pNew);
+}
+
+/* no hotkey array, then an empty one */
+static VOID TestEmpty(VOID)
+{
+	cJSON* pEmpty = cJSON_CreateArray();
+	FeInitializeHotkey(NULL);
+	FE_CHECK(TakeSnapshot() == 0);
+	FeUnregisterHotkey();
+	FeInitializeHotkey(pEmpty);
+	FE_CHECK(TakeSnapshot() == 0);
+	FeListHotkey(NULL);
+	FeUnregisterHotkey();
+	cJSON_Delete(pEmpty);
+}
+
+int main(void)
+{
+	ShimQuietLog(TRUE);
+	TestReload();
+	TestEmpty();
+	return FE_TEST_RESULT;
+}
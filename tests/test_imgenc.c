@@ -0,0 +1,220 @@
+﻿// SPDX-License-Identifier: GPL-3.0-or-later
+
+/* the QOI and BMP writers decoded back by the reference decoders of the corpus benchmark:
+ * a hand-encoded QOI stream, every QOI op over buffer flushes and run limits, padded
+ * strides, the BMP header, and a failing writer */
+
+#include "fe.h"
+#include "utils.h"
+#include "pngenc.h"
+#include "imgenc.h"
+#include "../bench/decode.h"
+#include "test.h"
+
+typedef struct _TEST_BUFFER
+{
+	UINT8* pData;
+	size_t szData;
+	/* refuse the write after this many, 0 for never */
+	UINT uFailAt;
+	UINT uWrites;
+} TEST_BUFFER;
+
+static BOOL WriteBuffer(PVOID pContext, const UINT8* pData, size_t szData)
+{
+	TEST_BUFFER* pBuffer = pContext;
+	UINT8* p;
+	if (pBuffer->uFailAt && ++pBuffer->uWrites >= pBuffer->uFailAt)
+		return FALSE;
+	p = realloc(pBuffer->pData, pBuffer->szData + szData);
+	if (!p)
+		return FALSE;
+	memcpy(p + pBuffer->szData, pData, szData);
+	pBuffer->pData = p;
+	pBuffer->szData += szData;
+	return TRUE;
+}
+
+static UINT TestRandom(UINT* pSeed)
+{
+	*pSeed = *pSeed * 1103515245 + 12345;
+	return *pSeed >> 16;
+}
+
+/* bands which each favour one QOI op: long runs, a palette for QOI_OP_INDEX, steps of one
+ * for QOI_OP_DIFF, of a few for QOI_OP_LUMA, and noise for QOI_OP_RGB. X is noise too */
+static VOID FillImage(UINT8* pBgrx, UINT w, UINT h, size_t szStride)
+{
+	static const UINT32 Palette[] = { 0x102030, 0xF0E0D0, 0x00FF00, 0x808080, 0x3A6EA5 };
+	UINT x, y;
+	UINT uSeed = 7;
+	for (y = 0; y < h; y++)
+	{
+		UINT8* p = pBgrx + y * szStride;
+		for (x = 0; x < w; x++, p += 4)
+		{
+			UINT uBand = (y / 8 + x / 97) % 5;
+			UINT32 c;
+			if (uBand == 0)
+				c = (y / 8) & 1 ? 0xFFFFFF : 0;
+			else if (uBand == 1)
+				c = Palette[(x / 3 + y) % ARRAYSIZE(Palette)];
+			else if (uBand == 2)
+				c = ((x & 0xFF) << 16) | (((x + y) & 0xFF) << 8) | (y & 0xFF);
+			else if (uBand == 3)
+				c = (((x * 5) & 0xFF) << 16) | (((x * 7) & 0xFF) << 8) | ((x * 9) & 0xFF);
+			else
+				c = TestRandom(&uSeed) | (TestRandom(&uSeed) << 16);
+			p[0] = (UINT8)c;
+			p[1] = (UINT8)(c >> 8);
+			p[2] = (UINT8)(c >> 16);
+			p[3] = (UINT8)TestRandom(&uSeed);
+		}
+	}
+}
+
+static BOOL SameImage(const UINT8* pOut, const UINT8* pBgrx, UINT w, UINT h, size_t szStride, BOOL bX)
+{
+	UINT x, y;
+	for (y = 0; y < h; y++)
+	{
+		const UINT8* p = pOut + (size_t)y * w * 4;
+		const UINT8* q = pBgrx + y * szStride;
+		for (x = 0; x < w; x++, p += 4, q += 4)
+		{
+			if (p[0] != q[0] || p[1] != q[1] || p[2] != q[2] || (bX ? p[3] != q[3] : p[3] != 255))
+				return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+/* six pixels, one of each op, checked byte by byte against the QOI specification */
+static VOID TestQoiBytes(VOID)
+{
+	static const UINT8 Pixels[] =
+	{
+		0, 0, 0, 0,
+		0, 0, 1, 0,
+		5, 10, 21, 0,
+		15, 20, 31, 0,
+		0, 0, 0, 0,
+		0, 0, 1, 0,
+	};
+	static const UINT8 Expected[] =
+	{
+		'q', 'o', 'i', 'f', 0, 0, 0, 6, 0, 0, 0, 1, 3, 0,
+		/* run of 1, diff, rgb, luma, rgb, index */
+		0xC0, 0x7A, 0xFE, 21, 10, 5, 0xAA, 0x88, 0xFE, 0, 0, 0, 0x38,
+		0, 0, 0, 0, 0, 0, 0, 1,
+	};
+	TEST_BUFFER qoi = { 0 };
+	size_t szOut = 0;
+	UINT8* pOut = NULL;
+	UINT w = 0, h = 0;
+	FE_CHECK(FeStreamQoiBgrx(NULL, WriteBuffer, &qoi, &szOut, Pixels, 6, 1, 24, FE_PNG_FAST) == 0);
+	FE_CHECK(szOut == sizeof(Expected) && qoi.szData == sizeof(Expected));
+	FE_CHECK(qoi.pData && qoi.szData == sizeof(Expected) && memcmp(qoi.pData, Expected, sizeof(Expected)) == 0);
+	FE_CHECK(BenchDecodeQoi(&pOut, &w, &h, Expected, sizeof(Expected)) == 0);
+	FE_CHECK(w == 6 && h == 1 && pOut && SameImage(pOut, Pixels, 6, 1, 24, FALSE));
+	free(pOut);
+	free(qoi.pData);
+}
+
+static VOID TestRoundTrip(UINT w, UINT h, UINT uPad)
+{
+	UINT i;
+	size_t szStride = (size_t)w * 4 + uPad * 4;
+	/* one byte in, so the rows are not aligned */
+	UINT8* pAlloc = malloc(szStride * h + 1);
+	UINT8* pBgrx = pAlloc + 1;
+	FE_CHECK(pAlloc != NULL);
+	if (!pAlloc)
+		return;
+	FillImage(pBgrx, w, h, szStride);
+	for (i = 0; i < 2; i++)
+	{
+		TEST_BUFFER file = { 0 };
+		size_t szOut = 0;
+		UINT8* pOut = NULL;
+		UINT dw = 0, dh = 0;
+		BOOL bQoi = i == 0;
+		FE_IMAGE_STREAM pfnStream = bQoi ? FeStreamQoiBgrx : FeStreamBmpBgrx;
+		FE_CHECK(pfnStream(NULL, WriteBuffer, &file, &szOut, pBgrx, w, h, szStride, FE_PNG_FAST) == 0);
+		FE_CHECK(szOut == file.szData);
+		FE_CHECK((bQoi ? BenchDecodeQoi : BenchDecodeBmp)(&pOut, &dw, &dh, file.pData, file.szData) == 0);
+		FE_CHECK(dw == w && dh == h && pOut && SameImage(pOut, pBgrx, w, h, szStride, !bQoi));
+		printf("%s %ux%u stride %zu: %zu bytes\n", bQoi ? "qoi" : "bmp", w, h, szStride, file.szData);
+		free(pOut);
+		free(file.pData);
+	}
+	free(pAlloc);
+}
+
+/* a top-down 32-bit BITMAPINFOHEADER file, the bytes Windows expects */
+static VOID TestBmpHeader(VOID)
+{
+	static const UINT8 Pixels[3 * 2 * 4] = { 1, 2, 3, 4 };
+	TEST_BUFFER bmp = { 0 };
+	FE_CHECK(FeStreamBmpBgrx(NULL, WriteBuffer, &bmp, NULL, Pixels, 3, 2, 12, FE_PNG_FAST) == 0);
+	FE_CHECK(bmp.szData == 54 + sizeof(Pixels));
+	if (bmp.szData != 54 + sizeof(Pixels))
+		return;
+	FE_CHECK(bmp.pData[0] == 'B' && bmp.pData[1] == 'M' && bmp.pData[2] == 54 + sizeof(Pixels));
+	FE_CHECK(bmp.pData[10] == 54 && bmp.pData[14] == 40 && bmp.pData[18] == 3);
+	/* -2 */
+	FE_CHECK(bmp.pData[22] == 0xFE && bmp.pData[23] == 0xFF && bmp.pData[24] == 0xFF && bmp.pData[25] == 0xFF);
+	FE_CHECK(bmp.pData[26] == 1 && bmp.pData[28] == 32 && bmp.pData[30] == 0 && bmp.pData[34] == sizeof(Pixels));
+	FE_CHECK(memcmp(bmp.pData + 54, Pixels, sizeof(Pixels)) == 0);
+	free(bmp.pData);
+}
+
+static VOID TestWriteFailure(VOID)
+{
+	UINT i;
+	UINT8* pBgrx = malloc(300 * 300 * 4);
+	FE_CHECK(pBgrx != NULL);
+	if (!pBgrx)
+		return;
+	FillImage(pBgrx, 300, 300, 300 * 4);
+	for (i = 1; i <= 3; i++)
+	{
+		TEST_BUFFER qoi = { NULL, 0, i, 0 };
+		TEST_BUFFER bmp = { NULL, 0, i, 0 };
+		FE_CHECK(FeStreamQoiBgrx(NULL, WriteBuffer, &qoi, NULL, pBgrx, 300, 300, 300 * 4, FE_PNG_FAST) == 79);
+		/* the rows go out in one write when they are packed */
+		if (i <= 2)
+			FE_CHECK(FeStreamBmpBgrx(NULL, WriteBuffer, &bmp, NULL, pBgrx, 300, 300, 300 * 4, FE_PNG_FAST) == 79);
+		free(qoi.pData);
+		free(bmp.pData);
+	}
+	FE_CHECK(FeStreamQoiBgrx(NULL, WriteBuffer, NULL, NULL, pBgrx, 0, 300, 0, FE_PNG_FAST) == 93);
+	FE_CHECK(FeStreamBmpBgrx(NULL, WriteBuffer, NULL, NULL, pBgrx, 300, 0, 300 * 4, FE_PNG_FAST) == 93);
+	free(pBgrx);
+}
+
+static VOID TestWriters(VOID)
+{
+	FE_CHECK(FeGetImageWriter(L"qoi")->pfnStream == FeStreamQoiBgrx);
+	FE_CHECK(FeGetImageWriter(L"BMP")->pfnStream == FeStreamBmpBgrx);
+	FE_CHECK(FeGetImageWriter(L"png")->pfnStream == FeStreamPngBgrx);
+	FE_CHECK(FeGetImageWriter(L"jpg")->pfnStream == FeStreamPngBgrx);
+	FE_CHECK(FeGetImageWriter(NULL)->pfnStream == FeStreamPngBgrx);
+}
+
+int main(void)
+{
+	TestQoiBytes();
+	TestBmpHeader();
+	/* a run ending the image */
+	TestRoundTrip(1, 1, 0);
+	/* a run of more than 62 pixels */
+	TestRoundTrip(200, 1, 0);
+	TestRoundTrip(613, 401, 0);
+	TestRoundTrip(613, 401, 3);
+	/* several QOI buffer flushes */
+	TestRoundTrip(1280, 720, 0);
+	TestWriteFailure();
+	TestWriters();
+	return FE_TEST_RESULT;
+}
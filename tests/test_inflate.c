@@ -0,0 +1,239 @@
+﻿// SPDX-License-Identifier: GPL-3.0-or-later
+
+/* the 64-bit fast inflate loop of lodepng: zlib streams of every block type, window and
+ * kind of content inflate back exactly, and truncated or corrupted ones fail or still
+ * give the original, without reading or writing past a buffer */
+
+#include "fe.h"
+#include "utils.h"
+#include "arena.h"
+#include "lodepng/lodepng.h"
+#include "test.h"
+
+typedef enum _TEST_CONTENT
+{
+	TEST_RANDOM,
+	TEST_TEXT,
+	TEST_RUNS,
+	TEST_ALPHABET,
+	/* matches at distances below 8, copied byte by byte */
+	TEST_PERIODIC,
+	/* sub-filtered RGBA rows of a gradient with a little noise, like a screenshot */
+	TEST_SCANLINES,
+	TEST_CONTENTS
+} TEST_CONTENT;
+
+static const char* mContents[] = { "random", "text", "runs", "alphabet", "periodic", "scanlines" };
+
+static const size_t mSizes[] = { 0, 1, 7, 8, 9, 100, 4096, 70000, 600000 };
+
+typedef struct _TEST_SETTINGS
+{
+	unsigned btype;
+	unsigned use_lz77;
+	unsigned windowsize;
+	unsigned matcher;
+} TEST_SETTINGS;
+
+static const TEST_SETTINGS mSettings[] =
+{
+	{ 0, 0, 2048, LMF_HASH3 },
+	{ 1, 1, 2048, LMF_HASH3 },
+	{ 2, 0, 2048, LMF_HASH3 },
+	{ 2, 1, 256, LMF_HASH3 },
+	{ 2, 1, 2048, LMF_HASH3 },
+	{ 2, 1, 32768, LMF_HASH3 },
+	{ 2, 1, 32768, LMF_HASHCHAIN4 },
+};
+
+static UINT TestRandom(UINT* pSeed)
+{
+	*pSeed = *pSeed * 1103515245 + 12345;
+	return *pSeed >> 16;
+}
+
+static UINT8* MakeContent(TEST_CONTENT uContent, size_t szData)
+{
+	static const char* Words[] = { "the ", "screenshot ", "hotkey ", "PNG ", "deflate ", "\r\n", "fe ", "= ", "{ }" };
+	size_t i = 0;
+	UINT uSeed = 3 + (UINT)uContent;
+	UINT8* pData = malloc(szData + 1);
+	if (!pData)
+		return NULL;
+	while (i < szData)
+	{
+		UINT r = TestRandom(&uSeed);
+		switch (uContent)
+		{
+		case TEST_RANDOM:
+			pData[i++] = (UINT8)r;
+			break;
+		case TEST_TEXT:
+		{
+			const char* p = Words[r % ARRAYSIZE(Words)];
+			for (; *p && i < szData; p++)
+				pData[i++] = (UINT8)*p;
+			break;
+		}
+		case TEST_RUNS:
+		{
+			size_t n = 1 + (r >> 8) % 300;
+			for (; n && i < szData; n--)
+				pData[i++] = (UINT8)r;
+			break;
+		}
+		case TEST_ALPHABET:
+			pData[i++] = (UINT8)("ACGT"[r & 3]);
+			break;
+		case TEST_PERIODIC:
+		{
+			size_t n, uPeriod = 2 + r % 6;
+			for (n = 0; n < 200 && i < szData; n++, i++)
+				pData[i] = (n < uPeriod) ? (UINT8)TestRandom(&uSeed) : pData[i - uPeriod];
+			break;
+		}
+		default:
+			/* a row of 1024 pixels behind its filter byte, the first byte of every row */
+			pData[i] = (UINT8)((i % 4097 == 0) ? 1 : (i % 4 == 0 || r % 61 == 0) ? r : 1);
+			i++;
+			break;
+		}
+	}
+	return pData;
+}
+
+static UINT8* Compress(size_t* pszZlib, const UINT8* pData, size_t szData, const TEST_SETTINGS* pSettings)
+{
+	LodePNGCompressSettings settings;
+	UINT8* pZlib = NULL;
+	lodepng_compress_settings_init(&settings);
+	settings.btype = pSettings->btype;
+	settings.use_lz77 = pSettings->use_lz77;
+	settings.windowsize = pSettings->windowsize;
+	settings.matcher = pSettings->matcher;
+	*pszZlib = 0;
+	if (lodepng_zlib_compress(&pZlib, pszZlib, pData, szData, &settings) != 0)
+	{
+		lodepng_free(pZlib);
+		return NULL;
+	}
+	return pZlib;
+}
+
+/* inflates szZlib bytes copied to a buffer of their own, so a read past them shows */
+static unsigned Inflate(const UINT8* pZlib, size_t szZlib, size_t szMax, const UINT8* pData, size_t szData,
+	BOOL* pbSame)
+{
+	LodePNGDecompressSettings settings;
+	UINT8* pOut = NULL;
+	size_t szOut = 0;
+	unsigned uError;
+	UINT8* pCopy = malloc(szZlib + 1);
+	if (!pCopy)
+		return 83;
+	memcpy(pCopy, pZlib, szZlib);
+	lodepng_decompress_settings_init(&settings);
+	settings.max_output_size = szMax;
+	uError = lodepng_zlib_decompress(&pOut, &szOut, pCopy, szZlib, &settings);
+	*pbSame = uError == 0 && szOut == szData && (szData == 0 || memcmp(pOut, pData, szData) == 0);
+	lodepng_free(pOut);
+	free(pCopy);
+	return uError;
+}
+
+/* every cut of a small stream, a few hundred of a large one */
+static BOOL CheckTruncated(const UINT8* pZlib, size_t szZlib, const UINT8* pData, size_t szData)
+{
+	size_t i;
+	size_t szStep = szZlib > 4096 ? szZlib / 300 : 1;
+	for (i = 0; i < szZlib; i += szStep)
+	{
+		BOOL bSame;
+		if (Inflate(pZlib, i, 0, pData, szData, &bSame) == 0)
+		{
+			printf("cut at %zu of %zu: no error\n", i, szZlib);
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+/* the adler32 at the end catches what the inflate does not */
+static BOOL CheckCorrupted(const UINT8* pZlib, size_t szZlib, const UINT8* pData, size_t szData, UINT* pSeed)
+{
+	UINT i;
+	BOOL bRet = TRUE;
+	UINT8* pBad = malloc(szZlib);
+	if (!pBad)
+		return FALSE;
+	for (i = 0; i < 100 && szZlib > 2; i++)
+	{
+		BOOL bSame;
+		UINT j;
+		memcpy(pBad, pZlib, szZlib);
+		/* the header stays, a bad one is turned down before the inflate */
+		for (j = 0; j < 1 + i % 4; j++)
+			pBad[2 + TestRandom(pSeed) % (szZlib - 2)] ^= (UINT8)(1 << (TestRandom(pSeed) & 7));
+		if (Inflate(pBad, szZlib, 0, pData, szData, &bSame) == 0 && !bSame)
+		{
+			printf("corruption %u of %zu bytes: wrong output\n", i, szZlib);
+			bRet = FALSE;
+			break;
+		}
+	}
+	free(pBad);
+	return bRet;
+}
+
+static VOID TestContent(TEST_CONTENT uContent, UINT* pSeed)
+{
+	UINT i, j;
+	for (i = 0; i < ARRAYSIZE(mSizes); i++)
+	{
+		size_t szData = mSizes[i];
+		UINT8* pData = MakeContent(uContent, szData);
+		FE_CHECK(pData != NULL);
+		if (!pData)
+			return;
+		for (j = 0; j < ARRAYSIZE(mSettings); j++)
+		{
+			BOOL bSame = FALSE;
+			size_t szZlib;
+			UINT8* pZlib;
+			/* lodepng_deflate makes one fixed block of the whole input and divides by its size */
+			if (szData == 0 && mSettings[j].btype == 1)
+				continue;
+			pZlib = Compress(&szZlib, pData, szData, &mSettings[j]);
+			FE_CHECK(pZlib != NULL);
+			if (!pZlib)
+				continue;
+			if (Inflate(pZlib, szZlib, 0, pData, szData, &bSame) != 0 || !bSame)
+			{
+				printf("%s, %zu bytes, settings %u: differs\n", mContents[uContent], szData, j);
+				gTestFailures++;
+			}
+			/* the limit is checked after each match of the fast loop too */
+			if (szData > 1000)
+				FE_CHECK(Inflate(pZlib, szZlib, szData / 2, pData, szData, &bSame) == 109);
+			if (szData <= 70000 && !CheckTruncated(pZlib, szZlib, pData, szData))
+			{
+				printf("%s, %zu bytes, settings %u: truncated\n", mContents[uContent], szData, j);
+				gTestFailures++;
+			}
+			if (szData == 4096 || szData == 70000)
+				FE_CHECK(CheckCorrupted(pZlib, szZlib, pData, szData, pSeed));
+			lodepng_free(pZlib);
+		}
+		free(pData);
+	}
+	printf("%s: done\n", mContents[uContent]);
+}
+
+int main(void)
+{
+	UINT i;
+	UINT uSeed = 5;
+	for (i = 0; i < TEST_CONTENTS; i++)
+		TestContent((TEST_CONTENT)i, &uSeed);
+	return FE_TEST_RESULT;
+}
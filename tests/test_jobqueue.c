@@ -0,0 +1,216 @@
+﻿// SPDX-License-Identifier: GPL-3.0-or-later
+
+/* jobqueue.c with the shim message queue standing in for the window: jobs run in
+ * order, the ninth waiting job is refused, completions come back through
+ * WM_FE_JOB_DONE or on the worker when the post fails, and stopping drains */
+
+#include "fe.h"
+#include "utils.h"
+#include "jobqueue.h"
+#include "test.h"
+
+#define TEST_JOBS 16
+
+typedef struct _TEST_JOB
+{
+	FE_JOB Job;
+	UINT uIndex;
+	/* wait for the gate in pfnRun */
+	BOOL bGated;
+	BOOL bDone;
+	pthread_t DoneThread;
+} TEST_JOB;
+
+static pthread_mutex_t mLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t mCond = PTHREAD_COND_INITIALIZER;
+static BOOL mGateOpen;
+static BOOL mGateReached;
+static UINT mRunOrder[TEST_JOBS];
+static UINT mRunCount;
+static UINT mDoneOrder[TEST_JOBS];
+static UINT mDoneCount;
+
+static VOID RunTestJob(FE_JOB* pJob)
+{
+	TEST_JOB* pTest = (TEST_JOB*)pJob;
+	pthread_mutex_lock(&mLock);
+	mRunOrder[mRunCount++] = pTest->uIndex;
+	if (pTest->bGated)
+	{
+		mGateReached = TRUE;
+		pthread_cond_broadcast(&mCond);
+		while (!mGateOpen)
+			pthread_cond_wait(&mCond, &mLock);
+	}
+	pthread_mutex_unlock(&mLock);
+}
+
+static VOID DoneTestJob(FE_JOB* pJob)
+{
+	TEST_JOB* pTest = (TEST_JOB*)pJob;
+	pthread_mutex_lock(&mLock);
+	mDoneOrder[mDoneCount++] = pTest->uIndex;
+	pTest->DoneThread = pthread_self();
+	pTest->bDone = TRUE;
+	pthread_cond_broadcast(&mCond);
+	pthread_mutex_unlock(&mLock);
+}
+
+static VOID InitTestJobs(TEST_JOB* pJobs, UINT uCount)
+{
+	UINT i;
+	ZeroMemory(pJobs, uCount * sizeof(TEST_JOB));
+	for (i = 0; i < uCount; i++)
+	{
+		pJobs[i].Job.pfnRun = RunTestJob;
+		pJobs[i].Job.pfnDone = DoneTestJob;
+		pJobs[i].uIndex = i;
+	}
+	pthread_mutex_lock(&mLock);
+	mGateOpen = FALSE;
+	mGateReached = FALSE;
+	mRunCount = 0;
+	mDoneCount = 0;
+	pthread_mutex_unlock(&mLock);
+}
+
+static VOID SetGate(BOOL bOpen)
+{
+	pthread_mutex_lock(&mLock);
+	mGateOpen = bOpen;
+	pthread_cond_broadcast(&mCond);
+	pthread_mutex_unlock(&mLock);
+}
+
+static VOID WaitGateReached(VOID)
+{
+	pthread_mutex_lock(&mLock);
+	while (!mGateReached)
+		pthread_cond_wait(&mCond, &mLock);
+	pthread_mutex_unlock(&mLock);
+}
+
+/* the part of the message loop in fe.c which completes jobs */
+static VOID PumpJobs(UINT uCount)
+{
+	MSG msg;
+	while (uCount-- > 0)
+	{
+		GetMessageW(&msg, NULL, 0, 0);
+		FE_CHECK(msg.message == WM_FE_JOB_DONE);
+		if (msg.message == WM_FE_JOB_DONE)
+			FeCompleteJob(msg.lParam);
+	}
+}
+
+/* the worker is busy until it has posted the last completion and locked the queue again */
+static BOOL WaitIdle(VOID)
+{
+	UINT i;
+	for (i = 0; i < 5000 && FeGetJobQueueDepth() != 0; i++)
+		Sleep(1);
+	return FeGetJobQueueDepth() == 0;
+}
+
+static VOID CheckOrder(const UINT* pOrder, UINT uCount)
+{
+	UINT i;
+	for (i = 0; i < uCount; i++)
+		FE_CHECK(pOrder[i] == i);
+}
+
+/* one running and eight waiting, the next is refused until the queue moves */
+static VOID TestOrderAndBackPressure(VOID)
+{
+	UINT i;
+	TEST_JOB Jobs[10];
+	pthread_t Self = pthread_self();
+
+	InitTestJobs(Jobs, ARRAYSIZE(Jobs));
+	Jobs[0].bGated = TRUE;
+	FE_CHECK(FeSubmitJob(&Jobs[0].Job));
+	WaitGateReached();
+	for (i = 1; i < 9; i++)
+	{
+		FE_CHECK(FeSubmitJob(&Jobs[i].Job));
+		FE_CHECK(Jobs[i].Job.uDepth == i);
+	}
+	FE_CHECK(FeGetJobQueueDepth() == 9);
+	FE_CHECK(!FeSubmitJob(&Jobs[9].Job));
+
+	SetGate(TRUE);
+	PumpJobs(9);
+	FE_CHECK(mRunCount == 9);
+	FE_CHECK(mDoneCount == 9);
+	CheckOrder(mRunOrder, 9);
+	CheckOrder(mDoneOrder, 9);
+	for (i = 0; i < 9; i++)
+	{
+		FE_CHECK(Jobs[i].bDone);
+		FE_CHECK(pthread_equal(Jobs[i].DoneThread, Self));
+		FE_CHECK(Jobs[i].Job.llQueued <= Jobs[i].Job.llStarted);
+		FE_CHECK(Jobs[i].Job.llStarted <= Jobs[i].Job.llFinished);
+	}
+	FE_CHECK(WaitIdle());
+
+	FE_CHECK(FeSubmitJob(&Jobs[9].Job));
+	FE_CHECK(Jobs[9].Job.uDepth == 0);
+	PumpJobs(1);
+	FE_CHECK(Jobs[9].bDone);
+}
+
+/* with the window gone pfnDone runs on the worker instead of being lost */
+static VOID TestPostFailure(VOID)
+{
+	TEST_JOB Jobs[1];
+	InitTestJobs(Jobs, ARRAYSIZE(Jobs));
+	ShimFailPostMessage(TRUE);
+	FE_CHECK(FeSubmitJob(&Jobs[0].Job));
+	pthread_mutex_lock(&mLock);
+	while (!Jobs[0].bDone)
+		pthread_cond_wait(&mCond, &mLock);
+	pthread_mutex_unlock(&mLock);
+	FE_CHECK(!pthread_equal(Jobs[0].DoneThread, pthread_self()));
+	ShimFailPostMessage(FALSE);
+}
+
+static void* OpenGateLater(void* p)
+{
+	UNREFERENCED_PARAMETER(p);
+	Sleep(50);
+	SetGate(TRUE);
+	return NULL;
+}
+
+/* FeStopJobQueue runs what is still queued, at exit the posts fail */
+static VOID TestDrainOnStop(VOID)
+{
+	UINT i;
+	TEST_JOB Jobs[6];
+	pthread_t Opener;
+	InitTestJobs(Jobs, ARRAYSIZE(Jobs));
+	Jobs[0].bGated = TRUE;
+	ShimFailPostMessage(TRUE);
+	for (i = 0; i < ARRAYSIZE(Jobs); i++)
+		FE_CHECK(FeSubmitJob(&Jobs[i].Job));
+	WaitGateReached();
+	FE_CHECK(FeGetJobQueueDepth() == ARRAYSIZE(Jobs));
+	/* most likely still closed when the queue is told to stop */
+	pthread_create(&Opener, NULL, OpenGateLater, NULL);
+	FeStopJobQueue();
+	pthread_join(Opener, NULL);
+	FE_CHECK(mRunCount == ARRAYSIZE(Jobs));
+	FE_CHECK(mDoneCount == ARRAYSIZE(Jobs));
+	CheckOrder(mRunOrder, ARRAYSIZE(Jobs));
+	CheckOrder(mDoneOrder, ARRAYSIZE(Jobs));
+	FE_CHECK(!FeSubmitJob(&Jobs[0].Job));
+	FE_CHECK(FeGetJobQueueDepth() == 0);
+}
+
+int main(void)
+{
+	TestOrderAndBackPressure();
+	TestPostFailure();
+	TestDrainOnStop();
+	return FE_TEST_RESULT;
+}
@@ -0,0 +1,153 @@
+﻿// SPDX-License-Identifier: GPL-3.0-or-later
+
+/* the LMF_HASHCHAIN4 long range match on scanlines wider than the window: rows of noise
+ * that repeat one scanline apart only compress through it, and the output inflates back */
+
+#include "fe.h"
+#include "utils.h"
+#include "pngenc.h"
+#include "arena.h"
+#include "test.h"
+
+static UINT TestRandom(UINT* pSeed)
+{
+	*pSeed = *pSeed * 1103515245 + 12345;
+	return *pSeed >> 16;
+}
+
+/* uRows scanlines of szLine bytes, every odd one a copy of the one before */
+static UINT8* MakeRepeatedRows(size_t szLine, UINT uRows)
+{
+	UINT y;
+	size_t x;
+	UINT uSeed = 7;
+	UINT8* pData = malloc(szLine * uRows);
+	if (!pData)
+		return NULL;
+	for (y = 0; y < uRows; y++)
+	{
+		UINT8* pRow = pData + y * szLine;
+		if (y & 1)
+		{
+			memcpy(pRow, pRow - szLine, szLine);
+			continue;
+		}
+		pRow[0] = 0;
+		for (x = 1; x < szLine; x++)
+			pRow[x] = (UINT8)TestRandom(&uSeed);
+	}
+	return pData;
+}
+
+static size_t CompressRows(const UINT8* pData, size_t szData, unsigned windowsize, unsigned longrange)
+{
+	LodePNGCompressSettings settings;
+	LodePNGDecompressSettings decompress;
+	UINT8* pZlib = NULL;
+	UINT8* pOut = NULL;
+	size_t szZlib = 0, szOut = 0;
+	unsigned uError;
+
+	lodepng_compress_settings_init(&settings);
+	settings.matcher = LMF_HASHCHAIN4;
+	settings.windowsize = windowsize;
+	settings.longrange = longrange;
+	uError = lodepng_zlib_compress(&pZlib, &szZlib, pData, szData, &settings);
+	FE_CHECK(uError == 0);
+	lodepng_decompress_settings_init(&decompress);
+	FE_CHECK(lodepng_zlib_decompress(&pOut, &szOut, pZlib, szZlib, &decompress) == 0);
+	FE_CHECK(szOut == szData && pOut && memcmp(pOut, pData, szData) == 0);
+	lodepng_free(pZlib);
+	lodepng_free(pOut);
+	return uError ? 0 : szZlib;
+}
+
+static VOID TestLongRange(UINT w, unsigned windowsize)
+{
+	size_t szLine = (size_t)w * 3 + 1;
+	UINT uRows = 32;
+	UINT8* pData = MakeRepeatedRows(szLine, uRows);
+	size_t szWithout, szWith;
+	FE_CHECK(pData != NULL);
+	if (!pData)
+		return;
+	szWithout = CompressRows(pData, szLine * uRows, windowsize, 0);
+	szWith = CompressRows(pData, szLine * uRows, windowsize, (unsigned)szLine);
+	printf("width %u window %u: %zu bytes, %zu with the long range match\n", w, windowsize,
+		szWithout, szWith);
+	FE_CHECK(szLine > windowsize);
+	/* the repeated half of the rows costs next to nothing */
+	FE_CHECK(szWith < szWithout * 6 / 10);
+	free(pData);
+}
+
+/* beyond the 32768 deflate distance the long range match is not taken */
+static VOID TestTooWide(VOID)
+{
+	size_t szLine = (size_t)11000 * 3 + 1;
+	UINT uRows = 4;
+	UINT8* pData = MakeRepeatedRows(szLine, uRows);
+	FE_CHECK(pData != NULL);
+	if (!pData)
+		return;
+	FE_CHECK(CompressRows(pData, szLine * uRows, 2048, (unsigned)szLine) != 0);
+	free(pData);
+}
+
+/* the stripe encoder sets longrange itself, its stripes are primed with one row at least */
+static VOID TestStripes(FE_PNG_PROFILE uProfile)
+{
+	UINT x, y;
+	UINT w = 2000, h = 600;
+	UINT uSeed = 11;
+	UINT8* pBgrx = malloc((size_t)w * h * 4);
+	UINT8* pPng = NULL;
+	UINT8* pOut = NULL;
+	size_t szPng = 0;
+	unsigned dw, dh;
+	FE_CHECK(pBgrx != NULL);
+	if (!pBgrx)
+		return;
+	for (y = 0; y < h; y++)
+	{
+		UINT8* pRow = pBgrx + (size_t)y * w * 4;
+		if (y & 1)
+		{
+			memcpy(pRow, pRow - (size_t)w * 4, (size_t)w * 4);
+			continue;
+		}
+		for (x = 0; x < w * 4; x++)
+			pRow[x] = (UINT8)TestRandom(&uSeed);
+	}
+	FE_CHECK(FeEncodePngBgrx(NULL, &pPng, &szPng, pBgrx, w, h, (size_t)w * 4, uProfile) == 0);
+	FE_CHECK(lodepng_decode24(&pOut, &dw, &dh, pPng, szPng) == 0);
+	FE_CHECK(dw == w && dh == h);
+	for (y = 0; pOut && y < h; y++)
+	{
+		for (x = 0; x < w; x++)
+		{
+			const UINT8* p = pBgrx + ((size_t)y * w + x) * 4;
+			const UINT8* q = pOut + ((size_t)y * w + x) * 3;
+			if (p[0] != q[2] || p[1] != q[1] || p[2] != q[0])
+				break;
+		}
+		if (x != w)
+			break;
+	}
+	FE_CHECK(pOut && y == h);
+	free(pPng);
+	lodepng_free(pOut);
+	free(pBgrx);
+}
+
+int main(void)
+{
+	/* the fast and balanced windows, 1080p and 4K scanlines */
+	TestLongRange(1920, 1024);
+	TestLongRange(1920, 2048);
+	TestLongRange(3840, 2048);
+	TestTooWide();
+	TestStripes(FE_PNG_FAST);
+	TestStripes(FE_PNG_BALANCED);
+	return FE_TEST_RESULT;
+}
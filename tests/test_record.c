@@ -0,0 +1,310 @@
+﻿// SPDX-License-Identifier: GPL-3.0-or-later
+
+/* the APNG writer and the recorder: the chunks are well formed, replaying the frames onto
+ * a canvas gives back every frame that changed, unchanged frames only lengthen the delay,
+ * and a recorder whose writes are slower than its clock drops ticks instead of blocking */
+
+#include "fe.h"
+#include "utils.h"
+#include "pngenc.h"
+#include "record.h"
+#include "arena.h"
+#include "test.h"
+
+#define TEST_WIDTH 320
+#define TEST_HEIGHT 240
+#define TEST_FRAMES 5
+
+typedef struct _TEST_FILE
+{
+	UINT8* pData;
+	size_t szData;
+	/* milliseconds every write takes */
+	UINT uWriteDelay;
+} TEST_FILE;
+
+typedef struct _TEST_REPLAY
+{
+	UINT8* pCanvas;
+	UINT uFrames;
+	UINT uActlFrames;
+	UINT Delays[64];
+	BOOL bValid;
+} TEST_REPLAY;
+
+typedef struct _TEST_CAPTURE
+{
+	UINT uFrame;
+	UINT8* pLast;
+} TEST_CAPTURE;
+
+static BOOL WriteTest(PVOID pContext, const UINT8* pData, size_t szData)
+{
+	TEST_FILE* pFile = pContext;
+	UINT8* p = realloc(pFile->pData, pFile->szData + szData);
+	if (!p)
+		return FALSE;
+	if (pFile->uWriteDelay)
+		Sleep(pFile->uWriteDelay);
+	memcpy(p + pFile->szData, pData, szData);
+	pFile->pData = p;
+	pFile->szData += szData;
+	return TRUE;
+}
+
+static BOOL PatchFile(PVOID pContext, size_t szOffset, const UINT8* pData, size_t szData)
+{
+	TEST_FILE* pFile = pContext;
+	if (szOffset + szData > pFile->szData)
+		return FALSE;
+	memcpy(pFile->pData + szOffset, pData, szData);
+	return TRUE;
+}
+
+static UINT GetUint32(const UINT8* p)
+{
+	return ((UINT)p[0] << 24) | ((UINT)p[1] << 16) | ((UINT)p[2] << 8) | p[3];
+}
+
+/* a desktop with a box that moves and a clock that ticks every other frame */
+static VOID DrawFrame(UINT8* pBgrx, UINT w, UINT h, UINT uFrame)
+{
+	UINT x, y;
+	UINT bx = (uFrame * 37) % (w - 64);
+	UINT by = (uFrame * 11) % (h - 64);
+	for (y = 0; y < h; y++)
+	{
+		for (x = 0; x < w; x++)
+		{
+			UINT8* q = pBgrx + ((size_t)y * w + x) * 4;
+			q[0] = (UINT8)((x / 16) * 9);
+			q[1] = (UINT8)((y / 8) * 5);
+			q[2] = (UINT8)((x ^ y) & 0x3F);
+			q[3] = 0;
+			if (x >= bx && x < bx + 64 && y >= by && y < by + 64)
+				q[0] = 0xFF;
+			if (x >= w - 100 && x < w - 20 && y >= h - 30 && y < h - 10)
+				q[1] = (UINT8)((uFrame / 2) * 40);
+		}
+	}
+}
+
+static BOOL SameFrame(const UINT8* pRgba, const UINT8* pBgrx, UINT w, UINT h)
+{
+	size_t i;
+	for (i = 0; i < (size_t)w * h; i++)
+	{
+		if (pRgba[i * 4] != pBgrx[i * 4 + 2] || pRgba[i * 4 + 1] != pBgrx[i * 4 + 1]
+			|| pRgba[i * 4 + 2] != pBgrx[i * 4])
+			return FALSE;
+	}
+	return TRUE;
+}
+
+/* decode the region of one frame as a PNG of its own and put it on the canvas */
+static BOOL PasteFrame(TEST_REPLAY* pReplay, const UINT8* pZlib, size_t szZlib,
+	const UINT8* pFctl, UINT w)
+{
+	static const UINT8 Signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+	UINT y;
+	UINT fw = GetUint32(pFctl + 4), fh = GetUint32(pFctl + 8);
+	UINT fx = GetUint32(pFctl + 12), fy = GetUint32(pFctl + 16);
+	UINT8 ihdr[13] = { 0 };
+	UINT8* pPng = lodepng_malloc(8);
+	size_t szPng = 8;
+	UINT8* pOut = NULL;
+	unsigned dw, dh;
+	BOOL bRet;
+	if (!pPng)
+		return FALSE;
+	memcpy(pPng, Signature, 8);
+	memcpy(ihdr, pFctl + 4, 8);
+	ihdr[8] = 8;
+	ihdr[9] = 2;
+	lodepng_chunk_create(&pPng, &szPng, 13, "IHDR", ihdr);
+	lodepng_chunk_create(&pPng, &szPng, (unsigned)szZlib, "IDAT", pZlib);
+	lodepng_chunk_create(&pPng, &szPng, 0, "IEND", NULL);
+	bRet = lodepng_decode32(&pOut, &dw, &dh, pPng, szPng) == 0 && dw == fw && dh == fh;
+	for (y = 0; bRet && y < fh; y++)
+		memcpy(pReplay->pCanvas + ((size_t)(fy + y) * w + fx) * 4, pOut + (size_t)y * fw * 4, (size_t)fw * 4);
+	lodepng_free(pOut);
+	lodepng_free(pPng);
+	return bRet;
+}
+
+/* walk the chunks, calling pfnFrame with the canvas after each frame */
+static VOID ReplayApng(TEST_REPLAY* pReplay, const TEST_FILE* pFile, UINT w, UINT h,
+	BOOL (*pfnFrame)(const TEST_REPLAY* pReplay, PVOID pContext), PVOID pContext)
+{
+	const UINT8* pEnd = pFile->pData + pFile->szData;
+	const UINT8* pChunk = pFile->pData + 8;
+	const UINT8* pFctl = NULL;
+	UINT8* pZlib = malloc(pFile->szData);
+	size_t szZlib = 0;
+	UINT uSequence = 0;
+
+	ZeroMemory(pReplay, sizeof(TEST_REPLAY));
+	pReplay->pCanvas = calloc((size_t)w * h, 4);
+	pReplay->bValid = pZlib && pReplay->pCanvas && pFile->szData > 8;
+	while (pReplay->bValid && pChunk + 12 <= pEnd)
+	{
+		const UINT8* pData = lodepng_chunk_data_const(pChunk);
+		BOOL bEnd = lodepng_chunk_type_equals(pChunk, "IEND");
+		if (lodepng_chunk_check_crc(pChunk) != 0)
+			pReplay->bValid = FALSE;
+		if ((bEnd || lodepng_chunk_type_equals(pChunk, "fcTL")) && pFctl)
+		{
+			pReplay->bValid &= PasteFrame(pReplay, pZlib, szZlib, pFctl, w);
+			pReplay->bValid &= pfnFrame(pReplay, pContext);
+			pReplay->uFrames++;
+			szZlib = 0;
+		}
+		if (bEnd)
+			break;
+		if (lodepng_chunk_type_equals(pChunk, "acTL"))
+			pReplay->uActlFrames = GetUint32(pData);
+		else if (lodepng_chunk_type_equals(pChunk, "fcTL"))
+		{
+			pReplay->bValid &= GetUint32(pData) == uSequence++;
+			if (pReplay->uFrames < ARRAYSIZE(pReplay->Delays))
+				pReplay->Delays[pReplay->uFrames] = (pData[20] << 8) | pData[21];
+			pFctl = pData;
+		}
+		else if (lodepng_chunk_type_equals(pChunk, "IDAT"))
+		{
+			pReplay->bValid &= pReplay->uFrames == 0;
+			memcpy(pZlib + szZlib, pData, lodepng_chunk_length(pChunk));
+			szZlib += lodepng_chunk_length(pChunk);
+		}
+		else if (lodepng_chunk_type_equals(pChunk, "fdAT"))
+		{
+			pReplay->bValid &= GetUint32(pData) == uSequence++;
+			memcpy(pZlib + szZlib, pData + 4, lodepng_chunk_length(pChunk) - 4);
+			szZlib += lodepng_chunk_length(pChunk) - 4;
+		}
+		pChunk = lodepng_chunk_next_const(pChunk, pEnd);
+	}
+	free(pZlib);
+}
+
+static BOOL DecodesFirst(const TEST_FILE* pFile, const UINT8* pBgrx, UINT w, UINT h)
+{
+	UINT8* pOut = NULL;
+	unsigned dw, dh;
+	BOOL bRet = lodepng_decode32(&pOut, &dw, &dh, pFile->pData, pFile->szData) == 0
+		&& dw == w && dh == h && SameFrame(pOut, pBgrx, w, h);
+	lodepng_free(pOut);
+	return bRet;
+}
+
+typedef struct _TEST_EXPECT
+{
+	UINT8* Frames[TEST_FRAMES];
+	/* source frame of each APNG frame */
+	UINT Map[TEST_FRAMES];
+} TEST_EXPECT;
+
+static BOOL CheckApngFrame(const TEST_REPLAY* pReplay, PVOID pContext)
+{
+	TEST_EXPECT* pExpect = pContext;
+	return SameFrame(pReplay->pCanvas, pExpect->Frames[pExpect->Map[pReplay->uFrames]],
+		TEST_WIDTH, TEST_HEIGHT);
+}
+
+/* frames at 0, 100, 200, 300 and 400 ms where the third repeats the second */
+static VOID TestApng(FE_PNG_PROFILE uProfile)
+{
+	UINT i;
+	BOOL bChanged;
+	size_t szPng = 0;
+	TEST_FILE file = { 0 };
+	TEST_EXPECT expect = { { 0 }, { 0, 1, 3, 4 } };
+	TEST_REPLAY replay;
+	UINT Draw[TEST_FRAMES] = { 0, 1, 1, 2, 3 };
+	FE_APNG* pApng = FeCreateApng(WriteTest, PatchFile, &file, TEST_WIDTH, TEST_HEIGHT, uProfile);
+	FE_CHECK(pApng != NULL);
+	if (!pApng)
+		return;
+	for (i = 0; i < TEST_FRAMES; i++)
+	{
+		expect.Frames[i] = malloc((size_t)TEST_WIDTH * TEST_HEIGHT * 4);
+		DrawFrame(expect.Frames[i], TEST_WIDTH, TEST_HEIGHT, Draw[i]);
+		FE_CHECK(FeAddApngFrame(pApng, expect.Frames[i], TEST_WIDTH * 4, i * 100, &bChanged) == 0);
+		FE_CHECK(bChanged == (i != 2));
+	}
+	FE_CHECK(FeCloseApng(pApng, 500, &szPng) == 0);
+	FE_CHECK(szPng == file.szData);
+
+	ReplayApng(&replay, &file, TEST_WIDTH, TEST_HEIGHT, CheckApngFrame, &expect);
+	FE_CHECK(replay.bValid);
+	FE_CHECK(replay.uFrames == 4 && replay.uActlFrames == 4);
+	FE_CHECK(replay.Delays[0] == 100 && replay.Delays[1] == 200);
+	FE_CHECK(replay.Delays[2] == 100 && replay.Delays[3] == 100);
+	/* viewers without APNG support show the first frame */
+	FE_CHECK(DecodesFirst(&file, expect.Frames[0], TEST_WIDTH, TEST_HEIGHT));
+
+	free(replay.pCanvas);
+	for (i = 0; i < TEST_FRAMES; i++)
+		free(expect.Frames[i]);
+	free(file.pData);
+}
+
+static BOOL CaptureTest(PVOID pContext, UINT8* pBgrx, UINT w, UINT h)
+{
+	TEST_CAPTURE* pCapture = pContext;
+	DrawFrame(pBgrx, w, h, pCapture->uFrame++);
+	memcpy(pCapture->pLast, pBgrx, (size_t)w * h * 4);
+	return TRUE;
+}
+
+static BOOL CountFrame(const TEST_REPLAY* pReplay, PVOID pContext)
+{
+	UNREFERENCED_PARAMETER(pReplay);
+	UNREFERENCED_PARAMETER(pContext);
+	return TRUE;
+}
+
+/* 50 frames a second into a file that takes 30 ms per write, the capture clock keeps
+ * going and drops the ticks while the ring is full */
+static VOID TestRecordDrops(VOID)
+{
+	size_t szPng = 0;
+	FE_RECORD_STATS stats;
+	TEST_FILE file = { 0 };
+	TEST_REPLAY replay;
+	TEST_CAPTURE capture = { 0 };
+	FE_RECORD* pRecord;
+
+	capture.pLast = malloc((size_t)TEST_WIDTH * TEST_HEIGHT * 4);
+	file.uWriteDelay = 30;
+	pRecord = FeStartRecord(CaptureTest, &capture, WriteTest, PatchFile, &file,
+		TEST_WIDTH, TEST_HEIGHT, 50, FE_PNG_FAST);
+	FE_CHECK(pRecord != NULL);
+	if (!pRecord)
+		return;
+	Sleep(600);
+	FE_CHECK(FeStopRecord(pRecord, &szPng, &stats) == 0);
+	printf("captured %u, dropped %u, changed %u, latency %.1f ms, max %.1f ms\n", stats.uCaptured,
+		stats.uDropped, stats.uChanged, stats.dLatency, stats.dMaxLatency);
+	FE_CHECK(stats.uCaptured == capture.uFrame);
+	FE_CHECK(stats.uDropped > 0);
+	FE_CHECK(stats.uChanged > 0 && stats.uChanged <= stats.uCaptured);
+	FE_CHECK(stats.dLatency <= stats.dMaxLatency);
+
+	/* the frames still queued at the stop are written, the last capture is the last frame */
+	ReplayApng(&replay, &file, TEST_WIDTH, TEST_HEIGHT, CountFrame, NULL);
+	FE_CHECK(replay.bValid);
+	FE_CHECK(replay.uFrames == stats.uChanged && replay.uActlFrames == stats.uChanged);
+	FE_CHECK(replay.pCanvas && SameFrame(replay.pCanvas, capture.pLast, TEST_WIDTH, TEST_HEIGHT));
+	free(replay.pCanvas);
+	free(capture.pLast);
+	free(file.pData);
+}
+
+int main(void)
+{
+	TestApng(FE_PNG_FAST);
+	TestApng(FE_PNG_BALANCED);
+	TestRecordDrops();
+	return FE_TEST_RESULT;
+}
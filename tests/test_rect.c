@@ -0,0 +1,155 @@
+﻿// SPDX-License-Identifier: GPL-3.0-or-later
+
+/* areas of a shared desktop buffer as screenshot.c hands them to the encoders: a
+ * sub-rectangle at any offset, with the stride of the whole buffer, encodes to the same
+ * file as a packed copy of it, and FeSwizzleRows packs it for lodepng in place */
+
+#include "fe.h"
+#include "utils.h"
+#include "pngenc.h"
+#include "swizzle.h"
+#include "arena.h"
+#include "test.h"
+
+#define TEST_WIDTH 613
+#define TEST_HEIGHT 401
+
+typedef struct _TEST_BUFFER
+{
+	UINT8* pData;
+	size_t szData;
+} TEST_BUFFER;
+
+static BOOL WriteBuffer(PVOID pContext, const UINT8* pData, size_t szData)
+{
+	TEST_BUFFER* pBuffer = pContext;
+	UINT8* p = realloc(pBuffer->pData, pBuffer->szData + szData);
+	if (!p)
+		return FALSE;
+	memcpy(p + pBuffer->szData, pData, szData);
+	pBuffer->pData = p;
+	pBuffer->szData += szData;
+	return TRUE;
+}
+
+static UINT TestRandom(UINT* pSeed)
+{
+	*pSeed = *pSeed * 1103515245 + 12345;
+	return *pSeed >> 16;
+}
+
+static BOOL SameFile(const UINT8* pA, size_t szA, const UINT8* pB, size_t szB)
+{
+	return pA && pB && szA == szB && memcmp(pA, pB, szA) == 0;
+}
+
+/* one area of the desktop buffer pDesk, szStride bytes per row */
+static VOID TestArea(const UINT8* pDesk, size_t szStride, UINT x, UINT y, UINT w, UINT h,
+	FE_PNG_PROFILE uProfile)
+{
+	UINT i;
+	const UINT8* pArea = pDesk + y * szStride + (size_t)x * 4;
+	UINT8* pPacked = malloc((size_t)w * h * 4);
+	UINT8* pRgba = malloc((size_t)w * h * 4);
+	UINT8* pRows = malloc(szStride * h);
+	UINT8* pOne = NULL;
+	UINT8* pTwo = NULL;
+	size_t szOne = 0, szTwo = 0;
+	TEST_BUFFER stream = { 0 }, packed = { 0 };
+	FE_CHECK(pPacked && pRgba && pRows);
+	if (!pPacked || !pRgba || !pRows)
+		return;
+	for (i = 0; i < h; i++)
+		memcpy(pPacked + (size_t)i * w * 4, pArea + i * szStride, (size_t)w * 4);
+
+	FE_CHECK(FeEncodePngBgrx(NULL, &pOne, &szOne, pPacked, w, h, (size_t)w * 4, uProfile) == 0);
+	FE_CHECK(FeEncodePngBgrx(NULL, &pTwo, &szTwo, pArea, w, h, szStride, uProfile) == 0);
+	FE_CHECK(SameFile(pOne, szOne, pTwo, szTwo));
+	/* the streamed file is cut into other IDAT chunks, compare it with a stream */
+	FE_CHECK(FeStreamPngBgrx(NULL, WriteBuffer, &stream, NULL, pArea, w, h, szStride, uProfile) == 0);
+	FE_CHECK(FeStreamPngBgrx(NULL, WriteBuffer, &packed, NULL, pPacked, w, h, (size_t)w * 4, uProfile) == 0);
+	FE_CHECK(SameFile(packed.pData, packed.szData, stream.pData, stream.szData));
+	free(pOne);
+	free(pTwo);
+	free(stream.pData);
+	free(packed.pData);
+
+	/* the max profile of screenshot.c, packed and swizzled in place for lodepng */
+	FeSwizzleBgra(pRgba, pPacked, (size_t)w * h);
+	for (i = 0; i < h; i++)
+		memcpy(pRows + i * szStride, pArea + i * szStride, (size_t)w * 4);
+	FeSwizzleRows(pRows, w, h, szStride);
+	FE_CHECK(memcmp(pRows, pRgba, (size_t)w * h * 4) == 0);
+
+	free(pPacked);
+	free(pRgba);
+	free(pRows);
+}
+
+/* a delta sequence read in place from the buffer against one from packed copies */
+static VOID TestDelta(UINT8* pDesk, size_t szStride, UINT x, UINT y, UINT w, UINT h, UINT* pSeed)
+{
+	UINT f, i;
+	UINT8* pPacked = malloc((size_t)w * h * 4);
+	FE_PNG_DELTA* pInPlace = FeCreatePngDelta();
+	FE_PNG_DELTA* pCopied = FeCreatePngDelta();
+	FE_CHECK(pPacked && pInPlace && pCopied);
+	if (!pPacked || !pInPlace || !pCopied)
+		return;
+	for (f = 0; f < 4; f++)
+	{
+		FE_PNG_DELTA_STATS stats, packed;
+		TEST_BUFFER one = { 0 }, two = { 0 };
+		UINT8* pArea = pDesk + y * szStride + (size_t)x * 4;
+		/* a few pixels change, some of them outside the area */
+		for (i = 0; i < 20; i++)
+			pDesk[TestRandom(pSeed) % (szStride * TEST_HEIGHT)] ^= 0x40;
+		for (i = 0; i < h; i++)
+			memcpy(pPacked + (size_t)i * w * 4, pArea + i * szStride, (size_t)w * 4);
+		FE_CHECK(FeStreamPngDelta(NULL, pInPlace, WriteBuffer, &one, NULL, pArea, w, h, szStride,
+			FE_PNG_FAST, &stats) == 0);
+		FE_CHECK(FeStreamPngDelta(NULL, pCopied, WriteBuffer, &two, NULL, pPacked, w, h, (size_t)w * 4,
+			FE_PNG_FAST, &packed) == 0);
+		FE_CHECK(SameFile(one.pData, one.szData, two.pData, two.szData));
+		FE_CHECK(stats.uDirtyTiles == packed.uDirtyTiles);
+		free(one.pData);
+		free(two.pData);
+	}
+	FeFreePngDelta(pInPlace);
+	FeFreePngDelta(pCopied);
+	free(pPacked);
+}
+
+int main(void)
+{
+	UINT i, k;
+	UINT uSeed = 9;
+	for (k = 0; k < 4; k++)
+	{
+		/* strides of w * 4 + k, so the rows and pixels of the area are unaligned */
+		size_t szStride = TEST_WIDTH * 4 + k;
+		UINT8* pAlloc = malloc(szStride * TEST_HEIGHT + 1);
+		UINT8* pDesk = pAlloc + (k & 1);
+		FE_CHECK(pAlloc != NULL);
+		if (!pAlloc)
+			return FE_TEST_RESULT;
+		for (i = 0; i < szStride * TEST_HEIGHT; i++)
+			pDesk[i] = (UINT8)((i % 7 == 0) ? TestRandom(&uSeed) : (i / 613) ^ (i / 97));
+		for (i = 0; i < 6; i++)
+		{
+			UINT w = 1 + TestRandom(&uSeed) % TEST_WIDTH;
+			UINT h = 1 + TestRandom(&uSeed) % TEST_HEIGHT;
+			UINT x = TestRandom(&uSeed) % (TEST_WIDTH - w + 1);
+			UINT y = TestRandom(&uSeed) % (TEST_HEIGHT - h + 1);
+			TestArea(pDesk, szStride, x, y, w, h, (FE_PNG_PROFILE)(i % 3));
+			if (i == 0)
+				TestDelta(pDesk, szStride, x, y, w, h, &uSeed);
+		}
+		/* the whole buffer and a column at its right edge */
+		TestArea(pDesk, szStride, 0, 0, TEST_WIDTH, TEST_HEIGHT, FE_PNG_FAST);
+		TestArea(pDesk, szStride, TEST_WIDTH - 1, 0, 1, TEST_HEIGHT, FE_PNG_BALANCED);
+		printf("stride %zu: done\n", szStride);
+		free(pAlloc);
+	}
+	return FE_TEST_RESULT;
+}
@@ -0,0 +1,244 @@
+﻿// SPDX-License-Identifier: GPL-3.0-or-later
+
+/* FeStreamPngBgrx writing through a pipe and into a file: what arrives decodes with
+ * lodepng_decode32 to the frame, holds the zlib stream FeEncodePngBgrx writes, comes in
+ * IDAT chunks of at most 64 KiB, and a failing write stops the encoder with error 79 */
+
+#include "fe.h"
+#include "utils.h"
+#include "pngenc.h"
+#include "arena.h"
+#include "test.h"
+
+#include <stdio.h>
+
+/* PNG_IDAT_SIZE in pngenc.c and the chunk length, type and CRC */
+#define TEST_MAX_WRITE (0x10000 + 12)
+
+typedef struct _TEST_READER
+{
+	pthread_t Thread;
+	int fd;
+	UINT8* pData;
+	size_t szData;
+} TEST_READER;
+
+typedef struct _TEST_WRITER
+{
+	int fd;
+	FILE* pFile;
+	size_t szMaxWrite;
+	UINT uWrites;
+	/* fail the write after this many, 0 never */
+	UINT uFailAt;
+} TEST_WRITER;
+
+static void* ReaderThread(void* p)
+{
+	TEST_READER* pReader = p;
+	UINT8 buf[4096];
+	ssize_t n;
+	while ((n = read(pReader->fd, buf, sizeof(buf))) > 0)
+	{
+		UINT8* pData = realloc(pReader->pData, pReader->szData + n);
+		if (!pData)
+			break;
+		memcpy(pData + pReader->szData, buf, n);
+		pReader->pData = pData;
+		pReader->szData += n;
+	}
+	return NULL;
+}
+
+static BOOL WriteTest(PVOID pContext, const UINT8* pData, size_t szData)
+{
+	TEST_WRITER* pWriter = pContext;
+	pWriter->uWrites++;
+	pWriter->szMaxWrite = max(pWriter->szMaxWrite, szData);
+	if (pWriter->uFailAt && pWriter->uWrites >= pWriter->uFailAt)
+		return FALSE;
+	if (pWriter->pFile)
+		return fwrite(pData, 1, szData, pWriter->pFile) == szData;
+	while (szData > 0)
+	{
+		ssize_t n = write(pWriter->fd, pData, szData);
+		if (n <= 0)
+			return FALSE;
+		pData += n;
+		szData -= n;
+	}
+	return TRUE;
+}
+
+static UINT8* MakeFrame(UINT w, UINT h, size_t szStride)
+{
+	UINT x, y;
+	UINT uSeed = 1;
+	UINT8* pBgrx = calloc(1, szStride * h);
+	if (!pBgrx)
+		return NULL;
+	for (y = 0; y < h; y++)
+	{
+		for (x = 0; x < w; x++)
+		{
+			UINT8* q = pBgrx + y * szStride + x * 4;
+			uSeed = uSeed * 1103515245 + 12345;
+			q[0] = (UINT8)((x / 64) * 20);
+			q[1] = (UINT8)((y / 32) * 10 + (uSeed >> 30));
+			q[2] = ((x / 8 + y / 16) % 7 == 0) ? 0 : 220;
+			q[3] = 0;
+		}
+	}
+	return pBgrx;
+}
+
+static BOOL CheckPng(const UINT8* pPng, size_t szPng, const UINT8* pBgrx, UINT w, UINT h, size_t szStride)
+{
+	UINT x, y;
+	UINT8* pOut = NULL;
+	unsigned dw, dh;
+	BOOL bRet = lodepng_decode32(&pOut, &dw, &dh, pPng, szPng) == 0 && dw == w && dh == h;
+	for (y = 0; bRet && y < h; y++)
+	{
+		for (x = 0; bRet && x < w; x++)
+		{
+			const UINT8* p = pBgrx + y * szStride + x * 4;
+			const UINT8* q = pOut + ((size_t)y * w + x) * 4;
+			bRet = q[0] == p[2] && q[1] == p[1] && q[2] == p[0] && q[3] == 0xFF;
+		}
+	}
+	lodepng_free(pOut);
+	return bRet;
+}
+
+static UINT CountIdat(const UINT8* pPng, size_t szPng)
+{
+	UINT uCount = 0;
+	const UINT8* pEnd = pPng + szPng;
+	const UINT8* pChunk = pPng + 8;
+	while (pChunk + 12 <= pEnd)
+	{
+		if (lodepng_chunk_type_equals(pChunk, "IDAT"))
+			uCount++;
+		if (lodepng_chunk_type_equals(pChunk, "IEND"))
+			break;
+		pChunk = lodepng_chunk_next_const(pChunk, pEnd);
+	}
+	return uCount;
+}
+
+/* the IDAT contents in one buffer, the zlib stream of the image */
+static UINT8* GetZlib(const UINT8* pPng, size_t szPng, size_t* pszZlib)
+{
+	const UINT8* pEnd = pPng + szPng;
+	const UINT8* pChunk = pPng + 8;
+	UINT8* pZlib = malloc(szPng);
+	*pszZlib = 0;
+	while (pZlib && pChunk + 12 <= pEnd && !lodepng_chunk_type_equals(pChunk, "IEND"))
+	{
+		if (lodepng_chunk_type_equals(pChunk, "IDAT"))
+		{
+			memcpy(pZlib + *pszZlib, lodepng_chunk_data_const(pChunk), lodepng_chunk_length(pChunk));
+			*pszZlib += lodepng_chunk_length(pChunk);
+		}
+		pChunk = lodepng_chunk_next_const(pChunk, pEnd);
+	}
+	return pZlib;
+}
+
+static VOID TestPipe(UINT w, UINT h, size_t szStride, FE_PNG_PROFILE uProfile)
+{
+	int fds[2];
+	UINT uError;
+	size_t szPng = 0, szBuffered = 0, szZlib, szBufferedZlib;
+	UINT8* pBuffered = NULL;
+	UINT8* pZlib;
+	UINT8* pBufferedZlib;
+	TEST_READER reader = { 0 };
+	TEST_WRITER writer = { 0 };
+	UINT8* pBgrx = MakeFrame(w, h, szStride);
+	FE_CHECK(pBgrx != NULL);
+	FE_CHECK(pipe(fds) == 0);
+	if (!pBgrx)
+		return;
+
+	reader.fd = fds[0];
+	writer.fd = fds[1];
+	pthread_create(&reader.Thread, NULL, ReaderThread, &reader);
+	uError = FeStreamPngBgrx(NULL, WriteTest, &writer, &szPng, pBgrx, w, h, szStride, uProfile);
+	close(fds[1]);
+	pthread_join(reader.Thread, NULL);
+	close(fds[0]);
+
+	FE_CHECK(uError == 0);
+	FE_CHECK(szPng == reader.szData);
+	FE_CHECK(CheckPng(reader.pData, reader.szData, pBgrx, w, h, szStride));
+	FE_CHECK(writer.szMaxWrite <= TEST_MAX_WRITE);
+	FE_CHECK(CountIdat(reader.pData, reader.szData) >= (reader.szData + 0xFFFF) / 0x10000 - 1);
+	FE_CHECK(FeEncodePngBgrx(NULL, &pBuffered, &szBuffered, pBgrx, w, h, szStride, uProfile) == 0);
+	pZlib = GetZlib(reader.pData, reader.szData, &szZlib);
+	pBufferedZlib = GetZlib(pBuffered, szBuffered, &szBufferedZlib);
+	FE_CHECK(pZlib && pBufferedZlib && szZlib == szBufferedZlib
+		&& memcmp(pZlib, pBufferedZlib, szZlib) == 0);
+	printf("pipe %ux%u stride %zu profile %d: %zu bytes in %u IDAT, %u writes\n", w, h, szStride,
+		uProfile, reader.szData, CountIdat(reader.pData, reader.szData), writer.uWrites);
+	free(pZlib);
+	free(pBufferedZlib);
+	free(pBuffered);
+	free(reader.pData);
+	free(pBgrx);
+}
+
+static VOID TestFile(UINT w, UINT h)
+{
+	long lSize;
+	size_t szPng = 0;
+	UINT8* pPng;
+	TEST_WRITER writer = { 0 };
+	UINT8* pBgrx = MakeFrame(w, h, (size_t)w * 4);
+	FE_CHECK(pBgrx != NULL);
+	writer.pFile = tmpfile();
+	FE_CHECK(writer.pFile != NULL);
+	if (!pBgrx || !writer.pFile)
+		return;
+	FE_CHECK(FeStreamPngBgrx(NULL, WriteTest, &writer, &szPng, pBgrx, w, h, (size_t)w * 4,
+		FE_PNG_BALANCED) == 0);
+	lSize = ftell(writer.pFile);
+	FE_CHECK(lSize == (long)szPng);
+	pPng = malloc(szPng);
+	rewind(writer.pFile);
+	FE_CHECK(pPng && fread(pPng, 1, szPng, writer.pFile) == szPng);
+	FE_CHECK(pPng && CheckPng(pPng, szPng, pBgrx, w, h, (size_t)w * 4));
+	fclose(writer.pFile);
+	free(pPng);
+	free(pBgrx);
+}
+
+/* the encoder stops at the first failed write instead of running to the end */
+static VOID TestAbort(VOID)
+{
+	UINT w = 1920, h = 1080;
+	TEST_WRITER writer = { 0 };
+	UINT8* pBgrx = MakeFrame(w, h, (size_t)w * 4);
+	FE_CHECK(pBgrx != NULL);
+	if (!pBgrx)
+		return;
+	writer.pFile = tmpfile();
+	writer.uFailAt = 3;
+	FE_CHECK(FeStreamPngBgrx(NULL, WriteTest, &writer, NULL, pBgrx, w, h, (size_t)w * 4,
+		FE_PNG_FAST) == 79);
+	FE_CHECK(writer.uWrites == 3);
+	fclose(writer.pFile);
+	free(pBgrx);
+}
+
+int main(void)
+{
+	TestPipe(1920, 1080, 1920 * 4, FE_PNG_FAST);
+	TestPipe(1920, 1080, 1920 * 4, FE_PNG_BALANCED);
+	TestPipe(1001, 333, 1001 * 4 + 12, FE_PNG_FAST);
+	TestPipe(1, 1, 4, FE_PNG_BALANCED);
+	TestFile(640, 480);
+	TestAbort();
+	return FE_TEST_RESULT;
+}
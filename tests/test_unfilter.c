@@ -0,0 +1,205 @@
+﻿// SPDX-License-Identifier: GPL-3.0-or-later
+
+/* every unfilter kernel the CPU runs against a plain unfilter from the PNG spec, on random
+ * rows of 3 and 4 byte pixels at any length and alignment, in place or not, and PNGs of
+ * every filter type decoded through lodepng's hook */
+
+/* the kernels are static */
+#include "../pngfilter.c"
+
+#include "arena.h"
+#include "test.h"
+
+#define TEST_PIXELS 600
+/* room for an unaligned start and for bytes behind the row which must not change */
+#define TEST_ROW (TEST_PIXELS * 4 + 64)
+
+typedef struct _TEST_KERNEL
+{
+	const char* pName;
+	/* FE_CPU_* flags the kernel needs */
+	UINT uFeatures;
+	UINT uType;
+	UNFILTER_PROC pfnKernel;
+} TEST_KERNEL;
+
+#ifdef PNGFILTER_X86
+static const TEST_KERNEL mKernels[] =
+{
+	{ "sub sse2", FE_CPU_SSE2, 1, UnfilterSubSse2 },
+	{ "up sse2", FE_CPU_SSE2, 2, UnfilterUpSse2 },
+	{ "up avx2", FE_CPU_AVX2, 2, UnfilterUpAvx2 },
+	{ "avg sse2", FE_CPU_SSE2, 3, UnfilterAvgSse2 },
+	{ "paeth sse2", FE_CPU_SSE2, 4, UnfilterPaethSse2 },
+	{ "paeth ssse3", FE_CPU_SSSE3, 4, UnfilterPaethSsse3 },
+};
+#endif
+
+static UINT TestRandom(UINT* pSeed)
+{
+	*pSeed = *pSeed * 1103515245 + 12345;
+	return *pSeed >> 16;
+}
+
+/* same as lodepng's paethPredictor */
+static UINT8 TestPaeth(INT a, INT b, INT c)
+{
+	INT p = a + b - c;
+	INT pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+	if (pa <= pb && pa <= pc)
+		return (UINT8)a;
+	return (UINT8)(pb <= pc ? b : c);
+}
+
+static VOID UnfilterReference(UINT8* pDst, const UINT8* pSrc, const UINT8* pPrev, size_t szBpp,
+	UINT uType, size_t szLength)
+{
+	size_t i;
+	for (i = 0; i < szLength; i++)
+	{
+		INT a = i >= szBpp ? pDst[i - szBpp] : 0;
+		INT b = pPrev ? pPrev[i] : 0;
+		INT c = (pPrev && i >= szBpp) ? pPrev[i - szBpp] : 0;
+		if (uType == 1)
+			pDst[i] = (UINT8)(pSrc[i] + a);
+		else if (uType == 2)
+			pDst[i] = (UINT8)(pSrc[i] + b);
+		else if (uType == 3)
+			pDst[i] = (UINT8)(pSrc[i] + ((a + b) >> 1));
+		else
+			pDst[i] = (UINT8)(pSrc[i] + TestPaeth(a, b, c));
+	}
+}
+
+/* noise, or runs and gradients where the predictors tie */
+static VOID FillRow(UINT8* pRow, size_t szLength, UINT* pSeed)
+{
+	size_t i;
+	UINT uKind = TestRandom(pSeed) % 3;
+	UINT uBase = TestRandom(pSeed);
+	for (i = 0; i < szLength; i++)
+	{
+		if (uKind == 0)
+			pRow[i] = (UINT8)TestRandom(pSeed);
+		else if (uKind == 1)
+			pRow[i] = (UINT8)((TestRandom(pSeed) % 13 == 0) ? TestRandom(pSeed) : uBase);
+		else
+			pRow[i] = (UINT8)(uBase + i + (TestRandom(pSeed) & 1) - (TestRandom(pSeed) & 1));
+	}
+}
+
+#ifdef PNGFILTER_X86
+static BOOL TestKernel(const TEST_KERNEL* pKernel, size_t szBpp, UINT* pSeed)
+{
+	UINT k;
+	BOOL bRet = TRUE;
+	UINT8* pSrc = malloc(TEST_ROW);
+	UINT8* pPrev = malloc(TEST_ROW);
+	UINT8* pDst = malloc(TEST_ROW);
+	UINT8* pRef = malloc(TEST_ROW);
+	if (!pSrc || !pPrev || !pDst || !pRef)
+		bRet = FALSE;
+	for (k = 0; bRet && k < 5000; k++)
+	{
+		/* every length up to a few vectors, then longer rows */
+		size_t szLength = szBpp * (k < 200 ? k % 40 + 1 : 1 + TestRandom(pSeed) % TEST_PIXELS);
+		UINT8* s = pSrc + TestRandom(pSeed) % 16;
+		UINT8* p = pPrev + TestRandom(pSeed) % 16;
+		UINT8* d = pDst + TestRandom(pSeed) % 16;
+		BOOL bInPlace = k % 3 == 0;
+		FillRow(pSrc, TEST_ROW, pSeed);
+		FillRow(pPrev, TEST_ROW, pSeed);
+		memset(pDst, 0xA5, TEST_ROW);
+		UnfilterReference(pRef, s, p, szBpp, pKernel->uType, szLength);
+		if (bInPlace)
+			d = s;
+		pKernel->pfnKernel(d, s, p, szBpp, szLength);
+		if (memcmp(d, pRef, szLength) != 0)
+			bRet = FALSE;
+		else if (!bInPlace && (d + szLength < pDst + TEST_ROW && d[szLength] != 0xA5))
+			bRet = FALSE;
+		if (!bRet)
+			printf("%s bpp %zu: row %u of %zu bytes differs\n", pKernel->pName, szBpp, k, szLength);
+	}
+	free(pSrc);
+	free(pPrev);
+	free(pDst);
+	free(pRef);
+	return bRet;
+}
+#endif
+
+/* what FeUnfilterRow turns down is left to lodepng */
+static VOID TestDeclined(VOID)
+{
+	UINT8 Src[24] = { 0 }, Prev[24] = { 0 }, Dst[24] = { 0 };
+	UINT uType;
+	BOOL bX86 = (FeGetCpuFeatures() & FE_CPU_SSE2) != 0;
+	FE_CHECK(!FeUnfilterRow(Dst, Src, Prev, 1, 4, 24));
+	FE_CHECK(!FeUnfilterRow(Dst, Src, Prev, 6, 4, 24));
+	FE_CHECK(!FeUnfilterRow(Dst, Src, Prev, 8, 4, 24));
+	FE_CHECK(!FeUnfilterRow(Dst, Src, Prev, 4, 0, 24));
+	FE_CHECK(!FeUnfilterRow(Dst, Src, Prev, 4, 5, 24));
+	for (uType = 2; uType <= 4; uType++)
+		FE_CHECK(!FeUnfilterRow(Dst, Src, NULL, 4, uType, 24));
+	/* Sub has no use for the previous row */
+	FE_CHECK(FeUnfilterRow(Dst, Src, NULL, 3, 1, 24) == bX86);
+}
+
+/* RGB and RGBA images with every filter type, decoded with lodepng_unfilter_scanline */
+static VOID TestDecode(LodePNGColorType uColor, UINT* pSeed)
+{
+	UINT uStrategy;
+	UINT w = 333, h = 41;
+	size_t szBpp = uColor == LCT_RGBA ? 4 : 3;
+	size_t szImage = (size_t)w * h * szBpp;
+	UINT8* pImage = malloc(szImage);
+	FE_CHECK(pImage != NULL);
+	if (!pImage)
+		return;
+	FillRow(pImage, szImage, pSeed);
+	for (uStrategy = LFS_ZERO; uStrategy <= LFS_MINSUM; uStrategy++)
+	{
+		LodePNGState state;
+		UINT8* pPng = NULL;
+		UINT8* pOut = NULL;
+		size_t szPng = 0;
+		unsigned dw = 0, dh = 0;
+		lodepng_state_init(&state);
+		state.info_raw.colortype = uColor;
+		state.info_png.color.colortype = uColor;
+		state.encoder.auto_convert = 0;
+		state.encoder.filter_strategy = (LodePNGFilterStrategy)uStrategy;
+		FE_CHECK(lodepng_encode(&pPng, &szPng, pImage, w, h, &state) == 0);
+		lodepng_state_cleanup(&state);
+		FE_CHECK(lodepng_decode_memory(&pOut, &dw, &dh, pPng, szPng, uColor, 8) == 0);
+		FE_CHECK(pOut && dw == w && dh == h && memcmp(pOut, pImage, szImage) == 0);
+		lodepng_free(pPng);
+		lodepng_free(pOut);
+	}
+	free(pImage);
+}
+
+int main(void)
+{
+	UINT uSeed = 7;
+#ifdef PNGFILTER_X86
+	UINT i;
+	UINT uFeatures = FeGetCpuFeatures();
+	for (i = 0; i < ARRAYSIZE(mKernels); i++)
+	{
+		if ((uFeatures & mKernels[i].uFeatures) != mKernels[i].uFeatures)
+		{
+			printf("%s: not on this CPU\n", mKernels[i].pName);
+			continue;
+		}
+		FE_CHECK(TestKernel(&mKernels[i], 3, &uSeed));
+		FE_CHECK(TestKernel(&mKernels[i], 4, &uSeed));
+		printf("%s: done\n", mKernels[i].pName);
+	}
+#endif
+	TestDeclined();
+	TestDecode(LCT_RGB, &uSeed);
+	TestDecode(LCT_RGBA, &uSeed);
+	return FE_TEST_RESULT;
+}
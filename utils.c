@@ -36,6 +36,21 @@ VOID FeClearLog(int lvl)
 	SetDlgItemTextW(gWnd, IDC_STATIC_JSON, L"");
 }
 
+UINT64 FeGetTimestamp(VOID)
+{
+	LARGE_INTEGER li;
+	QueryPerformanceCounter(&li);
+	return (UINT64)li.QuadPart;
+}
+
+double FeElapsedMs(UINT64 llStart, UINT64 llEnd)
+{
+	static LARGE_INTEGER liFreq;
+	if (liFreq.QuadPart == 0)
+		QueryPerformanceFrequency(&liFreq);
+	return (double)(llEnd - llStart) * 1000.0 / (double)liFreq.QuadPart;
+}
+
 typedef struct _KEYSYM
 {
 	LPCSTR name; /* the name in unshifted state */
@@ -284,7 +299,7 @@ WORD FeStrToShow(LPCSTR sw)
 }
 
 void
-FeKillProcessByName(WCHAR* pName, UINT uExitCode)
+FeKillProcessByName(LPCWSTR pName, UINT uExitCode)
 {
 	HANDLE hSnapShot = CreateToolhelp32Snapshot(TH32CS_SNAPALL, 0);
 	PROCESSENTRY32W pEntry = { .dwSize = sizeof(pEntry) };
@@ -13,15 +13,37 @@ VOID FeAddLog(INT lvl, LPCWSTR fmt, ...);
 
 VOID FeClearLog(INT lvl);
 
+UINT64 FeGetTimestamp(VOID);
+
+double FeElapsedMs(UINT64 llStart, UINT64 llEnd);
+
+#define FE_CPU_SSE2   (1U << 0)
+#define FE_CPU_SSSE3  (1U << 1)
+#define FE_CPU_SSE41  (1U << 2)
+#define FE_CPU_PCLMUL (1U << 3)
+#define FE_CPU_AVX2   (1U << 4)
+
+/* MSVC compiles any intrinsic anywhere, GCC only in functions built for its ISA, so the
+ * rest of the code keeps the baseline and the kernels are picked from FeGetCpuFeatures */
+#ifdef __GNUC__
+#define FE_TARGET(isa) __attribute__((target(isa)))
+#else
+#define FE_TARGET(isa)
+#endif
+
+UINT FeGetCpuFeatures(VOID);
+
 LPCWSTR FeGetConfigPath(VOID);
 
 cJSON* FeInitializeConfig(VOID);
 
+VOID FeFreeConfig(cJSON* pJSON);
+
 VOID FeReloadConfig(cJSON** m);
 
 VOID FeEditConfig(HWND hWnd, cJSON** m);
 
-VOID FeParseConfig(const cJSON* hk);
+BOOL FeRunSystrayAction(UINT uIndex);
 
 LPCWSTR FeKeyToStr(UINT fsModifiers, UINT vk);
 
@@ -35,7 +57,7 @@ VOID FeShellExec(LPCWSTR lpOperation, LPCWSTR lpFile, LPCWSTR lpParameters, LPCW
 
 WORD FeStrToShow(LPCSTR sw);
 
-void FeKillProcessByName(WCHAR* pName, UINT uExitCode);
+void FeKillProcessByName(LPCWSTR pName, UINT uExitCode);
 
 void FeKillProcessById(DWORD dwProcessId, UINT uExitCode);
 
@@ -43,7 +65,17 @@ LONG FeSetResolution(LPCWSTR pMonitor, LPCWSTR pResolution, DWORD dwFlags);
 
 VOID FeShowWindowByTitle(LPCWSTR pFileName, INT nCmdHide, INT nCmdShow);
 
-BOOL FeGetScreenShot(LPCWSTR lpScreen, LPCWSTR lpSave);
+BOOL FeGetScreenShot(LPCWSTR lpScreen, LPCWSTR lpSave, LPCWSTR lpCompression, LPCWSTR lpFormat, BOOL bDelta);
+
+BOOL FeToggleRecord(LPCWSTR lpScreen, LPCWSTR lpSave, LPCWSTR lpCompression, UINT uFps);
+
+VOID FeFreeScreenShotCache(VOID);
+
+VOID FeRenderClipboard(UINT uFormat);
+
+VOID FeRenderAllClipboard(VOID);
+
+VOID FeDestroyClipboard(VOID);
 
 VOID FeUnregisterHotkey(VOID);
 